@@ -33,6 +33,10 @@ option(TP_BUILD_BENCHMARK "Build benchmarks" OFF)
 option(TP_BUILD_PYTHON "Build python bindings" OFF)
 option(TP_BUILD_TESTING "Build tests" OFF)
 
+# How many bytes of captured state callbacks can hold without allocating
+set(TP_CALLBACK_INLINE_CAPACITY 64 CACHE STRING "Inline capacity of callbacks, in bytes")
+mark_as_advanced(TP_CALLBACK_INLINE_CAPACITY)
+
 # Whether to build a static or shared library
 if(BUILD_SHARED_LIBS)
   set(TP_STATIC_OR_SHARED SHARED CACHE STRING "")
@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <tensorpipe/common/busy_polling_loop.h>
+#include <tensorpipe/common/deferred_executor.h>
+
+// Measures how many tasks per second can be deferred to, and run by, a loop
+// when an increasing number of threads are deferring to it at the same time.
+// Both kinds of loops are measured: the on demand one, which is run by one of
+// the deferring threads, and the event loop one, which has its own thread.
+
+using namespace tensorpipe;
+
+namespace {
+
+struct Options {
+  int maxNumThreads{32};
+  size_t numTasks{1000 * 1000};
+};
+
+void usage(int status, const char* argv0) {
+  if (status != EXIT_SUCCESS) {
+    fprintf(stderr, "`%s --help' for more information.\n", argv0);
+    exit(status);
+  }
+
+  fprintf(stderr, "Usage: %s [OPTIONS]\n", argv0);
+#define X(x) fputs(x "\n", stderr);
+  X("");
+  X("--max-num-threads=NUM [optional]  Go up to this many deferring threads");
+  X("--num-tasks=NUM [optional]        Number of tasks deferred in total");
+#undef X
+
+  exit(status);
+}
+
+Options parseOptions(int argc, char** argv) {
+  Options options;
+  int opt;
+  int flag = -1;
+
+  enum Flags : int {
+    MAX_NUM_THREADS,
+    NUM_TASKS,
+    HELP,
+  };
+
+  static struct option long_options[] = {
+      {"max-num-threads", required_argument, &flag, MAX_NUM_THREADS},
+      {"num-tasks", required_argument, &flag, NUM_TASKS},
+      {"help", no_argument, &flag, HELP},
+      {nullptr, 0, nullptr, 0}};
+
+  while (1) {
+    opt = getopt_long(argc, argv, "", long_options, nullptr);
+    if (opt == -1) {
+      break;
+    }
+    if (opt != 0) {
+      usage(EXIT_FAILURE, argv[0]);
+      break;
+    }
+    switch (flag) {
+      case MAX_NUM_THREADS:
+        options.maxNumThreads = atoi(optarg);
+        break;
+      case NUM_TASKS:
+        options.numTasks = strtoull(optarg, nullptr, 10);
+        break;
+      case HELP:
+        usage(EXIT_SUCCESS, argv[0]);
+        break;
+      default:
+        usage(EXIT_FAILURE, argv[0]);
+        break;
+    }
+  }
+
+  if (options.maxNumThreads <= 0) {
+    fprintf(stderr, "Error:\n");
+    fprintf(stderr, "  --max-num-threads must be positive\n");
+    exit(EXIT_FAILURE);
+  }
+
+  return options;
+}
+
+// An event loop which does nothing but run the deferred tasks.
+class SpinningLoop final : public BusyPollingLoop {
+ public:
+  SpinningLoop() {
+    startThread("TP_BENCH_loop");
+  }
+
+  ~SpinningLoop() override {
+    stopBusyPolling();
+    joinThread();
+  }
+
+ protected:
+  bool pollOnce() override {
+    return false;
+  }
+
+  bool readyToClose() override {
+    return true;
+  }
+};
+
+// Return the throughput, in millions of tasks per second.
+double runOnce(DeferredExecutor& loop, int numThreads, size_t numTasks) {
+  // Only ever accessed from within the loop.
+  uint64_t numTasksRun = 0;
+  std::atomic<bool> done{false};
+  const size_t numTasksPerThread = numTasks / numThreads;
+  const uint64_t totalNumTasks = numTasksPerThread * numThreads;
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (int threadIdx = 0; threadIdx < numThreads; threadIdx++) {
+    threads.emplace_back([&]() {
+      for (size_t taskIdx = 0; taskIdx < numTasksPerThread; taskIdx++) {
+        loop.deferToLoop([&]() {
+          if (++numTasksRun == totalNumTasks) {
+            done = true;
+          }
+        });
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  while (!done) {
+    std::this_thread::yield();
+  }
+  auto duration = std::chrono::steady_clock::now() - start;
+
+  const double seconds =
+      std::chrono::duration_cast<std::chrono::duration<double>>(duration)
+          .count();
+  return totalNumTasks / seconds / 1e6;
+}
+
+void runAll(
+    const char* name,
+    DeferredExecutor& loop,
+    const Options& options) {
+  for (int numThreads = 1; numThreads <= options.maxNumThreads;
+       numThreads *= 2) {
+    const double throughput = runOnce(loop, numThreads, options.numTasks);
+    fprintf(
+        stderr,
+        "%-12s %-12d %-12lu %-12.3f\n",
+        name,
+        numThreads,
+        options.numTasks,
+        throughput);
+  }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  Options options = parseOptions(argc, argv);
+
+  fprintf(
+      stderr,
+      "%-12s %-12s %-12s %-12s\n",
+      "loop",
+      "# threads",
+      "# tasks",
+      "Mtasks/s");
+
+  {
+    OnDemandDeferredExecutor loop;
+    runAll("on-demand", loop, options);
+  }
+  {
+    SpinningLoop loop;
+    runAll("event-loop", loop, options);
+  }
+
+  return 0;
+}
@@ -6,7 +6,10 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <atomic>
+#include <cstdlib>
 #include <cstring>
+#include <new>
 
 #include <future>
 
@@ -24,6 +27,29 @@ using namespace tensorpipe::benchmark;
 
 Measurements measurements;
 
+// Count the heap allocations performed by the whole process, in order to report
+// how many of them each round trip causes on the client. This includes the ones
+// of the benchmark itself, which builds a new message for each round trip, but
+// not the ones that libuv makes with malloc.
+static std::atomic<uint64_t> numAllocations{0};
+
+void* operator new(size_t size) {
+  numAllocations.fetch_add(1, std::memory_order_relaxed);
+  void* ptr = std::malloc(size == 0 ? 1 : size);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t /* unused */) noexcept {
+  std::free(ptr);
+}
+
 struct Data {
   size_t numPayloads;
   size_t payloadSize;
@@ -38,6 +64,8 @@ struct Data {
   std::vector<std::unique_ptr<uint8_t[]>> temporaryTensor;
 
   std::string expectedMetadata;
+
+  int burstSize;
 };
 
 static void printMeasurements(Measurements& measurements, size_t dataLen) {
@@ -75,11 +103,11 @@ static std::unique_ptr<uint8_t[]> createData(const int size) {
 
 static void serverPongPingNonBlock(
     std::shared_ptr<Pipe> pipe,
-    int& numRoundTrips,
+    int& numMessages,
     std::promise<void>& doneProm,
     Data& data,
     Measurements& measurements) {
-  pipe->readDescriptor([pipe, &numRoundTrips, &doneProm, &data, &measurements](
+  pipe->readDescriptor([pipe, &numMessages, &doneProm, &data, &measurements](
                            const Error& error, Message&& message) {
     TP_THROW_ASSERT_IF(error) << error.what();
     TP_DCHECK_EQ(message.metadata, data.expectedMetadata);
@@ -112,7 +140,7 @@ static void serverPongPingNonBlock(
     }
     pipe->read(
         std::move(message),
-        [pipe, &numRoundTrips, &doneProm, &data, &measurements](
+        [pipe, &numMessages, &doneProm, &data, &measurements](
             const Error& error, Message&& message) {
           TP_THROW_ASSERT_IF(error) << error.what();
           if (data.payloadSize > 0) {
@@ -150,12 +178,12 @@ static void serverPongPingNonBlock(
           }
           pipe->write(
               std::move(message),
-              [pipe, &numRoundTrips, &doneProm, &data, &measurements](
+              [pipe, &numMessages, &doneProm, &data, &measurements](
                   const Error& error, Message&& message) {
                 TP_THROW_ASSERT_IF(error) << error.what();
-                if (--numRoundTrips > 0) {
+                if (--numMessages > 0) {
                   serverPongPingNonBlock(
-                      pipe, numRoundTrips, doneProm, data, measurements);
+                      pipe, numMessages, doneProm, data, measurements);
                 } else {
                   doneProm.set_value();
                 }
@@ -167,7 +195,7 @@ static void serverPongPingNonBlock(
 // Start with receiving ping
 static void runServer(const Options& options) {
   std::string addr = options.address;
-  int numRoundTrips = options.numRoundTrips;
+  int numMessages = options.numRoundTrips * options.burstSize;
 
   Data data;
   data.numPayloads = options.numPayloads;
@@ -189,11 +217,13 @@ static void runServer(const Options& options) {
         std::make_unique<uint8_t[]>(options.tensorSize));
   }
   data.expectedMetadata = std::string(options.metadataSize, 0x42);
+  data.burstSize = options.burstSize;
 
   Measurements measurements;
   measurements.reserve(options.numRoundTrips);
 
-  std::shared_ptr<Context> context = std::make_shared<Context>();
+  std::shared_ptr<Context> context = std::make_shared<Context>(
+      ContextOptions().batchWrites(options.batchWrites));
   auto transportContext =
       TensorpipeTransportRegistry().create(options.transport);
   validateTransportContext(transportContext);
@@ -213,13 +243,122 @@ static void runServer(const Options& options) {
 
   std::promise<void> doneProm;
   serverPongPingNonBlock(
-      std::move(pipe), numRoundTrips, doneProm, data, measurements);
+      std::move(pipe), numMessages, doneProm, data, measurements);
 
   doneProm.get_future().get();
   listener.reset();
   context->join();
 }
 
+static void clientPingPongNonBlock(
+    std::shared_ptr<Pipe> pipe,
+    int& numRoundTrips,
+    std::promise<void>& doneProm,
+    Data& data,
+    Measurements& measurements);
+
+static void clientReadPongNonBlock(
+    std::shared_ptr<Pipe> pipe,
+    int numPongsLeft,
+    int& numRoundTrips,
+    std::promise<void>& doneProm,
+    Data& data,
+    Measurements& measurements) {
+  pipe->readDescriptor([pipe,
+                        numPongsLeft,
+                        &numRoundTrips,
+                        &doneProm,
+                        &data,
+                        &measurements](const Error& error, Message&& message) {
+    TP_THROW_ASSERT_IF(error) << error.what();
+    TP_DCHECK_EQ(message.metadata, data.expectedMetadata);
+    if (data.payloadSize > 0) {
+      TP_DCHECK_EQ(message.payloads.size(), data.numPayloads);
+      for (size_t payloadIdx = 0; payloadIdx < data.numPayloads; payloadIdx++) {
+        TP_DCHECK_EQ(
+            message.payloads[payloadIdx].metadata,
+            data.expectedPayloadMetadata[payloadIdx]);
+        TP_DCHECK_EQ(message.payloads[payloadIdx].length, data.payloadSize);
+        message.payloads[payloadIdx].data =
+            data.temporaryPayload[payloadIdx].get();
+      }
+    } else {
+      TP_DCHECK_EQ(message.payloads.size(), 0);
+    }
+    if (data.tensorSize > 0) {
+      TP_DCHECK_EQ(message.tensors.size(), data.numTensors);
+      for (size_t tensorIdx = 0; tensorIdx < data.numTensors; tensorIdx++) {
+        TP_DCHECK_EQ(
+            message.tensors[tensorIdx].metadata,
+            data.expectedTensorMetadata[tensorIdx]);
+        TP_DCHECK_EQ(
+            message.tensors[tensorIdx].buffer.cpu.length, data.tensorSize);
+        message.tensors[tensorIdx].buffer.cpu.ptr =
+            data.temporaryTensor[tensorIdx].get();
+      }
+    } else {
+      TP_DCHECK_EQ(message.tensors.size(), 0);
+    }
+    pipe->read(
+        std::move(message),
+        [pipe,
+         numPongsLeft,
+         &numRoundTrips,
+         &doneProm,
+         &data,
+         &measurements](const Error& error, Message&& message) {
+          if (numPongsLeft == 1) {
+            measurements.markStop();
+          }
+          TP_THROW_ASSERT_IF(error) << error.what();
+          if (data.payloadSize > 0) {
+            TP_DCHECK_EQ(message.payloads.size(), data.numPayloads);
+            for (size_t payloadIdx = 0; payloadIdx < data.numPayloads;
+                 payloadIdx++) {
+              TP_DCHECK_EQ(
+                  memcmp(
+                      message.payloads[payloadIdx].data,
+                      data.expectedPayload[payloadIdx].get(),
+                      message.payloads[payloadIdx].length),
+                  0);
+            }
+          } else {
+            TP_DCHECK_EQ(message.payloads.size(), 0);
+          }
+          if (data.tensorSize > 0) {
+            TP_DCHECK_EQ(message.tensors.size(), data.numTensors);
+            for (size_t tensorIdx = 0; tensorIdx < data.numTensors;
+                 tensorIdx++) {
+              TP_DCHECK_EQ(
+                  memcmp(
+                      message.tensors[tensorIdx].buffer.cpu.ptr,
+                      data.expectedTensor[tensorIdx].get(),
+                      message.tensors[tensorIdx].buffer.cpu.length),
+                  0);
+            }
+          } else {
+            TP_DCHECK_EQ(message.tensors.size(), 0);
+          }
+          if (numPongsLeft > 1) {
+            clientReadPongNonBlock(
+                pipe,
+                numPongsLeft - 1,
+                numRoundTrips,
+                doneProm,
+                data,
+                measurements);
+          } else if (--numRoundTrips > 0) {
+            clientPingPongNonBlock(
+                pipe, numRoundTrips, doneProm, data, measurements);
+          } else {
+            printMeasurements(measurements, data.payloadSize);
+            doneProm.set_value();
+          }
+        });
+  });
+}
+
+// Write a burst of pings, back-to-back, and then read as many pongs.
 static void clientPingPongNonBlock(
     std::shared_ptr<Pipe> pipe,
     int& numRoundTrips,
@@ -227,113 +366,41 @@ static void clientPingPongNonBlock(
     Data& data,
     Measurements& measurements) {
   measurements.markStart();
-  Message message;
-  message.metadata = data.expectedMetadata;
-  if (data.payloadSize > 0) {
-    for (size_t payloadIdx = 0; payloadIdx < data.numPayloads; payloadIdx++) {
-      Message::Payload payload;
-      payload.data = data.expectedPayload[payloadIdx].get();
-      payload.length = data.payloadSize;
-      message.payloads.push_back(std::move(payload));
+  for (int pingIdx = 0; pingIdx < data.burstSize; pingIdx++) {
+    Message message;
+    message.metadata = data.expectedMetadata;
+    if (data.payloadSize > 0) {
+      for (size_t payloadIdx = 0; payloadIdx < data.numPayloads;
+           payloadIdx++) {
+        Message::Payload payload;
+        payload.data = data.expectedPayload[payloadIdx].get();
+        payload.length = data.payloadSize;
+        message.payloads.push_back(std::move(payload));
+      }
+    } else {
+      TP_DCHECK_EQ(message.tensors.size(), 0);
     }
-  } else {
-    TP_DCHECK_EQ(message.tensors.size(), 0);
-  }
-  if (data.tensorSize > 0) {
-    for (size_t tensorIdx = 0; tensorIdx < data.numTensors; tensorIdx++) {
-      Message::Tensor tensor;
-      tensor.buffer =
-          CpuBuffer{data.expectedTensor[tensorIdx].get(), data.tensorSize};
-      message.tensors.push_back(std::move(tensor));
+    if (data.tensorSize > 0) {
+      for (size_t tensorIdx = 0; tensorIdx < data.numTensors; tensorIdx++) {
+        Message::Tensor tensor;
+        tensor.buffer =
+            CpuBuffer{data.expectedTensor[tensorIdx].get(), data.tensorSize};
+        message.tensors.push_back(std::move(tensor));
+      }
+    } else {
+      TP_DCHECK_EQ(message.tensors.size(), 0);
     }
-  } else {
-    TP_DCHECK_EQ(message.tensors.size(), 0);
+    pipe->write(std::move(message), [](const Error& error, Message&& message) {
+      TP_THROW_ASSERT_IF(error) << error.what();
+    });
   }
-  pipe->write(
-      std::move(message),
-      [pipe, &numRoundTrips, &doneProm, &data, &measurements](
-          const Error& error, Message&& message) {
-        TP_THROW_ASSERT_IF(error) << error.what();
-        pipe->readDescriptor(
-            [pipe, &numRoundTrips, &doneProm, &data, &measurements](
-                const Error& error, Message&& message) {
-              TP_THROW_ASSERT_IF(error) << error.what();
-              TP_DCHECK_EQ(message.metadata, data.expectedMetadata);
-              if (data.payloadSize > 0) {
-                TP_DCHECK_EQ(message.payloads.size(), data.numPayloads);
-                for (size_t payloadIdx = 0; payloadIdx < data.numPayloads;
-                     payloadIdx++) {
-                  TP_DCHECK_EQ(
-                      message.payloads[payloadIdx].metadata,
-                      data.expectedPayloadMetadata[payloadIdx]);
-                  TP_DCHECK_EQ(
-                      message.payloads[payloadIdx].length, data.payloadSize);
-                  message.payloads[payloadIdx].data =
-                      data.temporaryPayload[payloadIdx].get();
-                }
-              } else {
-                TP_DCHECK_EQ(message.payloads.size(), 0);
-              }
-              if (data.tensorSize > 0) {
-                TP_DCHECK_EQ(message.tensors.size(), data.numTensors);
-                for (size_t tensorIdx = 0; tensorIdx < data.numTensors;
-                     tensorIdx++) {
-                  TP_DCHECK_EQ(
-                      message.tensors[tensorIdx].metadata,
-                      data.expectedTensorMetadata[tensorIdx]);
-                  TP_DCHECK_EQ(
-                      message.tensors[tensorIdx].buffer.cpu.length,
-                      data.tensorSize);
-                  message.tensors[tensorIdx].buffer.cpu.ptr =
-                      data.temporaryTensor[tensorIdx].get();
-                }
-              } else {
-                TP_DCHECK_EQ(message.tensors.size(), 0);
-              }
-              pipe->read(
-                  std::move(message),
-                  [pipe, &numRoundTrips, &doneProm, &data, &measurements](
-                      const Error& error, Message&& message) {
-                    measurements.markStop();
-                    TP_THROW_ASSERT_IF(error) << error.what();
-                    if (data.payloadSize > 0) {
-                      TP_DCHECK_EQ(message.payloads.size(), data.numPayloads);
-                      for (size_t payloadIdx = 0; payloadIdx < data.numPayloads;
-                           payloadIdx++) {
-                        TP_DCHECK_EQ(
-                            memcmp(
-                                message.payloads[payloadIdx].data,
-                                data.expectedPayload[payloadIdx].get(),
-                                message.payloads[payloadIdx].length),
-                            0);
-                      }
-                    } else {
-                      TP_DCHECK_EQ(message.payloads.size(), 0);
-                    }
-                    if (data.tensorSize > 0) {
-                      TP_DCHECK_EQ(message.tensors.size(), data.numTensors);
-                      for (size_t tensorIdx = 0; tensorIdx < data.numTensors;
-                           tensorIdx++) {
-                        TP_DCHECK_EQ(
-                            memcmp(
-                                message.tensors[tensorIdx].buffer.cpu.ptr,
-                                data.expectedTensor[tensorIdx].get(),
-                                message.tensors[tensorIdx].buffer.cpu.length),
-                            0);
-                      }
-                    } else {
-                      TP_DCHECK_EQ(message.tensors.size(), 0);
-                    }
-                    if (--numRoundTrips > 0) {
-                      clientPingPongNonBlock(
-                          pipe, numRoundTrips, doneProm, data, measurements);
-                    } else {
-                      printMeasurements(measurements, data.payloadSize);
-                      doneProm.set_value();
-                    }
-                  });
-            });
-      });
+  clientReadPongNonBlock(
+      std::move(pipe),
+      data.burstSize,
+      numRoundTrips,
+      doneProm,
+      data,
+      measurements);
 }
 
 // Start with sending ping
@@ -361,11 +428,13 @@ static void runClient(const Options& options) {
         std::make_unique<uint8_t[]>(options.tensorSize));
   }
   data.expectedMetadata = std::string(options.metadataSize, 0x42);
+  data.burstSize = options.burstSize;
 
   Measurements measurements;
   measurements.reserve(options.numRoundTrips);
 
-  std::shared_ptr<Context> context = std::make_shared<Context>();
+  std::shared_ptr<Context> context = std::make_shared<Context>(
+      ContextOptions().batchWrites(options.batchWrites));
   auto transportContext =
       TensorpipeTransportRegistry().create(options.transport);
   validateTransportContext(transportContext);
@@ -378,10 +447,16 @@ static void runClient(const Options& options) {
   std::shared_ptr<Pipe> pipe = context->connect(addr);
 
   std::promise<void> doneProm;
+  uint64_t numAllocationsAtStart = numAllocations.load();
   clientPingPongNonBlock(
       std::move(pipe), numRoundTrips, doneProm, data, measurements);
 
   doneProm.get_future().get();
+  fprintf(
+      stderr,
+      "allocations per round trip: %.3f\n",
+      (numAllocations.load() - numAllocationsAtStart) /
+          (float)options.numRoundTrips);
   context->join();
 }
 
@@ -397,6 +472,8 @@ int main(int argc, char** argv) {
   std::cout << "num_tensors = " << x.numTensors << "\n";
   std::cout << "tensor_size = " << x.tensorSize << "\n";
   std::cout << "metadata_size = " << x.metadataSize << "\n";
+  std::cout << "burst_size = " << x.burstSize << "\n";
+  std::cout << "batch_writes = " << x.batchWrites << "\n";
 
   if (x.mode == "listen") {
     runServer(x);
@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+#include <tensorpipe/common/defs.h>
+#include <tensorpipe/common/system.h>
+#include <tensorpipe/util/ringbuffer/consumer.h>
+#include <tensorpipe/util/ringbuffer/producer.h>
+#include <tensorpipe/util/ringbuffer/shm.h>
+
+// Measures the throughput of a shared-memory ringbuffer between a producer and
+// a consumer thread, each busy-polling on it. Run it with the two threads
+// pinned to cores of the same socket, and then of different sockets, in order
+// to see the cost of moving the ringbuffer's cache lines between them.
+
+using namespace tensorpipe;
+using namespace tensorpipe::util::ringbuffer;
+
+namespace {
+
+struct Options {
+  int producerCpu{-1};
+  int consumerCpu{-1};
+  size_t ringSize{2 * 1024 * 1024};
+  size_t chunkSize{64};
+  size_t numChunks{10 * 1000 * 1000};
+};
+
+void usage(int status, const char* argv0) {
+  if (status != EXIT_SUCCESS) {
+    fprintf(stderr, "`%s --help' for more information.\n", argv0);
+    exit(status);
+  }
+
+  fprintf(stderr, "Usage: %s [OPTIONS]\n", argv0);
+#define X(x) fputs(x "\n", stderr);
+  X("");
+  X("--producer-cpu=CPU [optional]  CPU to pin the producer thread to");
+  X("--consumer-cpu=CPU [optional]  CPU to pin the consumer thread to");
+  X("--ring-size=SIZE [optional]    Size of the ringbuffer's data");
+  X("--chunk-size=SIZE [optional]   Size of each write/read");
+  X("--num-chunks=NUM [optional]    Number of chunks to transfer");
+#undef X
+
+  exit(status);
+}
+
+Options parseOptions(int argc, char** argv) {
+  Options options;
+  int opt;
+  int flag = -1;
+
+  enum Flags : int {
+    PRODUCER_CPU,
+    CONSUMER_CPU,
+    RING_SIZE,
+    CHUNK_SIZE,
+    NUM_CHUNKS,
+    HELP,
+  };
+
+  static struct option long_options[] = {
+      {"producer-cpu", required_argument, &flag, PRODUCER_CPU},
+      {"consumer-cpu", required_argument, &flag, CONSUMER_CPU},
+      {"ring-size", required_argument, &flag, RING_SIZE},
+      {"chunk-size", required_argument, &flag, CHUNK_SIZE},
+      {"num-chunks", required_argument, &flag, NUM_CHUNKS},
+      {"help", no_argument, &flag, HELP},
+      {nullptr, 0, nullptr, 0}};
+
+  while (1) {
+    opt = getopt_long(argc, argv, "", long_options, nullptr);
+    if (opt == -1) {
+      break;
+    }
+    if (opt != 0) {
+      usage(EXIT_FAILURE, argv[0]);
+      break;
+    }
+    switch (flag) {
+      case PRODUCER_CPU:
+        options.producerCpu = atoi(optarg);
+        break;
+      case CONSUMER_CPU:
+        options.consumerCpu = atoi(optarg);
+        break;
+      case RING_SIZE:
+        options.ringSize = strtoull(optarg, nullptr, 10);
+        break;
+      case CHUNK_SIZE:
+        options.chunkSize = strtoull(optarg, nullptr, 10);
+        break;
+      case NUM_CHUNKS:
+        options.numChunks = strtoull(optarg, nullptr, 10);
+        break;
+      case HELP:
+        usage(EXIT_SUCCESS, argv[0]);
+        break;
+      default:
+        usage(EXIT_FAILURE, argv[0]);
+        break;
+    }
+  }
+
+  if (options.chunkSize == 0 || options.chunkSize > options.ringSize) {
+    fprintf(stderr, "Error:\n");
+    fprintf(stderr, "  --chunk-size must be in (0, ring-size]\n");
+    exit(EXIT_FAILURE);
+  }
+
+  return options;
+}
+
+void pinCurrentThread(int cpu) {
+  if (cpu >= 0) {
+    setThreadCpuAffinity(cpu);
+  }
+}
+
+void runProducer(RingBuffer& rb, const Options& options) {
+  pinCurrentThread(options.producerCpu);
+  Producer producer(rb);
+  auto chunk = std::make_unique<uint8_t[]>(options.chunkSize);
+  for (size_t chunkIdx = 0; chunkIdx < options.numChunks; chunkIdx++) {
+    std::memcpy(chunk.get(), &chunkIdx, std::min(options.chunkSize, 8ul));
+    while (true) {
+      ssize_t ret = producer.write(chunk.get(), options.chunkSize);
+      if (ret == options.chunkSize) {
+        break;
+      }
+      TP_THROW_ASSERT_IF(ret != -ENOSPC) << "Unexpected return value " << ret;
+    }
+  }
+}
+
+void runConsumer(RingBuffer& rb, const Options& options) {
+  pinCurrentThread(options.consumerCpu);
+  Consumer consumer(rb);
+  auto chunk = std::make_unique<uint8_t[]>(options.chunkSize);
+  for (size_t chunkIdx = 0; chunkIdx < options.numChunks; chunkIdx++) {
+    while (true) {
+      ssize_t ret = consumer.read(chunk.get(), options.chunkSize);
+      if (ret == options.chunkSize) {
+        break;
+      }
+      TP_THROW_ASSERT_IF(ret != -ENODATA) << "Unexpected return value " << ret;
+    }
+    TP_DCHECK_EQ(
+        std::memcmp(
+            chunk.get(), &chunkIdx, std::min(options.chunkSize, 8ul)),
+        0);
+  }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  Options options = parseOptions(argc, argv);
+
+  util::shm::Segment headerSegment;
+  util::shm::Segment dataSegment;
+  RingBuffer rb;
+  std::tie(headerSegment, dataSegment, rb) = util::ringbuffer::shm::create(
+      options.ringSize,
+      /*data_page_type=*/nullopt,
+      /*perm_write=*/true,
+      /*mirrored=*/true);
+
+  auto start = std::chrono::steady_clock::now();
+  std::thread producerThread([&]() { runProducer(rb, options); });
+  std::thread consumerThread([&]() { runConsumer(rb, options); });
+  producerThread.join();
+  consumerThread.join();
+  auto duration = std::chrono::steady_clock::now() - start;
+
+  const double seconds =
+      std::chrono::duration_cast<std::chrono::duration<double>>(duration)
+          .count();
+  const double totalBytes =
+      static_cast<double>(options.chunkSize) * options.numChunks;
+  fprintf(
+      stderr,
+      "%-13s %-13s %-12s %-12s %-12s %-12s\n",
+      "producer-cpu",
+      "consumer-cpu",
+      "chunk-size",
+      "# chunks",
+      "Mchunks/s",
+      "GB/s");
+  fprintf(
+      stderr,
+      "%-13d %-13d %-12lu %-12lu %-12.3f %-12.3f\n",
+      options.producerCpu,
+      options.consumerCpu,
+      options.chunkSize,
+      options.numChunks,
+      options.numChunks / seconds / 1e6,
+      totalBytes / seconds / 1e9);
+
+  return 0;
+}
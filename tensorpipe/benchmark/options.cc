@@ -64,6 +64,8 @@ static void usage(int status, const char* argv0) {
   X("--num-tensors=NUM [optional]    Number of tensors of each write/read pair");
   X("--tensor-size=SIZE [optional]   Size of tensor of each write/read pair");
   X("--metadata-size=SIZE [optional] Size of metadata of each write/read pair");
+  X("--burst-size=NUM [optional]     Number of write/read pairs per round trip");
+  X("--batch-writes=SIZE [optional]  Maximum size of a batch of writes");
 
   exit(status);
 }
@@ -86,6 +88,10 @@ static void validateOptions(Options options, const char* argv0) {
     fprintf(stderr, "Missing argument: --num-round-trips must be set\n");
     status = EXIT_FAILURE;
   }
+  if (options.burstSize <= 0) {
+    fprintf(stderr, "Invalid argument: --burst-size must be positive\n");
+    status = EXIT_FAILURE;
+  }
   if (status != EXIT_SUCCESS) {
     usage(status, argv0);
   }
@@ -107,6 +113,8 @@ struct Options parseOptions(int argc, char** argv) {
     NUM_TENSORS,
     TENSOR_SIZE,
     METADATA_SIZE,
+    BURST_SIZE,
+    BATCH_WRITES,
     HELP,
   };
 
@@ -121,6 +129,8 @@ struct Options parseOptions(int argc, char** argv) {
       {"num-tensors", required_argument, &flag, NUM_TENSORS},
       {"tensor-size", required_argument, &flag, TENSOR_SIZE},
       {"metadata-size", required_argument, &flag, METADATA_SIZE},
+      {"burst-size", required_argument, &flag, BURST_SIZE},
+      {"batch-writes", required_argument, &flag, BATCH_WRITES},
       {"help", no_argument, &flag, HELP},
       {nullptr, 0, nullptr, 0}};
 
@@ -169,6 +179,12 @@ struct Options parseOptions(int argc, char** argv) {
       case METADATA_SIZE:
         options.metadataSize = atoi(optarg);
         break;
+      case BURST_SIZE:
+        options.burstSize = atoi(optarg);
+        break;
+      case BATCH_WRITES:
+        options.batchWrites = atoi(optarg);
+        break;
       case HELP:
         usage(EXIT_SUCCESS, argv[0]);
         break;
@@ -27,6 +27,8 @@ struct Options {
   size_t numTensors{0};
   size_t tensorSize{0};
   size_t metadataSize{0};
+  int burstSize{1}; // number of messages written back-to-back per round trip
+  size_t batchWrites{0}; // see ContextOptions::batchWrites
 };
 
 struct Options parseOptions(int argc, char** argv);
@@ -8,11 +8,11 @@
 
 #pragma once
 
-#include <functional>
 #include <string>
 
 #include <tensorpipe/channel/context.h>
 #include <tensorpipe/common/error.h>
+#include <tensorpipe/common/inline_function.h>
 
 // Channels are an out of band mechanism to transfer data between
 // processes. Examples include a direct address space to address space
@@ -45,9 +45,9 @@ namespace tensorpipe {
 namespace channel {
 
 using TDescriptor = std::string;
-using TDescriptorCallback = std::function<void(const Error&, TDescriptor)>;
-using TSendCallback = std::function<void(const Error&)>;
-using TRecvCallback = std::function<void(const Error&)>;
+using TDescriptorCallback = InlineFunction<void(const Error&, TDescriptor)>;
+using TSendCallback = InlineFunction<void(const Error&)>;
+using TRecvCallback = InlineFunction<void(const Error&)>;
 
 // Abstract base class for channel classes.
 template <typename TBuffer>
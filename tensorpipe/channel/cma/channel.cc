@@ -16,6 +16,7 @@
 #include <limits>
 #include <list>
 #include <mutex>
+#include <set>
 
 #include <nop/serializer.h>
 #include <nop/structure.h>
@@ -85,6 +86,9 @@ class Channel::Impl : public std::enable_shared_from_this<Channel::Impl> {
       CpuBuffer buffer,
       TRecvCallback callback);
 
+  // Write the notifications of the completed copies to the peer, in order.
+  void writeNotificationsFromLoop();
+
   void setIdFromLoop(std::string id);
 
   void closeFromLoop();
@@ -107,6 +111,12 @@ class Channel::Impl : public std::enable_shared_from_this<Channel::Impl> {
   // Increasing identifier for recv operations.
   uint64_t nextTensorBeingReceived_{0};
 
+  // The copies of the context may complete out of order, whereas the peer
+  // matches the notifications with its send operations in order. Hence the
+  // notifications of the copies that completed early are held back.
+  uint64_t nextNotificationToWrite_{0};
+  std::set<uint64_t> completedCopies_;
+
   // An identifier for the channel, composed of the identifier for the context,
   // combined with an increasing sequence number. It will only be used for
   // logging and debugging purposes.
@@ -295,19 +305,32 @@ void Channel::Impl::recvFromLoop(
                    << sequenceNumber << ")";
 
         // Let peer know we've completed the copy.
-        TP_VLOG(6) << "Channel " << impl.id_ << " is writing notification (#"
-                   << sequenceNumber << ")";
-        impl.connection_->write(
-            nullptr, 0, impl.lazyCallbackWrapper_([sequenceNumber](Impl& impl) {
-              TP_VLOG(6) << "Channel " << impl.id_
-                         << " done writing notification (#" << sequenceNumber
-                         << ")";
-            }));
+        impl.completedCopies_.insert(sequenceNumber);
+        impl.writeNotificationsFromLoop();
 
         callback(impl.error_);
       }));
 }
 
+void Channel::Impl::writeNotificationsFromLoop() {
+  TP_DCHECK(loop_.inLoop());
+
+  while (!completedCopies_.empty() &&
+         *completedCopies_.begin() == nextNotificationToWrite_) {
+    const uint64_t sequenceNumber = nextNotificationToWrite_++;
+    completedCopies_.erase(completedCopies_.begin());
+
+    TP_VLOG(6) << "Channel " << id_ << " is writing notification (#"
+               << sequenceNumber << ")";
+    connection_->write(
+        nullptr, 0, lazyCallbackWrapper_([sequenceNumber](Impl& impl) {
+          TP_VLOG(6) << "Channel " << impl.id_
+                     << " done writing notification (#" << sequenceNumber
+                     << ")";
+        }));
+  }
+}
+
 void Channel::setId(std::string id) {
   impl_->setId(std::move(id));
 }
@@ -8,6 +8,7 @@
 
 #include <tensorpipe/channel/cma/context.h>
 
+#include <limits.h>
 #include <sys/types.h>
 #include <sys/uio.h>
 #include <unistd.h>
@@ -15,7 +16,7 @@
 #include <algorithm>
 #include <limits>
 #include <list>
-#include <mutex>
+#include <vector>
 
 #include <tensorpipe/channel/cma/channel.h>
 #include <tensorpipe/channel/cma/context_impl.h>
@@ -24,8 +25,6 @@
 #include <tensorpipe/common/callback.h>
 #include <tensorpipe/common/defs.h>
 #include <tensorpipe/common/error_macros.h>
-#include <tensorpipe/common/optional.h>
-#include <tensorpipe/common/queue.h>
 #include <tensorpipe/common/system.h>
 
 namespace tensorpipe {
@@ -58,12 +57,69 @@ std::string generateDomainDescriptor() {
   return oss.str();
 }
 
+// Copy each remote region into the corresponding local one, in as few syscalls
+// as possible, and return the outcome of each copy.
+std::vector<Error> performCopies(
+    pid_t remotePid,
+    const std::vector<struct iovec>& localIovs,
+    const std::vector<struct iovec>& remoteIovs) {
+  TP_DCHECK_EQ(localIovs.size(), remoteIovs.size());
+  TP_DCHECK_LE(remoteIovs.size(), IOV_MAX);
+  const size_t numIovs = remoteIovs.size();
+  std::vector<Error> errors(numIovs, Error::kSuccess);
+  size_t iovIdx = 0;
+  while (iovIdx < numIovs) {
+    // The syscall stops at the first remote region it can't access, returning
+    // the number of bytes copied until then, or failing if it's the first one.
+    // Hence we resume from the region after that one.
+    auto nread = ::process_vm_readv(
+        remotePid,
+        &localIovs[iovIdx],
+        numIovs - iovIdx,
+        &remoteIovs[iovIdx],
+        numIovs - iovIdx,
+        0);
+    if (nread == -1) {
+      errors[iovIdx] = TP_CREATE_ERROR(SystemError, "cma", errno);
+      iovIdx++;
+      continue;
+    }
+    size_t numBytesLeft = nread;
+    while (iovIdx < numIovs && remoteIovs[iovIdx].iov_len <= numBytesLeft) {
+      numBytesLeft -= remoteIovs[iovIdx].iov_len;
+      iovIdx++;
+    }
+    if (iovIdx < numIovs) {
+      errors[iovIdx] = TP_CREATE_ERROR(
+          ShortReadError, remoteIovs[iovIdx].iov_len, numBytesLeft);
+      iovIdx++;
+    }
+  }
+  return errors;
+}
+
+// The chunks handed over together by the pool all belong to the same process,
+// as the key of the batch is the PID.
+std::vector<Error> copyChunks(
+    const std::vector<CopyThreadPool::Chunk>& chunks) {
+  std::vector<struct iovec> localIovs;
+  std::vector<struct iovec> remoteIovs;
+  localIovs.reserve(chunks.size());
+  remoteIovs.reserve(chunks.size());
+  for (const auto& chunk : chunks) {
+    localIovs.push_back({chunk.localPtr, chunk.length});
+    remoteIovs.push_back({chunk.remotePtr, chunk.length});
+  }
+  return performCopies(
+      static_cast<pid_t>(chunks.front().batchKey), localIovs, remoteIovs);
+}
+
 } // namespace
 
 class Context::Impl : public Context::PrivateIface,
                       public std::enable_shared_from_this<Context::Impl> {
  public:
-  Impl();
+  explicit Impl(ContextOptions opts);
 
   const std::string& domainDescriptor() const;
 
@@ -75,7 +131,7 @@ class Context::Impl : public Context::PrivateIface,
 
   ClosingEmitter& getClosingEmitter() override;
 
-  using copy_request_callback_fn = std::function<void(const Error&)>;
+  using copy_request_callback_fn = PrivateIface::copy_request_callback_fn;
 
   void requestCopy(
       pid_t remotePid,
@@ -84,6 +140,8 @@ class Context::Impl : public Context::PrivateIface,
       size_t length,
       copy_request_callback_fn fn) override;
 
+  std::vector<CopyThreadStats> getCopyThreadStats();
+
   void close();
 
   void join();
@@ -91,17 +149,12 @@ class Context::Impl : public Context::PrivateIface,
   ~Impl() override = default;
 
  private:
-  struct CopyRequest {
-    pid_t remotePid;
-    void* remotePtr;
-    void* localPtr;
-    size_t length;
-    copy_request_callback_fn callback;
-  };
+  const std::string domainDescriptor_;
+
+  // Small requests for the same process are served in batches, one per
+  // syscall.
+  CopyThreadPool copyThreadPool_;
 
-  std::string domainDescriptor_;
-  std::thread thread_;
-  Queue<optional<CopyRequest>> requests_;
   std::atomic<bool> closed_{false};
   std::atomic<bool> joined_{false};
   ClosingEmitter closingEmitter_;
@@ -118,17 +171,20 @@ class Context::Impl : public Context::PrivateIface,
   // their identifiers based off this context's identifier. They will only be
   // used for logging and debugging.
   std::atomic<uint64_t> channelCounter_{0};
-
-  void handleCopyRequests();
 };
 
-Context::Context() : impl_(std::make_shared<Context::Impl>()) {}
+Context::Context(ContextOptions opts)
+    : impl_(std::make_shared<Context::Impl>(std::move(opts))) {}
 
-Context::Impl::Impl()
+Context::Impl::Impl(ContextOptions opts)
     : domainDescriptor_(generateDomainDescriptor()),
-      requests_(std::numeric_limits<int>::max()) {
-  thread_ = std::thread(&Impl::handleCopyRequests, this);
-}
+      copyThreadPool_(
+          "TP_CMA_loop",
+          opts.numThreads_,
+          opts.chunkSize_,
+          /*maxNumChunksPerBatch=*/IOV_MAX,
+          /*cpus=*/{},
+          copyChunks) {}
 
 void Context::close() {
   impl_->close();
@@ -139,7 +195,7 @@ void Context::Impl::close() {
     TP_VLOG(4) << "Channel context " << id_ << " is closing";
 
     closingEmitter_.close();
-    requests_.push(nullopt);
+    copyThreadPool_.close();
 
     TP_VLOG(4) << "Channel context " << id_ << " done closing";
   }
@@ -155,8 +211,7 @@ void Context::Impl::join() {
   if (!joined_.exchange(true)) {
     TP_VLOG(4) << "Channel context " << id_ << " is joining";
 
-    thread_.join();
-    // TP_DCHECK(requests_.empty());
+    copyThreadPool_.join();
 
     TP_VLOG(4) << "Channel context " << id_ << " done joining";
   }
@@ -173,6 +228,15 @@ void Context::setId(std::string id) {
 void Context::Impl::setId(std::string id) {
   TP_VLOG(4) << "Channel context " << id_ << " was renamed to " << id;
   id_ = std::move(id);
+  copyThreadPool_.setId(id_);
+}
+
+std::vector<CopyThreadStats> Context::getCopyThreadStats() {
+  return impl_->getCopyThreadStats();
+}
+
+std::vector<CopyThreadStats> Context::Impl::getCopyThreadStats() {
+  return copyThreadPool_.getStats();
 }
 
 ClosingEmitter& Context::Impl::getClosingEmitter() {
@@ -212,12 +276,12 @@ void Context::Impl::requestCopy(
     void* remotePtr,
     void* localPtr,
     size_t length,
-    std::function<void(const Error&)> fn) {
+    copy_request_callback_fn fn) {
   uint64_t requestId = nextRequestId_++;
   TP_VLOG(4) << "Channel context " << id_ << " received a copy request (#"
              << requestId << ")";
 
-  fn = [this, requestId, fn{std::move(fn)}](const Error& error) {
+  auto wrappedFn = [this, requestId, fn{std::move(fn)}](const Error& error) {
     TP_VLOG(4) << "Channel context " << id_
                << " is calling a copy request callback (#" << requestId << ")";
     fn(error);
@@ -226,36 +290,12 @@ void Context::Impl::requestCopy(
                << ")";
   };
 
-  requests_.push(
-      CopyRequest{remotePid, remotePtr, localPtr, length, std::move(fn)});
-}
-
-void Context::Impl::handleCopyRequests() {
-  setThreadName("TP_CMA_loop");
-  while (true) {
-    auto maybeRequest = requests_.pop();
-    if (!maybeRequest.has_value()) {
-      break;
-    }
-    CopyRequest request = std::move(maybeRequest).value();
-
-    // Perform copy.
-    struct iovec local {
-      .iov_base = request.localPtr, .iov_len = request.length
-    };
-    struct iovec remote {
-      .iov_base = request.remotePtr, .iov_len = request.length
-    };
-    auto nread =
-        ::process_vm_readv(request.remotePid, &local, 1, &remote, 1, 0);
-    if (nread == -1) {
-      request.callback(TP_CREATE_ERROR(SystemError, "cma", errno));
-    } else if (nread != request.length) {
-      request.callback(TP_CREATE_ERROR(ShortReadError, request.length, nread));
-    } else {
-      request.callback(Error::kSuccess);
-    }
-  }
+  copyThreadPool_.requestCopy(
+      remotePtr,
+      localPtr,
+      length,
+      /*batchKey=*/remotePid,
+      std::move(wrappedFn));
 }
 
 } // namespace cma
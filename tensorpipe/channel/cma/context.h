@@ -8,18 +8,45 @@
 
 #pragma once
 
+#include <cstddef>
 #include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
+#include <tensorpipe/channel/copy_thread_pool.h>
 #include <tensorpipe/channel/cpu_context.h>
 
 namespace tensorpipe {
 namespace channel {
 namespace cma {
 
+class ContextOptions {
+ public:
+  size_t numThreads_{4};
+  size_t chunkSize_{1024 * 1024};
+
+  // The number of threads performing the copies, which are shared by all the
+  // channels of the context. Larger pools allow more copies to be performed in
+  // parallel, when there are enough of them to keep all threads busy.
+  ContextOptions&& numThreads(size_t numThreads) && {
+    numThreads_ = numThreads;
+    return std::move(*this);
+  }
+
+  // Copies larger than this size are split into chunks of this size, which are
+  // performed in parallel by the threads of the pool. Copies no larger than
+  // this are instead performed in one go, and jump ahead of the chunks of the
+  // larger ones, so that they aren't held up behind them.
+  ContextOptions&& chunkSize(size_t chunkSize) && {
+    chunkSize_ = chunkSize;
+    return std::move(*this);
+  }
+};
+
 class Context : public channel::CpuContext {
  public:
-  Context();
+  explicit Context(ContextOptions opts = ContextOptions());
 
   const std::string& domainDescriptor() const override;
 
@@ -29,6 +56,10 @@ class Context : public channel::CpuContext {
 
   void setId(std::string id) override;
 
+  // How much data each thread of the pool has copied so far, and how long it
+  // took.
+  std::vector<CopyThreadStats> getCopyThreadStats();
+
   void close() override;
 
   void join() override;
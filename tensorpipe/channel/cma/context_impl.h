@@ -8,11 +8,10 @@
 
 #pragma once
 
-#include <functional>
-
 #include <tensorpipe/channel/cma/context.h>
 #include <tensorpipe/common/callback.h>
 #include <tensorpipe/common/error.h>
+#include <tensorpipe/common/inline_function.h>
 
 namespace tensorpipe {
 namespace channel {
@@ -22,7 +21,7 @@ class Context::PrivateIface {
  public:
   virtual ClosingEmitter& getClosingEmitter() = 0;
 
-  using copy_request_callback_fn = std::function<void(const Error&)>;
+  using copy_request_callback_fn = InlineFunction<void(const Error&)>;
 
   virtual void requestCopy(
       pid_t remotePid,
@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <tensorpipe/channel/copy_thread_pool.h>
+
+#include <algorithm>
+#include <utility>
+
+#include <tensorpipe/common/defs.h>
+#include <tensorpipe/common/system.h>
+
+namespace tensorpipe {
+namespace channel {
+
+CopyThreadPool::CopyThreadPool(
+    std::string threadName,
+    size_t numThreads,
+    size_t chunkSize,
+    size_t maxNumChunksPerBatch,
+    std::vector<int> cpus,
+    copy_fn fn)
+    : threadName_(std::move(threadName)),
+      chunkSize_(chunkSize),
+      maxNumChunksPerBatch_(maxNumChunksPerBatch),
+      cpus_(std::move(cpus)),
+      copy_(std::move(fn)),
+      stats_(numThreads) {
+  TP_THROW_ASSERT_IF(numThreads == 0) << "There must be at least one thread";
+  TP_THROW_ASSERT_IF(chunkSize_ == 0) << "The chunk size can't be zero";
+  TP_DCHECK_GT(maxNumChunksPerBatch_, 0);
+  TP_THROW_ASSERT_IF(!cpus_.empty() && cpus_.size() != numThreads)
+      << "Got " << cpus_.size() << " CPUs for " << numThreads << " threads";
+  for (int cpu : cpus_) {
+    validateCpu(cpu);
+  }
+  for (size_t threadIdx = 0; threadIdx < numThreads; threadIdx++) {
+    threads_.emplace_back(&CopyThreadPool::handleCopyRequests, this, threadIdx);
+  }
+}
+
+void CopyThreadPool::requestCopy(
+    void* remotePtr,
+    void* localPtr,
+    size_t length,
+    uint64_t batchKey,
+    copy_request_callback_fn fn) {
+  auto request = std::make_shared<CopyRequest>(CopyRequest{
+      reinterpret_cast<uint8_t*>(remotePtr),
+      reinterpret_cast<uint8_t*>(localPtr),
+      length,
+      batchKey,
+      std::move(fn)});
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (length <= chunkSize_) {
+    // If small requests can be batched and some were already pending, then a
+    // thread has been woken up for them and will also pick up this one as part
+    // of the same batch. Waking up another one would instead split the batch.
+    const bool wasEmpty = smallRequests_.empty();
+    smallRequests_.push_back(std::move(request));
+    if (wasEmpty || maxNumChunksPerBatch_ == 1) {
+      cv_.notify_one();
+    }
+  } else {
+    largeRequests_.push_back(std::move(request));
+    cv_.notify_one();
+  }
+}
+
+std::vector<CopyThreadStats> CopyThreadPool::getStats() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+void CopyThreadPool::setId(std::string id) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  id_ = std::move(id);
+}
+
+void CopyThreadPool::close() {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  cv_.notify_all();
+}
+
+void CopyThreadPool::join() {
+  close();
+  if (!joined_) {
+    joined_ = true;
+    for (auto& thread : threads_) {
+      thread.join();
+    }
+  }
+}
+
+CopyThreadPool::~CopyThreadPool() {
+  join();
+}
+
+void CopyThreadPool::handleCopyRequests(size_t threadIdx) {
+  setThreadName(threadName_);
+  if (!cpus_.empty()) {
+    setThreadCpuAffinity(cpus_[threadIdx]);
+  }
+
+  std::vector<std::shared_ptr<CopyRequest>> requests;
+  std::vector<Chunk> chunks;
+  std::vector<std::shared_ptr<CopyRequest>> requestsDone;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cv_.wait(lock, [&]() {
+      return stopping_ || !smallRequests_.empty() || !largeRequests_.empty();
+    });
+    if (smallRequests_.empty() && largeRequests_.empty()) {
+      TP_DCHECK(stopping_);
+      break;
+    }
+
+    popNextChunks(requests, chunks);
+    lock.unlock();
+
+    auto startTime = std::chrono::steady_clock::now();
+    std::vector<Error> errors = copy_(chunks);
+    auto timeSpentCopying = std::chrono::steady_clock::now() - startTime;
+    TP_DCHECK_EQ(errors.size(), chunks.size());
+
+    lock.lock();
+    CopyThreadStats& stats = stats_[threadIdx];
+    stats.timeSpentCopying += timeSpentCopying;
+    for (size_t chunkIdx = 0; chunkIdx < chunks.size(); chunkIdx++) {
+      CopyRequest& request = *requests[chunkIdx];
+      stats.numBytesCopied += chunks[chunkIdx].length;
+      if (errors[chunkIdx] && !request.error) {
+        request.error = std::move(errors[chunkIdx]);
+      }
+      request.numBytesDone += chunks[chunkIdx].length;
+      if (request.numBytesDone == request.length) {
+        requestsDone.push_back(std::move(requests[chunkIdx]));
+      }
+    }
+    requests.clear();
+    chunks.clear();
+
+    if (!requestsDone.empty()) {
+      lock.unlock();
+      for (const auto& request : requestsDone) {
+        request->callback(request->error);
+      }
+      requestsDone.clear();
+      lock.lock();
+    }
+  }
+
+  const CopyThreadStats& stats = stats_[threadIdx];
+  const double secondsSpentCopying =
+      std::chrono::duration_cast<std::chrono::duration<double>>(
+          stats.timeSpentCopying)
+          .count();
+  TP_VLOG(4) << "Channel context " << id_ << " copy thread #" << threadIdx
+             << " copied " << stats.numBytesCopied << " bytes in "
+             << secondsSpentCopying << " seconds ("
+             << (secondsSpentCopying > 0
+                     ? stats.numBytesCopied / secondsSpentCopying / 1e9
+                     : 0)
+             << " GB/s)";
+}
+
+void CopyThreadPool::popNextChunks(
+    std::vector<std::shared_ptr<CopyRequest>>& requests,
+    std::vector<Chunk>& chunks) {
+  if (!smallRequests_.empty()) {
+    // Group the first request with the following ones with the same key, as
+    // long as they fit in one chunk. This way many small copies can be done
+    // at once, whereas large amounts of data are still spread across threads.
+    const uint64_t batchKey = smallRequests_.front()->batchKey;
+    size_t numBytes = 0;
+    auto iter = smallRequests_.begin();
+    while (iter != smallRequests_.end() &&
+           requests.size() < maxNumChunksPerBatch_) {
+      const CopyRequest& request = **iter;
+      if (request.batchKey == batchKey &&
+          (requests.empty() || numBytes + request.length <= chunkSize_)) {
+        numBytes += request.length;
+        chunks.push_back(Chunk{
+            request.remotePtr,
+            request.localPtr,
+            request.length,
+            request.length,
+            request.batchKey});
+        requests.push_back(std::move(*iter));
+        iter = smallRequests_.erase(iter);
+      } else {
+        ++iter;
+      }
+    }
+    if (!smallRequests_.empty()) {
+      cv_.notify_one();
+    }
+    return;
+  }
+
+  // Take the next chunk of the first large request, and hand the request over
+  // to the other threads if it has more chunks left.
+  std::shared_ptr<CopyRequest> request = largeRequests_.front();
+  const size_t offset = request->offsetOfNextChunk;
+  const size_t length = std::min(chunkSize_, request->length - offset);
+  request->offsetOfNextChunk += length;
+  if (request->offsetOfNextChunk == request->length) {
+    largeRequests_.pop_front();
+  } else {
+    cv_.notify_one();
+  }
+  chunks.push_back(Chunk{
+      request->remotePtr + offset,
+      request->localPtr + offset,
+      length,
+      request->length,
+      request->batchKey});
+  requests.push_back(std::move(request));
+}
+
+} // namespace channel
+} // namespace tensorpipe
@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <tensorpipe/common/error.h>
+#include <tensorpipe/common/inline_function.h>
+
+namespace tensorpipe {
+namespace channel {
+
+// How much data a thread of a copy pool has copied, and how long it took.
+struct CopyThreadStats {
+  uint64_t numBytesCopied{0};
+  std::chrono::steady_clock::duration timeSpentCopying{0};
+};
+
+// A pool of threads performing the copies requested by all the channels of a
+// context. Copies larger than the chunk size are split into chunks, which idle
+// threads perform in parallel. Smaller copies are queued separately and are
+// always served first, so that they aren't held up behind the chunks of the
+// larger ones. Pending small copies with the same batch key (e.g., the remote
+// process) may be handed to the copy function together, to perform them at
+// once. A copy's callback is called once all its chunks are done, with the
+// first error encountered.
+class CopyThreadPool final {
+ public:
+  using copy_request_callback_fn =
+      InlineFunction<void(const Error&), kWrappedCallbackInlineCapacity>;
+
+  struct Chunk {
+    uint8_t* remotePtr;
+    uint8_t* localPtr;
+    size_t length;
+    // The total length of the copy that the chunk belongs to.
+    size_t requestLength;
+    uint64_t batchKey;
+  };
+
+  // Perform the given chunks (there is at least one) and return the outcome of
+  // each of them. This is called from the threads of the pool.
+  using copy_fn = std::function<std::vector<Error>(const std::vector<Chunk>&)>;
+
+  // If CPUs are given (one per thread), the i-th thread is pinned to the i-th
+  // CPU. Invalid options are reported here, before any thread is started.
+  CopyThreadPool(
+      std::string threadName,
+      size_t numThreads,
+      size_t chunkSize,
+      size_t maxNumChunksPerBatch,
+      std::vector<int> cpus,
+      copy_fn fn);
+
+  CopyThreadPool(const CopyThreadPool&) = delete;
+  CopyThreadPool(CopyThreadPool&&) = delete;
+  CopyThreadPool& operator=(const CopyThreadPool&) = delete;
+  CopyThreadPool& operator=(CopyThreadPool&&) = delete;
+
+  void requestCopy(
+      void* remotePtr,
+      void* localPtr,
+      size_t length,
+      uint64_t batchKey,
+      copy_request_callback_fn fn);
+
+  // Return the statistics of each thread so far.
+  std::vector<CopyThreadStats> getStats();
+
+  // Used for logging and debugging only.
+  void setId(std::string id);
+
+  // Let the threads exit once they have served all pending requests.
+  void close();
+
+  void join();
+
+  ~CopyThreadPool();
+
+ private:
+  struct CopyRequest {
+    uint8_t* remotePtr;
+    uint8_t* localPtr;
+    size_t length;
+    uint64_t batchKey;
+    copy_request_callback_fn callback;
+
+    // The chunks of a request may be copied by several threads at once.
+    size_t offsetOfNextChunk{0};
+    size_t numBytesDone{0};
+    Error error{Error::kSuccess};
+  };
+
+  const std::string threadName_;
+  const size_t chunkSize_;
+  const size_t maxNumChunksPerBatch_;
+  const std::vector<int> cpus_;
+  const copy_fn copy_;
+  std::vector<std::thread> threads_;
+  bool joined_{false};
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::shared_ptr<CopyRequest>> smallRequests_;
+  std::deque<std::shared_ptr<CopyRequest>> largeRequests_;
+  bool stopping_{false};
+  std::vector<CopyThreadStats> stats_;
+  std::string id_{"N/A"};
+
+  void handleCopyRequests(size_t threadIdx);
+
+  // Must be called with the mutex held.
+  void popNextChunks(
+      std::vector<std::shared_ptr<CopyRequest>>& requests,
+      std::vector<Chunk>& chunks);
+};
+
+} // namespace channel
+} // namespace tensorpipe
@@ -10,6 +10,7 @@
 
 #include <algorithm>
 #include <sstream>
+#include <vector>
 
 #include <tensorpipe/channel/error.h>
 #include <tensorpipe/channel/helpers.h>
@@ -18,6 +19,7 @@
 #include <tensorpipe/common/callback.h>
 #include <tensorpipe/common/defs.h>
 #include <tensorpipe/common/error_macros.h>
+#include <tensorpipe/common/optional.h>
 #include <tensorpipe/transport/connection.h>
 #include <tensorpipe/transport/context.h>
 #include <tensorpipe/transport/error.h>
@@ -34,7 +36,10 @@ struct SendOperation {
   uint64_t sequenceNumber;
   const void* ptr;
   size_t length;
+  // The bytes before this offset have already been handed out to the lanes.
+  size_t offsetOfNextChunk{0};
   int64_t numChunksBeingWritten{0};
+  bool done{false};
   TSendCallback callback;
 };
 
@@ -43,7 +48,9 @@ struct RecvOperation {
   uint64_t sequenceNumber;
   void* ptr;
   size_t length;
+  size_t numBytesRead{0};
   int64_t numChunksBeingRead{0};
+  bool done{false};
   TRecvCallback callback;
 };
 
@@ -56,6 +63,9 @@ class Channel::Impl : public std::enable_shared_from_this<Channel::Impl> {
       std::shared_ptr<transport::Connection> connection,
       Endpoint endpoint,
       uint64_t numLanes,
+      size_t stripingThreshold,
+      size_t chunkSize,
+      size_t maxBytesInFlight,
       std::string id);
 
   // Called by the channel's constructor.
@@ -109,17 +119,54 @@ class Channel::Impl : public std::enable_shared_from_this<Channel::Impl> {
   // operations that were performed in the meantime and queued.
   void startSendingAndReceivingUponEstablishingChannel();
 
-  // Performs the chunking and the writing of one send operation.
+  // Queues a send operation, for it to be sent in one piece if it's small or
+  // for it to be chunked if it's large.
   void sendOperation(SendOperation& op);
 
-  // Performs the chunking and the reading of one recv operation.
+  // Resumes the reading of the chunks destined to one recv operation.
   void recvOperation(RecvOperation& op);
 
+  // Hands out the queued small send operations, and then the chunks of the
+  // large ones, to the lanes, for as long as they have room for them.
+  void writePendingChunks();
+
+  // Returns the lane with the fewest bytes being written among those on which
+  // a chunk of the given operation can go, if there is any.
+  optional<uint64_t> leastLoadedLaneFor(const SendOperation& op) const;
+
+  // Writes the header and then the payload of a chunk on the given lane.
+  void writeChunk(
+      SendOperation& op,
+      uint64_t laneIdx,
+      size_t offset,
+      size_t length);
+
+  // Reads the header of the next chunk that will arrive on the given lane.
+  void readChunkHeader(uint64_t laneIdx);
+
+  // Called when the header of a chunk has been read on the given lane.
+  void onReadOfChunkHeader(uint64_t laneIdx, const ChunkHeader& nopChunkHeader);
+
+  // Reads the payload of a chunk, whose header arrived on the given lane.
+  void readChunk(
+      RecvOperation& op,
+      uint64_t laneIdx,
+      const ChunkHeader& nopChunkHeader);
+
   // Called when the write of one chunk of a send operation has been completed.
-  void onWriteOfPayload(SendOperation& op);
+  void onWriteOfPayload(SendOperation& op, uint64_t laneIdx, size_t length);
 
   // Called when the read of one chunk of a recv operation has been completed.
-  void onReadOfPayload(RecvOperation& op);
+  void onReadOfPayload(RecvOperation& op, size_t length);
+
+  // Invoke the callback of an operation if it has no more chunks to wait for,
+  // or if it failed and none of its chunks are still in flight.
+  void maybeCompleteSendOperation(SendOperation& op);
+  void maybeCompleteRecvOperation(RecvOperation& op);
+
+  // Operations can complete out of order, but they can only be dropped from
+  // the front of the queues, as the other ones must keep their addresses.
+  void dropCompletedOperations();
 
   void setError(Error error);
 
@@ -132,10 +179,43 @@ class Channel::Impl : public std::enable_shared_from_this<Channel::Impl> {
   Endpoint endpoint_;
   State state_{UNINITIALIZED};
   uint64_t numLanes_;
+  const size_t stripingThreshold_;
+  const size_t chunkSize_;
+  const size_t maxBytesInFlight_;
   uint64_t numLanesBeingAccepted_{0};
   std::vector<std::shared_ptr<transport::Connection>> lanes_;
   std::unordered_map<uint64_t, uint64_t> laneRegistrationIds_;
 
+  // The number of bytes of payload that have been handed to each lane and
+  // whose write hasn't completed yet. A lane is only given a new chunk of a
+  // large operation once this drops below the chunk size.
+  std::vector<size_t> numBytesBeingWrittenOnLane_;
+
+  // The sum of the above, over all lanes. No chunk is handed out while this is
+  // at or above the maximum number of bytes in flight.
+  size_t numBytesBeingWritten_{0};
+
+  // The sequence number of the last operation that had a chunk handed to each
+  // lane. The chunks written on a lane are in the order of their operations,
+  // hence the earlier operations can't use that lane anymore.
+  std::vector<uint64_t> lastSequenceNumberOnLane_;
+
+  // Small send operations that haven't been handed out to any lane yet. They
+  // take precedence over the chunks of large operations.
+  std::deque<SendOperation*> sendOperationsWaitingForLane_;
+
+  // Large send operations that still have chunks which haven't been handed out
+  // to any lane. They take turns: after one of them has a chunk handed out, it
+  // moves to the back, so that they all progress at the same pace and those
+  // that are shorter complete first.
+  std::deque<SendOperation*> sendOperationsBeingChunked_;
+
+  // The header of a chunk that arrived on a lane before the recv operation it
+  // belongs to was posted. The lane stops reading until that happens. This
+  // never holds back an earlier operation, whose chunks on that lane came
+  // before this one, as the sender writes them in the order of operations.
+  std::vector<optional<ChunkHeader>> chunkHeaderWaitingOnLane_;
+
   // Increasing identifier for send operations.
   uint64_t nextTensorBeingSent_{0};
 
@@ -169,12 +249,18 @@ Channel::Channel(
     std::shared_ptr<transport::Connection> connection,
     Endpoint endpoint,
     uint64_t numLanes,
+    size_t stripingThreshold,
+    size_t chunkSize,
+    size_t maxBytesInFlight,
     std::string id)
     : impl_(std::make_shared<Impl>(
           std::move(context),
           std::move(connection),
           endpoint,
           numLanes,
+          stripingThreshold,
+          chunkSize,
+          maxBytesInFlight,
           std::move(id))) {
   impl_->init();
 }
@@ -184,12 +270,21 @@ Channel::Impl::Impl(
     std::shared_ptr<transport::Connection> connection,
     Endpoint endpoint,
     uint64_t numLanes,
+    size_t stripingThreshold,
+    size_t chunkSize,
+    size_t maxBytesInFlight,
     std::string id)
     : context_(std::move(context)),
       connection_(std::move(connection)),
       endpoint_(endpoint),
       numLanes_(numLanes),
+      stripingThreshold_(stripingThreshold),
+      chunkSize_(chunkSize),
+      maxBytesInFlight_(maxBytesInFlight),
       lanes_(numLanes_),
+      numBytesBeingWrittenOnLane_(numLanes_, 0),
+      lastSequenceNumberOnLane_(numLanes_, 0),
+      chunkHeaderWaitingOnLane_(numLanes_),
       id_(std::move(id)),
       closingReceiver_(context_, context_->getClosingEmitter()) {}
 
@@ -456,6 +551,9 @@ void Channel::Impl::startSendingAndReceivingUponEstablishingChannel() {
   TP_DCHECK(loop_.inLoop());
   TP_DCHECK_EQ(state_, ESTABLISHED);
 
+  for (uint64_t laneIdx = 0; laneIdx < lanes_.size(); laneIdx++) {
+    readChunkHeader(laneIdx);
+  }
   for (SendOperation& op : sendOperations_) {
     sendOperation(op);
   }
@@ -468,26 +566,16 @@ void Channel::Impl::sendOperation(SendOperation& op) {
   TP_DCHECK(loop_.inLoop());
   TP_DCHECK_EQ(state_, ESTABLISHED);
 
-  for (uint64_t laneIdx = 0; laneIdx < lanes_.size(); laneIdx++) {
-    // Insert "cutpoints" at equally-spaced intervals in the buffer, rounding
-    // them down if they don't end up being at an integer position.
-    uint64_t offsetStart = op.length * laneIdx / lanes_.size();
-    uint64_t offsetEnd = op.length * (laneIdx + 1) / lanes_.size();
-    // As void "has no size" we cannot do pointer arithmetic on it. We need to
-    // temporarily convert the pointer to a type that has a size of 1 byte.
-    const void* ptr = reinterpret_cast<const uint8_t*>(op.ptr) + offsetStart;
-    uint64_t length = offsetEnd - offsetStart;
-
-    // Write payload.
-    TP_VLOG(6) << "Channel " << id_ << " writing payload #" << op.sequenceNumber
-               << " on lane " << laneIdx;
-    lanes_[laneIdx]->write(
-        ptr, length, eagerCallbackWrapper_([&op, laneIdx](Impl& impl) {
-          TP_VLOG(6) << "Channel " << impl.id_ << " done writing payload #"
-                     << op.sequenceNumber << " on lane " << laneIdx;
-          impl.onWriteOfPayload(op);
-        }));
-    ++op.numChunksBeingWritten;
+  if (op.length == 0) {
+    // The receiver completes empty operations by itself.
+    maybeCompleteSendOperation(op);
+    dropCompletedOperations();
+  } else if (op.length <= stripingThreshold_) {
+    sendOperationsWaitingForLane_.push_back(&op);
+    writePendingChunks();
+  } else {
+    sendOperationsBeingChunked_.push_back(&op);
+    writePendingChunks();
   }
 }
 
@@ -495,31 +583,225 @@ void Channel::Impl::recvOperation(RecvOperation& op) {
   TP_DCHECK(loop_.inLoop());
   TP_DCHECK_EQ(state_, ESTABLISHED);
 
+  // Some lanes may have stopped because they got a chunk of this operation.
+  for (uint64_t laneIdx = 0; laneIdx < lanes_.size(); laneIdx++) {
+    optional<ChunkHeader>& nopChunkHeader = chunkHeaderWaitingOnLane_[laneIdx];
+    if (nopChunkHeader.has_value() &&
+        nopChunkHeader->sequenceNumber == op.sequenceNumber) {
+      ChunkHeader nopChunkHeaderCopy = *nopChunkHeader;
+      nopChunkHeader.reset();
+      readChunk(op, laneIdx, nopChunkHeaderCopy);
+    }
+  }
+
+  if (op.length == 0) {
+    maybeCompleteRecvOperation(op);
+    dropCompletedOperations();
+  }
+}
+
+void Channel::Impl::writePendingChunks() {
+  TP_DCHECK(loop_.inLoop());
+  TP_DCHECK_EQ(state_, ESTABLISHED);
+
+  while (numBytesBeingWritten_ < maxBytesInFlight_) {
+    if (!sendOperationsWaitingForLane_.empty()) {
+      SendOperation& op = *sendOperationsWaitingForLane_.front();
+      optional<uint64_t> laneIdx = leastLoadedLaneFor(op);
+      if (laneIdx.has_value()) {
+        sendOperationsWaitingForLane_.pop_front();
+        writeChunk(op, laneIdx.value(), /*offset=*/0, op.length);
+        op.offsetOfNextChunk = op.length;
+        continue;
+      }
+    }
+
+    // Pick the first operation that has a lane with room for a chunk.
+    optional<uint64_t> laneIdx;
+    auto iter = std::find_if(
+        sendOperationsBeingChunked_.begin(),
+        sendOperationsBeingChunked_.end(),
+        [&](const SendOperation* op) {
+          laneIdx = leastLoadedLaneFor(*op);
+          return laneIdx.has_value() &&
+              numBytesBeingWrittenOnLane_[laneIdx.value()] < chunkSize_;
+        });
+    if (iter == sendOperationsBeingChunked_.end()) {
+      // All lanes are busy. We'll resume once one of them has drained.
+      return;
+    }
+    SendOperation& op = **iter;
+    sendOperationsBeingChunked_.erase(iter);
+    const size_t length =
+        std::min(chunkSize_, op.length - op.offsetOfNextChunk);
+    writeChunk(op, laneIdx.value(), op.offsetOfNextChunk, length);
+    op.offsetOfNextChunk += length;
+    if (op.offsetOfNextChunk < op.length) {
+      sendOperationsBeingChunked_.push_back(&op);
+    }
+  }
+}
+
+optional<uint64_t> Channel::Impl::leastLoadedLaneFor(
+    const SendOperation& op) const {
+  // A later operation mustn't take the last lane left to the oldest one that
+  // still has data to hand out, or the latter would be stuck. The lanes usable
+  // by an operation are also usable by all later ones, hence this suffices for
+  // all the ones in between too. No lane is reserved if this is out of range.
+  uint64_t reservedLaneIdx = lanes_.size();
+  for (const SendOperation& otherOp : sendOperations_) {
+    if (otherOp.offsetOfNextChunk == otherOp.length) {
+      continue;
+    }
+    if (otherOp.sequenceNumber < op.sequenceNumber) {
+      uint64_t numLanesForOtherOp = 0;
+      for (uint64_t laneIdx = 0; laneIdx < lanes_.size(); laneIdx++) {
+        if (lastSequenceNumberOnLane_[laneIdx] <= otherOp.sequenceNumber) {
+          reservedLaneIdx = laneIdx;
+          numLanesForOtherOp++;
+        }
+      }
+      TP_DCHECK_GE(numLanesForOtherOp, 1);
+      if (numLanesForOtherOp > 1) {
+        reservedLaneIdx = lanes_.size();
+      }
+    }
+    break;
+  }
+
+  optional<uint64_t> bestLaneIdx;
   for (uint64_t laneIdx = 0; laneIdx < lanes_.size(); laneIdx++) {
-    // Insert "cutpoints" at equally-spaced intervals in the buffer, rounding
-    // them down if they don't end up being at an integer position.
-    uint64_t offsetStart = op.length * laneIdx / lanes_.size();
-    uint64_t offsetEnd = op.length * (laneIdx + 1) / lanes_.size();
-    // As void "has no size" we cannot do pointer arithmetic on it. We need to
-    // temporarily convert the pointer to a type that has a size of 1 byte.
-    void* ptr = reinterpret_cast<uint8_t*>(op.ptr) + offsetStart;
-    uint64_t length = offsetEnd - offsetStart;
-
-    // Read payload.
-    TP_VLOG(6) << "Channel " << id_ << " reading payload #" << op.sequenceNumber
-               << " on lane " << laneIdx;
-    lanes_[laneIdx]->read(
-        ptr,
-        length,
-        eagerCallbackWrapper_(
-            [&op, laneIdx](
-                Impl& impl, const void* /* unused */, size_t /* unused */) {
-              TP_VLOG(6) << "Channel " << impl.id_ << " done reading payload #"
-                         << op.sequenceNumber << " on lane " << laneIdx;
-              impl.onReadOfPayload(op);
-            }));
-    ++op.numChunksBeingRead;
+    if (lastSequenceNumberOnLane_[laneIdx] > op.sequenceNumber ||
+        laneIdx == reservedLaneIdx) {
+      continue;
+    }
+    if (!bestLaneIdx.has_value() ||
+        numBytesBeingWrittenOnLane_[laneIdx] <
+            numBytesBeingWrittenOnLane_[bestLaneIdx.value()]) {
+      bestLaneIdx = laneIdx;
+    }
   }
+  return bestLaneIdx;
+}
+
+void Channel::Impl::writeChunk(
+    SendOperation& op,
+    uint64_t laneIdx,
+    size_t offset,
+    size_t length) {
+  TP_DCHECK(loop_.inLoop());
+  TP_DCHECK_EQ(state_, ESTABLISHED);
+
+  auto nopHolderOut = std::make_shared<NopHolder<ChunkHeader>>();
+  ChunkHeader& nopChunkHeader = nopHolderOut->getObject();
+  nopChunkHeader.sequenceNumber = op.sequenceNumber;
+  nopChunkHeader.offset = offset;
+  nopChunkHeader.length = length;
+  TP_VLOG(6) << "Channel " << id_ << " writing nop object (chunk header #"
+             << op.sequenceNumber << ") on lane " << laneIdx;
+  lanes_[laneIdx]->write(
+      *nopHolderOut,
+      lazyCallbackWrapper_([nopHolderOut, laneIdx](Impl& impl) {
+        TP_VLOG(6) << "Channel " << impl.id_
+                   << " done writing nop object (chunk header #"
+                   << nopHolderOut->getObject().sequenceNumber << ") on lane "
+                   << laneIdx;
+      }));
+
+  // As void "has no size" we cannot do pointer arithmetic on it. We need to
+  // temporarily convert the pointer to a type that has a size of 1 byte.
+  const void* ptr = reinterpret_cast<const uint8_t*>(op.ptr) + offset;
+
+  // Write payload.
+  TP_VLOG(6) << "Channel " << id_ << " writing payload #" << op.sequenceNumber
+             << " on lane " << laneIdx;
+  lanes_[laneIdx]->write(
+      ptr,
+      length,
+      eagerCallbackWrapper_([&op, laneIdx, length](Impl& impl) {
+        TP_VLOG(6) << "Channel " << impl.id_ << " done writing payload #"
+                   << op.sequenceNumber << " on lane " << laneIdx;
+        impl.onWriteOfPayload(op, laneIdx, length);
+      }));
+  ++op.numChunksBeingWritten;
+  numBytesBeingWrittenOnLane_[laneIdx] += length;
+  TP_DCHECK_GE(op.sequenceNumber, lastSequenceNumberOnLane_[laneIdx]);
+  lastSequenceNumberOnLane_[laneIdx] = op.sequenceNumber;
+  numBytesBeingWritten_ += length;
+}
+
+void Channel::Impl::readChunkHeader(uint64_t laneIdx) {
+  TP_DCHECK(loop_.inLoop());
+  TP_DCHECK_EQ(state_, ESTABLISHED);
+
+  auto nopHolderIn = std::make_shared<NopHolder<ChunkHeader>>();
+  TP_VLOG(6) << "Channel " << id_
+             << " reading nop object (chunk header) on lane " << laneIdx;
+  lanes_[laneIdx]->read(
+      *nopHolderIn, lazyCallbackWrapper_([nopHolderIn, laneIdx](Impl& impl) {
+        TP_VLOG(6) << "Channel " << impl.id_
+                   << " done reading nop object (chunk header #"
+                   << nopHolderIn->getObject().sequenceNumber << ") on lane "
+                   << laneIdx;
+        impl.onReadOfChunkHeader(laneIdx, nopHolderIn->getObject());
+      }));
+}
+
+void Channel::Impl::onReadOfChunkHeader(
+    uint64_t laneIdx,
+    const ChunkHeader& nopChunkHeader) {
+  TP_DCHECK(loop_.inLoop());
+  TP_DCHECK_EQ(state_, ESTABLISHED);
+
+  // The operations that are done have been dropped from the front of the
+  // queue, and all the following ones are still waiting for chunks.
+  if (!recvOperations_.empty()) {
+    const uint64_t firstSequenceNumber =
+        recvOperations_.front().sequenceNumber;
+    TP_DCHECK_GE(nopChunkHeader.sequenceNumber, firstSequenceNumber);
+    const uint64_t opIdx = nopChunkHeader.sequenceNumber - firstSequenceNumber;
+    if (opIdx < recvOperations_.size()) {
+      readChunk(recvOperations_[opIdx], laneIdx, nopChunkHeader);
+      return;
+    }
+  }
+
+  // The operation hasn't been posted yet: recvOperation will pick this up.
+  TP_DCHECK(!chunkHeaderWaitingOnLane_[laneIdx].has_value());
+  chunkHeaderWaitingOnLane_[laneIdx] = nopChunkHeader;
+}
+
+void Channel::Impl::readChunk(
+    RecvOperation& op,
+    uint64_t laneIdx,
+    const ChunkHeader& nopChunkHeader) {
+  TP_DCHECK(loop_.inLoop());
+  TP_DCHECK_EQ(state_, ESTABLISHED);
+  TP_DCHECK_EQ(op.sequenceNumber, nopChunkHeader.sequenceNumber);
+  TP_DCHECK_LE(nopChunkHeader.offset + nopChunkHeader.length, op.length);
+
+  // As void "has no size" we cannot do pointer arithmetic on it. We need to
+  // temporarily convert the pointer to a type that has a size of 1 byte.
+  void* ptr = reinterpret_cast<uint8_t*>(op.ptr) + nopChunkHeader.offset;
+  const size_t length = nopChunkHeader.length;
+
+  // Read payload.
+  TP_VLOG(6) << "Channel " << id_ << " reading payload #" << op.sequenceNumber
+             << " on lane " << laneIdx;
+  lanes_[laneIdx]->read(
+      ptr,
+      length,
+      eagerCallbackWrapper_(
+          [&op, laneIdx, length](
+              Impl& impl, const void* /* unused */, size_t /* unused */) {
+            TP_VLOG(6) << "Channel " << impl.id_ << " done reading payload #"
+                       << op.sequenceNumber << " on lane " << laneIdx;
+            impl.onReadOfPayload(op, length);
+          }));
+  ++op.numChunksBeingRead;
+
+  // The next header follows the payload on the lane.
+  readChunkHeader(laneIdx);
 }
 
 void Channel::close() {
@@ -540,35 +822,68 @@ void Channel::Impl::closeFromLoop() {
   setError(TP_CREATE_ERROR(ChannelClosedError));
 }
 
-void Channel::Impl::onWriteOfPayload(SendOperation& op) {
+void Channel::Impl::onWriteOfPayload(
+    SendOperation& op,
+    uint64_t laneIdx,
+    size_t length) {
   TP_DCHECK(loop_.inLoop());
 
   --op.numChunksBeingWritten;
-  if (op.numChunksBeingWritten > 0) {
-    return;
+  numBytesBeingWrittenOnLane_[laneIdx] -= length;
+  numBytesBeingWritten_ -= length;
+
+  if (!error_) {
+    writePendingChunks();
   }
+  maybeCompleteSendOperation(op);
+  dropCompletedOperations();
+}
 
-  op.callback(error_);
+void Channel::Impl::onReadOfPayload(RecvOperation& op, size_t length) {
+  TP_DCHECK(loop_.inLoop());
 
-  TP_DCHECK(!sendOperations_.empty());
-  TP_DCHECK(&op == &sendOperations_.front());
-  sendOperations_.pop_front();
+  --op.numChunksBeingRead;
+  op.numBytesRead += length;
+
+  maybeCompleteRecvOperation(op);
+  dropCompletedOperations();
 }
 
-void Channel::Impl::onReadOfPayload(RecvOperation& op) {
+void Channel::Impl::maybeCompleteSendOperation(SendOperation& op) {
   TP_DCHECK(loop_.inLoop());
-  TP_DCHECK_EQ(state_, ESTABLISHED);
 
-  --op.numChunksBeingRead;
-  if (op.numChunksBeingRead > 0) {
+  if (op.done || op.numChunksBeingWritten > 0) {
+    return;
+  }
+  if (!error_ && op.offsetOfNextChunk < op.length) {
     return;
   }
+  op.done = true;
+  op.callback(error_);
+}
+
+void Channel::Impl::maybeCompleteRecvOperation(RecvOperation& op) {
+  TP_DCHECK(loop_.inLoop());
 
+  if (op.done || op.numChunksBeingRead > 0) {
+    return;
+  }
+  if (!error_ && op.numBytesRead < op.length) {
+    return;
+  }
+  op.done = true;
   op.callback(error_);
+}
 
-  TP_DCHECK(!recvOperations_.empty());
-  TP_DCHECK(&op == &recvOperations_.front());
-  recvOperations_.pop_front();
+void Channel::Impl::dropCompletedOperations() {
+  TP_DCHECK(loop_.inLoop());
+
+  while (!sendOperations_.empty() && sendOperations_.front().done) {
+    sendOperations_.pop_front();
+  }
+  while (!recvOperations_.empty() && recvOperations_.front().done) {
+    recvOperations_.pop_front();
+  }
 }
 
 void Channel::Impl::setError(Error error) {
@@ -586,18 +901,17 @@ void Channel::Impl::handleError() {
   TP_DCHECK(loop_.inLoop());
   TP_VLOG(5) << "Channel " << id_ << " is handling error " << error_.what();
 
-  if (state_ != ESTABLISHED) {
-    for (SendOperation& op : sendOperations_) {
-      TP_DCHECK_EQ(op.numChunksBeingWritten, 0);
-      op.callback(error_);
-    }
-    sendOperations_.clear();
-    for (RecvOperation& op : recvOperations_) {
-      TP_DCHECK_EQ(op.numChunksBeingRead, 0);
-      op.callback(error_);
-    }
-    recvOperations_.clear();
+  // Fail the operations that have no chunk in flight (as they would never hear
+  // back otherwise), while the others will be failed once their chunks are.
+  sendOperationsWaitingForLane_.clear();
+  sendOperationsBeingChunked_.clear();
+  for (SendOperation& op : sendOperations_) {
+    maybeCompleteSendOperation(op);
+  }
+  for (RecvOperation& op : recvOperations_) {
+    maybeCompleteRecvOperation(op);
   }
+  dropCompletedOperations();
 
   // Close the connections so that all current operations will be aborted. This
   // will cause their callbacks to be invoked, and only then we'll invoke ours.
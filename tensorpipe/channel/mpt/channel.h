@@ -31,6 +31,9 @@ class Channel : public channel::CpuChannel {
       std::shared_ptr<transport::Connection> connection,
       Endpoint endpoint,
       uint64_t numLanes,
+      size_t stripingThreshold,
+      size_t chunkSize,
+      size_t maxBytesInFlight,
       std::string id);
 
   // Send memory region to peer.
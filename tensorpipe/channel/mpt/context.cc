@@ -22,6 +22,7 @@
 #include <tensorpipe/common/defs.h>
 #include <tensorpipe/common/error_macros.h>
 #include <tensorpipe/transport/connection.h>
+#include <tensorpipe/transport/connection_pool.h>
 #include <tensorpipe/transport/context.h>
 #include <tensorpipe/transport/error.h>
 #include <tensorpipe/transport/listener.h>
@@ -35,7 +36,8 @@ class Context::Impl : public Context::PrivateIface,
  public:
   Impl(
       std::vector<std::shared_ptr<transport::Context>>,
-      std::vector<std::shared_ptr<transport::Listener>>);
+      std::vector<std::shared_ptr<transport::Listener>>,
+      ContextOptions opts);
 
   // Called by the context's constructor.
   void init();
@@ -94,6 +96,10 @@ class Context::Impl : public Context::PrivateIface,
 
   std::vector<std::shared_ptr<transport::Context>> contexts_;
   std::vector<std::shared_ptr<transport::Listener>> listeners_;
+  const ContextOptions opts_;
+
+  // One for each lane, wrapping the transport context of that lane.
+  std::vector<std::unique_ptr<transport::ConnectionPool>> connectionPools_;
 
   std::string domainDescriptor_;
   std::atomic<bool> joined_{false};
@@ -135,16 +141,26 @@ class Context::Impl : public Context::PrivateIface,
 
 Context::Context(
     std::vector<std::shared_ptr<transport::Context>> contexts,
-    std::vector<std::shared_ptr<transport::Listener>> listeners)
-    : impl_(std::make_shared<Impl>(std::move(contexts), std::move(listeners))) {
+    std::vector<std::shared_ptr<transport::Listener>> listeners,
+    ContextOptions opts)
+    : impl_(std::make_shared<Impl>(
+          std::move(contexts),
+          std::move(listeners),
+          std::move(opts))) {
   impl_->init();
 }
 
 Context::Impl::Impl(
     std::vector<std::shared_ptr<transport::Context>> contexts,
-    std::vector<std::shared_ptr<transport::Listener>> listeners)
-    : contexts_(std::move(contexts)), listeners_(std::move(listeners)) {
+    std::vector<std::shared_ptr<transport::Listener>> listeners,
+    ContextOptions opts)
+    : contexts_(std::move(contexts)),
+      listeners_(std::move(listeners)),
+      opts_(std::move(opts)) {
   TP_THROW_ASSERT_IF(contexts_.size() != listeners_.size());
+  TP_THROW_ASSERT_IF(opts_.chunkSize_ == 0) << "The chunk size can't be zero";
+  TP_THROW_ASSERT_IF(opts_.maxBytesInFlight_ == 0)
+      << "The maximum number of bytes in flight can't be zero";
   numLanes_ = contexts_.size();
   // FIXME Escape the contexts' domain descriptors in case they contain a colon?
   // Or put them all in a nop object, that'll do the escaping for us.
@@ -160,6 +176,12 @@ Context::Impl::Impl(
   for (const auto& listener : listeners_) {
     addresses_.emplace_back(listener->addr());
   }
+
+  connectionPools_.reserve(numLanes_);
+  for (const auto& context : contexts_) {
+    connectionPools_.push_back(std::make_unique<transport::ConnectionPool>(
+        context, opts_.connectionPoolSize_));
+  }
 }
 
 void Context::Impl::init() {
@@ -204,6 +226,9 @@ std::shared_ptr<channel::CpuChannel> Context::Impl::createChannel(
       std::move(connection),
       endpoint,
       numLanes_,
+      opts_.stripingThreshold_,
+      opts_.chunkSize_,
+      opts_.maxBytesInFlight_,
       std::move(channelId));
 }
 
@@ -275,7 +300,7 @@ std::shared_ptr<transport::Connection> Context::Impl::connect(
     std::string address) {
   TP_VLOG(4) << "Channel context " << id_ << " opening connection on lane "
              << laneIdx;
-  return contexts_[laneIdx]->connect(std::move(address));
+  return connectionPools_[laneIdx]->connect(address);
 }
 
 void Context::Impl::acceptLane(uint64_t laneIdx) {
@@ -363,6 +388,9 @@ void Context::Impl::handleError() {
   for (auto& listener : listeners_) {
     listener->close();
   }
+  for (auto& connectionPool : connectionPools_) {
+    connectionPool->close();
+  }
   for (auto& context : contexts_) {
     context->close();
   }
@@ -19,11 +19,54 @@ namespace tensorpipe {
 namespace channel {
 namespace mpt {
 
+class ContextOptions {
+ public:
+  size_t stripingThreshold_{64 * 1024};
+  size_t chunkSize_{512 * 1024};
+  size_t maxBytesInFlight_{8 * 1024 * 1024};
+  size_t connectionPoolSize_{0};
+
+  // Tensors no larger than this size aren't striped: each of them is sent in
+  // one piece over the lane that has the fewest bytes being written.
+  ContextOptions&& stripingThreshold(size_t stripingThreshold) && {
+    stripingThreshold_ = stripingThreshold;
+    return std::move(*this);
+  }
+
+  // Larger tensors are split into chunks of this size, which are handed out to
+  // the lanes as they drain, so that faster lanes end up carrying more of them.
+  // The receiver doesn't need to use the same value.
+  ContextOptions&& chunkSize(size_t chunkSize) && {
+    chunkSize_ = chunkSize;
+    return std::move(*this);
+  }
+
+  // No new chunk is handed out to the lanes while this many bytes are being
+  // written by a channel. The chunks of all its pending tensors wait instead,
+  // taking turns once there's room, so that a small tensor doesn't get stuck
+  // in the lanes behind the whole of a large one sent before it. A tensor only
+  // gets ahead of an earlier one on the lanes that the latter won't use again,
+  // as the receiver may not be reading the later one yet.
+  ContextOptions&& maxBytesInFlight(size_t maxBytesInFlight) && {
+    maxBytesInFlight_ = maxBytesInFlight;
+    return std::move(*this);
+  }
+
+  // Keep this many spare connections, opened ahead of time, on each lane to
+  // each remote context that a channel connected to, so that later channels
+  // don't have to wait for the lanes' handshakes. By default there are none.
+  ContextOptions&& connectionPoolSize(size_t connectionPoolSize) && {
+    connectionPoolSize_ = connectionPoolSize;
+    return std::move(*this);
+  }
+};
+
 class Context : public channel::CpuContext {
  public:
   Context(
       std::vector<std::shared_ptr<transport::Context>>,
-      std::vector<std::shared_ptr<transport::Listener>>);
+      std::vector<std::shared_ptr<transport::Listener>>,
+      ContextOptions opts = ContextOptions());
 
   const std::string& domainDescriptor() const override;
 
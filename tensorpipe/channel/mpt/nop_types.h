@@ -42,6 +42,15 @@ struct ClientHello {
 
 using Packet = nop::Variant<ServerHello, ClientHello>;
 
+// Sent on a lane before each chunk of payload, to tell the receiver which
+// tensor it belongs to and where it goes within it.
+struct ChunkHeader {
+  uint64_t sequenceNumber;
+  uint64_t offset;
+  uint64_t length;
+  NOP_STRUCTURE(ChunkHeader, sequenceNumber, offset, length);
+};
+
 } // namespace mpt
 } // namespace channel
 } // namespace tensorpipe
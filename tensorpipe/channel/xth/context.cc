@@ -10,8 +10,14 @@
 
 #include <unistd.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
 #include <cstring>
 #include <limits>
+#include <vector>
 
 #include <tensorpipe/channel/error.h>
 #include <tensorpipe/channel/helpers.h>
@@ -20,8 +26,6 @@
 #include <tensorpipe/common/callback.h>
 #include <tensorpipe/common/defs.h>
 #include <tensorpipe/common/error_macros.h>
-#include <tensorpipe/common/optional.h>
-#include <tensorpipe/common/queue.h>
 #include <tensorpipe/common/system.h>
 
 namespace tensorpipe {
@@ -43,12 +47,62 @@ std::string generateDomainDescriptor() {
   return oss.str();
 }
 
+size_t getLastLevelCacheSize() {
+#if defined(_SC_LEVEL3_CACHE_SIZE) && defined(_SC_LEVEL2_CACHE_SIZE)
+  for (int name : {_SC_LEVEL3_CACHE_SIZE, _SC_LEVEL2_CACHE_SIZE}) {
+    long rv = ::sysconf(name);
+    if (rv > 0) {
+      return rv;
+    }
+  }
+#endif
+  // The cache sizes may not be available (e.g., on some virtual machines).
+  return 32 * 1024 * 1024;
+}
+
+// Copy using non-temporal stores, which write to memory without loading the
+// destination into the caches first and without evicting other data from them.
+void copyWithStreamingStores(uint8_t* dst, const uint8_t* src, size_t length) {
+#if defined(__SSE2__)
+  constexpr size_t kAlignment = sizeof(__m128i);
+  const size_t headLength = std::min(
+      length,
+      (kAlignment - reinterpret_cast<uintptr_t>(dst) % kAlignment) %
+          kAlignment);
+  std::memcpy(dst, src, headLength);
+  dst += headLength;
+  src += headLength;
+  length -= headLength;
+
+  while (length >= 4 * kAlignment) {
+    __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+    __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src) + 1);
+    __m128i v2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src) + 2);
+    __m128i v3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src) + 3);
+    _mm_stream_si128(reinterpret_cast<__m128i*>(dst), v0);
+    _mm_stream_si128(reinterpret_cast<__m128i*>(dst) + 1, v1);
+    _mm_stream_si128(reinterpret_cast<__m128i*>(dst) + 2, v2);
+    _mm_stream_si128(reinterpret_cast<__m128i*>(dst) + 3, v3);
+    dst += 4 * kAlignment;
+    src += 4 * kAlignment;
+    length -= 4 * kAlignment;
+  }
+  std::memcpy(dst, src, length);
+
+  // Non-temporal stores are weakly ordered, hence make them visible before the
+  // completion of the copy is signaled to another thread.
+  _mm_sfence();
+#else
+  std::memcpy(dst, src, length);
+#endif
+}
+
 } // namespace
 
 class Context::Impl : public Context::PrivateIface,
                       public std::enable_shared_from_this<Context::Impl> {
  public:
-  Impl();
+  explicit Impl(ContextOptions opts);
 
   const std::string& domainDescriptor() const;
 
@@ -60,7 +114,7 @@ class Context::Impl : public Context::PrivateIface,
 
   ClosingEmitter& getClosingEmitter() override;
 
-  using copy_request_callback_fn = std::function<void(const Error&)>;
+  using copy_request_callback_fn = PrivateIface::copy_request_callback_fn;
 
   void requestCopy(
       void* remotePtr,
@@ -68,6 +122,8 @@ class Context::Impl : public Context::PrivateIface,
       size_t length,
       copy_request_callback_fn fn) override;
 
+  std::vector<CopyThreadStats> getCopyThreadStats();
+
   void close();
 
   void join();
@@ -75,16 +131,10 @@ class Context::Impl : public Context::PrivateIface,
   ~Impl() override = default;
 
  private:
-  struct CopyRequest {
-    void* remotePtr;
-    void* localPtr;
-    size_t length;
-    copy_request_callback_fn callback;
-  };
+  const std::string domainDescriptor_;
+  const size_t streamingThreshold_;
+  CopyThreadPool copyThreadPool_;
 
-  std::string domainDescriptor_;
-  std::thread thread_;
-  Queue<optional<CopyRequest>> requests_;
   std::atomic<bool> closed_{false};
   std::atomic<bool> joined_{false};
   ClosingEmitter closingEmitter_;
@@ -102,16 +152,26 @@ class Context::Impl : public Context::PrivateIface,
   // used for logging and debugging.
   std::atomic<uint64_t> channelCounter_{0};
 
-  void handleCopyRequests();
+  std::vector<Error> copyChunks(const std::vector<CopyThreadPool::Chunk>&);
 };
 
-Context::Context() : impl_(std::make_shared<Context::Impl>()) {}
+Context::Context(ContextOptions opts)
+    : impl_(std::make_shared<Context::Impl>(std::move(opts))) {}
 
-Context::Impl::Impl()
+Context::Impl::Impl(ContextOptions opts)
     : domainDescriptor_(generateDomainDescriptor()),
-      requests_(std::numeric_limits<int>::max()) {
-  thread_ = std::thread(&Impl::handleCopyRequests, this);
-}
+      streamingThreshold_(
+          opts.streamingThreshold_ > 0 ? opts.streamingThreshold_
+                                       : getLastLevelCacheSize()),
+      copyThreadPool_(
+          "TP_XTH_loop",
+          opts.numThreads_,
+          opts.chunkSize_,
+          /*maxNumChunksPerBatch=*/1,
+          std::move(opts.cpus_),
+          [this](const std::vector<CopyThreadPool::Chunk>& chunks) {
+            return copyChunks(chunks);
+          }) {}
 
 void Context::close() {
   impl_->close();
@@ -122,7 +182,7 @@ void Context::Impl::close() {
     TP_VLOG(4) << "Channel context " << id_ << " is closing";
 
     closingEmitter_.close();
-    requests_.push(nullopt);
+    copyThreadPool_.close();
 
     TP_VLOG(4) << "Channel context " << id_ << " done closing";
   }
@@ -138,8 +198,7 @@ void Context::Impl::join() {
   if (!joined_.exchange(true)) {
     TP_VLOG(4) << "Channel context " << id_ << " is joining";
 
-    thread_.join();
-    // TP_DCHECK(requests_.empty());
+    copyThreadPool_.join();
 
     TP_VLOG(4) << "Channel context " << id_ << " done joining";
   }
@@ -156,6 +215,15 @@ void Context::setId(std::string id) {
 void Context::Impl::setId(std::string id) {
   TP_VLOG(4) << "Channel context " << id_ << " was renamed to " << id;
   id_ = std::move(id);
+  copyThreadPool_.setId(id_);
+}
+
+std::vector<CopyThreadStats> Context::getCopyThreadStats() {
+  return impl_->getCopyThreadStats();
+}
+
+std::vector<CopyThreadStats> Context::Impl::getCopyThreadStats() {
+  return copyThreadPool_.getStats();
 }
 
 ClosingEmitter& Context::Impl::getClosingEmitter() {
@@ -194,12 +262,12 @@ void Context::Impl::requestCopy(
     void* remotePtr,
     void* localPtr,
     size_t length,
-    std::function<void(const Error&)> fn) {
+    copy_request_callback_fn fn) {
   uint64_t requestId = nextRequestId_++;
   TP_VLOG(4) << "Channel context " << id_ << " received a copy request (#"
              << requestId << ")";
 
-  fn = [this, requestId, fn{std::move(fn)}](const Error& error) {
+  auto wrappedFn = [this, requestId, fn{std::move(fn)}](const Error& error) {
     TP_VLOG(4) << "Channel context " << id_
                << " is calling a copy request callback (#" << requestId << ")";
     fn(error);
@@ -208,27 +276,25 @@ void Context::Impl::requestCopy(
                << ")";
   };
 
-  requests_.push(CopyRequest{remotePtr, localPtr, length, std::move(fn)});
+  copyThreadPool_.requestCopy(
+      remotePtr, localPtr, length, /*batchKey=*/0, std::move(wrappedFn));
 }
 
-void Context::Impl::handleCopyRequests() {
-  setThreadName("TP_XTH_loop");
-  while (true) {
-    auto maybeRequest = requests_.pop();
-    if (!maybeRequest.has_value()) {
-      break;
-    }
-    CopyRequest request = std::move(maybeRequest).value();
-
+std::vector<Error> Context::Impl::copyChunks(
+    const std::vector<CopyThreadPool::Chunk>& chunks) {
+  for (const auto& chunk : chunks) {
     // Don't even call memcpy on a length of 0 to avoid issues with the pointer
     // possibly being null.
-    if (request.length > 0) {
-      // Perform copy.
-      std::memcpy(request.localPtr, request.remotePtr, request.length);
+    if (chunk.length == 0) {
+      continue;
+    }
+    if (chunk.requestLength > streamingThreshold_) {
+      copyWithStreamingStores(chunk.localPtr, chunk.remotePtr, chunk.length);
+    } else {
+      std::memcpy(chunk.localPtr, chunk.remotePtr, chunk.length);
     }
-
-    request.callback(Error::kSuccess);
   }
+  return std::vector<Error>(chunks.size(), Error::kSuccess);
 }
 
 } // namespace xth
@@ -8,18 +8,63 @@
 
 #pragma once
 
+#include <cstddef>
 #include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
+#include <tensorpipe/channel/copy_thread_pool.h>
 #include <tensorpipe/channel/cpu_context.h>
 
 namespace tensorpipe {
 namespace channel {
 namespace xth {
 
+class ContextOptions {
+ public:
+  size_t numThreads_{4};
+  size_t chunkSize_{1024 * 1024};
+  size_t streamingThreshold_{0};
+  std::vector<int> cpus_;
+
+  // The number of threads performing the copies, which are shared by all the
+  // channels of the context.
+  ContextOptions&& numThreads(size_t numThreads) && {
+    numThreads_ = numThreads;
+    return std::move(*this);
+  }
+
+  // Copies larger than this size are split into chunks of this size, which are
+  // performed in parallel by the threads of the pool, in order to use the
+  // memory bandwidth of several cores. Copies no larger than this are instead
+  // performed in one go, and jump ahead of the chunks of the larger ones.
+  ContextOptions&& chunkSize(size_t chunkSize) && {
+    chunkSize_ = chunkSize;
+    return std::move(*this);
+  }
+
+  // Copies larger than this size use non-temporal stores, which bypass the
+  // caches, as the destination wouldn't fit in them anyways and writing it
+  // would just evict everything else. By default (zero) this is the size of
+  // the last-level cache.
+  ContextOptions&& streamingThreshold(size_t streamingThreshold) && {
+    streamingThreshold_ = streamingThreshold;
+    return std::move(*this);
+  }
+
+  // Pin the i-th thread of the pool to the i-th CPU of this list, which must
+  // contain one entry per thread. On NUMA machines, use the CPUs of the node
+  // that holds the tensors. By default (empty list) threads aren't pinned.
+  ContextOptions&& cpus(std::vector<int> cpus) && {
+    cpus_ = std::move(cpus);
+    return std::move(*this);
+  }
+};
+
 class Context : public channel::CpuContext {
  public:
-  Context();
+  explicit Context(ContextOptions opts = ContextOptions());
 
   const std::string& domainDescriptor() const override;
 
@@ -29,6 +74,10 @@ class Context : public channel::CpuContext {
 
   void setId(std::string id) override;
 
+  // How much data each thread of the pool has copied so far, and how long it
+  // took, to tell whether the copies are bound by the memory bandwidth.
+  std::vector<CopyThreadStats> getCopyThreadStats();
+
   void close() override;
 
   void join() override;
@@ -8,7 +8,13 @@
 
 #pragma once
 
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
 #include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <string>
 #include <thread>
 #include <utility>
@@ -18,23 +24,74 @@
 
 namespace tensorpipe {
 
+// An event loop that repeatedly polls for work. By default it does so forever,
+// yielding between attempts. Subclasses that are able to have their producers
+// wake them up can instead enable sleeping: after having found no work for the
+// given spin duration the loop declares itself asleep in a futex word and waits
+// on it, until a producer calls wakeUpLoop on the same word after having made
+// some new work visible. The futex word can live in shared memory, in which
+// case producers can be in other processes.
 class BusyPollingLoop : public EventLoopDeferredExecutor {
+ public:
+  // Must be called by producers after making new work visible to the loop.
+  // It's cheap when the loop is awake, as it only involves reading the word.
+  static void wakeUpLoop(std::atomic<uint32_t>& futexWord) {
+    // Pairs with the fence in sleepFromLoop: either the loop sees our work, or
+    // we see that it's sleeping (or both).
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (futexWord.load(std::memory_order_relaxed) == kSleeping &&
+        futexWord.exchange(kAwake) == kSleeping) {
+      ::syscall(
+          SYS_futex,
+          reinterpret_cast<uint32_t*>(&futexWord),
+          FUTEX_WAKE,
+          /*val=*/1,
+          /*timeout=*/nullptr,
+          /*uaddr2=*/nullptr,
+          /*val3=*/0);
+    }
+  }
+
+  // Return whether the loop that uses the given word has declared itself
+  // asleep, and hasn't been woken up yet.
+  static bool isSleeping(const std::atomic<uint32_t>& futexWord) {
+    return futexWord.load() == kSleeping;
+  }
+
  protected:
   virtual bool pollOnce() = 0;
 
   virtual bool readyToClose() = 0;
 
+  // Must be called before starting the thread. The futex word must stay valid
+  // for the lifetime of the loop.
+  void enableSleeping(
+      std::atomic<uint32_t>& futexWord,
+      std::chrono::microseconds spinDuration) {
+    futexWord_ = &futexWord;
+    spinDuration_ = spinDuration;
+  }
+
   void stopBusyPolling() {
     closed_ = true;
-    // No need to wake up the thread, since it is busy-waiting.
+    if (futexWord_ != nullptr) {
+      wakeUpLoop(*futexWord_);
+    }
   }
 
   void eventLoop() override {
+    auto lastWorkTime = std::chrono::steady_clock::now();
     while (!closed_ || !readyToClose()) {
       if (pollOnce()) {
-        // continue
+        lastWorkTime = std::chrono::steady_clock::now();
       } else if (deferredFunctionCount_ > 0) {
         deferredFunctionCount_ -= runDeferredFunctionsFromEventLoop();
+        lastWorkTime = std::chrono::steady_clock::now();
+      } else if (
+          futexWord_ != nullptr && !closed_ &&
+          std::chrono::steady_clock::now() - lastWorkTime >= spinDuration_) {
+        sleepFromLoop();
+        lastWorkTime = std::chrono::steady_clock::now();
       } else {
         std::this_thread::yield();
       }
@@ -43,13 +100,41 @@ class BusyPollingLoop : public EventLoopDeferredExecutor {
 
   void wakeupEventLoopToDeferFunction() override {
     ++deferredFunctionCount_;
-    // No need to wake up the thread, since it is busy-waiting.
+    if (futexWord_ != nullptr) {
+      wakeUpLoop(*futexWord_);
+    }
   };
 
  private:
+  static constexpr uint32_t kAwake = 0;
+  static constexpr uint32_t kSleeping = 1;
+
   std::atomic<bool> closed_{false};
 
   std::atomic<int64_t> deferredFunctionCount_{0};
+
+  std::atomic<uint32_t>* futexWord_{nullptr};
+  std::chrono::microseconds spinDuration_{0};
+
+  void sleepFromLoop() {
+    futexWord_->store(kSleeping);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    // Any work that became visible before we declared ourselves asleep would
+    // not trigger a wake-up, hence we must check once more. If we find some we
+    // just process it and go back to spinning.
+    if (!pollOnce() && deferredFunctionCount_ == 0 && !closed_) {
+      // This returns immediately if a producer has already reset the word.
+      ::syscall(
+          SYS_futex,
+          reinterpret_cast<uint32_t*>(futexWord_),
+          FUTEX_WAIT,
+          /*val=*/kSleeping,
+          /*timeout=*/nullptr,
+          /*uaddr2=*/nullptr,
+          /*val3=*/0);
+    }
+    futexWord_->store(kAwake);
+  }
 };
 
 } // namespace tensorpipe
@@ -9,18 +9,16 @@
 #pragma once
 
 #include <atomic>
-#include <deque>
 #include <exception>
-#include <functional>
 #include <future>
 #include <memory>
-#include <mutex>
 #include <string>
 #include <thread>
 #include <utility>
-#include <vector>
 
 #include <tensorpipe/common/defs.h>
+#include <tensorpipe/common/inline_function.h>
+#include <tensorpipe/common/mpsc_queue.h>
 #include <tensorpipe/common/system.h>
 
 namespace tensorpipe {
@@ -37,7 +35,7 @@ namespace tensorpipe {
 // provide.
 class DeferredExecutor {
  public:
-  using TTask = std::function<void()>;
+  using TTask = InlineFunction<void(), kTaskInlineCapacity>;
 
   virtual void deferToLoop(TTask fn) = 0;
 
@@ -56,18 +54,17 @@ class DeferredExecutor {
     if (inLoop()) {
       fn();
     } else {
-      // Must use a copyable wrapper around std::promise because
-      // we use it from a std::function which must be copyable.
-      auto promise = std::make_shared<std::promise<void>>();
-      auto future = promise->get_future();
+      std::promise<void> promise;
+      auto future = promise.get_future();
       // Marked as mutable because the fn might hold some state (e.g., the
       // closure of a lambda) which it might want to modify.
-      deferToLoop([promise, fn{std::forward<F>(fn)}]() mutable {
+      deferToLoop([promise{std::move(promise)},
+                   fn{std::forward<F>(fn)}]() mutable {
         try {
           fn();
-          promise->set_value();
+          promise.set_value();
         } catch (...) {
-          promise->set_exception(std::current_exception());
+          promise.set_exception(std::current_exception());
         }
       });
       future.get();
@@ -99,58 +96,56 @@ class OnDemandDeferredExecutor : public DeferredExecutor {
   }
 
   void deferToLoop(TTask fn) override {
-    {
-      std::unique_lock<std::mutex> lock(mutex_);
-      pendingTasks_.push_back(std::move(fn));
-      if (currentLoop_ != std::thread::id()) {
-        return;
-      }
-      currentLoop_ = std::this_thread::get_id();
+    pendingTasks_.push(std::move(fn));
+    // Whoever brings the number of pending tasks up from zero becomes the loop,
+    // and remains so until it brings it back down to zero. Any task deferred in
+    // the meantime, including from within the loop, will be run by it.
+    if (numPendingTasks_.fetch_add(1, std::memory_order_acq_rel) > 0) {
+      return;
     }
 
-    while (true) {
-      TTask task;
-      {
-        std::unique_lock<std::mutex> lock(mutex_);
-        if (pendingTasks_.empty()) {
-          currentLoop_ = std::thread::id();
-          return;
-        }
-        task = std::move(pendingTasks_.front());
-        pendingTasks_.pop_front();
-      }
+    do {
+      // The task we're about to pop may belong to a producer that has counted
+      // it but not yet finished pushing it, in which case we wait for it.
+      TTask task = pendingTasks_.pop();
+      currentLoop_ = std::this_thread::get_id();
       task();
-    }
+      currentLoop_ = std::thread::id();
+    } while (numPendingTasks_.fetch_sub(1, std::memory_order_acq_rel) > 1);
   }
 
  private:
-  std::mutex mutex_;
   std::atomic<std::thread::id> currentLoop_{std::thread::id()};
-  std::deque<TTask> pendingTasks_;
+  std::atomic<uint64_t> numPendingTasks_{0};
+  MpscQueue<TTask> pendingTasks_;
 };
 
 class EventLoopDeferredExecutor : public virtual DeferredExecutor {
  public:
   void deferToLoop(TTask fn) override {
-    {
-      std::unique_lock<std::mutex> lock(mutex_);
-      if (likely(isThreadConsumingDeferredFunctions_)) {
-        fns_.push_back(std::move(fn));
-        wakeupEventLoopToDeferFunction();
-        return;
-      }
+    // Announce the function before checking whether the thread is still taking
+    // them, so that the thread cannot stop doing so while we push it, nor exit
+    // while we wake it up (see the loop method).
+    numDeferralsInProgress_.fetch_add(1, std::memory_order_acq_rel);
+    if (likely(
+            (numDeferredFunctions_.fetch_add(1, std::memory_order_acq_rel) &
+             kStoppedConsuming) == 0)) {
+      fns_.push(std::move(fn));
+      wakeupEventLoopToDeferFunction();
+      numDeferralsInProgress_.fetch_sub(1, std::memory_order_release);
+      return;
     }
-    // Must call it without holding the lock, as it could cause a reentrant
-    // call.
+    numDeferredFunctions_.fetch_sub(1, std::memory_order_relaxed);
+    numDeferralsInProgress_.fetch_sub(1, std::memory_order_release);
     onDemandLoop_.deferToLoop(std::move(fn));
   };
 
   inline bool inLoop() override {
-    {
-      std::unique_lock<std::mutex> lock(mutex_);
-      if (likely(isThreadConsumingDeferredFunctions_)) {
-        return std::this_thread::get_id() == thread_.get_id();
-      }
+    // The thread sets its own identifier, hence the comparison can only succeed
+    // when called from it, and in that case doesn't race.
+    if (std::this_thread::get_id() == threadId_.load()) {
+      return (numDeferredFunctions_.load(std::memory_order_relaxed) &
+              kStoppedConsuming) == 0;
     }
     return onDemandLoop_.inLoop();
   }
@@ -191,50 +186,60 @@ class EventLoopDeferredExecutor : public virtual DeferredExecutor {
   // method also returns the number of functions it executed, in case the
   // subclass is keeping count.
   size_t runDeferredFunctionsFromEventLoop() {
-    decltype(fns_) fns;
-
-    {
-      std::unique_lock<std::mutex> lock(mutex_);
-      std::swap(fns, fns_);
-    }
-
-    for (auto& fn : fns) {
+    size_t numFunctions = 0;
+    TTask fn;
+    // This may also run the functions deferred by the ones it runs, as well as
+    // stop short of some whose push is ongoing, but those will cause a wakeup.
+    while (fns_.tryPop(fn)) {
       fn();
+      ++numFunctions;
     }
+    numDeferredFunctions_.fetch_sub(numFunctions, std::memory_order_relaxed);
 
-    return fns.size();
+    return numFunctions;
   }
 
  private:
   void loop(std::string threadName) {
+    threadId_ = std::this_thread::get_id();
     setThreadName(std::move(threadName));
 
     eventLoop();
 
     // The loop is winding down and "handing over" control to the on demand
     // loop. But it can only do so safely once there are no pending deferred
-    // functions, as otherwise those may risk never being executed.
+    // functions, as otherwise those may risk never being executed. A function
+    // that has been announced (counted) will always be pushed, thus we can
+    // wait for it, and any function announced after we set the flag will go to
+    // the on demand loop instead.
     while (true) {
-      decltype(fns_) fns;
-
-      {
-        std::unique_lock<std::mutex> lock(mutex_);
-        if (fns_.empty()) {
-          isThreadConsumingDeferredFunctions_ = false;
-          break;
-        }
-        std::swap(fns, fns_);
+      uint64_t numDeferredFunctions = 0;
+      if (numDeferredFunctions_.compare_exchange_strong(
+              numDeferredFunctions,
+              kStoppedConsuming,
+              std::memory_order_acq_rel)) {
+        break;
       }
+      TTask fn = fns_.pop();
+      numDeferredFunctions_.fetch_sub(1, std::memory_order_relaxed);
+      fn();
+    }
 
-      for (auto& fn : fns) {
-        fn();
-      }
+    // The functions we ran may have been pushed by producers that haven't yet
+    // returned from waking us up, which may touch the subclass's resources.
+    // These are freed once the thread is joined, hence it must wait for them.
+    // All later producers see the flag, and won't call the subclass.
+    while (numDeferralsInProgress_.load(std::memory_order_acquire) > 0) {
+      std::this_thread::yield();
     }
   }
 
   std::thread thread_;
+  std::atomic<std::thread::id> threadId_{std::thread::id()};
 
-  // Whether the thread is still taking care of running the deferred functions
+  // The number of functions that have been deferred to the thread but that it
+  // hasn't picked up yet, plus a flag for whether the thread is still taking
+  // care of running the deferred functions.
   //
   // This is part of what can only be described as a hack. Sometimes, even when
   // using the API as intended, objects try to defer tasks to the loop after
@@ -245,14 +250,17 @@ class EventLoopDeferredExecutor : public virtual DeferredExecutor {
   // those tasks inline. In order to keep ensuring the single-threadedness
   // assumption of our model (which is what we rely on to be safe from race
   // conditions) we use an on-demand loop.
-  bool isThreadConsumingDeferredFunctions_{true};
+  static constexpr uint64_t kStoppedConsuming = uint64_t(1) << 63;
+  std::atomic<uint64_t> numDeferredFunctions_{0};
   OnDemandDeferredExecutor onDemandLoop_;
 
-  // Mutex to guard the deferring and the running of functions.
-  std::mutex mutex_;
+  // The number of calls to deferToLoop that announced their function and that
+  // haven't yet returned from waking up the thread (or from finding out that
+  // it's stopped).
+  std::atomic<uint64_t> numDeferralsInProgress_{0};
 
-  // List of deferred functions to run when the loop is ready.
-  std::vector<std::function<void()>> fns_;
+  // Deferred functions to run when the loop is ready. Only the thread pops.
+  MpscQueue<TTask> fns_;
 };
 
 } // namespace tensorpipe
@@ -0,0 +1,235 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include <tensorpipe/config.h>
+
+namespace tensorpipe {
+
+// How many bytes of captured state the callbacks that components hand to one
+// another (e.g., those given to the read and write methods of pipes, channels
+// and connections) can hold without allocating.
+constexpr size_t kCallbackInlineCapacity = TENSORPIPE_CALLBACK_INLINE_CAPACITY;
+
+// Components typically wrap the callbacks they receive in a lambda that also
+// captures a couple of words of bookkeeping (a pointer to themselves, a
+// sequence number, ...) before handing them to their internals. This is the
+// capacity needed to hold such a wrapper around a callback of the given one.
+constexpr size_t wrappingCapacity(size_t capacity) {
+  return capacity + 4 * sizeof(void*);
+}
+
+constexpr size_t kWrappedCallbackInlineCapacity =
+    wrappingCapacity(kCallbackInlineCapacity);
+
+// Tasks deferred to a loop usually capture a callback together with all the
+// arguments of the call that is being deferred (e.g., a message).
+constexpr size_t kTaskInlineCapacity = 4 * kCallbackInlineCapacity;
+
+template <typename TSignature, size_t Capacity = kCallbackInlineCapacity>
+class InlineFunction;
+
+// A replacement for std::function which stores the callable in a buffer of a
+// given capacity inside the object itself, rather than on the heap, as long as
+// it fits. Callables that are too large (or can't be moved without throwing)
+// still work but are allocated on the heap, hence the capacity should be picked
+// so that this doesn't happen on hot paths.
+//
+// Unlike std::function it's move-only, which allows it to hold move-only
+// callables (i.e., lambdas that capture unique_ptrs or other InlineFunctions)
+// and means it never needs to copy its state.
+template <typename R, typename... Args, size_t Capacity>
+class InlineFunction<R(Args...), Capacity> {
+  static_assert(
+      Capacity >= sizeof(void*),
+      "The capacity must be able to hold at least a pointer");
+
+  template <typename F>
+  using EnableIfCallable = typename std::enable_if<
+      !std::is_same<typename std::decay<F>::type, InlineFunction>::value &&
+      std::is_convertible<
+          decltype(std::declval<typename std::decay<F>::type&>()(
+              std::declval<Args>()...)),
+          R>::value>::type;
+
+ public:
+  // Whether a callable of the given type will be stored inline.
+  template <typename F>
+  static constexpr bool storesInline() {
+    return sizeof(F) <= Capacity && alignof(F) <= alignof(void*) &&
+        std::is_nothrow_move_constructible<F>::value;
+  }
+
+  InlineFunction() noexcept = default;
+
+  /* implicit */ InlineFunction(std::nullptr_t) noexcept {}
+
+  template <typename F, typename = EnableIfCallable<F>>
+  /* implicit */ InlineFunction(F&& fn) {
+    construct<typename std::decay<F>::type>(std::forward<F>(fn));
+  }
+
+  InlineFunction(InlineFunction&& other) noexcept {
+    moveFrom(other);
+  }
+
+  InlineFunction(const InlineFunction&) = delete;
+  InlineFunction& operator=(const InlineFunction&) = delete;
+
+  InlineFunction& operator=(InlineFunction&& other) noexcept {
+    if (this != &other) {
+      reset();
+      moveFrom(other);
+    }
+    return *this;
+  }
+
+  InlineFunction& operator=(std::nullptr_t) noexcept {
+    reset();
+    return *this;
+  }
+
+  template <typename F, typename = EnableIfCallable<F>>
+  InlineFunction& operator=(F&& fn) {
+    // The callable may be (or may own) the state of this very object, as in
+    // `fn = [fn{std::move(fn)}]() { ... }`, which is why it must be fully
+    // constructed before the current content gets destroyed.
+    InlineFunction tmp(std::forward<F>(fn));
+    reset();
+    moveFrom(tmp);
+    return *this;
+  }
+
+  ~InlineFunction() {
+    reset();
+  }
+
+  explicit operator bool() const noexcept {
+    return ops_ != nullptr;
+  }
+
+  // Like std::function, this is const but invokes the callable as non-const.
+  // This keeps it usable from within lambdas that aren't marked as mutable.
+  R operator()(Args... args) const {
+    return ops_->invoke(storage_, std::forward<Args>(args)...);
+  }
+
+ private:
+  struct Ops {
+    R (*invoke)(void* storage, Args&&... args);
+    // Move-construct into dst from src, and then destroy src.
+    void (*relocate)(void* dst, void* src) noexcept;
+    void (*destroy)(void* storage) noexcept;
+  };
+
+  template <typename F>
+  struct InlineOps {
+    static R invoke(void* storage, Args&&... args) {
+      return (*reinterpret_cast<F*>(storage))(std::forward<Args>(args)...);
+    }
+
+    static void relocate(void* dst, void* src) noexcept {
+      F* srcFn = reinterpret_cast<F*>(src);
+      new (dst) F(std::move(*srcFn));
+      srcFn->~F();
+    }
+
+    static void destroy(void* storage) noexcept {
+      reinterpret_cast<F*>(storage)->~F();
+    }
+
+    static constexpr Ops kOps{&invoke, &relocate, &destroy};
+  };
+
+  template <typename F>
+  struct HeapOps {
+    static F*& pointer(void* storage) {
+      return *reinterpret_cast<F**>(storage);
+    }
+
+    static R invoke(void* storage, Args&&... args) {
+      return (*pointer(storage))(std::forward<Args>(args)...);
+    }
+
+    static void relocate(void* dst, void* src) noexcept {
+      new (dst) F*(pointer(src));
+    }
+
+    static void destroy(void* storage) noexcept {
+      delete pointer(storage);
+    }
+
+    static constexpr Ops kOps{&invoke, &relocate, &destroy};
+  };
+
+  alignas(void*) mutable unsigned char storage_[Capacity];
+  const Ops* ops_{nullptr};
+
+  template <typename F, typename TArg>
+  typename std::enable_if<storesInline<F>()>::type construct(TArg&& fn) {
+    new (storage_) F(std::forward<TArg>(fn));
+    ops_ = &InlineOps<F>::kOps;
+  }
+
+  template <typename F, typename TArg>
+  typename std::enable_if<!storesInline<F>()>::type construct(TArg&& fn) {
+    new (storage_) F*(new F(std::forward<TArg>(fn)));
+    ops_ = &HeapOps<F>::kOps;
+  }
+
+  void moveFrom(InlineFunction& other) noexcept {
+    if (other.ops_ != nullptr) {
+      other.ops_->relocate(storage_, other.storage_);
+      ops_ = other.ops_;
+      other.ops_ = nullptr;
+    }
+  }
+
+  void reset() noexcept {
+    if (ops_ != nullptr) {
+      // Clear the field first, in case destroying the callable causes this
+      // object to be accessed again.
+      const Ops* ops = ops_;
+      ops_ = nullptr;
+      ops->destroy(storage_);
+    }
+  }
+};
+
+// Out-of-class definitions of the static constexpr members, needed in C++14.
+template <typename R, typename... Args, size_t Capacity>
+template <typename F>
+constexpr typename InlineFunction<R(Args...), Capacity>::Ops
+    InlineFunction<R(Args...), Capacity>::InlineOps<F>::kOps;
+
+template <typename R, typename... Args, size_t Capacity>
+template <typename F>
+constexpr typename InlineFunction<R(Args...), Capacity>::Ops
+    InlineFunction<R(Args...), Capacity>::HeapOps<F>::kOps;
+
+template <typename TSignature, size_t Capacity>
+bool operator==(
+    const InlineFunction<TSignature, Capacity>& fn,
+    std::nullptr_t) noexcept {
+  return !fn;
+}
+
+template <typename TSignature, size_t Capacity>
+bool operator!=(
+    const InlineFunction<TSignature, Capacity>& fn,
+    std::nullptr_t) noexcept {
+  return static_cast<bool>(fn);
+}
+
+} // namespace tensorpipe
@@ -27,6 +27,9 @@ class MmappedPtr {
     ptr_ = decltype(ptr_)(reinterpret_cast<uint8_t*>(ptr), Deleter{length});
   }
 
+  // Take ownership of an existing mapping.
+  MmappedPtr(uint8_t* ptr, size_t length) : ptr_(ptr, Deleter{length}) {}
+
   uint8_t* ptr() {
     return ptr_.get();
   }
@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace tensorpipe {
+
+// An unbounded multi-producer single-consumer FIFO queue that doesn't use any
+// lock: pushing costs one atomic exchange and popping none in the common case.
+// It's the intrusive queue by Dmitry Vyukov, where the elements are stored in
+// nodes linked in a list. The nodes are recycled rather than freed (see below),
+// thus in a steady state the queue doesn't allocate memory either.
+//
+// Any thread can push at any time, but only one thread at a time may pop.
+template <typename T>
+class MpscQueue {
+ public:
+  MpscQueue() = default;
+
+  MpscQueue(const MpscQueue&) = delete;
+  MpscQueue& operator=(const MpscQueue&) = delete;
+
+  void push(T value) {
+    Node* node = nodeCache().get();
+    node->value = std::move(value);
+    pushNode(node);
+  }
+
+  // Return false if the queue is empty or if the element at its front is still
+  // being pushed, i.e., if its producer hasn't yet returned from push. In the
+  // latter case, the consumer will find it if it tries again later, hence a
+  // consumer which is notified of each push (after it returns) can just wait
+  // for the notification.
+  bool tryPop(T& value) {
+    Node* tail = tail_;
+    Node* next = tail->next.load(std::memory_order_acquire);
+    if (tail == &stub_) {
+      if (next == nullptr) {
+        return false;
+      }
+      tail_ = next;
+      tail = next;
+      next = next->next.load(std::memory_order_acquire);
+    }
+    if (next == nullptr) {
+      if (tail != head_.load(std::memory_order_acquire)) {
+        // A producer has enqueued a node after the tail but hasn't linked it
+        // yet. We cannot pop the tail as the list would be left dangling.
+        return false;
+      }
+      // The tail is the only node: put the stub back behind it so it can go.
+      pushNode(&stub_);
+      next = tail->next.load(std::memory_order_acquire);
+      if (next == nullptr) {
+        return false;
+      }
+    }
+    tail_ = next;
+    value = std::move(tail->value);
+    // Release whatever the moved-from value may still be holding on to.
+    tail->value = T();
+    nodeCache().put(tail);
+    return true;
+  }
+
+  // Pop an element which is known to be in the queue, because its push has at
+  // least started, waiting for its producer to finish linking it if needed.
+  T pop() {
+    T value;
+    while (!tryPop(value)) {
+      std::this_thread::yield();
+    }
+    return value;
+  }
+
+  ~MpscQueue() {
+    T value;
+    while (tryPop(value)) {
+    }
+  }
+
+ private:
+  struct Node {
+    std::atomic<Node*> next{nullptr};
+    T value;
+  };
+
+  // Free nodes are kept in lists private to each thread, from which its pushes
+  // take them and to which its pops return them, so that recycling them needs
+  // no synchronization. However nodes typically flow from the producers to the
+  // consumer, hence these lists exchange nodes with a shared pool, in batches,
+  // so that the cost of locking the pool is spread over many operations.
+  struct NodeBatch {
+    Node* head{nullptr};
+    size_t size{0};
+
+    void add(Node* node) {
+      node->next.store(head, std::memory_order_relaxed);
+      head = node;
+      ++size;
+    }
+
+    Node* take() {
+      Node* node = head;
+      head = node->next.load(std::memory_order_relaxed);
+      --size;
+      return node;
+    }
+  };
+
+  static constexpr size_t kNodeBatchSize = 64;
+
+  class NodePool {
+   public:
+    NodeBatch getBatch() {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!batches_.empty()) {
+          NodeBatch batch = batches_.back();
+          batches_.pop_back();
+          return batch;
+        }
+      }
+      NodeBatch batch;
+      for (size_t nodeIdx = 0; nodeIdx < kNodeBatchSize; nodeIdx++) {
+        batch.add(new Node());
+      }
+      return batch;
+    }
+
+    void putBatch(NodeBatch batch) {
+      std::unique_lock<std::mutex> lock(mutex_);
+      batches_.push_back(batch);
+    }
+
+   private:
+    std::mutex mutex_;
+    std::vector<NodeBatch> batches_;
+  };
+
+  static NodePool& nodePool() {
+    // Leaked on purpose, as it may be used by threads that exit after the end
+    // of the program's static destruction.
+    static NodePool* pool = new NodePool();
+    return *pool;
+  }
+
+  class NodeCache {
+   public:
+    Node* get() {
+      if (current_.size == 0) {
+        if (spare_.size > 0) {
+          std::swap(current_, spare_);
+        } else {
+          current_ = nodePool().getBatch();
+        }
+      }
+      return current_.take();
+    }
+
+    void put(Node* node) {
+      if (current_.size == kNodeBatchSize) {
+        if (spare_.size == kNodeBatchSize) {
+          nodePool().putBatch(spare_);
+          spare_ = NodeBatch();
+        }
+        std::swap(current_, spare_);
+      }
+      current_.add(node);
+    }
+
+    ~NodeCache() {
+      for (NodeBatch* batch : {&current_, &spare_}) {
+        while (batch->size > 0) {
+          delete batch->take();
+        }
+      }
+    }
+
+   private:
+    // Two lists, each of at most a full batch, so that a thread alternating
+    // between getting and putting nodes doesn't bounce batches with the pool.
+    NodeBatch current_;
+    NodeBatch spare_;
+  };
+
+  static NodeCache& nodeCache() {
+    static thread_local NodeCache cache;
+    return cache;
+  }
+
+  // The head is where the producers append nodes, the tail is where the
+  // consumer takes them from. The stub is a dummy node that allows the list to
+  // never be empty, which is what makes it possible to push with one exchange.
+  Node stub_;
+  std::atomic<Node*> head_{&stub_};
+  Node* tail_{&stub_};
+
+  void pushNode(Node* node) {
+    node->next.store(nullptr, std::memory_order_relaxed);
+    Node* prev = head_.exchange(node, std::memory_order_acq_rel);
+    prev->next.store(node, std::memory_order_release);
+  }
+};
+
+} // namespace tensorpipe
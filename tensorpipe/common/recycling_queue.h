@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <tensorpipe/common/defs.h>
+
+namespace tensorpipe {
+
+// A FIFO queue for objects that are expensive to set up (e.g., because they
+// contain containers or strings), which hangs on to the objects that are popped
+// from it and hands them out again when pushing, rather than destroying them
+// and constructing new ones. Once the queue has reached its peak size it thus
+// doesn't allocate memory anymore, and neither do the objects it contains if
+// they are reused in a way that preserves their capacity.
+//
+// Recycled objects are returned as they were left, hence it's up to the caller
+// to reset them. The objects never move in memory, which means that references
+// to them remain valid until the queue is destroyed (but they may point to a
+// different element after it's been popped and the object has been recycled).
+template <typename T>
+class RecyclingQueue {
+ public:
+  RecyclingQueue() = default;
+
+  RecyclingQueue(const RecyclingQueue&) = delete;
+  RecyclingQueue& operator=(const RecyclingQueue&) = delete;
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  T& operator[](size_t idx) {
+    TP_DCHECK_LT(idx, size_);
+    return *slots_[(head_ + idx) % slots_.size()];
+  }
+
+  T& front() {
+    return (*this)[0];
+  }
+
+  T& back() {
+    return (*this)[size_ - 1];
+  }
+
+  // Append an element to the queue, reusing the object of one that was popped
+  // earlier if there is one, or default-constructing a new one otherwise.
+  T& pushBack() {
+    if (size_ == slots_.size()) {
+      grow();
+    }
+    std::unique_ptr<T>& slot = slots_[(head_ + size_) % slots_.size()];
+    if (slot == nullptr) {
+      slot = std::make_unique<T>();
+    }
+    ++size_;
+    return *slot;
+  }
+
+  void popFront() {
+    TP_DCHECK_GT(size_, 0);
+    head_ = (head_ + 1) % slots_.size();
+    --size_;
+  }
+
+ private:
+  // A circular buffer, whose slots that are outside of the range of the queue
+  // contain the objects available for recycling, or null if none was created.
+  std::vector<std::unique_ptr<T>> slots_;
+  size_t head_{0};
+  size_t size_{0};
+
+  void grow() {
+    std::vector<std::unique_ptr<T>> newSlots(
+        std::max<size_t>(kMinNumSlots, 2 * slots_.size()));
+    for (size_t idx = 0; idx < slots_.size(); ++idx) {
+      newSlots[idx] = std::move(slots_[(head_ + idx) % slots_.size()]);
+    }
+    slots_ = std::move(newSlots);
+    head_ = 0;
+  }
+
+  static constexpr size_t kMinNumSlots = 4;
+};
+
+template <typename T>
+constexpr size_t RecyclingQueue<T>::kMinNumSlots;
+
+} // namespace tensorpipe
@@ -8,14 +8,17 @@
 
 #pragma once
 
+#include <sys/uio.h>
+
 #include <array>
-#include <functional>
 #include <memory>
 #include <tuple>
 #include <utility>
+#include <vector>
 
 #include <tensorpipe/common/defs.h>
 #include <tensorpipe/common/error.h>
+#include <tensorpipe/common/inline_function.h>
 #include <tensorpipe/common/nop.h>
 #include <tensorpipe/util/ringbuffer/consumer.h>
 #include <tensorpipe/util/ringbuffer/producer.h>
@@ -30,6 +33,10 @@ namespace tensorpipe {
 // duration of the callback. If the memory contents must be
 // preserved for longer, it must be copied elsewhere.
 //
+// Multiple consecutive buffers can be read by a single operation into
+// user-provided memory, in which case they are all consumed in the
+// same ringbuffer transaction if they are available.
+//
 class RingbufferReadOperation {
   enum Mode {
     READ_LENGTH,
@@ -37,12 +44,21 @@ class RingbufferReadOperation {
   };
 
  public:
-  using read_callback_fn =
-      std::function<void(const Error& error, const void* ptr, size_t len)>;
+  // Transports may wrap the callbacks they were given once more before passing
+  // them here, hence these have the room for it.
+  using read_callback_fn = InlineFunction<
+      void(const Error& error, const void* ptr, size_t len),
+      wrappingCapacity(kWrappedCallbackInlineCapacity)>;
   // Read into a user-provided buffer of known length.
   inline RingbufferReadOperation(void* ptr, size_t len, read_callback_fn fn);
-  // Read into an auto-allocated buffer, whose length is read from the wire.
-  explicit inline RingbufferReadOperation(read_callback_fn fn);
+  // Read into multiple user-provided buffers of known length.
+  inline RingbufferReadOperation(std::vector<iovec> iovs, read_callback_fn fn);
+  // Read into an auto-allocated buffer, whose length is read from the wire. The
+  // operation takes over the given buffer (e.g., left over by an earlier one,
+  // see releaseBuffer) and only allocates if it's too small.
+  inline RingbufferReadOperation(
+      std::vector<uint8_t> buffer,
+      read_callback_fn fn);
   // Read into a user-provided libnop object, read length from the wire.
   inline RingbufferReadOperation(
       AbstractNopHolder* nopObject,
@@ -52,18 +68,28 @@ class RingbufferReadOperation {
   inline size_t handleRead(util::ringbuffer::Consumer& consumer);
 
   bool completed() const {
-    return (mode_ == READ_PAYLOAD && bytesRead_ == len_);
+    return (
+        mode_ == READ_PAYLOAD && bytesRead_ == len_ &&
+        iovIdx_ + 1 >= iovs_.size());
   }
 
   inline void handleError(const Error& error);
 
+  // Hand over the auto-allocated buffer, if any, so that it can be reused by a
+  // later operation once this one is done.
+  inline std::vector<uint8_t> releaseBuffer();
+
  private:
   Mode mode_{READ_LENGTH};
   void* ptr_{nullptr};
   AbstractNopHolder* nopObject_{nullptr};
-  std::unique_ptr<uint8_t[]> buf_;
+  // Never shrunk, so that its whole capacity is available to later operations.
+  std::vector<uint8_t> buf_;
   size_t len_{0};
   size_t bytesRead_{0};
+  // In case of multiple buffers, ptr_ and len_ refer to the one at iovIdx_.
+  std::vector<iovec> iovs_;
+  size_t iovIdx_{0};
   read_callback_fn fn_;
   // Use a separare flag, rather than checking if ptr_ == nullptr, to catch the
   // case of a user explicitly passing in a nullptr with length zero, in which
@@ -80,6 +106,11 @@ class RingbufferReadOperation {
 // The memory pointed to by the pointer may only be reused or freed
 // after the callback has been called.
 //
+// Multiple buffers can be written by a single operation, in which case
+// each of them is framed separately (i.e., has its own length header)
+// but they are all written in the same ringbuffer transaction if space
+// allows for it.
+//
 class RingbufferWriteOperation {
   enum Mode {
     WRITE_LENGTH,
@@ -87,12 +118,18 @@ class RingbufferWriteOperation {
   };
 
  public:
-  using write_callback_fn = std::function<void(const Error& error)>;
+  using write_callback_fn = InlineFunction<
+      void(const Error& error),
+      wrappingCapacity(kWrappedCallbackInlineCapacity)>;
   // Write from a user-provided buffer of known length.
   inline RingbufferWriteOperation(
       const void* ptr,
       size_t len,
       write_callback_fn fn);
+  // Write from multiple user-provided buffers of known length.
+  inline RingbufferWriteOperation(
+      std::vector<iovec> iovs,
+      write_callback_fn fn);
   // Write from a user-provided libnop object.
   inline RingbufferWriteOperation(
       const AbstractNopHolder* nopObject,
@@ -101,7 +138,9 @@ class RingbufferWriteOperation {
   inline size_t handleWrite(util::ringbuffer::Producer& producer);
 
   bool completed() const {
-    return (mode_ == WRITE_PAYLOAD && bytesWritten_ == len_);
+    return (
+        mode_ == WRITE_PAYLOAD && bytesWritten_ == len_ &&
+        iovIdx_ + 1 >= iovs_.size());
   }
 
   inline void handleError(const Error& error);
@@ -112,6 +151,9 @@ class RingbufferWriteOperation {
   const AbstractNopHolder* nopObject_{nullptr};
   size_t len_{0};
   size_t bytesWritten_{0};
+  // In case of multiple buffers, ptr_ and len_ refer to the one at iovIdx_.
+  std::vector<iovec> iovs_;
+  size_t iovIdx_{0};
   write_callback_fn fn_;
 
   inline ssize_t writeNopObject(util::ringbuffer::Producer& producer);
@@ -123,8 +165,19 @@ RingbufferReadOperation::RingbufferReadOperation(
     read_callback_fn fn)
     : ptr_(ptr), len_(len), fn_(std::move(fn)), ptrProvided_(true) {}
 
-RingbufferReadOperation::RingbufferReadOperation(read_callback_fn fn)
-    : fn_(std::move(fn)), ptrProvided_(false) {}
+RingbufferReadOperation::RingbufferReadOperation(
+    std::vector<iovec> iovs,
+    read_callback_fn fn)
+    : iovs_(std::move(iovs)), fn_(std::move(fn)), ptrProvided_(true) {
+  TP_DCHECK(!iovs_.empty());
+  ptr_ = iovs_[0].iov_base;
+  len_ = iovs_[0].iov_len;
+}
+
+RingbufferReadOperation::RingbufferReadOperation(
+    std::vector<uint8_t> buffer,
+    read_callback_fn fn)
+    : buf_(std::move(buffer)), fn_(std::move(fn)), ptrProvided_(false) {}
 
 RingbufferReadOperation::RingbufferReadOperation(
     AbstractNopHolder* nopObject,
@@ -141,39 +194,55 @@ size_t RingbufferReadOperation::handleRead(util::ringbuffer::Consumer& inbox) {
   ret = inbox.startTx();
   TP_THROW_SYSTEM_IF(ret < 0, -ret);
 
-  if (mode_ == READ_LENGTH) {
-    uint32_t length;
-    ret = inbox.readInTx</*allowPartial=*/false>(&length, sizeof(length));
-    if (likely(ret >= 0)) {
-      mode_ = READ_PAYLOAD;
-      bytesReadNow += ret;
+  while (true) {
+    if (mode_ == READ_LENGTH) {
+      uint32_t length;
+      ret = inbox.readInTx</*allowPartial=*/false>(&length, sizeof(length));
+      if (likely(ret >= 0)) {
+        mode_ = READ_PAYLOAD;
+        bytesReadNow += ret;
+        if (nopObject_ != nullptr) {
+          len_ = length;
+        } else if (ptrProvided_) {
+          TP_DCHECK_EQ(length, len_);
+        } else {
+          len_ = length;
+          if (buf_.size() < len_) {
+            buf_.resize(len_);
+          }
+          ptr_ = buf_.data();
+        }
+      } else if (unlikely(ret != -ENODATA)) {
+        TP_THROW_SYSTEM(-ret);
+      }
+    }
+
+    if (mode_ == READ_PAYLOAD) {
       if (nopObject_ != nullptr) {
-        len_ = length;
-      } else if (ptrProvided_) {
-        TP_DCHECK_EQ(length, len_);
+        ret = readNopObject(inbox);
       } else {
-        len_ = length;
-        buf_ = std::make_unique<uint8_t[]>(len_);
-        ptr_ = buf_.get();
+        ret = inbox.readInTx</*allowPartial=*/true>(
+            reinterpret_cast<uint8_t*>(ptr_) + bytesRead_, len_ - bytesRead_);
+      }
+      if (likely(ret >= 0)) {
+        bytesRead_ += ret;
+        bytesReadNow += ret;
+      } else if (unlikely(ret != -ENODATA)) {
+        TP_THROW_SYSTEM(-ret);
       }
-    } else if (unlikely(ret != -ENODATA)) {
-      TP_THROW_SYSTEM(-ret);
     }
-  }
 
-  if (mode_ == READ_PAYLOAD) {
-    if (nopObject_ != nullptr) {
-      ret = readNopObject(inbox);
-    } else {
-      ret = inbox.readInTx</*allowPartial=*/true>(
-          reinterpret_cast<uint8_t*>(ptr_) + bytesRead_, len_ - bytesRead_);
-    }
-    if (likely(ret >= 0)) {
-      bytesRead_ += ret;
-      bytesReadNow += ret;
-    } else if (unlikely(ret != -ENODATA)) {
-      TP_THROW_SYSTEM(-ret);
+    // Move on to the next buffer, if any, within the same transaction.
+    if (mode_ == READ_PAYLOAD && bytesRead_ == len_ &&
+        iovIdx_ + 1 < iovs_.size()) {
+      ++iovIdx_;
+      ptr_ = iovs_[iovIdx_].iov_base;
+      len_ = iovs_[iovIdx_].iov_len;
+      bytesRead_ = 0;
+      mode_ = READ_LENGTH;
+      continue;
     }
+    break;
   }
 
   ret = inbox.commitTx();
@@ -214,12 +283,25 @@ void RingbufferReadOperation::handleError(const Error& error) {
   fn_(error, nullptr, 0);
 }
 
+std::vector<uint8_t> RingbufferReadOperation::releaseBuffer() {
+  return std::move(buf_);
+}
+
 RingbufferWriteOperation::RingbufferWriteOperation(
     const void* ptr,
     size_t len,
     write_callback_fn fn)
     : ptr_(ptr), len_(len), fn_(std::move(fn)) {}
 
+RingbufferWriteOperation::RingbufferWriteOperation(
+    std::vector<iovec> iovs,
+    write_callback_fn fn)
+    : iovs_(std::move(iovs)), fn_(std::move(fn)) {
+  TP_DCHECK(!iovs_.empty());
+  ptr_ = iovs_[0].iov_base;
+  len_ = iovs_[0].iov_len;
+}
+
 RingbufferWriteOperation::RingbufferWriteOperation(
     const AbstractNopHolder* nopObject,
     write_callback_fn fn)
@@ -236,31 +318,45 @@ size_t RingbufferWriteOperation::handleWrite(
   ret = outbox.startTx();
   TP_THROW_SYSTEM_IF(ret < 0, -ret);
 
-  if (mode_ == WRITE_LENGTH) {
-    uint32_t length = len_;
-    ret = outbox.writeInTx</*allowPartial=*/false>(&length, sizeof(length));
-    if (likely(ret >= 0)) {
-      mode_ = WRITE_PAYLOAD;
-      bytesWrittenNow += ret;
-    } else if (unlikely(ret != -ENOSPC)) {
-      TP_THROW_SYSTEM(-ret);
+  while (true) {
+    if (mode_ == WRITE_LENGTH) {
+      uint32_t length = len_;
+      ret = outbox.writeInTx</*allowPartial=*/false>(&length, sizeof(length));
+      if (likely(ret >= 0)) {
+        mode_ = WRITE_PAYLOAD;
+        bytesWrittenNow += ret;
+      } else if (unlikely(ret != -ENOSPC)) {
+        TP_THROW_SYSTEM(-ret);
+      }
     }
-  }
 
-  if (mode_ == WRITE_PAYLOAD) {
-    if (nopObject_ != nullptr) {
-      ret = writeNopObject(outbox);
-    } else {
-      ret = outbox.writeInTx</*allowPartial=*/true>(
-          reinterpret_cast<const uint8_t*>(ptr_) + bytesWritten_,
-          len_ - bytesWritten_);
+    if (mode_ == WRITE_PAYLOAD) {
+      if (nopObject_ != nullptr) {
+        ret = writeNopObject(outbox);
+      } else {
+        ret = outbox.writeInTx</*allowPartial=*/true>(
+            reinterpret_cast<const uint8_t*>(ptr_) + bytesWritten_,
+            len_ - bytesWritten_);
+      }
+      if (likely(ret >= 0)) {
+        bytesWritten_ += ret;
+        bytesWrittenNow += ret;
+      } else if (unlikely(ret != -ENOSPC)) {
+        TP_THROW_SYSTEM(-ret);
+      }
     }
-    if (likely(ret >= 0)) {
-      bytesWritten_ += ret;
-      bytesWrittenNow += ret;
-    } else if (unlikely(ret != -ENOSPC)) {
-      TP_THROW_SYSTEM(-ret);
+
+    // Move on to the next buffer, if any, within the same transaction.
+    if (mode_ == WRITE_PAYLOAD && bytesWritten_ == len_ &&
+        iovIdx_ + 1 < iovs_.size()) {
+      ++iovIdx_;
+      ptr_ = iovs_[iovIdx_].iov_base;
+      len_ = iovs_[iovIdx_].iov_len;
+      bytesWritten_ = 0;
+      mode_ = WRITE_LENGTH;
+      continue;
     }
+    break;
   }
 
   ret = outbox.commitTx();
@@ -8,14 +8,17 @@
 
 #pragma once
 
+#include <sys/uio.h>
+
 #include <array>
-#include <functional>
 #include <memory>
 #include <tuple>
 #include <utility>
+#include <vector>
 
 #include <tensorpipe/common/defs.h>
 #include <tensorpipe/common/error.h>
+#include <tensorpipe/common/inline_function.h>
 #include <tensorpipe/common/optional.h>
 
 namespace tensorpipe {
@@ -27,6 +30,14 @@ namespace tensorpipe {
 // read side of the connection to either 1) not know how many bytes
 // to expected, and dynamically allocate, or 2) know how many bytes
 // to expect, and preallocate the destination memory.
+//
+// A read operation can also cover multiple consecutive chunks, each
+// with its own header, which are scattered into as many preallocated
+// buffers of known length.
+//
+// Operations are meant to be recycled (e.g., in a RecyclingQueue): they
+// are default-constructed once and then set up for each read by one of
+// the reset methods, which reuse the memory allocated by earlier reads.
 class StreamReadOperation {
   enum Mode {
     READ_LENGTH,
@@ -35,12 +46,22 @@ class StreamReadOperation {
   };
 
  public:
-  using read_callback_fn =
-      std::function<void(const Error& error, const void* ptr, size_t len)>;
+  // Transports may wrap the callbacks they were given once more before passing
+  // them here, hence these have the room for it.
+  using read_callback_fn = InlineFunction<
+      void(const Error& error, const void* ptr, size_t len),
+      wrappingCapacity(kWrappedCallbackInlineCapacity)>;
+
+  StreamReadOperation() = default;
+
+  // Read into a buffer of the length found in the stream, which the operation
+  // takes from the given one (e.g., left over by an earlier operation, see
+  // releaseBuffer), and only allocates if that one is too small.
+  inline void reset(std::vector<char> buffer, read_callback_fn fn);
 
-  explicit inline StreamReadOperation(read_callback_fn fn);
+  inline void reset(void* ptr, size_t length, read_callback_fn fn);
 
-  inline StreamReadOperation(void* ptr, size_t length, read_callback_fn fn);
+  inline void reset(std::vector<iovec> iovs, read_callback_fn fn);
 
   // Called when a buffer is needed to read data from stream.
   inline void allocFromLoop(char** buf, size_t* len);
@@ -51,9 +72,14 @@ class StreamReadOperation {
   // Returns if this read operation is complete.
   inline bool completeFromLoop() const;
 
-  // Invoke user callback.
+  // Invoke user callback. It's released right after, rather than when the
+  // operation is recycled, as it may be holding on to some resources.
   inline void callbackFromLoop(const Error& error);
 
+  // Hand over the buffer that held the data when no length was specified, so
+  // that it can be reused by a later operation once this one is done.
+  inline std::vector<char> releaseBuffer();
+
  private:
   Mode mode_{READ_LENGTH};
   char* ptr_{nullptr};
@@ -68,21 +94,55 @@ class StreamReadOperation {
   // This is reset to 0 when we advance from READ_LENGTH to READ_PAYLOAD.
   size_t bytesRead_{0};
 
-  // Holds temporary allocation if no length was specified.
-  std::unique_ptr<char[]> buffer_{nullptr};
+  // Holds temporary allocation if no length was specified. It's never shrunk,
+  // so that its whole capacity is available to the next operations.
+  std::vector<char> buffer_;
+
+  // In case of multiple chunks, ptr_ and givenLength_ refer to the one at
+  // iovIdx_.
+  std::vector<iovec> iovs_;
+  size_t iovIdx_{0};
 
   // User callback.
   read_callback_fn fn_;
+
+  // Bring the state of the read back to its start, for the given buffer.
+  inline void start(char* ptr, optional<size_t> givenLength);
 };
 
-StreamReadOperation::StreamReadOperation(read_callback_fn fn)
-    : fn_(std::move(fn)) {}
+void StreamReadOperation::reset(std::vector<char> buffer, read_callback_fn fn) {
+  start(nullptr, nullopt);
+  buffer_ = std::move(buffer);
+  iovs_.clear();
+  fn_ = std::move(fn);
+}
 
-StreamReadOperation::StreamReadOperation(
+void StreamReadOperation::reset(
     void* ptr,
     size_t length,
-    read_callback_fn fn)
-    : ptr_(static_cast<char*>(ptr)), givenLength_(length), fn_(std::move(fn)) {}
+    read_callback_fn fn) {
+  start(static_cast<char*>(ptr), length);
+  iovs_.clear();
+  fn_ = std::move(fn);
+}
+
+void StreamReadOperation::reset(
+    std::vector<iovec> iovs,
+    read_callback_fn fn) {
+  TP_DCHECK(!iovs.empty());
+  start(static_cast<char*>(iovs[0].iov_base), iovs[0].iov_len);
+  iovs_ = std::move(iovs);
+  fn_ = std::move(fn);
+}
+
+void StreamReadOperation::start(char* ptr, optional<size_t> givenLength) {
+  mode_ = READ_LENGTH;
+  ptr_ = ptr;
+  givenLength_ = givenLength;
+  readLength_ = 0;
+  bytesRead_ = 0;
+  iovIdx_ = 0;
+}
 
 void StreamReadOperation::allocFromLoop(char** base, size_t* len) {
   if (mode_ == READ_LENGTH) {
@@ -109,8 +169,10 @@ void StreamReadOperation::readFromLoop(size_t nread) {
         TP_DCHECK_EQ(readLength_, givenLength_.value());
       } else {
         TP_DCHECK(ptr_ == nullptr);
-        buffer_ = std::make_unique<char[]>(readLength_);
-        ptr_ = buffer_.get();
+        if (buffer_.size() < readLength_) {
+          buffer_.resize(readLength_);
+        }
+        ptr_ = buffer_.data();
       }
       if (readLength_ == 0) {
         mode_ = COMPLETE;
@@ -127,6 +189,16 @@ void StreamReadOperation::readFromLoop(size_t nread) {
   } else {
     TP_THROW_ASSERT() << "invalid mode " << mode_;
   }
+
+  // Move on to the next chunk, if any.
+  if (mode_ == COMPLETE && iovIdx_ + 1 < iovs_.size()) {
+    ++iovIdx_;
+    ptr_ = static_cast<char*>(iovs_[iovIdx_].iov_base);
+    givenLength_ = iovs_[iovIdx_].iov_len;
+    readLength_ = 0;
+    bytesRead_ = 0;
+    mode_ = READ_LENGTH;
+  }
 }
 
 bool StreamReadOperation::completeFromLoop() const {
@@ -134,7 +206,12 @@ bool StreamReadOperation::completeFromLoop() const {
 }
 
 void StreamReadOperation::callbackFromLoop(const Error& error) {
-  fn_(error, ptr_, readLength_);
+  read_callback_fn fn = std::move(fn_);
+  fn(error, ptr_, readLength_);
+}
+
+std::vector<char> StreamReadOperation::releaseBuffer() {
+  return std::move(buffer_);
 }
 
 // The write operation captures all state associated with writing a
@@ -143,14 +220,22 @@ void StreamReadOperation::callbackFromLoop(const Error& error) {
 // write. This header is a member field on this class and therefore
 // the instance must be kept alive and the reference to the instance
 // must remain valid until the write callback has been called.
+//
+// A write operation can also cover multiple chunks, each with its own
+// header, so that they can all be handed to the stream at once.
+//
+// Like read operations, write operations are meant to be recycled.
 class StreamWriteOperation {
  public:
-  using write_callback_fn = std::function<void(const Error& error)>;
+  using write_callback_fn = InlineFunction<
+      void(const Error& error),
+      wrappingCapacity(kWrappedCallbackInlineCapacity)>;
+
+  StreamWriteOperation() = default;
+
+  inline void reset(const void* ptr, size_t length, write_callback_fn fn);
 
-  inline StreamWriteOperation(
-      const void* ptr,
-      size_t length,
-      write_callback_fn fn);
+  inline void reset(const iovec* iovs, size_t numIovs, write_callback_fn fn);
 
   struct Buf {
     char* base;
@@ -159,38 +244,78 @@ class StreamWriteOperation {
 
   inline std::tuple<Buf*, size_t> getBufs();
 
-  // Invoke user callback.
+  // Invoke user callback. It's released right after, rather than when the
+  // operation is recycled, as it may be holding on to some resources.
   inline void callbackFromLoop(const Error& error);
 
  private:
-  const char* ptr_;
-  const size_t length_;
+  const char* ptr_{nullptr};
+  size_t length_{0};
 
   // Buffers (structs with pointers and lengths) to write to stream.
   std::array<Buf, 2> bufs_;
 
+  // The headers and the buffers to write to stream in case of a write of
+  // multiple chunks. They keep their capacity across writes.
+  std::vector<size_t> lengths_;
+  std::vector<Buf> vectoredBufs_;
+
   // User callback.
   write_callback_fn fn_;
 };
 
-StreamWriteOperation::StreamWriteOperation(
+void StreamWriteOperation::reset(
     const void* ptr,
     size_t length,
-    write_callback_fn fn)
-    : ptr_(static_cast<const char*>(ptr)), length_(length), fn_(std::move(fn)) {
+    write_callback_fn fn) {
+  ptr_ = static_cast<const char*>(ptr);
+  length_ = length;
   bufs_[0].base = const_cast<char*>(reinterpret_cast<const char*>(&length_));
   bufs_[0].len = sizeof(length_);
   bufs_[1].base = const_cast<char*>(ptr_);
   bufs_[1].len = length_;
+  lengths_.clear();
+  vectoredBufs_.clear();
+  fn_ = std::move(fn);
+}
+
+void StreamWriteOperation::reset(
+    const iovec* iovs,
+    size_t numIovs,
+    write_callback_fn fn) {
+  TP_DCHECK_GT(numIovs, 0);
+  ptr_ = nullptr;
+  length_ = 0;
+  // The buffers point into the headers, hence the latter must be reserved in
+  // full before they're filled in, so that they don't move.
+  lengths_.clear();
+  lengths_.reserve(numIovs);
+  vectoredBufs_.clear();
+  vectoredBufs_.reserve(2 * numIovs);
+  for (size_t iovIdx = 0; iovIdx < numIovs; iovIdx++) {
+    const iovec& iov = iovs[iovIdx];
+    lengths_.push_back(iov.iov_len);
+    vectoredBufs_.push_back(
+        Buf{reinterpret_cast<char*>(&lengths_.back()), sizeof(size_t)});
+    if (iov.iov_len > 0) {
+      vectoredBufs_.push_back(
+          Buf{reinterpret_cast<char*>(iov.iov_base), iov.iov_len});
+    }
+  }
+  fn_ = std::move(fn);
 }
 
 std::tuple<StreamWriteOperation::Buf*, size_t> StreamWriteOperation::getBufs() {
+  if (!vectoredBufs_.empty()) {
+    return std::make_tuple(vectoredBufs_.data(), vectoredBufs_.size());
+  }
   size_t numBuffers = length_ == 0 ? 1 : 2;
   return std::make_tuple(bufs_.data(), numBuffers);
 }
 
 void StreamWriteOperation::callbackFromLoop(const Error& error) {
-  fn_(error);
+  write_callback_fn fn = std::move(fn_);
+  fn(error);
 }
 
 } // namespace tensorpipe
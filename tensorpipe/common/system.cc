@@ -10,6 +10,7 @@
 
 #ifdef __linux__
 #include <pthread.h>
+#include <sched.h>
 #endif
 
 #ifdef __APPLE__
@@ -17,6 +18,7 @@
 #endif
 
 #include <array>
+#include <cerrno>
 #include <cstring>
 #include <fstream>
 #include <iomanip>
@@ -103,4 +105,31 @@ void setThreadName(std::string name) {
 #endif
 }
 
+void setThreadCpuAffinity(int cpu) {
+#ifdef __linux__
+  TP_THROW_ASSERT_IF(cpu < 0 || cpu >= CPU_SETSIZE) << "Invalid CPU " << cpu;
+  cpu_set_t cpuset;
+  CPU_ZERO(&cpuset);
+  CPU_SET(cpu, &cpuset);
+  int rv = pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+  TP_THROW_SYSTEM_IF(rv != 0, rv) << "Failed to pin thread to CPU " << cpu;
+#else
+  TP_THROW_ASSERT() << "Setting the CPU affinity of threads is not supported";
+#endif
+}
+
+void validateCpu(int cpu) {
+#ifdef __linux__
+  TP_THROW_ASSERT_IF(cpu < 0 || cpu >= CPU_SETSIZE) << "Invalid CPU " << cpu;
+  cpu_set_t cpuset;
+  CPU_ZERO(&cpuset);
+  int rv = sched_getaffinity(0, sizeof(cpuset), &cpuset);
+  TP_THROW_SYSTEM_IF(rv != 0, errno) << "Failed to get the CPU affinity";
+  TP_THROW_ASSERT_IF(!CPU_ISSET(cpu, &cpuset))
+      << "CPU " << cpu << " doesn't exist or isn't allowed for this process";
+#else
+  TP_THROW_ASSERT() << "Setting the CPU affinity of threads is not supported";
+#endif
+}
+
 } // namespace tensorpipe
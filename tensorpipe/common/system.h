@@ -90,4 +90,13 @@ optional<std::string> getBootID();
 // Set the name of the current thread, if possible. Use only for debugging.
 void setThreadName(std::string name);
 
+// Restrict the current thread to run only on the given CPU. Throws if the CPU
+// doesn't exist or isn't allowed for this process.
+void setThreadCpuAffinity(int cpu);
+
+// Throw if setThreadCpuAffinity would fail for the given CPU in the threads
+// started by the current one (which inherit its affinity). This allows to
+// check the CPUs given in the options before starting any thread.
+void validateCpu(int cpu);
+
 } // namespace tensorpipe
@@ -0,0 +1,242 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <tensorpipe/core/buffer_pool.h>
+
+#include <cstddef>
+#include <memory>
+
+#include <tensorpipe/common/defs.h>
+
+namespace tensorpipe {
+
+namespace {
+
+// Each block is preceded by a header that tells which slab it belongs to, and
+// which links it to the next free block of that slab while it's not in use. It
+// keeps the blocks aligned like the ones returned by malloc.
+struct alignas(alignof(std::max_align_t)) BlockHeader {
+  void* slab;
+  BlockHeader* nextFreeBlock;
+};
+
+constexpr size_t roundUpToAlignment(size_t length) {
+  return (length + alignof(BlockHeader) - 1) / alignof(BlockHeader) *
+      alignof(BlockHeader);
+}
+
+} // namespace
+
+struct BufferPool::Slab {
+  size_t sizeClassIdx;
+  size_t blockSize;
+  size_t numBlocks;
+
+  // Blocks are only carved out of the memory when first needed, so that a new
+  // slab doesn't have to be touched all at once.
+  size_t numBlocksCarved{0};
+  size_t numBlocksInUse{0};
+  BlockHeader* firstFreeBlock{nullptr};
+
+  // Neighbors in the list of slabs of the size class that have free blocks.
+  Slab* prev{nullptr};
+  Slab* next{nullptr};
+
+  // Left uninitialized, as the application will overwrite it anyway.
+  std::unique_ptr<uint8_t[]> memory;
+
+  bool isFull() const {
+    return firstFreeBlock == nullptr && numBlocksCarved == numBlocks;
+  }
+};
+
+constexpr size_t BufferPool::kDefaultSlabSize;
+constexpr size_t BufferPool::kMinBlockSize;
+constexpr size_t BufferPool::kMaxNumSizeClasses;
+
+BufferPool::BufferPool(size_t slabSize, size_t maxNumIdleSlabsPerSizeClass)
+    : slabSize_(slabSize),
+      maxNumIdleSlabsPerSizeClass_(maxNumIdleSlabsPerSizeClass) {
+  while (numSizeClasses_ < kMaxNumSizeClasses &&
+         2 * (sizeof(BlockHeader) + (kMinBlockSize << numSizeClasses_)) <=
+             slabSize_) {
+    ++numSizeClasses_;
+  }
+}
+
+BufferPool::~BufferPool() {
+  for (size_t sizeClassIdx = 0; sizeClassIdx < numSizeClasses_;
+       ++sizeClassIdx) {
+    SizeClass& sizeClass = sizeClasses_[sizeClassIdx];
+    while (sizeClass.firstSlabWithFreeBlocks != nullptr) {
+      Slab* slab = sizeClass.firstSlabWithFreeBlocks;
+      unlinkSlab(slab);
+      destroySlab(slab);
+    }
+  }
+  // Any other slab still has buffers in use.
+  TP_DCHECK_EQ(numSlabs_, 0);
+}
+
+void* BufferPool::allocate(size_t length) {
+  if (length == 0) {
+    return nullptr;
+  }
+
+  const size_t sizeClassIdx = sizeClassForLength(length);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  Slab* slab;
+  if (sizeClassIdx >= numSizeClasses_) {
+    slab = createSlab(
+        numSizeClasses_, roundUpToAlignment(length), /*numBlocks=*/1);
+  } else {
+    SizeClass& sizeClass = sizeClasses_[sizeClassIdx];
+    slab = sizeClass.firstSlabWithFreeBlocks;
+    if (slab == nullptr) {
+      const size_t blockSize = kMinBlockSize << sizeClassIdx;
+      slab = createSlab(
+          sizeClassIdx,
+          blockSize,
+          slabSize_ / (sizeof(BlockHeader) + blockSize));
+      linkSlab(slab);
+      ++sizeClass.numIdleSlabs;
+    }
+    if (slab->numBlocksInUse == 0) {
+      TP_DCHECK_GT(sizeClass.numIdleSlabs, 0);
+      --sizeClass.numIdleSlabs;
+    }
+  }
+
+  BlockHeader* header;
+  if (slab->firstFreeBlock != nullptr) {
+    header = slab->firstFreeBlock;
+    slab->firstFreeBlock = header->nextFreeBlock;
+  } else {
+    TP_DCHECK_LT(slab->numBlocksCarved, slab->numBlocks);
+    header = reinterpret_cast<BlockHeader*>(
+        slab->memory.get() +
+        slab->numBlocksCarved * (sizeof(BlockHeader) + slab->blockSize));
+    header->slab = slab;
+    ++slab->numBlocksCarved;
+  }
+  header->nextFreeBlock = nullptr;
+  ++slab->numBlocksInUse;
+
+  if (sizeClassIdx < numSizeClasses_ && slab->isFull()) {
+    unlinkSlab(slab);
+  }
+
+  return header + 1;
+}
+
+void BufferPool::release(void* ptr) {
+  if (ptr == nullptr) {
+    return;
+  }
+
+  BlockHeader* header = reinterpret_cast<BlockHeader*>(ptr) - 1;
+
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  Slab* slab = static_cast<Slab*>(header->slab);
+  TP_DCHECK_GT(slab->numBlocksInUse, 0);
+  --slab->numBlocksInUse;
+
+  if (slab->sizeClassIdx >= numSizeClasses_) {
+    destroySlab(slab);
+    return;
+  }
+
+  const bool wasFull = slab->isFull();
+  header->nextFreeBlock = slab->firstFreeBlock;
+  slab->firstFreeBlock = header;
+  if (wasFull) {
+    linkSlab(slab);
+  }
+
+  if (slab->numBlocksInUse == 0) {
+    SizeClass& sizeClass = sizeClasses_[slab->sizeClassIdx];
+    ++sizeClass.numIdleSlabs;
+    if (sizeClass.numIdleSlabs > maxNumIdleSlabsPerSizeClass_) {
+      unlinkSlab(slab);
+      destroySlab(slab);
+      --sizeClass.numIdleSlabs;
+    }
+  }
+}
+
+void BufferPool::release(Message& message) {
+  for (Message::Payload& payload : message.payloads) {
+    release(payload.data);
+    payload.data = nullptr;
+  }
+  for (Message::Tensor& tensor : message.tensors) {
+    if (tensor.buffer.type == DeviceType::kCpu) {
+      release(tensor.buffer.cpu.ptr);
+      tensor.buffer.cpu.ptr = nullptr;
+    }
+  }
+}
+
+size_t BufferPool::sizeClassForLength(size_t length) const {
+  size_t sizeClassIdx = 0;
+  while (sizeClassIdx < numSizeClasses_ &&
+         (kMinBlockSize << sizeClassIdx) < length) {
+    ++sizeClassIdx;
+  }
+  return sizeClassIdx;
+}
+
+BufferPool::Slab* BufferPool::createSlab(
+    size_t sizeClassIdx,
+    size_t blockSize,
+    size_t numBlocks) {
+  Slab* slab = new Slab();
+  slab->sizeClassIdx = sizeClassIdx;
+  slab->blockSize = blockSize;
+  slab->numBlocks = numBlocks;
+  slab->memory = std::unique_ptr<uint8_t[]>(
+      new uint8_t[numBlocks * (sizeof(BlockHeader) + blockSize)]);
+  ++numSlabs_;
+  return slab;
+}
+
+void BufferPool::destroySlab(Slab* slab) {
+  TP_DCHECK_GT(numSlabs_, 0);
+  --numSlabs_;
+  delete slab;
+}
+
+void BufferPool::linkSlab(Slab* slab) {
+  SizeClass& sizeClass = sizeClasses_[slab->sizeClassIdx];
+  TP_DCHECK(slab->prev == nullptr && slab->next == nullptr);
+  slab->next = sizeClass.firstSlabWithFreeBlocks;
+  if (slab->next != nullptr) {
+    slab->next->prev = slab;
+  }
+  sizeClass.firstSlabWithFreeBlocks = slab;
+}
+
+void BufferPool::unlinkSlab(Slab* slab) {
+  SizeClass& sizeClass = sizeClasses_[slab->sizeClassIdx];
+  if (slab->prev != nullptr) {
+    slab->prev->next = slab->next;
+  } else {
+    TP_DCHECK_EQ(sizeClass.firstSlabWithFreeBlocks, slab);
+    sizeClass.firstSlabWithFreeBlocks = slab->next;
+  }
+  if (slab->next != nullptr) {
+    slab->next->prev = slab->prev;
+  }
+  slab->prev = nullptr;
+  slab->next = nullptr;
+}
+
+} // namespace tensorpipe
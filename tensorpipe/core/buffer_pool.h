@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#include <tensorpipe/core/message.h>
+
+namespace tensorpipe {
+
+// A pool of CPU memory from which pipes can allocate the payloads and the CPU
+// tensors of the messages they receive (see ContextOptions::bufferPool and
+// Pipe::readMessage), so that the application doesn't have to. It can also be
+// used directly by the application.
+//
+// Buffers are carved out of larger slabs, each of which is dedicated to a size
+// class (a power of two). Each slab counts how many of its buffers are in use:
+// once none are, it's kept around for later allocations of the same class, up
+// to a given number of such idle slabs per class, beyond which it's freed.
+// Buffers larger than the biggest size class get a slab of their own, which is
+// freed as soon as they are released.
+//
+// All methods are thread-safe. The pool must outlive the buffers it handed out.
+class BufferPool final {
+ public:
+  static constexpr size_t kDefaultSlabSize = 1024 * 1024;
+
+  explicit BufferPool(
+      size_t slabSize = kDefaultSlabSize,
+      size_t maxNumIdleSlabsPerSizeClass = 1);
+
+  BufferPool(const BufferPool&) = delete;
+  BufferPool(BufferPool&&) = delete;
+  BufferPool& operator=(const BufferPool&) = delete;
+  BufferPool& operator=(BufferPool&&) = delete;
+
+  ~BufferPool();
+
+  // Return a buffer of at least the given number of bytes, aligned like the
+  // ones returned by malloc, or null if the length is zero.
+  void* allocate(size_t length);
+
+  // Give back a buffer returned by allocate. Null pointers are ignored.
+  void release(void* ptr);
+
+  // Give back the buffers of all the payloads and the CPU tensors of a message
+  // that was read with Pipe::readMessage, and reset their pointers.
+  void release(Message& message);
+
+ private:
+  struct Slab;
+
+  // The smallest size class. Buffers of up to this many bytes share one class.
+  static constexpr size_t kMinBlockSize = 64;
+  static constexpr size_t kMaxNumSizeClasses = 48;
+
+  const size_t slabSize_;
+  const size_t maxNumIdleSlabsPerSizeClass_;
+
+  // The number of size classes, whose block sizes are the powers of two from
+  // kMinBlockSize up to the largest one that fits at least twice in a slab.
+  size_t numSizeClasses_{0};
+
+  std::mutex mutex_;
+
+  struct SizeClass {
+    // The slabs that have at least one free block, in a doubly-linked list.
+    Slab* firstSlabWithFreeBlocks{nullptr};
+    size_t numIdleSlabs{0};
+  };
+  std::array<SizeClass, kMaxNumSizeClasses> sizeClasses_;
+
+  size_t numSlabs_{0};
+
+  size_t sizeClassForLength(size_t length) const;
+  Slab* createSlab(size_t sizeClassIdx, size_t blockSize, size_t numBlocks);
+  void destroySlab(Slab* slab);
+  void linkSlab(Slab* slab);
+  void unlinkSlab(Slab* slab);
+};
+
+} // namespace tensorpipe
@@ -12,8 +12,11 @@
 #include <unistd.h>
 
 #include <atomic>
+#include <map>
+#include <mutex>
 #include <thread>
 #include <unordered_map>
+#include <utility>
 
 #include <tensorpipe/common/callback.h>
 #include <tensorpipe/common/defs.h>
@@ -24,6 +27,7 @@
 #include <tensorpipe/core/listener.h>
 #include <tensorpipe/core/pipe.h>
 #include <tensorpipe/transport/connection.h>
+#include <tensorpipe/transport/connection_pool.h>
 
 namespace tensorpipe {
 
@@ -66,6 +70,10 @@ class Context::Impl : public Context::PrivateIface,
   ClosingEmitter& getClosingEmitter() override;
 
   std::shared_ptr<transport::Context> getTransport(const std::string&) override;
+
+  std::shared_ptr<transport::Connection> connect(
+      const std::string& transport,
+      const std::string& address) override;
   std::shared_ptr<channel::CpuContext> getCpuChannel(
       const std::string&) override;
 #if TENSORPIPE_SUPPORTS_CUDA
@@ -84,6 +92,34 @@ class Context::Impl : public Context::PrivateIface,
   const TOrderedChannels<CudaBuffer>& getOrderedCudaChannels() override;
 #endif // TENSORPIPE_SUPPORTS_CUDA
 
+  bool channelAcceptsTensorOfSize(const std::string&, size_t) override;
+
+  size_t getInlineTensorThreshold() override;
+
+  size_t getReadAheadMaxMessages() override;
+  size_t getReadAheadMaxPayloadsSize() override;
+
+  const std::shared_ptr<BufferPool>& getBufferPool() override;
+
+  size_t getWriteBatchMaxSize() override;
+
+  bool getOutOfOrderCompletion() override;
+
+  using PrivateIface::CachedBrochureAnswer;
+
+  optional<CachedBrochureAnswer> getCachedBrochureAnswer(
+      const std::string& url,
+      const std::string& remoteName) override;
+
+  void cacheBrochureAnswer(
+      const std::string& url,
+      const std::string& remoteName,
+      CachedBrochureAnswer answer) override;
+
+  void forgetBrochureAnswer(
+      const std::string& url,
+      const std::string& remoteName) override;
+
   const std::string& getName() override;
 
   void close();
@@ -114,9 +150,51 @@ class Context::Impl : public Context::PrivateIface,
   // identify the endpoints of a pipe.
   std::string name_;
 
+  // The size ranges (inclusive) of the tensors that each channel will be used
+  // for, as given in the options. Channels not in this map accept any size.
+  const std::unordered_map<std::string, std::pair<size_t, size_t>>
+      channelSizeRanges_;
+
+  // The size below which CPU tensors are sent inline, as given in the options.
+  const size_t inlineTensorThreshold_;
+
+  // The number of spare connections to keep to each address, as given in the
+  // options.
+  const size_t connectionPoolSize_;
+
+  // Whether pipes should reuse the brochure answers they got (see below), as
+  // given in the options.
+  const bool cacheBrochureAnswers_;
+
+  // How far pipes may read ahead, as given in the options.
+  const size_t readAheadMaxMessages_;
+  const size_t readAheadMaxPayloadsSize_;
+
+  // Where pipes allocate the messages read with readMessage, as given in the
+  // options.
+  const std::shared_ptr<BufferPool> bufferPool_;
+
+  // How many bytes of messages pipes may write at once, as given in the
+  // options.
+  const size_t writeBatchMaxSize_;
+
+  // Whether independent messages may complete out of order, as given in the
+  // options.
+  const bool outOfOrderCompletion_;
+
+  // The last brochure answer received by a pipe, keyed by the URL and remote
+  // name it connected to. This is accessed by the pipes from their loops, hence
+  // from multiple threads.
+  std::mutex brochureAnswersMutex_;
+  std::map<std::pair<std::string, std::string>, CachedBrochureAnswer>
+      brochureAnswers_;
+
   std::unordered_map<std::string, std::shared_ptr<transport::Context>>
       transports_;
 
+  std::unordered_map<std::string, std::shared_ptr<transport::ConnectionPool>>
+      connectionPools_;
+
   template <typename TBuffer>
   using TContextMap = std::
       unordered_map<std::string, std::shared_ptr<channel::Context<TBuffer>>>;
@@ -137,12 +215,26 @@ Context::Context(ContextOptions opts)
     : impl_(std::make_shared<Context::Impl>(std::move(opts))) {}
 
 Context::Impl::Impl(ContextOptions opts)
-    : id_(createContextId()), name_(std::move(opts.name_)) {
+    : id_(createContextId()),
+      name_(std::move(opts.name_)),
+      channelSizeRanges_(std::move(opts.channelSizeRanges_)),
+      inlineTensorThreshold_(opts.inlineTensorThreshold_),
+      connectionPoolSize_(opts.connectionPoolSize_),
+      cacheBrochureAnswers_(opts.cacheBrochureAnswers_),
+      readAheadMaxMessages_(opts.readAheadMaxMessages_),
+      readAheadMaxPayloadsSize_(opts.readAheadMaxPayloadsSize_),
+      bufferPool_(std::move(opts.bufferPool_)),
+      writeBatchMaxSize_(opts.writeBatchMaxSize_),
+      outOfOrderCompletion_(opts.outOfOrderCompletion_) {
   TP_VLOG(1) << "Context " << id_ << " created";
   if (name_ != "") {
     TP_VLOG(1) << "Context " << id_ << " aliased as " << name_;
     id_ = name_;
   }
+  for (const auto& iter : channelSizeRanges_) {
+    TP_THROW_ASSERT_IF(iter.second.first > iter.second.second)
+        << "invalid size range for channel " << iter.first;
+  }
 }
 
 void Context::registerTransport(
@@ -170,6 +262,10 @@ void Context::Impl::registerTransport(
   TP_VLOG(1) << "Context " << id_ << " is registering transport " << transport;
   context->setId(id_ + ".tr_" + transport);
   transports_.emplace(transport, context);
+  connectionPools_.emplace(
+      transport,
+      std::make_shared<transport::ConnectionPool>(
+          context, connectionPoolSize_));
   // Reverse the priority, as the pipe will pick the *first* available transport
   // it can find in the ordered map, so higher priorities should come first.
   transportsByPriority_.emplace(-priority, std::make_tuple(transport, context));
@@ -272,6 +368,16 @@ std::shared_ptr<transport::Context> Context::Impl::getTransport(
   return iter->second;
 }
 
+std::shared_ptr<transport::Connection> Context::Impl::connect(
+    const std::string& transport,
+    const std::string& address) {
+  auto iter = connectionPools_.find(transport);
+  if (iter == connectionPools_.end()) {
+    TP_THROW_EINVAL() << "unsupported transport " << transport;
+  }
+  return iter->second->connect(address);
+}
+
 template <typename TBuffer>
 std::shared_ptr<channel::Context<TBuffer>> Context::Impl::getChannel(
     const std::string& channel) {
@@ -311,6 +417,73 @@ const Context::Impl::TOrderedChannels<CudaBuffer>& Context::Impl::
 }
 #endif // TENSORPIPE_SUPPORTS_CUDA
 
+bool Context::Impl::channelAcceptsTensorOfSize(
+    const std::string& channel,
+    size_t length) {
+  auto iter = channelSizeRanges_.find(channel);
+  if (iter == channelSizeRanges_.end()) {
+    return true;
+  }
+  return iter->second.first <= length && length <= iter->second.second;
+}
+
+size_t Context::Impl::getInlineTensorThreshold() {
+  return inlineTensorThreshold_;
+}
+
+size_t Context::Impl::getReadAheadMaxMessages() {
+  return readAheadMaxMessages_;
+}
+
+size_t Context::Impl::getReadAheadMaxPayloadsSize() {
+  return readAheadMaxPayloadsSize_;
+}
+
+const std::shared_ptr<BufferPool>& Context::Impl::getBufferPool() {
+  return bufferPool_;
+}
+
+size_t Context::Impl::getWriteBatchMaxSize() {
+  return writeBatchMaxSize_;
+}
+
+bool Context::Impl::getOutOfOrderCompletion() {
+  return outOfOrderCompletion_;
+}
+
+optional<Context::Impl::CachedBrochureAnswer> Context::Impl::
+    getCachedBrochureAnswer(
+        const std::string& url,
+        const std::string& remoteName) {
+  if (!cacheBrochureAnswers_) {
+    return nullopt;
+  }
+  std::unique_lock<std::mutex> lock(brochureAnswersMutex_);
+  auto iter = brochureAnswers_.find(std::make_pair(url, remoteName));
+  if (iter == brochureAnswers_.end()) {
+    return nullopt;
+  }
+  return iter->second;
+}
+
+void Context::Impl::cacheBrochureAnswer(
+    const std::string& url,
+    const std::string& remoteName,
+    CachedBrochureAnswer answer) {
+  if (!cacheBrochureAnswers_) {
+    return;
+  }
+  std::unique_lock<std::mutex> lock(brochureAnswersMutex_);
+  brochureAnswers_[std::make_pair(url, remoteName)] = std::move(answer);
+}
+
+void Context::Impl::forgetBrochureAnswer(
+    const std::string& url,
+    const std::string& remoteName) {
+  std::unique_lock<std::mutex> lock(brochureAnswersMutex_);
+  brochureAnswers_.erase(std::make_pair(url, remoteName));
+}
+
 const std::string& Context::Impl::getName() {
   return name_;
 }
@@ -325,6 +498,9 @@ void Context::Impl::close() {
 
     closingEmitter_.close();
 
+    for (auto& iter : connectionPools_) {
+      iter.second->close();
+    }
     for (auto& iter : transports_) {
       iter.second->close();
     }
@@ -8,11 +8,16 @@
 
 #pragma once
 
+#include <cstddef>
+#include <limits>
 #include <memory>
 #include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include <tensorpipe/config.h>
+#include <tensorpipe/core/buffer_pool.h>
 #include <tensorpipe/transport/context.h>
 
 #include <tensorpipe/channel/cpu_context.h>
@@ -28,6 +33,16 @@ class Pipe;
 class ContextOptions {
  public:
   std::string name_;
+  std::unordered_map<std::string, std::pair<size_t, size_t>>
+      channelSizeRanges_;
+  size_t inlineTensorThreshold_{0};
+  size_t connectionPoolSize_{0};
+  bool cacheBrochureAnswers_{false};
+  size_t readAheadMaxMessages_{0};
+  size_t readAheadMaxPayloadsSize_{0};
+  std::shared_ptr<BufferPool> bufferPool_;
+  size_t writeBatchMaxSize_{0};
+  bool outOfOrderCompletion_{false};
 
   // The name should be a semantically meaningful description of this context.
   // It will only be used for logging and debugging purposes, to identify the
@@ -36,6 +51,106 @@ class ContextOptions {
     name_ = std::move(name);
     return std::move(*this);
   }
+
+  // Restrict the channel with the given name to tensors whose size in bytes is
+  // within [minSize, maxSize]. When sending a tensor, the pipe picks the
+  // channel with the highest priority among those whose range includes the
+  // tensor's size, which allows for instance to route small tensors through a
+  // channel with low fixed costs and large ones through a high-bandwidth one.
+  // Channels without a range accept tensors of any size. If no channel accepts
+  // a tensor, the pipe falls back to the one with the highest priority.
+  ContextOptions&& channelSizeRange(
+      std::string channel,
+      size_t minSize,
+      size_t maxSize = std::numeric_limits<size_t>::max()) && {
+    channelSizeRanges_[std::move(channel)] = std::make_pair(minSize, maxSize);
+    return std::move(*this);
+  }
+
+  // CPU tensors strictly smaller than this many bytes will not be sent over a
+  // channel but will instead be copied inside the message descriptor, which
+  // saves the fixed cost of a channel operation. The receiver still needs to
+  // provide CPU memory for them. By default no tensor is inlined.
+  ContextOptions&& inlineTensorThreshold(size_t inlineTensorThreshold) && {
+    inlineTensorThreshold_ = inlineTensorThreshold;
+    return std::move(*this);
+  }
+
+  // Keep this many spare connections, opened ahead of time, to each address
+  // that a pipe connected to (be it for the pipe itself or for its channels).
+  // Later pipes to the same remote context then find them already set up and
+  // don't have to wait for the transports' handshakes. By default there are
+  // no spare connections.
+  ContextOptions&& connectionPoolSize(size_t connectionPoolSize) && {
+    connectionPoolSize_ = connectionPoolSize;
+    return std::move(*this);
+  }
+
+  // Remember which transport and channels the remote end picked for the last
+  // pipe to each URL and remote name. New pipes to the same place then set up
+  // the same ones right away and start sending messages together with the
+  // handshake, rather than waiting for its answer. If the remote end picks
+  // differently this time the pipe falls back to the full negotiation, which
+  // makes it slower than when disabled, as it is by default.
+  ContextOptions&& cacheBrochureAnswers(bool cacheBrochureAnswers) && {
+    cacheBrochureAnswers_ = cacheBrochureAnswers;
+    return std::move(*this);
+  }
+
+  // Let pipes read the descriptors of up to this many messages ahead of the
+  // ones the application is allocating memory for, as long as those messages
+  // have at most the given number of bytes of payloads in total. Their payloads
+  // are read into the pipe's own buffers, so that the connection can move on to
+  // the next descriptor without waiting for the application's buffers. This
+  // only applies to messages for which readDescriptor was already called. The
+  // payloads given to the readDescriptor callback then point to the pipe's
+  // buffers, which the data may still be being received into: their contents
+  // must only be accessed from the read callback, and only until it returns.
+  // If they're passed to read unchanged the data isn't copied, otherwise it's
+  // copied into the application's buffers. By default pipes don't read ahead.
+  ContextOptions&& readAhead(size_t maxMessages, size_t maxPayloadsSize) && {
+    readAheadMaxMessages_ = maxMessages;
+    readAheadMaxPayloadsSize_ = maxPayloadsSize;
+    return std::move(*this);
+  }
+
+  // The pool from which pipes allocate the memory for the payloads and the CPU
+  // tensors of the messages read with readMessage. The application must give
+  // the buffers back to the pool once it's done with them. By default there is
+  // no pool, and readMessage can't be used.
+  ContextOptions&& bufferPool(std::shared_ptr<BufferPool> bufferPool) && {
+    bufferPool_ = std::move(bufferPool);
+    return std::move(*this);
+  }
+
+  // Let pipes coalesce the descriptors and payloads of consecutive messages
+  // into a single write on the connection, as long as they amount to at most
+  // the given number of bytes. Much like Nagle's algorithm, a message that's
+  // ready to be written while the connection is still writing an earlier batch
+  // waits for that to complete (or for the batch to be full) and then goes out
+  // with all the others that piled up in the meantime. This reduces the number
+  // of writes the transport performs for bursts of small messages, but it isn't
+  // a throughput optimization: there is no window in which messages are held
+  // back, hence a plain ping-pong never batches, and in bursts the savings are
+  // within the noise of the benchmarks (see benchmark_pipe --batch-writes). The
+  // order of messages and of write callbacks doesn't change, nor does what the
+  // remote pipe sees. By default writes aren't batched.
+  ContextOptions&& batchWrites(size_t maxBatchSize) && {
+    writeBatchMaxSize_ = maxBatchSize;
+    return std::move(*this);
+  }
+
+  // Let the messages that are marked as independent (see Message::independent)
+  // complete out of order: their write or read callback may be called as soon
+  // as their tensors are transferred, before the ones of earlier messages, and
+  // the other messages only wait for the earlier ones that aren't independent.
+  // The descriptors and payloads still go through the connection in order, and
+  // the readDescriptor callbacks are still called in order. Each end of a pipe
+  // decides on its own whether it honors the flag of the messages.
+  ContextOptions&& outOfOrderCompletion(bool outOfOrderCompletion) && {
+    outOfOrderCompletion_ = outOfOrderCompletion;
+    return std::move(*this);
+  }
 };
 
 class PipeOptions {
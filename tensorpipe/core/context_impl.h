@@ -12,10 +12,14 @@
 #include <memory>
 #include <string>
 #include <tuple>
+#include <vector>
 
 #include <tensorpipe/common/callback.h>
+#include <tensorpipe/common/optional.h>
 #include <tensorpipe/config.h>
+#include <tensorpipe/core/buffer_helpers.h>
 #include <tensorpipe/core/context.h>
+#include <tensorpipe/transport/connection.h>
 #include <tensorpipe/transport/context.h>
 
 #include <tensorpipe/channel/cpu_context.h>
@@ -35,6 +39,13 @@ class Context::PrivateIface {
   virtual std::shared_ptr<transport::Context> getTransport(
       const std::string&) = 0;
 
+  // Return a connection to the given address using the given transport, which
+  // may come from the pool of spare ones (see
+  // ContextOptions::connectionPoolSize).
+  virtual std::shared_ptr<transport::Connection> connect(
+      const std::string& transport,
+      const std::string& address) = 0;
+
   virtual std::shared_ptr<channel::CpuContext> getCpuChannel(
       const std::string&) = 0;
 
@@ -60,6 +71,57 @@ class Context::PrivateIface {
   virtual const TOrderedChannels<CudaBuffer>& getOrderedCudaChannels() = 0;
 #endif // TENSORPIPE_SUPPORTS_CUDA
 
+  // Return whether the channel with the given name was configured to accept
+  // tensors of the given size (see ContextOptions::channelSizeRange).
+  virtual bool channelAcceptsTensorOfSize(const std::string&, size_t) = 0;
+
+  // Return the size below which CPU tensors are copied inside the message
+  // descriptor (see ContextOptions::inlineTensorThreshold).
+  virtual size_t getInlineTensorThreshold() = 0;
+
+  // Return how many messages pipes may read ahead of the allocation of their
+  // memory, and up to which total size of payloads (see
+  // ContextOptions::readAhead).
+  virtual size_t getReadAheadMaxMessages() = 0;
+  virtual size_t getReadAheadMaxPayloadsSize() = 0;
+
+  // Return the pool that pipes allocate the messages read with readMessage
+  // from, if any (see ContextOptions::bufferPool).
+  virtual const std::shared_ptr<BufferPool>& getBufferPool() = 0;
+
+  // Return the maximum size in bytes of the batches of messages that pipes
+  // write at once, or zero if they don't (see ContextOptions::batchWrites).
+  virtual size_t getWriteBatchMaxSize() = 0;
+
+  // Return whether pipes let independent messages complete out of order (see
+  // ContextOptions::outOfOrderCompletion).
+  virtual bool getOutOfOrderCompletion() = 0;
+
+  // What the remote end of a pipe picked in its answer to the brochure.
+  struct CachedBrochureAnswer {
+    std::string transport;
+    std::string address;
+    TP_DEVICE_FIELD(std::vector<std::string>, std::vector<std::string>)
+    channels;
+  };
+
+  // Return the answer obtained by the last pipe that connected to the given URL
+  // and remote name, if any (see ContextOptions::cacheBrochureAnswers).
+  virtual optional<CachedBrochureAnswer> getCachedBrochureAnswer(
+      const std::string& url,
+      const std::string& remoteName) = 0;
+
+  virtual void cacheBrochureAnswer(
+      const std::string& url,
+      const std::string& remoteName,
+      CachedBrochureAnswer) = 0;
+
+  // Drop the cached answer, if any, for instance because it turned out to be
+  // stale (e.g., the remote end restarted on another address).
+  virtual void forgetBrochureAnswer(
+      const std::string& url,
+      const std::string& remoteName) = 0;
+
   // Return the name given to the context's constructor. It will be retrieved
   // by the pipes and listener in order to attach it to logged messages.
   virtual const std::string& getName() = 0;
@@ -8,7 +8,12 @@
 
 #include <tensorpipe/core/listener.h>
 
+#include <chrono>
 #include <deque>
+#include <iterator>
+#include <list>
+#include <tuple>
+#include <unordered_map>
 #include <unordered_set>
 
 #include <tensorpipe/common/address.h>
@@ -26,6 +31,16 @@
 
 namespace tensorpipe {
 
+namespace {
+
+// The connections held back until their pipe registers for them are dropped
+// when there are too many of them, or once they have waited for too long, as
+// the pipe may never do so (e.g., if its remote end went away in between).
+constexpr size_t kMaxNumConnectionsWaitingForRegistration = 1024;
+constexpr std::chrono::seconds kMaxTimeWaitingForRegistration{30};
+
+} // namespace
+
 class Listener::Impl : public Listener::PrivateIface,
                        public std::enable_shared_from_this<Listener::Impl> {
  public:
@@ -48,6 +63,8 @@ class Listener::Impl : public Listener::PrivateIface,
   using PrivateIface::connection_request_callback_fn;
 
   uint64_t registerConnectionRequest(connection_request_callback_fn) override;
+  void registerConnectionRequest(uint64_t, connection_request_callback_fn)
+      override;
   void unregisterConnectionRequest(uint64_t) override;
 
   void close();
@@ -102,6 +119,21 @@ class Listener::Impl : public Listener::PrivateIface,
   std::unordered_map<uint64_t, connection_request_callback_fn>
       connectionRequestRegistrations_;
 
+  // Connections with an id chosen by the remote end that arrived before their
+  // pipe registered for them. They are kept until it does, or unregisters, or
+  // until they are dropped (see kMaxNumConnectionsWaitingForRegistration), or
+  // until the listener is closed.
+  struct ConnectionWaitingForRegistration {
+    std::string transport;
+    std::shared_ptr<transport::Connection> connection;
+    std::chrono::steady_clock::time_point arrivedAt;
+    // The position of the id in the list of waiting ones, by arrival time.
+    std::list<uint64_t>::iterator arrivalOrderIter;
+  };
+  std::unordered_map<uint64_t, ConnectionWaitingForRegistration>
+      connectionsWaitingForRegistration_;
+  std::list<uint64_t> connectionsWaitingForRegistrationByArrival_;
+
   ClosingReceiver closingReceiver_;
 
   //
@@ -120,6 +152,18 @@ class Listener::Impl : public Listener::PrivateIface,
 
   void unregisterConnectionRequestFromLoop(uint64_t);
 
+  //
+  // Helpers for the connections waiting for their registration
+  //
+
+  void holdConnectionUntilRegistered(
+      uint64_t,
+      std::string,
+      std::shared_ptr<transport::Connection>);
+  void dropConnectionWaitingForRegistration(
+      std::unordered_map<uint64_t, ConnectionWaitingForRegistration>::iterator);
+  void dropStaleConnectionsWaitingForRegistration();
+
   //
   // Helpers to prepare callbacks from transports
   //
@@ -300,6 +344,15 @@ uint64_t Listener::Impl::registerConnectionRequest(
   return registrationId;
 }
 
+void Listener::Impl::registerConnectionRequest(
+    uint64_t registrationId,
+    connection_request_callback_fn fn) {
+  TP_DCHECK(registrationId & kRemoteRegistrationIdBit);
+  loop_.deferToLoop([this, registrationId, fn{std::move(fn)}]() mutable {
+    registerConnectionRequestFromLoop(registrationId, std::move(fn));
+  });
+}
+
 void Listener::Impl::registerConnectionRequestFromLoop(
     uint64_t registrationId,
     connection_request_callback_fn fn) {
@@ -324,9 +377,23 @@ void Listener::Impl::registerConnectionRequestFromLoop(
 
   if (error_) {
     fn(error_, std::string(), std::shared_ptr<transport::Connection>());
-  } else {
-    connectionRequestRegistrations_.emplace(registrationId, std::move(fn));
+    return;
   }
+
+  dropStaleConnectionsWaitingForRegistration();
+  auto iter = connectionsWaitingForRegistration_.find(registrationId);
+  if (iter != connectionsWaitingForRegistration_.end()) {
+    std::string transport = std::move(iter->second.transport);
+    std::shared_ptr<transport::Connection> connection =
+        std::move(iter->second.connection);
+    connectionsWaitingForRegistrationByArrival_.erase(
+        iter->second.arrivalOrderIter);
+    connectionsWaitingForRegistration_.erase(iter);
+    fn(Error::kSuccess, std::move(transport), std::move(connection));
+    return;
+  }
+
+  connectionRequestRegistrations_.emplace(registrationId, std::move(fn));
 }
 
 void Listener::Impl::unregisterConnectionRequest(uint64_t registrationId) {
@@ -342,6 +409,71 @@ void Listener::Impl::unregisterConnectionRequestFromLoop(
              << " received a connection request de-registration (#"
              << registrationId << ")";
   connectionRequestRegistrations_.erase(registrationId);
+  auto iter = connectionsWaitingForRegistration_.find(registrationId);
+  if (iter != connectionsWaitingForRegistration_.end()) {
+    dropConnectionWaitingForRegistration(iter);
+  }
+}
+
+//
+// Helpers for the connections waiting for their registration
+//
+
+void Listener::Impl::holdConnectionUntilRegistered(
+    uint64_t registrationId,
+    std::string transport,
+    std::shared_ptr<transport::Connection> connection) {
+  TP_DCHECK(loop_.inLoop());
+  dropStaleConnectionsWaitingForRegistration();
+  if (connectionsWaitingForRegistration_.size() >=
+      kMaxNumConnectionsWaitingForRegistration) {
+    TP_VLOG(3) << "Listener " << id_
+               << " is dropping the oldest connection waiting for its "
+               << "registration to make room";
+    dropConnectionWaitingForRegistration(
+        connectionsWaitingForRegistration_.find(
+            connectionsWaitingForRegistrationByArrival_.front()));
+  }
+  connectionsWaitingForRegistrationByArrival_.push_back(registrationId);
+  bool inserted;
+  std::tie(std::ignore, inserted) = connectionsWaitingForRegistration_.emplace(
+      registrationId,
+      ConnectionWaitingForRegistration{
+          std::move(transport),
+          connection,
+          std::chrono::steady_clock::now(),
+          std::prev(connectionsWaitingForRegistrationByArrival_.end())});
+  // The remote end is buggy (or malicious) if it reuses an id.
+  if (!inserted) {
+    TP_LOG_WARNING() << "Listener " << id_ << " got connection #"
+                     << registrationId << " twice";
+    connectionsWaitingForRegistrationByArrival_.pop_back();
+    connection->close();
+  }
+}
+
+void Listener::Impl::dropConnectionWaitingForRegistration(
+    std::unordered_map<uint64_t, ConnectionWaitingForRegistration>::iterator
+        iter) {
+  TP_DCHECK(iter != connectionsWaitingForRegistration_.end());
+  iter->second.connection->close();
+  connectionsWaitingForRegistrationByArrival_.erase(
+      iter->second.arrivalOrderIter);
+  connectionsWaitingForRegistration_.erase(iter);
+}
+
+void Listener::Impl::dropStaleConnectionsWaitingForRegistration() {
+  const auto now = std::chrono::steady_clock::now();
+  while (!connectionsWaitingForRegistrationByArrival_.empty()) {
+    auto iter = connectionsWaitingForRegistration_.find(
+        connectionsWaitingForRegistrationByArrival_.front());
+    if (now - iter->second.arrivedAt <= kMaxTimeWaitingForRegistration) {
+      break;
+    }
+    TP_VLOG(3) << "Listener " << id_ << " is dropping connection #"
+               << iter->first << " which waited too long for its registration";
+    dropConnectionWaitingForRegistration(iter);
+  }
 }
 
 //
@@ -376,6 +508,8 @@ void Listener::Impl::handleError() {
     listener.second->close();
   }
   connectionsWaitingForHello_.clear();
+  connectionsWaitingForRegistration_.clear();
+  connectionsWaitingForRegistrationByArrival_.clear();
 }
 
 //
@@ -469,6 +603,11 @@ void Listener::Impl::onConnectionHelloRead(
       auto fn = std::move(iter->second);
       connectionRequestRegistrations_.erase(iter);
       fn(Error::kSuccess, std::move(transport), std::move(connection));
+    } else if (registrationId & kRemoteRegistrationIdBit) {
+      // The remote end chose this id and may have connected before sending us
+      // the brochure that will cause the pipe to register it.
+      holdConnectionUntilRegistered(
+          registrationId, std::move(transport), std::move(connection));
     }
   } else {
     TP_LOG_ERROR() << "packet contained unknown content: "
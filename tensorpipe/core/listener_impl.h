@@ -19,6 +19,11 @@
 
 namespace tensorpipe {
 
+// Registration ids with this bit set are chosen by the remote end of a pipe (at
+// random) rather than handed out by the listener, which lets the remote open a
+// connection before the listener expects it.
+constexpr uint64_t kRemoteRegistrationIdBit = uint64_t(1) << 63;
+
 class Listener::PrivateIface {
  public:
   using connection_request_callback_fn = std::function<
@@ -27,6 +32,13 @@ class Listener::PrivateIface {
   virtual uint64_t registerConnectionRequest(
       connection_request_callback_fn) = 0;
 
+  // Register a request for a connection whose id was chosen by the remote end
+  // (see kRemoteRegistrationIdBit). If such a connection arrived before being
+  // registered, it was held back and is delivered right away.
+  virtual void registerConnectionRequest(
+      uint64_t,
+      connection_request_callback_fn) = 0;
+
   virtual void unregisterConnectionRequest(uint64_t) = 0;
 
   virtual const std::map<std::string, std::string>& addresses() const = 0;
@@ -59,6 +59,12 @@ class Message final {
 
   // Holds the tensors that are offered to the side channels.
   std::vector<Tensor> tensors;
+
+  // Whether the order of this message with respect to the others doesn't
+  // matter, which lets the pipes complete it out of order if their context
+  // allows it (see ContextOptions::outOfOrderCompletion). The flag is sent to
+  // the remote end, where it's set on the message that is read.
+  bool independent{false};
 };
 
 } // namespace tensorpipe
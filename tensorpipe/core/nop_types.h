@@ -40,22 +40,34 @@ struct ChannelAdvertisement {
   NOP_STRUCTURE(ChannelAdvertisement, domainDescriptor);
 };
 
+struct ChannelSelection {
+  uint64_t registrationId;
+  NOP_STRUCTURE(ChannelSelection, registrationId);
+};
+
 struct Brochure {
   std::unordered_map<std::string, TransportAdvertisement>
       transportAdvertisement;
   std::unordered_map<std::string, ChannelAdvertisement> cpuChannelAdvertisement;
   std::unordered_map<std::string, ChannelAdvertisement>
       cudaChannelAdvertisement;
+  // Set by a client that didn't wait for the answer to this brochure: it used
+  // the one it got from this server last time, already opened the channels it
+  // listed (with the registration ids given here, chosen by the client) and
+  // may have started sending messages after this brochure.
+  bool optimistic{false};
+  std::unordered_map<std::string, ChannelSelection>
+      optimisticCpuChannelSelection;
+  std::unordered_map<std::string, ChannelSelection>
+      optimisticCudaChannelSelection;
   NOP_STRUCTURE(
       Brochure,
       transportAdvertisement,
       cpuChannelAdvertisement,
-      cudaChannelAdvertisement);
-};
-
-struct ChannelSelection {
-  uint64_t registrationId;
-  NOP_STRUCTURE(ChannelSelection, registrationId);
+      cudaChannelAdvertisement,
+      optimistic,
+      optimisticCpuChannelSelection,
+      optimisticCudaChannelSelection);
 };
 
 struct BrochureAnswer {
@@ -64,13 +76,18 @@ struct BrochureAnswer {
   uint64_t registrationId;
   std::unordered_map<std::string, ChannelSelection> cpuChannelSelection;
   std::unordered_map<std::string, ChannelSelection> cudaChannelSelection;
+  // Whether the server picked the same transport and channels that the client
+  // had optimistically set up. If not, the client must drop that setup, and the
+  // messages it sent over it, and use the ones given in this answer instead.
+  bool optimisticSetupAccepted{false};
   NOP_STRUCTURE(
       BrochureAnswer,
       transport,
       address,
       registrationId,
       cpuChannelSelection,
-      cudaChannelSelection);
+      cudaChannelSelection,
+      optimisticSetupAccepted);
 };
 
 struct MessageDescriptor {
@@ -97,23 +114,30 @@ struct MessageDescriptor {
     DeviceType deviceType;
     std::string channelName;
     std::string channelDescriptor;
+
+    // Small CPU tensors may be sent inline, in which case their channel name is
+    // empty and their content is stored here rather than sent on a channel.
+    std::string inlineData;
     NOP_STRUCTURE(
         TensorDescriptor,
         sizeInBytes,
         metadata,
         deviceType,
         channelName,
-        channelDescriptor);
+        channelDescriptor,
+        inlineData);
   };
 
   std::string metadata;
   std::vector<PayloadDescriptor> payloadDescriptors;
   std::vector<TensorDescriptor> tensorDescriptors;
+  bool independent{false};
   NOP_STRUCTURE(
       MessageDescriptor,
       metadata,
       payloadDescriptors,
-      tensorDescriptors);
+      tensorDescriptors,
+      independent);
 };
 
 using Packet = nop::Variant<
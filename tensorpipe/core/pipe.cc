@@ -8,9 +8,13 @@
 
 #include <tensorpipe/core/pipe.h>
 
+#include <sys/uio.h>
+
 #include <algorithm>
-#include <deque>
+#include <cstring>
 #include <mutex>
+#include <random>
+#include <string>
 #include <unordered_map>
 
 #include <tensorpipe/channel/channel.h>
@@ -19,6 +23,7 @@
 #include <tensorpipe/common/defs.h>
 #include <tensorpipe/common/error_macros.h>
 #include <tensorpipe/common/optional.h>
+#include <tensorpipe/common/recycling_queue.h>
 #include <tensorpipe/core/buffer_helpers.h>
 #include <tensorpipe/core/context_impl.h>
 #include <tensorpipe/core/error.h>
@@ -48,10 +53,19 @@ struct ReadOperation {
   int64_t numPayloadsBeingRead{0};
   int64_t numTensorsBeingReceived{0};
 
+  // Whether the message may complete out of order. It's only known once the
+  // descriptor has been read (see ContextOptions::outOfOrderCompletion).
+  bool independent{false};
+
   // Callbacks.
   Pipe::read_descriptor_callback_fn readDescriptorCallback;
   Pipe::read_callback_fn readCallback;
 
+  // Set if the message was requested through readWithAllocator (or through
+  // readMessage, which uses the buffer pool), in which case the pipe calls it
+  // as soon as it has the descriptor, rather than the readDescriptor callback.
+  Pipe::allocator_fn allocator;
+
   // Metadata found in the descriptor read from the connection.
   struct Payload {
     ssize_t length{-1};
@@ -60,48 +74,97 @@ struct ReadOperation {
   struct Tensor {
     DeviceType type;
     ssize_t length{-1};
+    // Empty if the tensor was sent inline, in which case its content is stored
+    // in inlineData rather than being received from a channel.
     std::string channelName;
     channel::TDescriptor descriptor;
+    std::string inlineData;
   };
   std::vector<Tensor> tensors;
 
   // Buffers allocated by the user.
   Message message;
+
+  // Whether the payloads were read ahead into the staging buffer, before the
+  // user provided its own buffers (see ContextOptions::readAhead). The buffer
+  // is kept for the next messages that get this operation object.
+  bool payloadsStaged{false};
+  std::vector<uint8_t> stagingBuffer;
+
+  // The nop object the descriptor is read into. The callback of the read takes
+  // it, and gives it back once done, so that the next message that gets this
+  // operation object can reuse it.
+  std::unique_ptr<NopHolder<Packet>> nopHolderIn;
+
+  // Operation objects are recycled: this brings one back to its initial state,
+  // while holding on to the memory it had allocated.
+  void reset() {
+    sequenceNumber = -1;
+    state = UNINITIALIZED;
+    doneReadingDescriptor = false;
+    doneGettingAllocation = false;
+    numPayloadsBeingRead = 0;
+    numTensorsBeingReceived = 0;
+    independent = false;
+    readDescriptorCallback = nullptr;
+    readCallback = nullptr;
+    allocator = nullptr;
+    payloads.clear();
+    tensors.clear();
+    message = Message();
+    payloadsStaged = false;
+  }
 };
 
-// Copy the payload and tensors sizes, the tensor descriptors, etc. from the
+// Move the payload and tensors sizes, the tensor descriptors, etc. from the
 // message descriptor that is contained in the nop object to the ReadOperation.
-void parseDescriptorOfMessage(ReadOperation& op, const Packet& nopPacketIn) {
+// Return an error if the descriptor is inconsistent, as it can't be trusted.
+Error parseDescriptorOfMessage(ReadOperation& op, Packet& nopPacketIn) {
   Message& message = op.message;
 
   TP_DCHECK_EQ(nopPacketIn.index(), nopPacketIn.index_of<MessageDescriptor>());
-  const MessageDescriptor& nopMessageDescriptor =
+  MessageDescriptor& nopMessageDescriptor =
       *nopPacketIn.get<MessageDescriptor>();
 
-  message.metadata = nopMessageDescriptor.metadata;
-  for (const auto& nopPayloadDescriptor :
-       nopMessageDescriptor.payloadDescriptors) {
+  message.metadata = std::move(nopMessageDescriptor.metadata);
+  message.independent = nopMessageDescriptor.independent;
+  for (auto& nopPayloadDescriptor : nopMessageDescriptor.payloadDescriptors) {
     Message::Payload payload;
     ReadOperation::Payload payloadBeingAllocated;
     payload.length = nopPayloadDescriptor.sizeInBytes;
     payloadBeingAllocated.length = payload.length;
-    payload.metadata = nopPayloadDescriptor.metadata;
+    payload.metadata = std::move(nopPayloadDescriptor.metadata);
     message.payloads.push_back(std::move(payload));
     op.payloads.push_back(std::move(payloadBeingAllocated));
   }
 
-  for (const auto& nopTensorDescriptor :
-       nopMessageDescriptor.tensorDescriptors) {
+  for (auto& nopTensorDescriptor : nopMessageDescriptor.tensorDescriptors) {
     ReadOperation::Tensor tensorBeingAllocated;
     tensorBeingAllocated.length = nopTensorDescriptor.sizeInBytes;
     tensorBeingAllocated.channelName = nopTensorDescriptor.channelName;
-    // FIXME If the nop object wasn't const we could move the string out...
-    tensorBeingAllocated.descriptor = nopTensorDescriptor.channelDescriptor;
+    tensorBeingAllocated.descriptor =
+        std::move(nopTensorDescriptor.channelDescriptor);
+    tensorBeingAllocated.inlineData =
+        std::move(nopTensorDescriptor.inlineData);
+
+    // The content of inline tensors is copied into the CPU buffers that the
+    // user allocated for the announced size, hence the two must match.
+    if (tensorBeingAllocated.channelName.empty() &&
+        (nopTensorDescriptor.deviceType != DeviceType::kCpu ||
+         static_cast<int64_t>(tensorBeingAllocated.inlineData.size()) !=
+             nopTensorDescriptor.sizeInBytes)) {
+      return TP_CREATE_ERROR(
+          LogicError,
+          "inline tensor of " +
+              std::to_string(tensorBeingAllocated.inlineData.size()) +
+              " bytes announced as " +
+              std::to_string(nopTensorDescriptor.sizeInBytes) + " CPU bytes");
+    }
 
     message.tensors.emplace_back();
     Message::Tensor& tensor = message.tensors.back();
     op.tensors.push_back(std::move(tensorBeingAllocated));
-    tensor.metadata = nopTensorDescriptor.metadata;
+    tensor.metadata = std::move(nopTensorDescriptor.metadata);
     switch (nopTensorDescriptor.deviceType) {
       case DeviceType::kCpu: {
         CpuBuffer buffer;
@@ -121,6 +184,21 @@ void parseDescriptorOfMessage(ReadOperation& op, const Packet& nopPacketIn) {
         TP_THROW_ASSERT() << "Unexpected device type.";
     };
   }
+
+  return Error::kSuccess;
+}
+
+// Point the payloads and the CPU tensors of the message to new buffers of the
+// pool. This is the allocator used by readMessage.
+void allocateFromBufferPool(BufferPool& bufferPool, Message& message) {
+  for (Message::Payload& payload : message.payloads) {
+    payload.data = bufferPool.allocate(payload.length);
+  }
+  for (Message::Tensor& tensor : message.tensors) {
+    TP_THROW_ASSERT_IF(tensor.buffer.type != DeviceType::kCpu)
+        << "readMessage doesn't support CUDA tensors";
+    tensor.buffer.cpu.ptr = bufferPool.allocate(tensor.buffer.cpu.length);
+  }
 }
 
 // Raise an error if the number or sizes of the payloads and the tensors in
@@ -143,6 +221,11 @@ void checkAllocationCompatibility(
     const Message::Tensor& tensor = message.tensors[tensorIdx];
     const ReadOperation::Tensor& tensorBeingAllocated = op.tensors[tensorIdx];
     TP_DCHECK_GE(tensorBeingAllocated.length, 0);
+    // Inline tensors are copied straight out of the descriptor, which can only
+    // be done into CPU memory.
+    TP_THROW_ASSERT_IF(
+        tensorBeingAllocated.channelName.empty() &&
+        tensor.buffer.type != DeviceType::kCpu);
     switch (tensor.buffer.type) {
       case DeviceType::kCpu:
         TP_THROW_ASSERT_IF(
@@ -175,6 +258,10 @@ struct WriteOperation {
   int64_t numTensorDescriptorsBeingCollected{0};
   int64_t numTensorsBeingSent{0};
 
+  // Whether the message may complete out of order (see
+  // ContextOptions::outOfOrderCompletion).
+  bool independent{false};
+
   // Callbacks.
   Pipe::write_callback_fn writeCallback;
 
@@ -184,46 +271,85 @@ struct WriteOperation {
   // Tensor descriptors collected from the channels.
   struct Tensor {
     DeviceType type;
+    // Empty if the tensor is sent inline, inside the message descriptor.
     std::string channelName;
     channel::TDescriptor descriptor;
   };
   std::vector<Tensor> tensors;
+
+  // The nop object holding the descriptor, which is reused by the next message
+  // that gets this operation object.
+  NopHolder<Packet> nopHolderOut;
+
+  // The buffer the descriptor is serialized into, and the array of buffers
+  // (the descriptor and the payloads) that is handed to the connection. The
+  // callback of the write takes them, and gives them back once done, so that
+  // they too are reused by the next message that gets this operation object.
+  struct WriteBuffers {
+    std::vector<uint8_t> descriptor;
+    std::vector<iovec> iovs;
+  };
+  std::unique_ptr<WriteBuffers> writeBuffers;
+
+  // Operation objects are recycled: this brings one back to its initial state,
+  // while holding on to the memory it had allocated.
+  void reset() {
+    sequenceNumber = -1;
+    state = UNINITIALIZED;
+    numPayloadsBeingWritten = 0;
+    numTensorDescriptorsBeingCollected = 0;
+    numTensorsBeingSent = 0;
+    independent = false;
+    writeCallback = nullptr;
+    message = Message();
+    tensors.clear();
+  }
 };
 
-// Produce a nop object containing a message descriptor using the information
-// contained in the WriteOperation: number and sizes of payloads and tensors,
-// tensor descriptors, ...
-std::shared_ptr<NopHolder<Packet>> makeDescriptorForMessage(
-    const WriteOperation& op) {
-  auto nopHolderOut = std::make_shared<NopHolder<Packet>>();
-  Packet& nopPacketOut = nopHolderOut->getObject();
-  nopPacketOut.Become(nopPacketOut.index_of<MessageDescriptor>());
+// Fill the nop object of the WriteOperation with a message descriptor, using
+// the information contained in the operation: number and sizes of payloads and
+// tensors, tensor descriptors, ... The fields of the descriptor of the previous
+// message are overwritten in place, so that their strings and vectors can be
+// reused.
+void makeDescriptorForMessage(WriteOperation& op) {
+  Packet& nopPacketOut = op.nopHolderOut.getObject();
+  if (nopPacketOut.index() != nopPacketOut.index_of<MessageDescriptor>()) {
+    nopPacketOut.Become(nopPacketOut.index_of<MessageDescriptor>());
+  }
   MessageDescriptor& nopMessageDescriptor =
       *nopPacketOut.get<MessageDescriptor>();
 
   nopMessageDescriptor.metadata = op.message.metadata;
+  nopMessageDescriptor.independent = op.message.independent;
 
+  nopMessageDescriptor.payloadDescriptors.resize(op.message.payloads.size());
   for (int payloadIdx = 0; payloadIdx < op.message.payloads.size();
        ++payloadIdx) {
     const Message::Payload& payload = op.message.payloads[payloadIdx];
-    nopMessageDescriptor.payloadDescriptors.emplace_back();
     MessageDescriptor::PayloadDescriptor& nopPayloadDescriptor =
-        nopMessageDescriptor.payloadDescriptors.back();
+        nopMessageDescriptor.payloadDescriptors[payloadIdx];
     nopPayloadDescriptor.sizeInBytes = payload.length;
     nopPayloadDescriptor.metadata = payload.metadata;
   }
 
   TP_DCHECK_EQ(op.message.tensors.size(), op.tensors.size());
+  nopMessageDescriptor.tensorDescriptors.resize(op.tensors.size());
   for (int tensorIdx = 0; tensorIdx < op.tensors.size(); ++tensorIdx) {
     const Message::Tensor& tensor = op.message.tensors[tensorIdx];
-    const WriteOperation::Tensor& otherTensor = op.tensors[tensorIdx];
-    nopMessageDescriptor.tensorDescriptors.emplace_back();
+    WriteOperation::Tensor& otherTensor = op.tensors[tensorIdx];
     MessageDescriptor::TensorDescriptor& nopTensorDescriptor =
-        nopMessageDescriptor.tensorDescriptors.back();
+        nopMessageDescriptor.tensorDescriptors[tensorIdx];
     nopTensorDescriptor.metadata = tensor.metadata;
     nopTensorDescriptor.channelName = otherTensor.channelName;
-    // FIXME In principle we could move here.
-    nopTensorDescriptor.channelDescriptor = otherTensor.descriptor;
+    nopTensorDescriptor.channelDescriptor = std::move(otherTensor.descriptor);
+    if (otherTensor.channelName.empty()) {
+      TP_DCHECK(tensor.buffer.type == DeviceType::kCpu);
+      nopTensorDescriptor.inlineData.assign(
+          reinterpret_cast<const char*>(tensor.buffer.cpu.ptr),
+          tensor.buffer.cpu.length);
+    } else {
+      nopTensorDescriptor.inlineData.clear();
+    }
 
     nopTensorDescriptor.deviceType = tensor.buffer.type;
     switch (tensor.buffer.type) {
@@ -239,8 +365,6 @@ std::shared_ptr<NopHolder<Packet>> makeDescriptorForMessage(
         TP_THROW_ASSERT() << "Unknown device type.";
     };
   }
-
-  return nopHolderOut;
 }
 
 template <typename TBuffer>
@@ -315,6 +439,49 @@ const std::unordered_map<std::string, ChannelSelection>& getChannelSelection<
 }
 #endif // TENSORPIPE_SUPPORTS_CUDA
 
+template <typename TBuffer>
+std::unordered_map<std::string, ChannelSelection>&
+getOptimisticChannelSelection(Brochure& nopBrochure);
+
+template <>
+std::unordered_map<std::string, ChannelSelection>&
+getOptimisticChannelSelection<CpuBuffer>(Brochure& nopBrochure) {
+  return nopBrochure.optimisticCpuChannelSelection;
+}
+
+#if TENSORPIPE_SUPPORTS_CUDA
+template <>
+std::unordered_map<std::string, ChannelSelection>&
+getOptimisticChannelSelection<CudaBuffer>(Brochure& nopBrochure) {
+  return nopBrochure.optimisticCudaChannelSelection;
+}
+#endif // TENSORPIPE_SUPPORTS_CUDA
+
+template <typename TBuffer>
+const std::unordered_map<std::string, ChannelSelection>&
+getOptimisticChannelSelection(const Brochure& nopBrochure);
+
+template <>
+const std::unordered_map<std::string, ChannelSelection>&
+getOptimisticChannelSelection<CpuBuffer>(const Brochure& nopBrochure) {
+  return nopBrochure.optimisticCpuChannelSelection;
+}
+
+#if TENSORPIPE_SUPPORTS_CUDA
+template <>
+const std::unordered_map<std::string, ChannelSelection>&
+getOptimisticChannelSelection<CudaBuffer>(const Brochure& nopBrochure) {
+  return nopBrochure.optimisticCudaChannelSelection;
+}
+#endif // TENSORPIPE_SUPPORTS_CUDA
+
+// Pick a registration id for a connection that the client opens before the
+// server asked for it. See kRemoteRegistrationIdBit.
+uint64_t generateRemoteRegistrationId() {
+  static thread_local std::mt19937_64 generator{std::random_device{}()};
+  return generator() | kRemoteRegistrationIdBit;
+}
+
 template <typename TBuffer>
 TBuffer unwrap(Buffer);
 
@@ -355,6 +522,8 @@ class Pipe::Impl : public std::enable_shared_from_this<Pipe::Impl> {
 
   void readDescriptor(read_descriptor_callback_fn);
   void read(Message, read_callback_fn);
+  void readMessage(read_callback_fn);
+  void readWithAllocator(allocator_fn, read_callback_fn);
   void write(Message, write_callback_fn);
 
   const std::string& getRemoteName();
@@ -370,6 +539,8 @@ class Pipe::Impl : public std::enable_shared_from_this<Pipe::Impl> {
 
   void readFromLoop(Message, read_callback_fn);
 
+  void readWithAllocatorFromLoop(allocator_fn, read_callback_fn);
+
   void writeFromLoop(Message, write_callback_fn);
 
   void closeFromLoop();
@@ -398,6 +569,10 @@ class Pipe::Impl : public std::enable_shared_from_this<Pipe::Impl> {
   // incoming pipes).
   std::string remoteName_;
 
+  // The URL given to the connect method of the local context (for outgoing
+  // pipes). Empty for incoming pipes.
+  std::string url_;
+
   std::string transport_;
   std::shared_ptr<transport::Connection> connection_;
 
@@ -414,10 +589,28 @@ class Pipe::Impl : public std::enable_shared_from_this<Pipe::Impl> {
   TP_DEVICE_FIELD(TChannelRegistrationMap, TChannelRegistrationMap)
   channelRegistrationIds_;
 
+  // The server registers for the channel connections of an optimistic setup it
+  // rejected only to close them as they arrive. If some never do, these would
+  // linger in the listener, hence they are tied to the pipe's lifetime.
+  std::vector<uint64_t> rejectedChannelRegistrationIds_;
+
+  // When the context has a cached answer for the pipe's URL and remote name,
+  // the client sets up the transport and channels it lists right away, and it
+  // starts writing (but not reading) messages as if it were established, until
+  // the actual answer tells whether the server agrees.
+  optional<Context::PrivateIface::CachedBrochureAnswer> cachedBrochureAnswer_;
+  bool optimisticSetupPending_{false};
+
+  // Incremented whenever the client abandons an optimistic setup, in order to
+  // recognize and drop the callbacks of the operations started on it.
+  uint64_t setupAttempt_{0};
+
   ClosingReceiver closingReceiver_;
 
-  std::deque<ReadOperation> readOperations_;
-  std::deque<WriteOperation> writeOperations_;
+  // The objects of finished operations are recycled for the new ones, so that a
+  // pipe in a steady state doesn't need to allocate memory for them.
+  RecyclingQueue<ReadOperation> readOperations_;
+  RecyclingQueue<WriteOperation> writeOperations_;
 
   // A sequence number for the calls to read and write.
   uint64_t nextMessageBeingRead_{0};
@@ -448,6 +641,22 @@ class Pipe::Impl : public std::enable_shared_from_this<Pipe::Impl> {
   int64_t nextMessageGettingAllocation_{0};
   int64_t nextMessageAskingForAllocation_{0};
 
+  // The number of messages whose payloads were read ahead and that are still
+  // waiting for the user to allocate memory for them.
+  size_t numMessagesReadAhead_{0};
+
+  // When writes are batched (see ContextOptions::batchWrites), the messages
+  // waiting to be written in the next batch, which are consecutive, and their
+  // total size in bytes, together with the number of batches being written.
+  int64_t firstMessageInBatch_{0};
+  int64_t numMessagesInBatch_{0};
+  size_t batchSize_{0};
+  int64_t numBatchesBeingWritten_{0};
+
+  // The buffer that the descriptors of the next batch will be serialized into.
+  // The callback of the write of a batch gives its buffer back.
+  std::vector<uint8_t> batchBuf_;
+
   Error error_{Error::kSuccess};
 
   //
@@ -457,11 +666,43 @@ class Pipe::Impl : public std::enable_shared_from_this<Pipe::Impl> {
   LazyCallbackWrapper<Impl> lazyCallbackWrapper_{*this, this->loop_};
   EagerCallbackWrapper<Impl> eagerCallbackWrapper_{*this, this->loop_};
 
+  // For the operations that may be started on an optimistic setup: the client's
+  // handshake and the writes of messages. It acts like the lazy or the eager
+  // wrapper, except that callbacks are dropped if their setup was abandoned in
+  // the meantime, and errors occurring while it is still pending make the pipe
+  // fall back to the full negotiation rather than fail.
+  template <bool kEager, typename TBoundFn>
+  auto setupAttemptCallbackWrapper(TBoundFn&& fn) {
+    return [impl{shared_from_this()},
+            attempt{setupAttempt_},
+            fn{std::move(fn)}](const Error& error, auto&&... args) mutable {
+      // FIXME We're copying the args here...
+      impl->loop_.deferToLoop(
+          [impl, attempt, fn{std::move(fn)}, error, args...]() mutable {
+            TP_DCHECK(impl->loop_.inLoop());
+            if (attempt != impl->setupAttempt_) {
+              return;
+            }
+            if (error && impl->optimisticSetupPending_ && !impl->error_) {
+              TP_VLOG(2) << "Pipe " << impl->id_ << " got error "
+                         << error.what() << " on its optimistic setup";
+              impl->retryWithoutOptimisticSetup();
+              return;
+            }
+            impl->setError(error);
+            if (kEager || !impl->error_) {
+              fn(*impl, args...);
+            }
+          });
+    };
+  }
+
   //
   // Helpers to schedule our callbacks into user code
   //
 
   void callReadDescriptorCallback(ReadOperation& op);
+  void callAllocator(ReadOperation& op);
   void callReadCallback(ReadOperation& op);
   void callWriteCallback(WriteOperation& op);
 
@@ -480,6 +721,11 @@ class Pipe::Impl : public std::enable_shared_from_this<Pipe::Impl> {
   void startReadingUponEstablishingPipe();
   void startWritingUponEstablishingPipe();
 
+  void writeHelloAndBrochure();
+  void abandonOptimisticSetup();
+  void retryWithoutOptimisticSetup();
+  void cacheBrochureAnswer(const BrochureAnswer&);
+
   void advanceReadOperation(ReadOperation& op);
   void advanceWriteOperation(WriteOperation& op);
 
@@ -488,23 +734,33 @@ class Pipe::Impl : public std::enable_shared_from_this<Pipe::Impl> {
 
   void readDescriptorOfMessage(ReadOperation&);
   void readPayloadsAndReceiveTensorsOfMessage(ReadOperation&);
+  void readPayloadsOfMessage(ReadOperation&);
+  void stagePayloadsOfMessage(ReadOperation&);
+  void copyStagedPayloadsOfMessage(ReadOperation&);
   void sendTensorsOfMessage(WriteOperation&);
   void writeDescriptorAndPayloadsOfMessage(WriteOperation&);
+  void addMessageToBatch(WriteOperation&);
+  void writeBatchOfMessages();
   void onReadWhileServerWaitingForBrochure(const Packet&);
   void onReadWhileClientWaitingForBrochureAnswer(const Packet&);
   void onAcceptWhileServerWaitingForConnection(
       std::string,
       std::shared_ptr<transport::Connection>);
   template <typename TBuffer>
+  void openChannel(const std::string&, const std::string&, uint64_t);
+  template <typename TBuffer>
+  std::vector<std::string> selectChannels(const Brochure&);
+  template <typename TBuffer>
   void onAcceptWhileServerWaitingForChannel(
       std::string,
       std::string,
       std::shared_ptr<transport::Connection>);
-  void onReadOfMessageDescriptor(ReadOperation&, const Packet&);
+  void onReadOfMessageDescriptor(ReadOperation&, Packet&);
   void onDescriptorOfTensor(WriteOperation&, int64_t, channel::TDescriptor);
   void onReadOfPayload(ReadOperation&);
   void onRecvOfTensor(ReadOperation&);
   void onWriteOfPayload(WriteOperation&);
+  void onWriteOfBatch(int64_t, int64_t);
   void onSendOfTensor(WriteOperation&);
 
   ReadOperation* findReadOperation(int64_t sequenceNumber);
@@ -573,10 +829,18 @@ Pipe::Impl::Impl(
       context_(std::move(context)),
       id_(std::move(id)),
       remoteName_(std::move(remoteName)),
+      url_(url),
+      cachedBrochureAnswer_(
+          context_->getCachedBrochureAnswer(url_, remoteName_)),
       closingReceiver_(context_, context_->getClosingEmitter()) {
   std::string address;
-  std::tie(transport_, address) = splitSchemeOfURL(url);
-  connection_ = context_->getTransport(transport_)->connect(std::move(address));
+  if (cachedBrochureAnswer_.has_value()) {
+    transport_ = cachedBrochureAnswer_->transport;
+    address = cachedBrochureAnswer_->address;
+  } else {
+    std::tie(transport_, address) = splitSchemeOfURL(url_);
+  }
+  connection_ = context_->connect(transport_, address);
   connection_->setId(id_ + ".tr_" + transport_);
 }
 
@@ -624,64 +888,7 @@ void Pipe::Impl::initFromLoop() {
   TP_DCHECK(loop_.inLoop());
   closingReceiver_.activate(*this);
   if (state_ == CLIENT_ABOUT_TO_SEND_HELLO_AND_BROCHURE) {
-    auto nopHolderOut = std::make_shared<NopHolder<Packet>>();
-    Packet& nopPacketOut = nopHolderOut->getObject();
-    nopPacketOut.Become(nopPacketOut.index_of<SpontaneousConnection>());
-    SpontaneousConnection& nopSpontaneousConnection =
-        *nopPacketOut.get<SpontaneousConnection>();
-    nopSpontaneousConnection.contextName = context_->getName();
-    TP_VLOG(3) << "Pipe " << id_
-               << " is writing nop object (spontaneous connection)";
-    connection_->write(
-        *nopHolderOut, lazyCallbackWrapper_([nopHolderOut](Impl& impl) {
-          TP_VLOG(3) << "Pipe " << impl.id_
-                     << " done writing nop object (spontaneous connection)";
-        }));
-
-    auto nopHolderOut2 = std::make_shared<NopHolder<Packet>>();
-    Packet& nopPacketOut2 = nopHolderOut2->getObject();
-    nopPacketOut2.Become(nopPacketOut2.index_of<Brochure>());
-    Brochure& nopBrochure = *nopPacketOut2.get<Brochure>();
-    for (const auto& transportContextIter : context_->getOrderedTransports()) {
-      const std::string& transportName =
-          std::get<0>(transportContextIter.second);
-      const transport::Context& transportContext =
-          *(std::get<1>(transportContextIter.second));
-      TransportAdvertisement& nopTransportAdvertisement =
-          nopBrochure.transportAdvertisement[transportName];
-      nopTransportAdvertisement.domainDescriptor =
-          transportContext.domainDescriptor();
-    }
-    forEachDeviceType([&](auto buffer) {
-      for (const auto& channelContextIter :
-           this->getOrderedChannels<decltype(buffer)>()) {
-        const std::string& channelName = std::get<0>(channelContextIter.second);
-        const channel::Context<decltype(buffer)>& channelContext =
-            *(std::get<1>(channelContextIter.second));
-        auto& nopChannelAdvertisementMap =
-            getChannelAdvertisement<decltype(buffer)>(nopBrochure);
-        ChannelAdvertisement& nopChannelAdvertisement =
-            nopChannelAdvertisementMap[channelName];
-        nopChannelAdvertisement.domainDescriptor =
-            channelContext.domainDescriptor();
-      }
-    });
-    TP_VLOG(3) << "Pipe " << id_ << " is writing nop object (brochure)";
-    connection_->write(
-        *nopHolderOut2, lazyCallbackWrapper_([nopHolderOut2](Impl& impl) {
-          TP_VLOG(3) << "Pipe " << impl.id_
-                     << " done writing nop object (brochure)";
-        }));
-    state_ = CLIENT_WAITING_FOR_BROCHURE_ANSWER;
-    auto nopHolderIn = std::make_shared<NopHolder<Packet>>();
-    TP_VLOG(3) << "Pipe " << id_ << " is reading nop object (brochure answer)";
-    connection_->read(
-        *nopHolderIn, lazyCallbackWrapper_([nopHolderIn](Impl& impl) {
-          TP_VLOG(3) << "Pipe " << impl.id_
-                     << " done reading nop object (brochure answer)";
-          impl.onReadWhileClientWaitingForBrochureAnswer(
-              nopHolderIn->getObject());
-        }));
+    writeHelloAndBrochure();
   }
   if (state_ == SERVER_WAITING_FOR_BROCHURE) {
     auto nopHolderIn = std::make_shared<NopHolder<Packet>>();
@@ -738,23 +945,13 @@ void Pipe::Impl::readDescriptor(read_descriptor_callback_fn fn) {
 void Pipe::Impl::readDescriptorFromLoop(read_descriptor_callback_fn fn) {
   TP_DCHECK(loop_.inLoop());
 
-  readOperations_.emplace_back();
-  ReadOperation& op = readOperations_.back();
+  ReadOperation& op = readOperations_.pushBack();
+  op.reset();
   op.sequenceNumber = nextMessageBeingRead_++;
 
   TP_VLOG(1) << "Pipe " << id_ << " received a readDescriptor request (#"
              << op.sequenceNumber << ")";
 
-  fn = [this, sequenceNumber{op.sequenceNumber}, fn{std::move(fn)}](
-           const Error& error, Message message) {
-    TP_DCHECK_EQ(sequenceNumber, nextReadDescriptorCallbackToCall_++);
-    TP_VLOG(1) << "Pipe " << id_ << " is calling a readDescriptor callback (#"
-               << sequenceNumber << ")";
-    fn(error, std::move(message));
-    TP_VLOG(1) << "Pipe " << id_ << " done calling a readDescriptor callback (#"
-               << sequenceNumber << ")";
-  };
-
   op.readDescriptorCallback = std::move(fn);
 
   advanceReadOperation(op);
@@ -765,14 +962,10 @@ void Pipe::read(Message message, read_callback_fn fn) {
 }
 
 void Pipe::Impl::read(Message message, read_callback_fn fn) {
-  // Messages aren't copyable and thus if a lambda captures them it cannot be
-  // wrapped in a std::function. Therefore we wrap Messages in shared_ptrs.
-  auto sharedMessage = std::make_shared<Message>(std::move(message));
-  loop_.deferToLoop([this,
-                     sharedMessage{std::move(sharedMessage)},
-                     fn{std::move(fn)}]() mutable {
-    readFromLoop(std::move(*sharedMessage), std::move(fn));
-  });
+  loop_.deferToLoop(
+      [this, message{std::move(message)}, fn{std::move(fn)}]() mutable {
+        readFromLoop(std::move(message), std::move(fn));
+      });
 }
 
 void Pipe::Impl::readFromLoop(Message message, read_callback_fn fn) {
@@ -781,7 +974,16 @@ void Pipe::Impl::readFromLoop(Message message, read_callback_fn fn) {
   // This is such a bad logical error on the user's side that it doesn't deserve
   // to pass through the channel for "expected errors" (i.e., the callback).
   // This check fails when there is no message for which we are expecting an
-  // allocation.
+  // allocation. Messages read with readWithAllocator got theirs already, which
+  // may leave some of them in the interval.
+  while (nextMessageGettingAllocation_ < nextMessageAskingForAllocation_) {
+    const ReadOperation* opPtr =
+        findReadOperation(nextMessageGettingAllocation_);
+    if (opPtr != nullptr && !opPtr->doneGettingAllocation) {
+      break;
+    }
+    ++nextMessageGettingAllocation_;
+  }
   TP_THROW_ASSERT_IF(
       nextMessageGettingAllocation_ == nextMessageAskingForAllocation_);
 
@@ -792,20 +994,14 @@ void Pipe::Impl::readFromLoop(Message message, read_callback_fn fn) {
 
   checkAllocationCompatibility(op, message);
 
-  fn = [this, sequenceNumber{op.sequenceNumber}, fn{std::move(fn)}](
-           const Error& error, Message message) {
-    TP_DCHECK_EQ(sequenceNumber, nextReadCallbackToCall_++);
-    TP_VLOG(1) << "Pipe " << id_ << " is calling a read callback (#"
-               << sequenceNumber << ")";
-    fn(error, std::move(message));
-    TP_VLOG(1) << "Pipe " << id_ << " done calling a read callback (#"
-               << sequenceNumber << ")";
-  };
-
   TP_DCHECK_EQ(op.state, ReadOperation::ASKING_FOR_ALLOCATION);
   op.message = std::move(message);
   op.readCallback = std::move(fn);
   op.doneGettingAllocation = true;
+  if (op.payloadsStaged) {
+    TP_DCHECK_GT(numMessagesReadAhead_, 0);
+    --numMessagesReadAhead_;
+  }
 
   TP_VLOG(1) << "Pipe " << id_ << " received a read request (#"
              << op.sequenceNumber << ", containing "
@@ -815,6 +1011,52 @@ void Pipe::Impl::readFromLoop(Message message, read_callback_fn fn) {
   advanceReadOperation(op);
 }
 
+void Pipe::readMessage(read_callback_fn fn) {
+  impl_->readMessage(std::move(fn));
+}
+
+void Pipe::Impl::readMessage(read_callback_fn fn) {
+  // The context was not given a pool to allocate messages from.
+  TP_THROW_ASSERT_IF(context_->getBufferPool() == nullptr);
+  readWithAllocator(
+      [bufferPool{context_->getBufferPool()}](Message& message) {
+        allocateFromBufferPool(*bufferPool, message);
+      },
+      std::move(fn));
+}
+
+void Pipe::readWithAllocator(allocator_fn allocator, read_callback_fn fn) {
+  impl_->readWithAllocator(std::move(allocator), std::move(fn));
+}
+
+void Pipe::Impl::readWithAllocator(
+    allocator_fn allocator,
+    read_callback_fn fn) {
+  loop_.deferToLoop([this,
+                     allocator{std::move(allocator)},
+                     fn{std::move(fn)}]() mutable {
+    readWithAllocatorFromLoop(std::move(allocator), std::move(fn));
+  });
+}
+
+void Pipe::Impl::readWithAllocatorFromLoop(
+    allocator_fn allocator,
+    read_callback_fn fn) {
+  TP_DCHECK(loop_.inLoop());
+
+  ReadOperation& op = readOperations_.pushBack();
+  op.reset();
+  op.sequenceNumber = nextMessageBeingRead_++;
+
+  TP_VLOG(1) << "Pipe " << id_ << " received a readWithAllocator request (#"
+             << op.sequenceNumber << ")";
+
+  op.allocator = std::move(allocator);
+  op.readCallback = std::move(fn);
+
+  advanceReadOperation(op);
+}
+
 void Pipe::Impl::readPayloadsAndReceiveTensorsOfMessage(ReadOperation& op) {
   TP_DCHECK(loop_.inLoop());
   TP_DCHECK_EQ(state_, ESTABLISHED);
@@ -826,31 +1068,28 @@ void Pipe::Impl::readPayloadsAndReceiveTensorsOfMessage(ReadOperation& op) {
              << " is reading payloads and receiving tensors of message #"
              << op.sequenceNumber;
 
-  TP_DCHECK_EQ(connectionState_, AWAITING_PAYLOADS);
-  TP_DCHECK_EQ(messageBeingReadFromConnection_, op.sequenceNumber);
-  for (size_t payloadIdx = 0; payloadIdx < op.message.payloads.size();
-       payloadIdx++) {
-    Message::Payload& payload = op.message.payloads[payloadIdx];
-    TP_VLOG(3) << "Pipe " << id_ << " is reading payload #" << op.sequenceNumber
-               << "." << payloadIdx;
-    connection_->read(
-        payload.data,
-        payload.length,
-        eagerCallbackWrapper_(
-            [&op, payloadIdx](
-                Impl& impl, const void* /* unused */, size_t /* unused */) {
-              TP_VLOG(3) << "Pipe " << impl.id_ << " done reading payload #"
-                         << op.sequenceNumber << "." << payloadIdx;
-              impl.onReadOfPayload(op);
-            }));
-    ++op.numPayloadsBeingRead;
+  // Payloads that were read ahead will be copied once they are all there.
+  if (!op.payloadsStaged) {
+    readPayloadsOfMessage(op);
   }
-  connectionState_ = AWAITING_DESCRIPTOR;
-  ++messageBeingReadFromConnection_;
 
   for (size_t tensorIdx = 0; tensorIdx < op.message.tensors.size();
        tensorIdx++) {
     Message::Tensor& tensor = op.message.tensors[tensorIdx];
+    if (op.tensors[tensorIdx].channelName.empty()) {
+      const std::string& inlineData = op.tensors[tensorIdx].inlineData;
+      TP_DCHECK(tensor.buffer.type == DeviceType::kCpu);
+      TP_DCHECK_EQ(tensor.buffer.cpu.length, inlineData.size());
+      TP_VLOG(3) << "Pipe " << id_ << " is copying inline tensor #"
+                 << op.sequenceNumber << "." << tensorIdx;
+      // Don't even call memcpy on a length of 0 to avoid issues with the
+      // pointer possibly being null.
+      if (!inlineData.empty()) {
+        std::memcpy(
+            tensor.buffer.cpu.ptr, inlineData.data(), inlineData.size());
+      }
+      continue;
+    }
     switchOnDeviceType(
         op.message.tensors[tensorIdx].buffer.type, [&](auto buffer) {
           ReadOperation::Tensor& tensorBeingAllocated = op.tensors[tensorIdx];
@@ -873,42 +1112,126 @@ void Pipe::Impl::readPayloadsAndReceiveTensorsOfMessage(ReadOperation& op) {
   }
 }
 
+void Pipe::Impl::readPayloadsOfMessage(ReadOperation& op) {
+  TP_DCHECK(loop_.inLoop());
+  TP_DCHECK_EQ(state_, ESTABLISHED);
+
+  TP_DCHECK_EQ(connectionState_, AWAITING_PAYLOADS);
+  TP_DCHECK_EQ(messageBeingReadFromConnection_, op.sequenceNumber);
+  if (op.message.payloads.size() == 1) {
+    // Spare ourselves the allocation of a vector for a single buffer.
+    Message::Payload& payload = op.message.payloads[0];
+    TP_VLOG(3) << "Pipe " << id_ << " is reading payloads #"
+               << op.sequenceNumber;
+    connection_->read(
+        payload.data,
+        payload.length,
+        eagerCallbackWrapper_(
+            [&op](Impl& impl, const void* /* unused */, size_t /* unused */) {
+              TP_VLOG(3) << "Pipe " << impl.id_ << " done reading payloads #"
+                         << op.sequenceNumber;
+              impl.onReadOfPayload(op);
+            }));
+    ++op.numPayloadsBeingRead;
+  } else if (!op.message.payloads.empty()) {
+    // Scatter all the payloads directly into the user's buffers with a single
+    // vectored read, which thus counts as one.
+    std::vector<iovec> iovs;
+    iovs.reserve(op.message.payloads.size());
+    for (const Message::Payload& payload : op.message.payloads) {
+      iovs.push_back(iovec{payload.data, payload.length});
+    }
+    TP_VLOG(3) << "Pipe " << id_ << " is reading payloads #"
+               << op.sequenceNumber;
+    connection_->read(
+        std::move(iovs), eagerCallbackWrapper_([&op](Impl& impl) {
+          TP_VLOG(3) << "Pipe " << impl.id_ << " done reading payloads #"
+                     << op.sequenceNumber;
+          impl.onReadOfPayload(op);
+        }));
+    ++op.numPayloadsBeingRead;
+  }
+  connectionState_ = AWAITING_DESCRIPTOR;
+  ++messageBeingReadFromConnection_;
+}
+
+void Pipe::Impl::stagePayloadsOfMessage(ReadOperation& op) {
+  TP_DCHECK(loop_.inLoop());
+  TP_DCHECK_EQ(state_, ESTABLISHED);
+
+  TP_DCHECK_EQ(op.state, ReadOperation::READING_DESCRIPTOR);
+  TP_DCHECK(!op.payloadsStaged);
+  op.payloadsStaged = true;
+  ++numMessagesReadAhead_;
+
+  TP_VLOG(2) << "Pipe " << id_ << " is reading ahead payloads of message #"
+             << op.sequenceNumber;
+
+  size_t payloadsSize = 0;
+  for (const ReadOperation::Payload& payload : op.payloads) {
+    payloadsSize += payload.length;
+  }
+  op.stagingBuffer.resize(payloadsSize);
+
+  // The message that will be given to the readDescriptor callback points to the
+  // staged payloads, so that if the user passes it back as is there will be no
+  // need to copy them. Their contents may not have arrived yet by then, hence
+  // they can only be accessed once the read callback is called.
+  size_t offset = 0;
+  for (Message::Payload& payload : op.message.payloads) {
+    payload.data = op.stagingBuffer.data() + offset;
+    offset += payload.length;
+  }
+
+  readPayloadsOfMessage(op);
+}
+
+void Pipe::Impl::copyStagedPayloadsOfMessage(ReadOperation& op) {
+  TP_DCHECK(loop_.inLoop());
+
+  TP_DCHECK(op.payloadsStaged);
+  TP_DCHECK_EQ(op.numPayloadsBeingRead, 0);
+
+  size_t offset = 0;
+  for (size_t payloadIdx = 0; payloadIdx < op.message.payloads.size();
+       payloadIdx++) {
+    Message::Payload& payload = op.message.payloads[payloadIdx];
+    const uint8_t* stagedData = op.stagingBuffer.data() + offset;
+    // Don't even call memcpy on a length of 0 to avoid issues with the pointer
+    // possibly being null.
+    if (payload.data != stagedData && payload.length > 0) {
+      TP_VLOG(3) << "Pipe " << id_ << " is copying staged payload #"
+                 << op.sequenceNumber << "." << payloadIdx;
+      std::memcpy(payload.data, stagedData, payload.length);
+    }
+    offset += payload.length;
+  }
+}
+
 void Pipe::write(Message message, write_callback_fn fn) {
   impl_->write(std::move(message), std::move(fn));
 }
 
 void Pipe::Impl::write(Message message, write_callback_fn fn) {
-  // Messages aren't copyable and thus if a lambda captures them it cannot be
-  // wrapped in a std::function. Therefore we wrap Messages in shared_ptrs.
-  auto sharedMessage = std::make_shared<Message>(std::move(message));
-  loop_.deferToLoop([this,
-                     sharedMessage{std::move(sharedMessage)},
-                     fn{std::move(fn)}]() mutable {
-    writeFromLoop(std::move(*sharedMessage), std::move(fn));
-  });
+  loop_.deferToLoop(
+      [this, message{std::move(message)}, fn{std::move(fn)}]() mutable {
+        writeFromLoop(std::move(message), std::move(fn));
+      });
 }
 
 void Pipe::Impl::writeFromLoop(Message message, write_callback_fn fn) {
   TP_DCHECK(loop_.inLoop());
 
-  writeOperations_.emplace_back();
-  WriteOperation& op = writeOperations_.back();
+  WriteOperation& op = writeOperations_.pushBack();
+  op.reset();
   op.sequenceNumber = nextMessageBeingWritten_++;
 
   TP_VLOG(1) << "Pipe " << id_ << " received a write request (#"
              << op.sequenceNumber << ", contaning " << message.payloads.size()
              << " payloads and " << message.tensors.size() << " tensors)";
 
-  fn = [this, sequenceNumber{op.sequenceNumber}, fn{std::move(fn)}](
-           const Error& error, Message message) {
-    TP_DCHECK_EQ(sequenceNumber, nextWriteCallbackToCall_++);
-    TP_VLOG(1) << "Pipe " << id_ << " is calling a write callback (#"
-               << sequenceNumber << ")";
-    fn(error, std::move(message));
-    TP_VLOG(1) << "Pipe " << id_ << " done calling a write callback (#"
-               << sequenceNumber << ")";
-  };
-
+  op.independent =
+      message.independent && context_->getOutOfOrderCompletion();
   op.message = std::move(message);
   op.writeCallback = std::move(fn);
 
@@ -931,11 +1254,39 @@ void Pipe::Impl::callReadDescriptorCallback(ReadOperation& op) {
   TP_DCHECK_EQ(op.sequenceNumber, nextMessageAskingForAllocation_);
   ++nextMessageAskingForAllocation_;
 
+  TP_DCHECK_EQ(op.sequenceNumber, nextReadDescriptorCallbackToCall_++);
+  if (op.allocator) {
+    callAllocator(op);
+    return;
+  }
+  TP_VLOG(1) << "Pipe " << id_ << " is calling a readDescriptor callback (#"
+             << op.sequenceNumber << ")";
   op.readDescriptorCallback(error_, std::move(op.message));
+  TP_VLOG(1) << "Pipe " << id_ << " done calling a readDescriptor callback (#"
+             << op.sequenceNumber << ")";
   // Reset callback to release the resources it was holding.
   op.readDescriptorCallback = nullptr;
 }
 
+void Pipe::Impl::callAllocator(ReadOperation& op) {
+  TP_DCHECK(loop_.inLoop());
+
+  TP_DCHECK(op.allocator != nullptr);
+  op.doneGettingAllocation = true;
+  // In case of error there's nothing to read, the read callback will get the
+  // message without any memory.
+  if (!error_) {
+    TP_VLOG(1) << "Pipe " << id_ << " is calling an allocator (#"
+               << op.sequenceNumber << ")";
+    op.allocator(op.message);
+    TP_VLOG(1) << "Pipe " << id_ << " done calling an allocator (#"
+               << op.sequenceNumber << ")";
+    checkAllocationCompatibility(op, op.message);
+  }
+  // Reset allocator to release the resources it was holding.
+  op.allocator = nullptr;
+}
+
 void Pipe::Impl::callReadCallback(ReadOperation& op) {
   TP_DCHECK(loop_.inLoop());
   // Don't check state_ == ESTABLISHED: it can be called after failed handshake
@@ -945,7 +1296,20 @@ void Pipe::Impl::callReadCallback(ReadOperation& op) {
       op.state == ReadOperation::READING_PAYLOADS_AND_RECEIVING_TENSORS);
   op.state = ReadOperation::FINISHED;
 
+  if (op.payloadsStaged && !error_) {
+    copyStagedPayloadsOfMessage(op);
+  }
+
+  // Independent messages may overtake, and be overtaken by, the others.
+  TP_DCHECK(
+      op.sequenceNumber == nextReadCallbackToCall_ ||
+      context_->getOutOfOrderCompletion());
+  ++nextReadCallbackToCall_;
+  TP_VLOG(1) << "Pipe " << id_ << " is calling a read callback (#"
+             << op.sequenceNumber << ")";
   op.readCallback(error_, std::move(op.message));
+  TP_VLOG(1) << "Pipe " << id_ << " done calling a read callback (#"
+             << op.sequenceNumber << ")";
   // Reset callback to release the resources it was holding.
   op.readCallback = nullptr;
 }
@@ -960,7 +1324,16 @@ void Pipe::Impl::callWriteCallback(WriteOperation& op) {
       op.state == WriteOperation::WRITING_PAYLOADS_AND_SENDING_TENSORS);
   op.state = WriteOperation::FINISHED;
 
+  // Independent messages may overtake, and be overtaken by, the others.
+  TP_DCHECK(
+      op.sequenceNumber == nextWriteCallbackToCall_ ||
+      context_->getOutOfOrderCompletion());
+  ++nextWriteCallbackToCall_;
+  TP_VLOG(1) << "Pipe " << id_ << " is calling a write callback (#"
+             << op.sequenceNumber << ")";
   op.writeCallback(error_, std::move(op.message));
+  TP_VLOG(1) << "Pipe " << id_ << " done calling a write callback (#"
+             << op.sequenceNumber << ")";
   // Reset callback to release the resources it was holding.
   op.writeCallback = nullptr;
 }
@@ -1001,6 +1374,19 @@ void Pipe::Impl::handleError() {
     }
     channelRegistrationIds_.get<decltype(buffer)>().clear();
   });
+  for (uint64_t token : rejectedChannelRegistrationIds_) {
+    listener_->unregisterConnectionRequest(token);
+  }
+  rejectedChannelRegistrationIds_.clear();
+
+  // The messages waiting for the next batch will never be written.
+  for (int64_t sequenceNumber = firstMessageInBatch_;
+       sequenceNumber < firstMessageInBatch_ + numMessagesInBatch_;
+       ++sequenceNumber) {
+    findWriteOperation(sequenceNumber)->numPayloadsBeingWritten--;
+  }
+  numMessagesInBatch_ = 0;
+  batchSize_ = 0;
 
   if (!readOperations_.empty()) {
     advanceReadOperation(readOperations_.front());
@@ -1035,10 +1421,23 @@ void Pipe::Impl::startWritingUponEstablishingPipe() {
 void Pipe::Impl::advanceReadOperation(ReadOperation& initialOp) {
   // Advancing one operation may unblock later ones that could have progressed
   // but were prevented from overtaking. Thus each time an operation manages to
-  // advance we'll try to also advance the one after.
+  // advance we'll try to also advance the one after. Operations that others
+  // may overtake when completing (the independent ones, and those that already
+  // completed out of order) don't stop us from trying the ones after them.
   for (int64_t sequenceNumber = initialOp.sequenceNumber;; ++sequenceNumber) {
+    // Those that completed out of order are removed from the queue as soon as
+    // the one before them completes, hence we may need to skip past them.
+    if (!readOperations_.empty() &&
+        sequenceNumber < readOperations_.front().sequenceNumber) {
+      sequenceNumber = readOperations_.front().sequenceNumber;
+    }
     ReadOperation* opPtr = findReadOperation(sequenceNumber);
-    if (opPtr == nullptr || !advanceOneReadOperation(*opPtr)) {
+    if (opPtr == nullptr) {
+      break;
+    }
+    const bool canBeOvertaken =
+        opPtr->independent || opPtr->state == ReadOperation::FINISHED;
+    if (!advanceOneReadOperation(*opPtr) && !canBeOvertaken) {
       break;
     }
   }
@@ -1054,16 +1453,40 @@ bool Pipe::Impl::advanceOneReadOperation(ReadOperation& op) {
   const ReadOperation* prevOpPtr = findReadOperation(op.sequenceNumber - 1);
   const ReadOperation::State prevOpState =
       prevOpPtr != nullptr ? prevOpPtr->state : ReadOperation::FINISHED;
+  // The exception is completing, for which independent operations don't wait
+  // for anyone, and the others only wait for the last earlier operation that
+  // isn't independent (all other steps must stay in order as they share the
+  // connection). This is the same as above unless out-of-order completion is
+  // enabled (see ContextOptions::outOfOrderCompletion).
+  ReadOperation::State prevOpStateForCompletion = ReadOperation::FINISHED;
+  if (!op.independent) {
+    for (int64_t sequenceNumber = op.sequenceNumber - 1;; --sequenceNumber) {
+      const ReadOperation* otherOpPtr = findReadOperation(sequenceNumber);
+      if (otherOpPtr == nullptr) {
+        break;
+      }
+      if (!otherOpPtr->independent) {
+        prevOpStateForCompletion = otherOpPtr->state;
+        break;
+      }
+    }
+  }
+  // An operation whose payloads were read ahead is done with the connection
+  // even though it hasn't reached the state where that usually happens.
+  const bool prevOpPayloadsStaged =
+      prevOpPtr != nullptr && prevOpPtr->payloadsStaged;
 
   // Use this helper to force a very specific structure on our checks, as
   // otherwise we'll be tempted to start merging `if`s, using `else`s, etc.
   // which seem good ideas but hide nasty pitfalls.
-  auto attemptTransition = [this, &op, prevOpState](
+  auto attemptTransition = [this, &op, prevOpState, prevOpStateForCompletion](
                                ReadOperation::State from,
                                ReadOperation::State to,
                                bool cond,
                                void (Impl::*action)(ReadOperation&)) {
-    if (op.state == from && cond && to <= prevOpState) {
+    if (op.state == from && cond &&
+        to <= (to == ReadOperation::FINISHED ? prevOpStateForCompletion
+                                             : prevOpState)) {
       (this->*action)(op);
       TP_DCHECK_EQ(op.state, to);
     }
@@ -1091,8 +1514,10 @@ bool Pipe::Impl::advanceOneReadOperation(ReadOperation& op) {
   attemptTransition(
       /*from=*/ReadOperation::UNINITIALIZED,
       /*to=*/ReadOperation::READING_DESCRIPTOR,
-      /*cond=*/!error_ && state_ == ESTABLISHED &&
-          prevOpState >= ReadOperation::READING_PAYLOADS_AND_RECEIVING_TENSORS,
+      /*cond=*/!error_ && state_ == ESTABLISHED && !optimisticSetupPending_ &&
+          (prevOpState >=
+               ReadOperation::READING_PAYLOADS_AND_RECEIVING_TENSORS ||
+           prevOpPayloadsStaged),
       /*action=*/&Impl::readDescriptorOfMessage);
 
   attemptTransition(
@@ -1104,7 +1529,8 @@ bool Pipe::Impl::advanceOneReadOperation(ReadOperation& op) {
   attemptTransition(
       /*from=*/ReadOperation::ASKING_FOR_ALLOCATION,
       /*to=*/ReadOperation::FINISHED,
-      /*cond=*/error_ && op.doneGettingAllocation,
+      /*cond=*/error_ && op.doneGettingAllocation &&
+          op.numPayloadsBeingRead == 0,
       /*action=*/&Impl::callReadCallback);
 
   attemptTransition(
@@ -1122,9 +1548,11 @@ bool Pipe::Impl::advanceOneReadOperation(ReadOperation& op) {
   // Compute return value now in case we next delete the operation.
   bool hasAdvanced = op.state != initialState;
 
-  if (op.state == ReadOperation::FINISHED) {
-    TP_DCHECK_EQ(readOperations_.front().sequenceNumber, op.sequenceNumber);
-    readOperations_.pop_front();
+  // Operations that completed out of order stay in the queue until all the
+  // earlier ones have completed too.
+  while (!readOperations_.empty() &&
+         readOperations_.front().state == ReadOperation::FINISHED) {
+    readOperations_.popFront();
   }
 
   return hasAdvanced;
@@ -1133,10 +1561,23 @@ bool Pipe::Impl::advanceOneReadOperation(ReadOperation& op) {
 void Pipe::Impl::advanceWriteOperation(WriteOperation& initialOp) {
   // Advancing one operation may unblock later ones that could have progressed
   // but were prevented from overtaking. Thus each time an operation manages to
-  // advance we'll try to also advance the one after.
+  // advance we'll try to also advance the one after. Operations that others
+  // may overtake when completing (the independent ones, and those that already
+  // completed out of order) don't stop us from trying the ones after them.
   for (int64_t sequenceNumber = initialOp.sequenceNumber;; ++sequenceNumber) {
+    // Those that completed out of order are removed from the queue as soon as
+    // the one before them completes, hence we may need to skip past them.
+    if (!writeOperations_.empty() &&
+        sequenceNumber < writeOperations_.front().sequenceNumber) {
+      sequenceNumber = writeOperations_.front().sequenceNumber;
+    }
     WriteOperation* opPtr = findWriteOperation(sequenceNumber);
-    if (opPtr == nullptr || !advanceOneWriteOperation(*opPtr)) {
+    if (opPtr == nullptr) {
+      break;
+    }
+    const bool canBeOvertaken =
+        opPtr->independent || opPtr->state == WriteOperation::FINISHED;
+    if (!advanceOneWriteOperation(*opPtr) && !canBeOvertaken) {
       break;
     }
   }
@@ -1152,16 +1593,36 @@ bool Pipe::Impl::advanceOneWriteOperation(WriteOperation& op) {
   const WriteOperation* prevOpPtr = findWriteOperation(op.sequenceNumber - 1);
   const WriteOperation::State prevOpState =
       prevOpPtr != nullptr ? prevOpPtr->state : WriteOperation::FINISHED;
+  // The exception is completing, for which independent operations don't wait
+  // for anyone, and the others only wait for the last earlier operation that
+  // isn't independent (all other steps must stay in order as they share the
+  // connection). This is the same as above unless out-of-order completion is
+  // enabled (see ContextOptions::outOfOrderCompletion).
+  WriteOperation::State prevOpStateForCompletion = WriteOperation::FINISHED;
+  if (!op.independent) {
+    for (int64_t sequenceNumber = op.sequenceNumber - 1;; --sequenceNumber) {
+      const WriteOperation* otherOpPtr = findWriteOperation(sequenceNumber);
+      if (otherOpPtr == nullptr) {
+        break;
+      }
+      if (!otherOpPtr->independent) {
+        prevOpStateForCompletion = otherOpPtr->state;
+        break;
+      }
+    }
+  }
 
   // Use this helper to force a very specific structure on our checks, as
   // otherwise we'll be tempted to start merging `if`s, using `else`s, etc.
   // which seem good ideas but hide nasty pitfalls.
-  auto attemptTransition = [this, &op, prevOpState](
+  auto attemptTransition = [this, &op, prevOpState, prevOpStateForCompletion](
                                WriteOperation::State from,
                                WriteOperation::State to,
                                bool cond,
                                void (Impl::*action)(WriteOperation&)) {
-    if (op.state == from && cond && to <= prevOpState) {
+    if (op.state == from && cond &&
+        to <= (to == WriteOperation::FINISHED ? prevOpStateForCompletion
+                                              : prevOpState)) {
       (this->*action)(op);
       TP_DCHECK_EQ(op.state, to);
     }
@@ -1208,15 +1669,18 @@ bool Pipe::Impl::advanceOneWriteOperation(WriteOperation& op) {
   attemptTransition(
       /*from=*/WriteOperation::WRITING_PAYLOADS_AND_SENDING_TENSORS,
       /*to=*/WriteOperation::FINISHED,
-      /*cond=*/op.numPayloadsBeingWritten == 0 && op.numTensorsBeingSent == 0,
+      /*cond=*/op.numPayloadsBeingWritten == 0 && op.numTensorsBeingSent == 0 &&
+          (error_ || !optimisticSetupPending_),
       /*action=*/&Impl::callWriteCallback);
 
   // Compute return value now in case we next delete the operation.
   bool hasAdvanced = op.state != initialState;
 
-  if (op.state == WriteOperation::FINISHED) {
-    TP_DCHECK_EQ(writeOperations_.front().sequenceNumber, op.sequenceNumber);
-    writeOperations_.pop_front();
+  // Operations that completed out of order stay in the queue until all the
+  // earlier ones have completed too.
+  while (!writeOperations_.empty() &&
+         writeOperations_.front().state == WriteOperation::FINISHED) {
+    writeOperations_.popFront();
   }
 
   return hasAdvanced;
@@ -1234,16 +1698,23 @@ void Pipe::Impl::readDescriptorOfMessage(ReadOperation& op) {
 
   TP_DCHECK_EQ(connectionState_, AWAITING_DESCRIPTOR);
   TP_DCHECK_EQ(messageBeingReadFromConnection_, op.sequenceNumber);
-  auto nopHolderIn = std::make_shared<NopHolder<Packet>>();
+  // The holder may have been lost by an earlier message that failed.
+  if (op.nopHolderIn == nullptr) {
+    op.nopHolderIn = std::make_unique<NopHolder<Packet>>();
+  }
+  NopHolder<Packet>& nopHolderIn = *op.nopHolderIn;
   TP_VLOG(3) << "Pipe " << id_ << " is reading nop object (message descriptor #"
              << op.sequenceNumber << ")";
   connection_->read(
-      *nopHolderIn, lazyCallbackWrapper_([&op, nopHolderIn](Impl& impl) {
-        TP_VLOG(3) << "Pipe " << impl.id_
-                   << " done reading nop object (message descriptor #"
-                   << op.sequenceNumber << ")";
-        impl.onReadOfMessageDescriptor(op, nopHolderIn->getObject());
-      }));
+      nopHolderIn,
+      lazyCallbackWrapper_(
+          [&op, nopHolderIn{std::move(op.nopHolderIn)}](Impl& impl) mutable {
+            TP_VLOG(3) << "Pipe " << impl.id_
+                       << " done reading nop object (message descriptor #"
+                       << op.sequenceNumber << ")";
+            op.nopHolderIn = std::move(nopHolderIn);
+            impl.onReadOfMessageDescriptor(op, op.nopHolderIn->getObject());
+          }));
   connectionState_ = AWAITING_PAYLOADS;
 }
 
@@ -1260,23 +1731,49 @@ void Pipe::Impl::sendTensorsOfMessage(WriteOperation& op) {
   for (int tensorIdx = 0; tensorIdx < op.message.tensors.size(); ++tensorIdx) {
     const auto& tensor = op.message.tensors[tensorIdx];
 
+    if (tensor.buffer.type == DeviceType::kCpu &&
+        tensor.buffer.cpu.length < context_->getInlineTensorThreshold()) {
+      TP_VLOG(3) << "Pipe " << id_ << " is inlining tensor #"
+                 << op.sequenceNumber << "." << tensorIdx;
+      op.tensors.push_back(WriteOperation::Tensor{DeviceType::kCpu, ""});
+      continue;
+    }
+
     auto t = switchOnDeviceType(tensor.buffer.type, [&](auto buffer) {
       auto& orderedChannels = this->getOrderedChannels<decltype(buffer)>();
       auto& availableChannels = channels_.get<decltype(buffer)>();
+      const size_t length = unwrap<decltype(buffer)>(tensor.buffer).length;
+
+      // Pick the available channel with the highest priority among those that
+      // accept tensors of this size, or with the highest priority overall if
+      // none of them does.
+      auto channelIter = availableChannels.end();
       for (const auto& channelContextIter : orderedChannels) {
         const std::string& channelName = std::get<0>(channelContextIter.second);
-        auto channelIter = availableChannels.find(channelName);
-        if (channelIter == availableChannels.cend()) {
+        auto iter = availableChannels.find(channelName);
+        if (iter == availableChannels.end()) {
           continue;
         }
+        if (channelIter == availableChannels.end()) {
+          channelIter = iter;
+        }
+        if (context_->channelAcceptsTensorOfSize(channelName, length)) {
+          channelIter = iter;
+          break;
+        }
+      }
+
+      if (channelIter != availableChannels.end()) {
+        const std::string& channelName = channelIter->first;
         auto& channel = *(channelIter->second);
 
         TP_VLOG(3) << "Pipe " << id_ << " is sending tensor #"
-                   << op.sequenceNumber << "." << tensorIdx;
+                   << op.sequenceNumber << "." << tensorIdx << " (of "
+                   << length << " bytes) over channel " << channelName;
 
         channel.send(
             unwrap<decltype(buffer)>(tensor.buffer),
-            eagerCallbackWrapper_(
+            this->setupAttemptCallbackWrapper</*kEager=*/true>(
                 [&op, tensorIdx](Impl& impl, channel::TDescriptor descriptor) {
                   TP_VLOG(3)
                       << "Pipe " << impl.id_ << " got tensor descriptor #"
@@ -1284,11 +1781,12 @@ void Pipe::Impl::sendTensorsOfMessage(WriteOperation& op) {
                   impl.onDescriptorOfTensor(
                       op, tensorIdx, std::move(descriptor));
                 }),
-            eagerCallbackWrapper_([&op, tensorIdx](Impl& impl) {
-              TP_VLOG(3) << "Pipe " << impl.id_ << " done sending tensor #"
-                         << op.sequenceNumber << "." << tensorIdx;
-              impl.onSendOfTensor(op);
-            }));
+            this->setupAttemptCallbackWrapper</*kEager=*/true>(
+                [&op, tensorIdx](Impl& impl) {
+                  TP_VLOG(3) << "Pipe " << impl.id_ << " done sending tensor #"
+                             << op.sequenceNumber << "." << tensorIdx;
+                  impl.onSendOfTensor(op);
+                }));
         return WriteOperation::Tensor{tensor.buffer.type, channelName};
       }
 
@@ -1310,38 +1808,283 @@ void Pipe::Impl::writeDescriptorAndPayloadsOfMessage(WriteOperation& op) {
       op.state, WriteOperation::SENDING_TENSORS_AND_COLLECTING_DESCRIPTORS);
   op.state = WriteOperation::WRITING_PAYLOADS_AND_SENDING_TENSORS;
 
+  if (context_->getWriteBatchMaxSize() > 0) {
+    addMessageToBatch(op);
+    return;
+  }
+
   TP_VLOG(2) << "Pipe " << id_
              << " is writing descriptor and payloads of message #"
              << op.sequenceNumber;
 
-  std::shared_ptr<NopHolder<Packet>> holder = makeDescriptorForMessage(op);
+  makeDescriptorForMessage(op);
+
+  // Serialize the descriptor ourselves so that it can be written together with
+  // the payloads, in a single vectored write, which the transport can coalesce
+  // into one syscall or ringbuffer transaction. The buffers keep their capacity
+  // from earlier messages, unless they were lost by one that was abandoned.
+  if (op.writeBuffers == nullptr) {
+    op.writeBuffers = std::make_unique<WriteOperation::WriteBuffers>();
+  }
+  WriteOperation::WriteBuffers& buffers = *op.writeBuffers;
+  const size_t descriptorLength = op.nopHolderOut.getSize();
+  buffers.descriptor.resize(descriptorLength);
+  uint8_t* descriptorPtr = buffers.descriptor.data();
+  NopWriter writer(descriptorPtr, descriptorLength);
+  nop::Status<void> status = op.nopHolderOut.write(writer);
+  TP_THROW_ASSERT_IF(status.has_error())
+      << "Error writing nop object: " << status.GetErrorMessage();
+
+  buffers.iovs.clear();
+  buffers.iovs.push_back(iovec{descriptorPtr, descriptorLength});
+  for (const Message::Payload& payload : op.message.payloads) {
+    buffers.iovs.push_back(iovec{payload.data, payload.length});
+  }
+  const iovec* iovs = buffers.iovs.data();
+  const size_t numIovs = buffers.iovs.size();
 
-  TP_VLOG(3) << "Pipe " << id_ << " is writing nop object (message descriptor #"
+  auto fn = setupAttemptCallbackWrapper</*kEager=*/true>(
+      [&op, writeBuffers{std::move(op.writeBuffers)}](Impl& impl) mutable {
+        TP_VLOG(3) << "Pipe " << impl.id_
+                   << " done writing nop object and payloads (message "
+                   << "descriptor #" << op.sequenceNumber << ")";
+        op.writeBuffers = std::move(writeBuffers);
+        impl.onWriteOfPayload(op);
+      });
+
+  TP_VLOG(3) << "Pipe " << id_
+             << " is writing nop object and payloads (message descriptor #"
              << op.sequenceNumber << ")";
+  if (numIovs == 1) {
+    connection_->write(descriptorPtr, descriptorLength, std::move(fn));
+  } else {
+    connection_->writeArray(iovs, numIovs, std::move(fn));
+  }
+  // The payloads are all written by the same operation, so they count as one.
+  ++op.numPayloadsBeingWritten;
+}
+
+void Pipe::Impl::addMessageToBatch(WriteOperation& op) {
+  TP_DCHECK(loop_.inLoop());
+  TP_DCHECK_EQ(state_, ESTABLISHED);
+
+  TP_DCHECK_EQ(op.state, WriteOperation::WRITING_PAYLOADS_AND_SENDING_TENSORS);
+
+  TP_VLOG(2) << "Pipe " << id_ << " is adding message #" << op.sequenceNumber
+             << " to the batch of messages to write";
+
+  // The descriptor is only serialized when the batch is written, but it must be
+  // filled in now, as the tensor descriptors are moved into it.
+  makeDescriptorForMessage(op);
+
+  if (numMessagesInBatch_ == 0) {
+    firstMessageInBatch_ = op.sequenceNumber;
+  }
+  TP_DCHECK_EQ(op.sequenceNumber, firstMessageInBatch_ + numMessagesInBatch_);
+  ++numMessagesInBatch_;
+  batchSize_ += op.nopHolderOut.getSize();
+  for (const Message::Payload& payload : op.message.payloads) {
+    batchSize_ += payload.length;
+  }
+  // The whole message is written by the batch's write, hence it counts as one.
+  ++op.numPayloadsBeingWritten;
+
+  // Only wait for more messages if there's a write to wait for, and some room.
+  if (numBatchesBeingWritten_ == 0 ||
+      batchSize_ >= context_->getWriteBatchMaxSize()) {
+    writeBatchOfMessages();
+  }
+}
+
+void Pipe::Impl::writeBatchOfMessages() {
+  TP_DCHECK(loop_.inLoop());
+  TP_DCHECK_EQ(state_, ESTABLISHED);
+
+  TP_DCHECK_GT(numMessagesInBatch_, 0);
+  const int64_t firstMessage = firstMessageInBatch_;
+  const int64_t numMessages = numMessagesInBatch_;
+  numMessagesInBatch_ = 0;
+  batchSize_ = 0;
+
+  TP_VLOG(2) << "Pipe " << id_ << " is writing descriptors and payloads of "
+             << "messages #" << firstMessage << " to #"
+             << firstMessage + numMessages - 1;
+
+  size_t descriptorsLength = 0;
+  size_t numIovs = 0;
+  for (int64_t sequenceNumber = firstMessage;
+       sequenceNumber < firstMessage + numMessages;
+       ++sequenceNumber) {
+    const WriteOperation& op = *findWriteOperation(sequenceNumber);
+    descriptorsLength += op.nopHolderOut.getSize();
+    numIovs += 1 + op.message.payloads.size();
+  }
+
+  // Each descriptor and payload is still framed on its own, exactly as if the
+  // messages had been written one by one, but they all go in a single vectored
+  // write. The buffer may have been lost by a batch that was abandoned.
+  std::vector<uint8_t> descriptorsBuf = std::move(batchBuf_);
+  descriptorsBuf.resize(descriptorsLength);
+  std::vector<iovec> iovs;
+  iovs.reserve(numIovs);
+  size_t offset = 0;
+  for (int64_t sequenceNumber = firstMessage;
+       sequenceNumber < firstMessage + numMessages;
+       ++sequenceNumber) {
+    const WriteOperation& op = *findWriteOperation(sequenceNumber);
+    const size_t descriptorLength = op.nopHolderOut.getSize();
+    uint8_t* descriptorPtr = descriptorsBuf.data() + offset;
+    NopWriter writer(descriptorPtr, descriptorLength);
+    nop::Status<void> status = op.nopHolderOut.write(writer);
+    TP_THROW_ASSERT_IF(status.has_error())
+        << "Error writing nop object: " << status.GetErrorMessage();
+    iovs.push_back(iovec{descriptorPtr, descriptorLength});
+    for (const Message::Payload& payload : op.message.payloads) {
+      iovs.push_back(iovec{payload.data, payload.length});
+    }
+    offset += descriptorLength;
+  }
+
   connection_->write(
-      *holder,
-      lazyCallbackWrapper_(
-          [sequenceNumber{op.sequenceNumber}, holder](Impl& impl) {
+      std::move(iovs),
+      setupAttemptCallbackWrapper</*kEager=*/true>(
+          [firstMessage,
+           numMessages,
+           descriptorsBuf{std::move(descriptorsBuf)}](Impl& impl) mutable {
             TP_VLOG(3) << "Pipe " << impl.id_
-                       << " done writing nop object (message descriptor #"
-                       << sequenceNumber << ")";
+                       << " done writing descriptors and payloads of "
+                       << "messages #" << firstMessage << " to #"
+                       << firstMessage + numMessages - 1;
+            impl.batchBuf_ = std::move(descriptorsBuf);
+            impl.onWriteOfBatch(firstMessage, numMessages);
           }));
+  ++numBatchesBeingWritten_;
+}
 
-  for (size_t payloadIdx = 0; payloadIdx < op.message.payloads.size();
-       payloadIdx++) {
-    Message::Payload& payload = op.message.payloads[payloadIdx];
-    TP_VLOG(3) << "Pipe " << id_ << " is writing payload #" << op.sequenceNumber
-               << "." << payloadIdx;
-    connection_->write(
-        payload.data,
-        payload.length,
-        eagerCallbackWrapper_([&op, payloadIdx](Impl& impl) {
-          TP_VLOG(3) << "Pipe " << impl.id_ << " done writing payload #"
-                     << op.sequenceNumber << "." << payloadIdx;
-          impl.onWriteOfPayload(op);
-        }));
-    ++op.numPayloadsBeingWritten;
+void Pipe::Impl::writeHelloAndBrochure() {
+  TP_DCHECK(loop_.inLoop());
+  TP_DCHECK_EQ(state_, CLIENT_ABOUT_TO_SEND_HELLO_AND_BROCHURE);
+
+  auto nopHolderOut = std::make_shared<NopHolder<Packet>>();
+  Packet& nopPacketOut = nopHolderOut->getObject();
+  nopPacketOut.Become(nopPacketOut.index_of<SpontaneousConnection>());
+  SpontaneousConnection& nopSpontaneousConnection =
+      *nopPacketOut.get<SpontaneousConnection>();
+  nopSpontaneousConnection.contextName = context_->getName();
+  TP_VLOG(3) << "Pipe " << id_
+             << " is writing nop object (spontaneous connection)";
+  connection_->write(
+      *nopHolderOut,
+      setupAttemptCallbackWrapper</*kEager=*/false>(
+          [nopHolderOut](Impl& impl) {
+            TP_VLOG(3) << "Pipe " << impl.id_
+                       << " done writing nop object (spontaneous connection)";
+          }));
+
+  auto nopHolderOut2 = std::make_shared<NopHolder<Packet>>();
+  Packet& nopPacketOut2 = nopHolderOut2->getObject();
+  nopPacketOut2.Become(nopPacketOut2.index_of<Brochure>());
+  Brochure& nopBrochure = *nopPacketOut2.get<Brochure>();
+  for (const auto& transportContextIter : context_->getOrderedTransports()) {
+    const std::string& transportName =
+        std::get<0>(transportContextIter.second);
+    const transport::Context& transportContext =
+        *(std::get<1>(transportContextIter.second));
+    TransportAdvertisement& nopTransportAdvertisement =
+        nopBrochure.transportAdvertisement[transportName];
+    nopTransportAdvertisement.domainDescriptor =
+        transportContext.domainDescriptor();
+  }
+  forEachDeviceType([&](auto buffer) {
+    for (const auto& channelContextIter :
+         this->getOrderedChannels<decltype(buffer)>()) {
+      const std::string& channelName = std::get<0>(channelContextIter.second);
+      const channel::Context<decltype(buffer)>& channelContext =
+          *(std::get<1>(channelContextIter.second));
+      auto& nopChannelAdvertisementMap =
+          getChannelAdvertisement<decltype(buffer)>(nopBrochure);
+      ChannelAdvertisement& nopChannelAdvertisement =
+          nopChannelAdvertisementMap[channelName];
+      nopChannelAdvertisement.domainDescriptor =
+          channelContext.domainDescriptor();
+    }
+  });
+
+  if (cachedBrochureAnswer_.has_value()) {
+    TP_VLOG(2) << "Pipe " << id_ << " is optimistically setting up transport "
+               << transport_ << " and its channels as last time";
+    nopBrochure.optimistic = true;
+    forEachDeviceType([&](auto buffer) {
+      for (const std::string& channelName :
+           cachedBrochureAnswer_->channels.get<decltype(buffer)>()) {
+        uint64_t token = generateRemoteRegistrationId();
+        this->openChannel<decltype(buffer)>(
+            channelName, cachedBrochureAnswer_->address, token);
+        auto& nopChannelSelectionMap =
+            getOptimisticChannelSelection<decltype(buffer)>(nopBrochure);
+        ChannelSelection& nopChannelSelection =
+            nopChannelSelectionMap[channelName];
+        nopChannelSelection.registrationId = token;
+      }
+    });
+  }
+
+  TP_VLOG(3) << "Pipe " << id_ << " is writing nop object (brochure)";
+  connection_->write(
+      *nopHolderOut2,
+      setupAttemptCallbackWrapper</*kEager=*/false>(
+          [nopHolderOut2](Impl& impl) {
+            TP_VLOG(3) << "Pipe " << impl.id_
+                       << " done writing nop object (brochure)";
+          }));
+  auto nopHolderIn = std::make_shared<NopHolder<Packet>>();
+  TP_VLOG(3) << "Pipe " << id_ << " is reading nop object (brochure answer)";
+  connection_->read(
+      *nopHolderIn,
+      setupAttemptCallbackWrapper</*kEager=*/false>([nopHolderIn](Impl& impl) {
+        TP_VLOG(3) << "Pipe " << impl.id_
+                   << " done reading nop object (brochure answer)";
+        impl.onReadWhileClientWaitingForBrochureAnswer(
+            nopHolderIn->getObject());
+      }));
+
+  if (cachedBrochureAnswer_.has_value()) {
+    cachedBrochureAnswer_.reset();
+    optimisticSetupPending_ = true;
+    state_ = ESTABLISHED;
+    startWritingUponEstablishingPipe();
+  } else {
+    state_ = CLIENT_WAITING_FOR_BROCHURE_ANSWER;
+  }
+}
+
+template <typename TBuffer>
+std::vector<std::string> Pipe::Impl::selectChannels(
+    const Brochure& nopBrochure) {
+  std::vector<std::string> channelNames;
+  for (const auto& channelContextIter : getOrderedChannels<TBuffer>()) {
+    const std::string& channelName = std::get<0>(channelContextIter.second);
+    const channel::Context<TBuffer>& channelContext =
+        *(std::get<1>(channelContextIter.second));
+
+    const auto& nopChannelAdvertisementMap =
+        getChannelAdvertisement<TBuffer>(nopBrochure);
+    const auto nopChannelAdvertisementIter =
+        nopChannelAdvertisementMap.find(channelName);
+    if (nopChannelAdvertisementIter == nopChannelAdvertisementMap.cend()) {
+      continue;
+    }
+    const ChannelAdvertisement& nopChannelAdvertisement =
+        nopChannelAdvertisementIter->second;
+    const std::string& domainDescriptor =
+        nopChannelAdvertisement.domainDescriptor;
+    if (domainDescriptor != channelContext.domainDescriptor()) {
+      continue;
+    }
+
+    channelNames.push_back(channelName);
   }
+  return channelNames;
 }
 
 void Pipe::Impl::onReadWhileServerWaitingForBrochure(
@@ -1389,67 +2132,87 @@ void Pipe::Impl::onReadWhileServerWaitingForBrochure(
     nopBrochureAnswer.transport = transportName;
     nopBrochureAnswer.address = address;
 
-    if (transportName != transport_) {
-      transport_ = transportName;
-      TP_DCHECK(!registrationId_.has_value());
-      TP_VLOG(3) << "Pipe " << id_
-                 << " is requesting connection (as replacement)";
-      uint64_t token =
-          listener_->registerConnectionRequest(lazyCallbackWrapper_(
-              [](Impl& impl,
-                 std::string transport,
-                 std::shared_ptr<transport::Connection> connection) {
-                TP_VLOG(3) << "Pipe " << impl.id_
-                           << " done requesting connection (as replacement)";
-                impl.onAcceptWhileServerWaitingForConnection(
-                    std::move(transport), std::move(connection));
-              }));
-      registrationId_.emplace(token);
-      needToWaitForConnections = true;
-      nopBrochureAnswer.registrationId = token;
-    }
-
     foundATransport = true;
     break;
   }
   TP_THROW_ASSERT_IF(!foundATransport);
 
+  // An optimistic client has already set up the pipe as we did last time, and
+  // we can only go along with it if we would end up with the same setup.
+  bool acceptOptimisticSetup =
+      nopBrochure.optimistic && nopBrochureAnswer.transport == transport_;
   forEachDeviceType([&](auto buffer) {
-    for (const auto& channelContextIter :
-         this->getOrderedChannels<decltype(buffer)>()) {
-      const std::string& channelName = std::get<0>(channelContextIter.second);
-      const channel::Context<decltype(buffer)>& channelContext =
-          *(std::get<1>(channelContextIter.second));
-
-      const auto& nopChannelAdvertisementMap =
-          getChannelAdvertisement<decltype(buffer)>(nopBrochure);
-      const auto nopChannelAdvertisementIter =
-          nopChannelAdvertisementMap.find(channelName);
-      if (nopChannelAdvertisementIter == nopChannelAdvertisementMap.cend()) {
-        continue;
-      }
-      const ChannelAdvertisement& nopChannelAdvertisement =
-          nopChannelAdvertisementIter->second;
-      const std::string& domainDescriptor =
-          nopChannelAdvertisement.domainDescriptor;
-      if (domainDescriptor != channelContext.domainDescriptor()) {
-        continue;
+    const auto& nopChannelSelectionMap =
+        getOptimisticChannelSelection<decltype(buffer)>(nopBrochure);
+    const std::vector<std::string> channelNames =
+        this->selectChannels<decltype(buffer)>(nopBrochure);
+    if (channelNames.size() != nopChannelSelectionMap.size()) {
+      acceptOptimisticSetup = false;
+    }
+    for (const std::string& channelName : channelNames) {
+      auto nopChannelSelectionIter = nopChannelSelectionMap.find(channelName);
+      if (nopChannelSelectionIter == nopChannelSelectionMap.cend() ||
+          !(nopChannelSelectionIter->second.registrationId &
+            kRemoteRegistrationIdBit)) {
+        acceptOptimisticSetup = false;
       }
+    }
+  });
+  nopBrochureAnswer.optimisticSetupAccepted = acceptOptimisticSetup;
+  if (nopBrochure.optimistic) {
+    TP_VLOG(2) << "Pipe " << id_ << " is "
+               << (acceptOptimisticSetup ? "accepting" : "rejecting")
+               << " the optimistic setup of the client";
+  }
 
+  // When rejecting an optimistic setup, the current connection may contain
+  // messages we cannot make sense of, hence we need a new one in any case.
+  if (nopBrochureAnswer.transport != transport_ ||
+      (nopBrochure.optimistic && !acceptOptimisticSetup)) {
+    transport_ = nopBrochureAnswer.transport;
+    TP_DCHECK(!registrationId_.has_value());
+    TP_VLOG(3) << "Pipe " << id_
+               << " is requesting connection (as replacement)";
+    uint64_t token = listener_->registerConnectionRequest(lazyCallbackWrapper_(
+        [](Impl& impl,
+           std::string transport,
+           std::shared_ptr<transport::Connection> connection) {
+          TP_VLOG(3) << "Pipe " << impl.id_
+                     << " done requesting connection (as replacement)";
+          impl.onAcceptWhileServerWaitingForConnection(
+              std::move(transport), std::move(connection));
+        }));
+    registrationId_.emplace(token);
+    needToWaitForConnections = true;
+    nopBrochureAnswer.registrationId = token;
+  }
+
+  forEachDeviceType([&](auto buffer) {
+    const auto& nopOptimisticChannelSelectionMap =
+        getOptimisticChannelSelection<decltype(buffer)>(nopBrochure);
+    for (const std::string& channelName :
+         this->selectChannels<decltype(buffer)>(nopBrochure)) {
       TP_VLOG(3) << "Pipe " << id_ << " is requesting connection (for channel "
                  << channelName << ")";
-      uint64_t token =
-          listener_->registerConnectionRequest(lazyCallbackWrapper_(
-              [channelName](
-                  Impl& impl,
-                  std::string transport,
-                  std::shared_ptr<transport::Connection> connection) {
-                TP_VLOG(3) << "Pipe " << impl.id_
-                           << " done requesting connection (for channel "
-                           << channelName << ")";
-                impl.onAcceptWhileServerWaitingForChannel<decltype(buffer)>(
-                    channelName, std::move(transport), std::move(connection));
-              }));
+      auto fn = lazyCallbackWrapper_(
+          [channelName](
+              Impl& impl,
+              std::string transport,
+              std::shared_ptr<transport::Connection> connection) {
+            TP_VLOG(3) << "Pipe " << impl.id_
+                       << " done requesting connection (for channel "
+                       << channelName << ")";
+            impl.onAcceptWhileServerWaitingForChannel<decltype(buffer)>(
+                channelName, std::move(transport), std::move(connection));
+          });
+      uint64_t token;
+      if (acceptOptimisticSetup) {
+        token =
+            nopOptimisticChannelSelectionMap.at(channelName).registrationId;
+        listener_->registerConnectionRequest(token, std::move(fn));
+      } else {
+        token = listener_->registerConnectionRequest(std::move(fn));
+      }
       channelRegistrationIds_.get<decltype(buffer)>()[channelName] = token;
       needToWaitForConnections = true;
       auto& nopChannelSelectionMap =
@@ -1458,6 +2221,29 @@ void Pipe::Impl::onReadWhileServerWaitingForBrochure(
           nopChannelSelectionMap[channelName];
       nopChannelSelection.registrationId = token;
     }
+
+    // The connections that the client opened for a rejected setup will still
+    // reach the listener, which will hold on to them until claimed, hence we
+    // claim them only to close them.
+    if (nopBrochure.optimistic && !acceptOptimisticSetup) {
+      for (const auto& nopChannelSelectionIter :
+           nopOptimisticChannelSelectionMap) {
+        const uint64_t token = nopChannelSelectionIter.second.registrationId;
+        if (!(token & kRemoteRegistrationIdBit)) {
+          continue;
+        }
+        listener_->registerConnectionRequest(
+            token,
+            [](const Error& /* unused */,
+               std::string /* unused */,
+               std::shared_ptr<transport::Connection> connection) {
+              if (connection) {
+                connection->close();
+              }
+            });
+        rejectedChannelRegistrationIds_.push_back(token);
+      }
+    }
   });
 
   TP_VLOG(3) << "Pipe " << id_ << " is writing nop object (brochure answer)";
@@ -1490,22 +2276,74 @@ std::shared_ptr<channel::Context<CudaBuffer>> Pipe::Impl::getChannelContext(
 }
 #endif // TENSORPIPE_SUPPORTS_CUDA
 
+template <typename TBuffer>
+void Pipe::Impl::openChannel(
+    const std::string& channelName,
+    const std::string& address,
+    uint64_t token) {
+  std::shared_ptr<channel::Context<TBuffer>> channelContext =
+      getChannelContext<TBuffer>(channelName);
+
+  TP_VLOG(3) << "Pipe " << id_ << " is opening connection (for channel "
+             << channelName << ")";
+  std::shared_ptr<transport::Connection> connection =
+      context_->connect(transport_, address);
+  connection->setId(id_ + ".ch_" + channelName);
+
+  auto nopHolderOut = std::make_shared<NopHolder<Packet>>();
+  Packet& nopPacketOut = nopHolderOut->getObject();
+  nopPacketOut.Become(nopPacketOut.index_of<RequestedConnection>());
+  RequestedConnection& nopRequestedConnection =
+      *nopPacketOut.get<RequestedConnection>();
+  nopRequestedConnection.registrationId = token;
+  TP_VLOG(3) << "Pipe " << id_
+             << " is writing nop object (requested connection)";
+  connection->write(
+      *nopHolderOut,
+      setupAttemptCallbackWrapper</*kEager=*/false>(
+          [nopHolderOut](Impl& impl) {
+            TP_VLOG(3) << "Pipe " << impl.id_
+                       << " done writing nop object (requested connection)";
+          }));
+
+  std::shared_ptr<channel::Channel<TBuffer>> channel =
+      channelContext->createChannel(
+          std::move(connection), channel::Endpoint::kConnect);
+  channel->setId(id_ + ".ch_" + channelName);
+  channels_.get<TBuffer>().emplace(channelName, std::move(channel));
+}
+
 void Pipe::Impl::onReadWhileClientWaitingForBrochureAnswer(
     const Packet& nopPacketIn) {
   TP_DCHECK(loop_.inLoop());
-  TP_DCHECK_EQ(state_, CLIENT_WAITING_FOR_BROCHURE_ANSWER);
+  TP_DCHECK(
+      state_ == CLIENT_WAITING_FOR_BROCHURE_ANSWER || optimisticSetupPending_);
   TP_DCHECK_EQ(nopPacketIn.index(), nopPacketIn.index_of<BrochureAnswer>());
 
   const BrochureAnswer& nopBrochureAnswer = *nopPacketIn.get<BrochureAnswer>();
   const std::string& transport = nopBrochureAnswer.transport;
-  std::string address = nopBrochureAnswer.address;
-  std::shared_ptr<transport::Context> transportContext =
-      context_->getTransport(transport);
+  const std::string& address = nopBrochureAnswer.address;
+
+  bool needToReplaceConnection = transport != transport_;
+  if (optimisticSetupPending_) {
+    if (nopBrochureAnswer.optimisticSetupAccepted) {
+      TP_VLOG(2) << "Pipe " << id_ << " got its optimistic setup accepted";
+      optimisticSetupPending_ = false;
+      startReadingUponEstablishingPipe();
+      startWritingUponEstablishingPipe();
+      return;
+    }
+    TP_VLOG(2) << "Pipe " << id_ << " got its optimistic setup rejected";
+    abandonOptimisticSetup();
+    // The server always asks for a new connection in this case, as the one we
+    // have may contain messages it won't read.
+    needToReplaceConnection = true;
+  }
 
-  if (transport != transport_) {
+  if (needToReplaceConnection) {
     TP_VLOG(3) << "Pipe " << id_ << " is opening connection (as replacement)";
     std::shared_ptr<transport::Connection> connection =
-        transportContext->connect(address);
+        context_->connect(transport, address);
     connection->setId(id_ + ".tr_" + transport);
     auto nopHolderOut = std::make_shared<NopHolder<Packet>>();
     Packet& nopPacketOut = nopHolderOut->getObject();
@@ -1532,45 +2370,81 @@ void Pipe::Impl::onReadWhileClientWaitingForBrochureAnswer(
       const std::string& channelName = nopChannelSelectionIter.first;
       const ChannelSelection& nopChannelSelection =
           nopChannelSelectionIter.second;
-
-      std::shared_ptr<channel::Context<decltype(buffer)>> channelContext =
-          this->getChannelContext<decltype(buffer)>(channelName);
-
-      TP_VLOG(3) << "Pipe " << id_ << " is opening connection (for channel "
-                 << channelName << ")";
-      std::shared_ptr<transport::Connection> connection =
-          transportContext->connect(address);
-      connection->setId(id_ + ".ch_" + channelName);
-
-      auto nopHolderOut = std::make_shared<NopHolder<Packet>>();
-      Packet& nopPacketOut = nopHolderOut->getObject();
-      nopPacketOut.Become(nopPacketOut.index_of<RequestedConnection>());
-      RequestedConnection& nopRequestedConnection =
-          *nopPacketOut.get<RequestedConnection>();
-      uint64_t token = nopChannelSelection.registrationId;
-      nopRequestedConnection.registrationId = token;
-      TP_VLOG(3) << "Pipe " << id_
-                 << " is writing nop object (requested connection)";
-      connection->write(
-          *nopHolderOut, lazyCallbackWrapper_([nopHolderOut](Impl& impl) {
-            TP_VLOG(3) << "Pipe " << impl.id_
-                       << " done writing nop object (requested connection)";
-          }));
-
-      std::shared_ptr<channel::Channel<decltype(buffer)>> channel =
-          channelContext->createChannel(
-              std::move(connection), channel::Endpoint::kConnect);
-      channel->setId(id_ + ".ch_" + channelName);
-      channels_.get<decltype(buffer)>().emplace(
-          channelName, std::move(channel));
+      this->openChannel<decltype(buffer)>(
+          channelName, address, nopChannelSelection.registrationId);
     }
   });
 
+  cacheBrochureAnswer(nopBrochureAnswer);
+
   state_ = ESTABLISHED;
   startReadingUponEstablishingPipe();
   startWritingUponEstablishingPipe();
 }
 
+void Pipe::Impl::abandonOptimisticSetup() {
+  TP_DCHECK(loop_.inLoop());
+  TP_DCHECK(optimisticSetupPending_);
+  TP_VLOG(2) << "Pipe " << id_ << " is abandoning its optimistic setup";
+
+  ++setupAttempt_;
+  optimisticSetupPending_ = false;
+  state_ = CLIENT_WAITING_FOR_BROCHURE_ANSWER;
+
+  connection_->close();
+  forEachDeviceType([&](auto buffer) {
+    for (auto& channelIter : channels_.get<decltype(buffer)>()) {
+      channelIter.second->close();
+    }
+    channels_.get<decltype(buffer)>().clear();
+  });
+
+  // None of the writes could complete without the server's confirmation, and
+  // they'll all be started over once the pipe is established for real.
+  for (size_t opIdx = 0; opIdx < writeOperations_.size(); ++opIdx) {
+    WriteOperation& op = writeOperations_[opIdx];
+    TP_DCHECK_NE(op.state, WriteOperation::FINISHED);
+    op.state = WriteOperation::UNINITIALIZED;
+    op.numPayloadsBeingWritten = 0;
+    op.numTensorDescriptorsBeingCollected = 0;
+    op.numTensorsBeingSent = 0;
+    op.tensors.clear();
+  }
+  numMessagesInBatch_ = 0;
+  batchSize_ = 0;
+  numBatchesBeingWritten_ = 0;
+}
+
+void Pipe::Impl::retryWithoutOptimisticSetup() {
+  TP_DCHECK(loop_.inLoop());
+
+  // The cached answer may be stale (the server may have restarted elsewhere, or
+  // be gone), hence we start over from the URL the user gave us.
+  context_->forgetBrochureAnswer(url_, remoteName_);
+  abandonOptimisticSetup();
+
+  std::string address;
+  std::tie(transport_, address) = splitSchemeOfURL(url_);
+  connection_ = context_->connect(transport_, address);
+  connection_->setId(id_ + ".tr_" + transport_);
+  state_ = CLIENT_ABOUT_TO_SEND_HELLO_AND_BROCHURE;
+  writeHelloAndBrochure();
+}
+
+void Pipe::Impl::cacheBrochureAnswer(const BrochureAnswer& nopBrochureAnswer) {
+  Context::PrivateIface::CachedBrochureAnswer answer;
+  answer.transport = nopBrochureAnswer.transport;
+  answer.address = nopBrochureAnswer.address;
+  forEachDeviceType([&](auto buffer) {
+    for (const auto& nopChannelSelectionIter :
+         getChannelSelection<decltype(buffer)>(nopBrochureAnswer)) {
+      answer.channels.get<decltype(buffer)>().push_back(
+          nopChannelSelectionIter.first);
+    }
+  });
+  context_->cacheBrochureAnswer(url_, remoteName_, std::move(answer));
+}
+
 void Pipe::Impl::onAcceptWhileServerWaitingForConnection(
     std::string receivedTransport,
     std::shared_ptr<transport::Connection> receivedConnection) {
@@ -1627,13 +2501,34 @@ void Pipe::Impl::onAcceptWhileServerWaitingForChannel(
 
 void Pipe::Impl::onReadOfMessageDescriptor(
     ReadOperation& op,
-    const Packet& nopPacketIn) {
+    Packet& nopPacketIn) {
   TP_DCHECK(loop_.inLoop());
   TP_DCHECK_EQ(state_, ESTABLISHED);
 
   TP_DCHECK_EQ(op.state, ReadOperation::READING_DESCRIPTOR);
-  parseDescriptorOfMessage(op, nopPacketIn);
+  Error error = parseDescriptorOfMessage(op, nopPacketIn);
   op.doneReadingDescriptor = true;
+  if (error) {
+    // This advances all operations, including this one.
+    setError(std::move(error));
+    return;
+  }
+  op.independent =
+      op.message.independent && context_->getOutOfOrderCompletion();
+
+  // Unless we're too far ahead already, read small payloads right away, so
+  // that the next descriptor can be read while the user allocates memory. The
+  // memory of messages read with readWithAllocator is allocated right away.
+  if (!op.allocator &&
+      numMessagesReadAhead_ < context_->getReadAheadMaxMessages()) {
+    size_t payloadsSize = 0;
+    for (const ReadOperation::Payload& payload : op.payloads) {
+      payloadsSize += payload.length;
+    }
+    if (payloadsSize <= context_->getReadAheadMaxPayloadsSize()) {
+      stagePayloadsOfMessage(op);
+    }
+  }
 
   advanceReadOperation(op);
 }
@@ -1656,7 +2551,9 @@ void Pipe::Impl::onDescriptorOfTensor(
 void Pipe::Impl::onReadOfPayload(ReadOperation& op) {
   TP_DCHECK(loop_.inLoop());
 
-  TP_DCHECK_EQ(op.state, ReadOperation::READING_PAYLOADS_AND_RECEIVING_TENSORS);
+  // Payloads that are read ahead may arrive before the allocation.
+  TP_DCHECK_GE(op.state, ReadOperation::ASKING_FOR_ALLOCATION);
+  TP_DCHECK_LE(op.state, ReadOperation::READING_PAYLOADS_AND_RECEIVING_TENSORS);
   op.numPayloadsBeingRead--;
 
   advanceReadOperation(op);
@@ -1680,6 +2577,29 @@ void Pipe::Impl::onWriteOfPayload(WriteOperation& op) {
   advanceWriteOperation(op);
 }
 
+void Pipe::Impl::onWriteOfBatch(int64_t firstMessage, int64_t numMessages) {
+  TP_DCHECK(loop_.inLoop());
+
+  TP_DCHECK_GT(numBatchesBeingWritten_, 0);
+  --numBatchesBeingWritten_;
+  for (int64_t sequenceNumber = firstMessage;
+       sequenceNumber < firstMessage + numMessages;
+       ++sequenceNumber) {
+    WriteOperation* opPtr = findWriteOperation(sequenceNumber);
+    TP_DCHECK(opPtr != nullptr);
+    TP_DCHECK_EQ(
+        opPtr->state, WriteOperation::WRITING_PAYLOADS_AND_SENDING_TENSORS);
+    opPtr->numPayloadsBeingWritten--;
+  }
+
+  // The messages that piled up while the connection was busy can go now.
+  if (numBatchesBeingWritten_ == 0 && numMessagesInBatch_ > 0) {
+    writeBatchOfMessages();
+  }
+
+  advanceWriteOperation(*findWriteOperation(firstMessage));
+}
+
 void Pipe::Impl::onSendOfTensor(WriteOperation& op) {
   TP_DCHECK(loop_.inLoop());
 
@@ -8,11 +8,11 @@
 
 #pragma once
 
-#include <functional>
 #include <memory>
 #include <string>
 
 #include <tensorpipe/common/error.h>
+#include <tensorpipe/common/inline_function.h>
 #include <tensorpipe/core/context.h>
 #include <tensorpipe/core/listener.h>
 #include <tensorpipe/core/message.h>
@@ -65,15 +65,35 @@ class Pipe final {
   //
 
   using read_descriptor_callback_fn =
-      std::function<void(const Error&, Message)>;
+      InlineFunction<void(const Error&, Message)>;
 
   void readDescriptor(read_descriptor_callback_fn);
 
-  using read_callback_fn = std::function<void(const Error&, Message)>;
+  using read_callback_fn = InlineFunction<void(const Error&, Message)>;
 
   void read(Message, read_callback_fn);
 
-  using write_callback_fn = std::function<void(const Error&, Message)>;
+  // Given the message as it would be passed to the readDescriptor callback,
+  // set the pointers of its payloads and tensors to the memory to read into.
+  using allocator_fn = InlineFunction<void(Message&)>;
+
+  // Read the next message in a single step: as soon as its descriptor arrives,
+  // the pipe calls the allocator, from its event loop, and then it receives the
+  // payloads and tensors and calls the callback. This spares the round trip of
+  // readDescriptor and read through the application, hence the allocator must
+  // return quickly and must not call back into the pipe. It isn't called if an
+  // error occurs before the descriptor arrives. Calls to this method and to
+  // readDescriptor can be interleaved.
+  void readWithAllocator(allocator_fn, read_callback_fn);
+
+  // Like readWithAllocator, with an allocator that takes the memory for the
+  // payloads and CPU tensors from the context's buffer pool (see
+  // ContextOptions::bufferPool). The buffers of the message, even if there is
+  // an error, belong to the application, which must release them to the pool.
+  // Messages that contain CUDA tensors can't be read this way.
+  void readMessage(read_callback_fn);
+
+  using write_callback_fn = InlineFunction<void(const Error&, Message)>;
 
   void write(Message, write_callback_fn);
 
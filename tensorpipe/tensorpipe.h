@@ -13,6 +13,7 @@
 // High-level API
 
 #include <tensorpipe/core/buffer.h>
+#include <tensorpipe/core/buffer_pool.h>
 #include <tensorpipe/core/context.h>
 #include <tensorpipe/core/error.h>
 #include <tensorpipe/core/listener.h>
@@ -200,3 +200,76 @@ class CallbacksAreDeferredTest : public ClientServerChannelTestCase<CpuBuffer> {
 };
 
 CHANNEL_TEST(CpuChannelTestSuite, CallbacksAreDeferred);
+
+// Send a large tensor and then a small one, but only receive the second one
+// once the first one is done, as a pipe reading one message at a time would.
+// Their chunks must not be ordered in a way that makes the first one wait for
+// the second one.
+class RecvOneAtATimeTest : public ClientServerChannelTestCase<CpuBuffer> {
+  static constexpr size_t kLargeSize = 1024 * 1024;
+  static constexpr size_t kSmallSize = 16;
+
+  void server(std::shared_ptr<transport::Connection> conn) override {
+    std::shared_ptr<CpuContext> ctx = this->helper_->makeContext("server");
+    auto channel = ctx->createChannel(std::move(conn), Endpoint::kListen);
+
+    std::vector<uint8_t> largeData(kLargeSize);
+    std::iota(largeData.begin(), largeData.end(), 0);
+    std::vector<uint8_t> smallData(kSmallSize);
+    std::iota(smallData.begin(), smallData.end(), 0);
+
+    // Perform both sends back to back, so that the second one is queued while
+    // the first one is still being chunked, and wait for completion.
+    std::vector<std::future<std::tuple<Error, TDescriptor>>> descriptorFutures;
+    std::vector<std::future<Error>> sendFutures;
+    for (auto* data : {&largeData, &smallData}) {
+      std::future<std::tuple<Error, TDescriptor>> descriptorFuture;
+      std::future<Error> sendFuture;
+      std::tie(descriptorFuture, sendFuture) =
+          sendWithFuture(channel, CpuBuffer{data->data(), data->size()});
+      descriptorFutures.push_back(std::move(descriptorFuture));
+      sendFutures.push_back(std::move(sendFuture));
+    }
+    for (auto& descriptorFuture : descriptorFutures) {
+      Error descriptorError;
+      TDescriptor descriptor;
+      std::tie(descriptorError, descriptor) = descriptorFuture.get();
+      EXPECT_FALSE(descriptorError) << descriptorError.what();
+      this->peers_->send(PeerGroup::kClient, descriptor);
+    }
+    for (auto& sendFuture : sendFutures) {
+      Error sendError = sendFuture.get();
+      EXPECT_FALSE(sendError) << sendError.what();
+    }
+
+    this->peers_->done(PeerGroup::kServer);
+    this->peers_->join(PeerGroup::kServer);
+
+    ctx->join();
+  }
+
+  void client(std::shared_ptr<transport::Connection> conn) override {
+    std::shared_ptr<CpuContext> ctx = this->helper_->makeContext("client");
+    auto channel = ctx->createChannel(std::move(conn), Endpoint::kConnect);
+
+    // Perform each recv and wait for its completion before the next one.
+    for (size_t size : {kLargeSize, kSmallSize}) {
+      std::vector<uint8_t> data(size);
+      auto descriptor = this->peers_->recv(PeerGroup::kClient);
+      std::future<Error> recvFuture = recvWithFuture(
+          channel, descriptor, CpuBuffer{data.data(), data.size()});
+      Error recvError = recvFuture.get();
+      EXPECT_FALSE(recvError) << recvError.what();
+      for (size_t i = 0; i < size; i++) {
+        EXPECT_EQ(data[i], i % 256);
+      }
+    }
+
+    this->peers_->done(PeerGroup::kClient);
+    this->peers_->join(PeerGroup::kClient);
+
+    ctx->join();
+  }
+};
+
+CHANNEL_TEST(CpuChannelTestSuite, RecvOneAtATime);
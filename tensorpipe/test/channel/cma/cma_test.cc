@@ -13,16 +13,35 @@ namespace {
 
 class CmaChannelTestHelper : public ChannelTestHelper<tensorpipe::CpuBuffer> {
  public:
+  explicit CmaChannelTestHelper(
+      tensorpipe::channel::cma::ContextOptions opts =
+          tensorpipe::channel::cma::ContextOptions())
+      : opts_(std::move(opts)) {}
+
   std::shared_ptr<tensorpipe::channel::CpuContext> makeContext(
       std::string id) override {
-    auto context = std::make_shared<tensorpipe::channel::cma::Context>();
+    auto context = std::make_shared<tensorpipe::channel::cma::Context>(opts_);
     context->setId(std::move(id));
     return context;
   }
+
+ private:
+  const tensorpipe::channel::cma::ContextOptions opts_;
 };
 
 CmaChannelTestHelper helper;
 
+// Split most tensors into many chunks, which are copied in parallel and can
+// thus complete out of order.
+CmaChannelTestHelper chunkedHelper(tensorpipe::channel::cma::ContextOptions()
+                                       .numThreads(8)
+                                       .chunkSize(4 * 1024));
+
 } // namespace
 
 INSTANTIATE_TEST_CASE_P(Cma, CpuChannelTestSuite, ::testing::Values(&helper));
+
+INSTANTIATE_TEST_CASE_P(
+    CmaChunked,
+    CpuChannelTestSuite,
+    ::testing::Values(&chunkedHelper));
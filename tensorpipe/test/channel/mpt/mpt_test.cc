@@ -13,6 +13,11 @@ namespace {
 
 class MptChannelTestHelper : public ChannelTestHelper<tensorpipe::CpuBuffer> {
  public:
+  explicit MptChannelTestHelper(
+      tensorpipe::channel::mpt::ContextOptions opts =
+          tensorpipe::channel::mpt::ContextOptions())
+      : opts_(std::move(opts)) {}
+
   std::shared_ptr<tensorpipe::channel::CpuContext> makeContext(
       std::string id) override {
     std::vector<std::shared_ptr<tensorpipe::transport::Context>> contexts = {
@@ -24,14 +29,30 @@ class MptChannelTestHelper : public ChannelTestHelper<tensorpipe::CpuBuffer> {
         contexts[1]->listen("127.0.0.1"),
         contexts[2]->listen("127.0.0.1")};
     auto context = std::make_shared<tensorpipe::channel::mpt::Context>(
-        std::move(contexts), std::move(listeners));
+        std::move(contexts), std::move(listeners), opts_);
     context->setId(std::move(id));
     return context;
   }
+
+ private:
+  const tensorpipe::channel::mpt::ContextOptions opts_;
 };
 
 MptChannelTestHelper helper;
 
+// Split most tensors into many small chunks, which are spread over the lanes
+// as they drain and, with few bytes allowed in flight, are interleaved with
+// those of other tensors. They can thus arrive out of order.
+MptChannelTestHelper chunkedHelper(tensorpipe::channel::mpt::ContextOptions()
+                                       .stripingThreshold(1024)
+                                       .chunkSize(4 * 1024)
+                                       .maxBytesInFlight(16 * 1024));
+
 } // namespace
 
 INSTANTIATE_TEST_CASE_P(Mpt, CpuChannelTestSuite, ::testing::Values(&helper));
+
+INSTANTIATE_TEST_CASE_P(
+    MptChunked,
+    CpuChannelTestSuite,
+    ::testing::Values(&chunkedHelper));
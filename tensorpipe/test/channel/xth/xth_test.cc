@@ -6,6 +6,10 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <sched.h>
+
+#include <stdexcept>
+
 #include <tensorpipe/channel/xth/context.h>
 #include <tensorpipe/test/channel/channel_test.h>
 
@@ -13,16 +17,61 @@ namespace {
 
 class XthChannelTestHelper : public ChannelTestHelper<tensorpipe::CpuBuffer> {
  public:
+  explicit XthChannelTestHelper(
+      tensorpipe::channel::xth::ContextOptions opts =
+          tensorpipe::channel::xth::ContextOptions())
+      : opts_(std::move(opts)) {}
+
   std::shared_ptr<tensorpipe::channel::CpuContext> makeContext(
       std::string id) override {
-    auto context = std::make_shared<tensorpipe::channel::xth::Context>();
+    auto context = std::make_shared<tensorpipe::channel::xth::Context>(opts_);
     context->setId(std::move(id));
     return context;
   }
+
+ private:
+  const tensorpipe::channel::xth::ContextOptions opts_;
 };
 
 XthChannelTestHelper helper;
 
+// Split most tensors into many chunks, which are copied in parallel (and can
+// thus complete out of order) using non-temporal stores.
+XthChannelTestHelper chunkedHelper(tensorpipe::channel::xth::ContextOptions()
+                                       .numThreads(8)
+                                       .chunkSize(4 * 1024)
+                                       .streamingThreshold(16 * 1024));
+
 } // namespace
 
 INSTANTIATE_TEST_CASE_P(Xth, CpuChannelTestSuite, ::testing::Values(&helper));
+
+INSTANTIATE_TEST_CASE_P(
+    XthChunked,
+    CpuChannelTestSuite,
+    ::testing::Values(&chunkedHelper));
+
+TEST(XthContext, InvalidCpus) {
+  using tensorpipe::channel::xth::Context;
+  using tensorpipe::channel::xth::ContextOptions;
+  // These are rejected when the context is created, rather than by the copy
+  // threads, where they couldn't be reported.
+  EXPECT_THROW(
+      Context(ContextOptions().numThreads(1).cpus({CPU_SETSIZE - 1})),
+      std::runtime_error);
+  EXPECT_THROW(
+      Context(ContextOptions().numThreads(1).cpus({-1})), std::runtime_error);
+  EXPECT_THROW(
+      Context(ContextOptions().numThreads(2).cpus({0})), std::runtime_error);
+}
+
+TEST(XthContext, CopyThreadStats) {
+  tensorpipe::channel::xth::Context context(
+      tensorpipe::channel::xth::ContextOptions().numThreads(3));
+  auto stats = context.getCopyThreadStats();
+  ASSERT_EQ(stats.size(), 3);
+  for (const auto& threadStats : stats) {
+    EXPECT_EQ(threadStats.numBytesCopied, 0);
+  }
+  context.join();
+}
@@ -0,0 +1,281 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <tensorpipe/common/busy_polling_loop.h>
+#include <tensorpipe/common/deferred_executor.h>
+#include <tensorpipe/common/mpsc_queue.h>
+
+#include <gtest/gtest.h>
+
+using namespace tensorpipe;
+
+namespace {
+
+constexpr int kNumThreads = 8;
+constexpr int kNumItemsPerThread = 10000;
+
+} // namespace
+
+TEST(MpscQueue, SingleThread) {
+  MpscQueue<int> queue;
+  int value;
+  EXPECT_FALSE(queue.tryPop(value));
+  queue.push(1);
+  queue.push(2);
+  ASSERT_TRUE(queue.tryPop(value));
+  EXPECT_EQ(value, 1);
+  ASSERT_TRUE(queue.tryPop(value));
+  EXPECT_EQ(value, 2);
+  EXPECT_FALSE(queue.tryPop(value));
+  queue.push(3);
+  ASSERT_TRUE(queue.tryPop(value));
+  EXPECT_EQ(value, 3);
+  EXPECT_FALSE(queue.tryPop(value));
+}
+
+TEST(MpscQueue, ManyProducers) {
+  MpscQueue<std::pair<int, int>> queue;
+  std::vector<std::thread> threads;
+  for (int threadIdx = 0; threadIdx < kNumThreads; threadIdx++) {
+    threads.emplace_back([&, threadIdx]() {
+      for (int itemIdx = 0; itemIdx < kNumItemsPerThread; itemIdx++) {
+        queue.push(std::make_pair(threadIdx, itemIdx));
+      }
+    });
+  }
+
+  // Each producer's items must come out in the order it pushed them.
+  std::vector<int> nextItemIdx(kNumThreads, 0);
+  for (int itemIdx = 0; itemIdx < kNumThreads * kNumItemsPerThread;
+       itemIdx++) {
+    std::pair<int, int> item = queue.pop();
+    EXPECT_EQ(item.second, nextItemIdx[item.first]);
+    nextItemIdx[item.first] = item.second + 1;
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  std::pair<int, int> item;
+  EXPECT_FALSE(queue.tryPop(item));
+}
+
+TEST(OnDemandDeferredExecutor, ManyThreads) {
+  OnDemandDeferredExecutor loop;
+  // Only ever accessed from within the loop.
+  std::vector<int> nextItemIdx(kNumThreads, 0);
+  int numTasksRun = 0;
+  std::atomic<int> numTasksRunning{0};
+
+  std::vector<std::thread> threads;
+  for (int threadIdx = 0; threadIdx < kNumThreads; threadIdx++) {
+    threads.emplace_back([&, threadIdx]() {
+      for (int itemIdx = 0; itemIdx < kNumItemsPerThread; itemIdx++) {
+        loop.deferToLoop([&, threadIdx, itemIdx]() {
+          EXPECT_EQ(numTasksRunning.fetch_add(1), 0);
+          EXPECT_TRUE(loop.inLoop());
+          EXPECT_EQ(itemIdx, nextItemIdx[threadIdx]);
+          nextItemIdx[threadIdx] = itemIdx + 1;
+          ++numTasksRun;
+          numTasksRunning.fetch_sub(1);
+        });
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  // Once all threads have returned, all their tasks must have been run.
+  loop.runInLoop(
+      [&]() { EXPECT_EQ(numTasksRun, kNumThreads * kNumItemsPerThread); });
+}
+
+namespace {
+
+// A loop with no work of its own, which stops as soon as it's asked to, even
+// if some functions were deferred to it in the meantime: those are then left
+// to the hand-over to the on-demand loop.
+class IdleLoop final : public BusyPollingLoop {
+ public:
+  IdleLoop() {
+    startThread("TP_TEST_loop");
+  }
+
+  void close() {
+    stopBusyPolling();
+  }
+
+  void join() {
+    close();
+    if (!joined_.exchange(true)) {
+      joinThread();
+    }
+  }
+
+  ~IdleLoop() override {
+    join();
+  }
+
+  bool onLoopThread() const {
+    return std::this_thread::get_id() == threadId_.load();
+  }
+
+ protected:
+  void eventLoop() override {
+    threadId_ = std::this_thread::get_id();
+    BusyPollingLoop::eventLoop();
+  }
+
+  bool pollOnce() override {
+    return false;
+  }
+
+  bool readyToClose() override {
+    return true;
+  }
+
+ private:
+  std::atomic<bool> joined_{false};
+  std::atomic<std::thread::id> threadId_{std::thread::id()};
+};
+
+} // namespace
+
+TEST(EventLoopDeferredExecutor, HandOverWhileDeferring) {
+  constexpr int kNumIterations = 100;
+  constexpr int kNumItemsPerThreadAndIteration = 500;
+
+  // The loop stops while the threads are deferring functions to it, hence each
+  // of these runs either on the loop's thread or on the on-demand loop, but it
+  // must run exactly once, in order, and never alongside another one.
+  int numTasksRunOnLoopThread = 0;
+  int numTasksRunOnDemand = 0;
+  for (int iterIdx = 0; iterIdx < kNumIterations; iterIdx++) {
+    IdleLoop loop;
+    // Only ever accessed from within the loop.
+    std::vector<int> nextItemIdx(kNumThreads, 0);
+    int numTasksRun = 0;
+    std::atomic<int> numTasksRunning{0};
+    std::atomic<int> numItemsDeferred{0};
+
+    std::vector<std::thread> threads;
+    for (int threadIdx = 0; threadIdx < kNumThreads; threadIdx++) {
+      threads.emplace_back([&, threadIdx]() {
+        for (int itemIdx = 0; itemIdx < kNumItemsPerThreadAndIteration;
+             itemIdx++) {
+          loop.deferToLoop([&, threadIdx, itemIdx]() {
+            EXPECT_EQ(numTasksRunning.fetch_add(1), 0);
+            EXPECT_TRUE(loop.inLoop());
+            EXPECT_EQ(itemIdx, nextItemIdx[threadIdx]);
+            nextItemIdx[threadIdx] = itemIdx + 1;
+            ++numTasksRun;
+            ++(loop.onLoopThread() ? numTasksRunOnLoopThread
+                                   : numTasksRunOnDemand);
+            numTasksRunning.fetch_sub(1);
+          });
+          ++numItemsDeferred;
+          // Let the loop catch up, so that it gets to stop in the middle.
+          std::this_thread::yield();
+        }
+      });
+    }
+    // Vary the point at which the loop stops across iterations.
+    while (numItemsDeferred <
+           iterIdx * kNumThreads * kNumItemsPerThreadAndIteration /
+               kNumIterations) {
+      std::this_thread::yield();
+    }
+    loop.close();
+    for (auto& thread : threads) {
+      thread.join();
+    }
+
+    loop.join();
+    loop.runInLoop([&]() {
+      EXPECT_EQ(numTasksRun, kNumThreads * kNumItemsPerThreadAndIteration);
+    });
+  }
+
+  // Both sides of the hand-over must have been exercised.
+  EXPECT_GT(numTasksRunOnLoopThread, 0);
+  EXPECT_GT(numTasksRunOnDemand, 0);
+}
+
+namespace {
+
+// A loop that, like the uv one, frees the state that its producers use to wake
+// it up as soon as its thread has been joined. It leaves the producers some
+// time to be caught in the middle of a wake-up when that happens.
+class LoopWithWakeUpState final : public EventLoopDeferredExecutor {
+ public:
+  LoopWithWakeUpState() {
+    startThread("TP_TEST_loop");
+  }
+
+  void join() {
+    closed_ = true;
+    joinThread();
+    numWakeUps_.reset();
+  }
+
+ protected:
+  void eventLoop() override {
+    while (!closed_) {
+      runDeferredFunctionsFromEventLoop();
+      std::this_thread::yield();
+    }
+  }
+
+  void wakeupEventLoopToDeferFunction() override {
+    std::this_thread::yield();
+    ++*numWakeUps_;
+  }
+
+ private:
+  std::atomic<bool> closed_{false};
+  std::unique_ptr<std::atomic<int>> numWakeUps_ =
+      std::make_unique<std::atomic<int>>(0);
+};
+
+} // namespace
+
+TEST(EventLoopDeferredExecutor, JoinWhileWakingUp) {
+  constexpr int kNumIterations = 100;
+
+  // The loop must not return from joining while a producer is still waking it
+  // up, or the latter would access freed memory (which ASan would catch).
+  for (int iterIdx = 0; iterIdx < kNumIterations; iterIdx++) {
+    LoopWithWakeUpState loop;
+    std::atomic<bool> joined{false};
+    std::atomic<int> numItemsDeferred{0};
+
+    std::vector<std::thread> threads;
+    for (int threadIdx = 0; threadIdx < kNumThreads; threadIdx++) {
+      threads.emplace_back([&]() {
+        while (!joined) {
+          loop.deferToLoop([]() {});
+          ++numItemsDeferred;
+        }
+      });
+    }
+    while (numItemsDeferred < kNumThreads) {
+      std::this_thread::yield();
+    }
+    loop.join();
+    joined = true;
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
+}
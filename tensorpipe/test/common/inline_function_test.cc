@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <array>
+#include <memory>
+#include <vector>
+
+#include <tensorpipe/common/inline_function.h>
+
+#include <gtest/gtest.h>
+
+using namespace tensorpipe;
+
+namespace {
+
+// Keeps track of how many instances of it are alive.
+class Tracker {
+ public:
+  explicit Tracker(int& numAlive) : numAlive_(&numAlive) {
+    ++*numAlive_;
+  }
+
+  Tracker(const Tracker& other) : numAlive_(other.numAlive_) {
+    ++*numAlive_;
+  }
+
+  Tracker(Tracker&& other) noexcept : numAlive_(other.numAlive_) {
+    ++*numAlive_;
+  }
+
+  ~Tracker() {
+    --*numAlive_;
+  }
+
+ private:
+  int* numAlive_;
+};
+
+} // namespace
+
+TEST(InlineFunction, Empty) {
+  InlineFunction<void()> fn;
+  EXPECT_FALSE(fn);
+  EXPECT_TRUE(fn == nullptr);
+
+  InlineFunction<void()> otherFn = nullptr;
+  EXPECT_FALSE(otherFn);
+}
+
+TEST(InlineFunction, Invoke) {
+  int sum = 0;
+  InlineFunction<int(int, int)> fn = [&sum](int a, int b) {
+    sum += a + b;
+    return sum;
+  };
+  EXPECT_TRUE(fn);
+  EXPECT_TRUE(fn != nullptr);
+  EXPECT_EQ(fn(1, 2), 3);
+  EXPECT_EQ(fn(3, 4), 10);
+  EXPECT_EQ(sum, 10);
+}
+
+TEST(InlineFunction, MoveOnlyCapture) {
+  auto ptr = std::make_unique<int>(42);
+  InlineFunction<int()> fn = [ptr{std::move(ptr)}]() { return *ptr; };
+  EXPECT_EQ(fn(), 42);
+
+  InlineFunction<int()> otherFn = std::move(fn);
+  EXPECT_FALSE(fn);
+  EXPECT_EQ(otherFn(), 42);
+}
+
+TEST(InlineFunction, MoveOnlyArgument) {
+  InlineFunction<int(std::unique_ptr<int>)> fn = [](std::unique_ptr<int> ptr) {
+    return *ptr;
+  };
+  EXPECT_EQ(fn(std::make_unique<int>(42)), 42);
+}
+
+TEST(InlineFunction, StoresInline) {
+  using TFunction = InlineFunction<void(), 64>;
+
+  auto smallFn = [array{std::array<char, 64>()}]() {};
+  EXPECT_TRUE(TFunction::storesInline<decltype(smallFn)>());
+
+  auto largeFn = [array{std::array<char, 65>()}]() {};
+  EXPECT_FALSE(TFunction::storesInline<decltype(largeFn)>());
+
+  // Nested callbacks need the room for the captures of the wrapper too.
+  auto wrappingFn = [inner{TFunction()}, seq{uint64_t(0)}]() {};
+  EXPECT_FALSE(TFunction::storesInline<decltype(wrappingFn)>());
+  EXPECT_TRUE(
+      (InlineFunction<void(), wrappingCapacity(64)>::storesInline<
+          decltype(wrappingFn)>()));
+}
+
+TEST(InlineFunction, HeapFallback) {
+  int numAlive = 0;
+  {
+    std::array<char, 128> array;
+    array.fill('x');
+    InlineFunction<char(), 16> fn = [tracker{Tracker(numAlive)}, array]() {
+      return array[127];
+    };
+    EXPECT_EQ(numAlive, 1);
+    EXPECT_EQ(fn(), 'x');
+
+    InlineFunction<char(), 16> otherFn = std::move(fn);
+    EXPECT_EQ(numAlive, 1);
+    EXPECT_EQ(otherFn(), 'x');
+  }
+  EXPECT_EQ(numAlive, 0);
+}
+
+TEST(InlineFunction, Destruction) {
+  int numAlive = 0;
+  {
+    InlineFunction<void()> fn = [tracker{Tracker(numAlive)}]() {};
+    EXPECT_EQ(numAlive, 1);
+
+    InlineFunction<void()> otherFn = std::move(fn);
+    EXPECT_EQ(numAlive, 1);
+
+    otherFn = nullptr;
+    EXPECT_EQ(numAlive, 0);
+
+    fn = [tracker{Tracker(numAlive)}]() {};
+    EXPECT_EQ(numAlive, 1);
+
+    // Assigning over a non-empty function destroys the previous callable.
+    fn = [tracker{Tracker(numAlive)}]() {};
+    EXPECT_EQ(numAlive, 1);
+  }
+  EXPECT_EQ(numAlive, 0);
+}
+
+TEST(InlineFunction, WrapItself) {
+  int numAlive = 0;
+  std::vector<int> calls;
+  {
+    InlineFunction<void(int)> fn = [&calls, tracker{Tracker(numAlive)}](
+                                       int value) { calls.push_back(value); };
+    fn = [&calls, fn{std::move(fn)}](int value) {
+      calls.push_back(-value);
+      fn(value);
+    };
+    EXPECT_EQ(numAlive, 1);
+    fn(1);
+  }
+  EXPECT_EQ(numAlive, 0);
+  EXPECT_EQ(calls, std::vector<int>({-1, 1}));
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <tensorpipe/common/recycling_queue.h>
+
+#include <gtest/gtest.h>
+
+using namespace tensorpipe;
+
+namespace {
+
+struct Operation {
+  int64_t sequenceNumber{-1};
+  std::string metadata;
+  std::vector<int64_t> lengths;
+};
+
+} // namespace
+
+TEST(RecyclingQueue, Fifo) {
+  RecyclingQueue<Operation> queue;
+  EXPECT_TRUE(queue.empty());
+  for (int64_t idx = 0; idx < 10; ++idx) {
+    queue.pushBack().sequenceNumber = idx;
+  }
+  EXPECT_EQ(queue.size(), 10u);
+  for (int64_t idx = 0; idx < 10; ++idx) {
+    EXPECT_EQ(queue[idx].sequenceNumber, idx);
+  }
+  for (int64_t idx = 0; idx < 10; ++idx) {
+    EXPECT_EQ(queue.front().sequenceNumber, idx);
+    queue.popFront();
+  }
+  EXPECT_TRUE(queue.empty());
+}
+
+TEST(RecyclingQueue, ObjectsDontMove) {
+  RecyclingQueue<Operation> queue;
+  std::vector<Operation*> ops;
+  // Pop some elements first so that the queue wraps around when growing.
+  queue.pushBack();
+  queue.pushBack();
+  queue.popFront();
+  queue.popFront();
+  for (int64_t idx = 0; idx < 100; ++idx) {
+    Operation& op = queue.pushBack();
+    op.sequenceNumber = idx;
+    ops.push_back(&op);
+  }
+  for (int64_t idx = 0; idx < 100; ++idx) {
+    EXPECT_EQ(&queue[idx], ops[idx]);
+    EXPECT_EQ(ops[idx]->sequenceNumber, idx);
+  }
+}
+
+TEST(RecyclingQueue, RecyclesObjects) {
+  RecyclingQueue<Operation> queue;
+  Operation& op = queue.pushBack();
+  op.metadata = "foo";
+  queue.popFront();
+  std::vector<Operation*> ops;
+  // The queue may hand out other objects first, but it never creates more than
+  // it needs to hold its peak number of elements.
+  for (int idx = 0; idx < 100; ++idx) {
+    ops.push_back(&queue.pushBack());
+    queue.popFront();
+  }
+  EXPECT_NE(std::find(ops.begin(), ops.end(), &op), ops.end());
+  EXPECT_EQ(op.metadata, "foo");
+}
@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// These tests count the heap allocations of the whole process, by replacing
+// the global allocation functions, hence they're built as their own executable
+// rather than as part of the main test suite.
+
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <future>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <tensorpipe/common/recycling_queue.h>
+#include <tensorpipe/tensorpipe.h>
+
+#include <gtest/gtest.h>
+
+using namespace tensorpipe;
+
+namespace {
+
+std::atomic<uint64_t> numAllocations{0};
+
+void* countedAlloc(size_t size) {
+  numAllocations.fetch_add(1, std::memory_order_relaxed);
+  void* ptr = std::malloc(size == 0 ? 1 : size);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+} // namespace
+
+void* operator new(size_t size) {
+  return countedAlloc(size);
+}
+
+void* operator new[](size_t size) {
+  return countedAlloc(size);
+}
+
+void operator delete(void* ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t /* unused */) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void* ptr, size_t /* unused */) noexcept {
+  std::free(ptr);
+}
+
+namespace {
+
+struct Operation {
+  int64_t sequenceNumber{-1};
+  std::string metadata;
+  std::vector<int64_t> lengths;
+};
+
+constexpr size_t kPayloadLength = 64;
+
+// Bounces a message with one payload between the two ends of a pipe, each of
+// them reading it into a buffer of its own, which is allocated only once.
+class PingPong {
+ public:
+  PingPong(std::shared_ptr<Pipe> clientPipe, std::shared_ptr<Pipe> serverPipe)
+      : clientPipe_(std::move(clientPipe)), serverPipe_(std::move(serverPipe)) {
+    message_.payloads.push_back(
+        Message::Payload{clientBuffer_.data(), kPayloadLength});
+    serve();
+  }
+
+  // Perform the given number of round trips and, once they're done, return
+  // how many allocations they made (not counting the ones to wait for them).
+  uint64_t run(int numRoundTrips) {
+    numRoundTripsLeft_ = numRoundTrips;
+    doneProm_ = std::promise<void>();
+    std::future<void> doneFuture = doneProm_.get_future();
+    uint64_t numAllocationsBefore = numAllocations.load();
+    ping(std::move(message_));
+    doneFuture.get();
+    return numAllocations.load() - numAllocationsBefore;
+  }
+
+ private:
+  const std::shared_ptr<Pipe> clientPipe_;
+  const std::shared_ptr<Pipe> serverPipe_;
+  std::array<uint8_t, kPayloadLength> clientBuffer_{};
+  std::array<uint8_t, kPayloadLength> serverBuffer_{};
+  Message message_;
+  int numRoundTripsLeft_{0};
+  std::promise<void> doneProm_;
+
+  void ping(Message message) {
+    clientPipe_->write(
+        std::move(message), [](const Error& error, Message /* unused */) {
+          ASSERT_FALSE(error) << error.what();
+        });
+    clientPipe_->readDescriptor([this](const Error& error, Message message) {
+      ASSERT_FALSE(error) << error.what();
+      message.payloads[0].data = clientBuffer_.data();
+      clientPipe_->read(
+          std::move(message), [this](const Error& error, Message message) {
+            ASSERT_FALSE(error) << error.what();
+            if (--numRoundTripsLeft_ > 0) {
+              ping(std::move(message));
+            } else {
+              message_ = std::move(message);
+              doneProm_.set_value();
+            }
+          });
+    });
+  }
+
+  void serve() {
+    serverPipe_->readDescriptor([this](const Error& error, Message message) {
+      if (error) {
+        // The pipe was closed at the end of the test.
+        return;
+      }
+      message.payloads[0].data = serverBuffer_.data();
+      serverPipe_->read(
+          std::move(message), [this](const Error& error, Message message) {
+            ASSERT_FALSE(error) << error.what();
+            serverPipe_->write(
+                std::move(message),
+                [](const Error& error, Message /* unused */) {
+                  ASSERT_FALSE(error) << error.what();
+                });
+            serve();
+          });
+    });
+  }
+};
+
+} // namespace
+
+TEST(Allocation, RecyclingQueueInSteadyState) {
+  RecyclingQueue<Operation> queue;
+  auto runOneRound = [&](int64_t sequenceNumber) {
+    for (int idx = 0; idx < 3; ++idx) {
+      Operation& op = queue.pushBack();
+      op.sequenceNumber = sequenceNumber;
+      op.metadata.assign(100, 'x');
+      op.lengths.resize(10);
+    }
+    for (int idx = 0; idx < 3; ++idx) {
+      queue.popFront();
+    }
+  };
+
+  // Warm up, to let the queue and the objects reach their peak size.
+  for (int64_t sequenceNumber = 0; sequenceNumber < 10; ++sequenceNumber) {
+    runOneRound(sequenceNumber);
+  }
+
+  uint64_t numAllocationsBefore = numAllocations.load();
+  for (int64_t sequenceNumber = 0; sequenceNumber < 1000; ++sequenceNumber) {
+    runOneRound(sequenceNumber);
+  }
+  EXPECT_EQ(numAllocations.load() - numAllocationsBefore, 0u);
+}
+
+TEST(Allocation, PipePingPong) {
+  auto context = std::make_shared<Context>();
+  context->registerTransport(
+      0, "uv", std::make_shared<transport::uv::Context>());
+  context->registerChannel(
+      0, "basic", std::make_shared<channel::basic::Context>());
+
+  auto listener = context->listen({"uv://127.0.0.1"});
+  std::promise<std::shared_ptr<Pipe>> serverPipeProm;
+  listener->accept([&](const Error& error, std::shared_ptr<Pipe> pipe) {
+    ASSERT_FALSE(error) << error.what();
+    serverPipeProm.set_value(std::move(pipe));
+  });
+  std::shared_ptr<Pipe> clientPipe = context->connect(listener->url("uv"));
+  std::shared_ptr<Pipe> serverPipe = serverPipeProm.get_future().get();
+
+  PingPong pingPong(clientPipe, serverPipe);
+
+  // Warm up, to let the pipes' and the connections' queues and buffers reach
+  // their peak size.
+  pingPong.run(100);
+
+  constexpr int kNumRoundTrips = 1000;
+  uint64_t numAllocationsDuring = pingPong.run(kNumRoundTrips);
+
+  // The pipes reuse their operations, descriptor buffers and arrays of buffers
+  // to write, and the uv connections their operations and write requests. What
+  // is left is the Message that each end gets from readDescriptor: its vector
+  // of payloads, which holds the one payload (its vector of tensors is empty,
+  // hence it doesn't allocate).
+  EXPECT_EQ(numAllocationsDuring, 2 * kNumRoundTrips);
+
+  clientPipe->close();
+  serverPipe->close();
+  listener->close();
+  context->join();
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <tensorpipe/core/buffer_pool.h>
+
+#include <gtest/gtest.h>
+
+using namespace tensorpipe;
+
+namespace {
+
+bool isAligned(void* ptr) {
+  return reinterpret_cast<uintptr_t>(ptr) % alignof(std::max_align_t) == 0;
+}
+
+} // namespace
+
+TEST(BufferPool, ZeroLength) {
+  BufferPool pool;
+  EXPECT_EQ(pool.allocate(0), nullptr);
+  pool.release(nullptr);
+}
+
+TEST(BufferPool, ReusesReleasedBuffers) {
+  BufferPool pool;
+  void* ptr = pool.allocate(100);
+  ASSERT_NE(ptr, nullptr);
+  pool.release(ptr);
+  // Buffers of the same size class share their memory.
+  EXPECT_EQ(pool.allocate(128), ptr);
+  pool.release(ptr);
+}
+
+TEST(BufferPool, BuffersDontOverlap) {
+  constexpr size_t kSlabSize = 4096;
+  BufferPool pool(kSlabSize);
+  // Enough buffers of various sizes to span several slabs of each class.
+  std::vector<std::pair<uint8_t*, size_t>> buffers;
+  for (int idx = 0; idx < 200; ++idx) {
+    size_t length = 1 + (idx * 37) % (2 * kSlabSize);
+    uint8_t* ptr = reinterpret_cast<uint8_t*>(pool.allocate(length));
+    ASSERT_NE(ptr, nullptr);
+    EXPECT_TRUE(isAligned(ptr));
+    std::memset(ptr, idx, length);
+    buffers.emplace_back(ptr, length);
+  }
+  for (size_t idx = 0; idx < buffers.size(); ++idx) {
+    uint8_t* ptr = buffers[idx].first;
+    size_t length = buffers[idx].second;
+    EXPECT_TRUE(std::all_of(ptr, ptr + length, [&](uint8_t value) {
+      return value == static_cast<uint8_t>(idx);
+    }));
+  }
+  for (const auto& buffer : buffers) {
+    pool.release(buffer.first);
+  }
+}
+
+TEST(BufferPool, LargeBuffers) {
+  constexpr size_t kSlabSize = 4096;
+  BufferPool pool(kSlabSize);
+  uint8_t* ptr = reinterpret_cast<uint8_t*>(pool.allocate(10 * kSlabSize));
+  ASSERT_NE(ptr, nullptr);
+  EXPECT_TRUE(isAligned(ptr));
+  std::memset(ptr, 0x42, 10 * kSlabSize);
+  pool.release(ptr);
+}
+
+TEST(BufferPool, ReleaseMessage) {
+  BufferPool pool;
+  Message message;
+  message.payloads.resize(2);
+  for (Message::Payload& payload : message.payloads) {
+    payload.length = 16;
+    payload.data = pool.allocate(payload.length);
+  }
+  message.tensors.resize(1);
+  CpuBuffer buffer;
+  buffer.length = 1024;
+  buffer.ptr = pool.allocate(buffer.length);
+  message.tensors[0].buffer = buffer;
+
+  pool.release(message);
+  for (const Message::Payload& payload : message.payloads) {
+    EXPECT_EQ(payload.data, nullptr);
+  }
+  EXPECT_EQ(message.tensors[0].buffer.cpu.ptr, nullptr);
+}
+
+TEST(BufferPool, MultipleThreads) {
+  constexpr int kNumThreads = 4;
+  constexpr int kNumIterations = 1000;
+  BufferPool pool(4096);
+  std::vector<std::thread> threads;
+  for (int threadIdx = 0; threadIdx < kNumThreads; ++threadIdx) {
+    threads.emplace_back([&pool, threadIdx]() {
+      std::vector<void*> ptrs;
+      for (int idx = 0; idx < kNumIterations; ++idx) {
+        void* ptr = pool.allocate(1 + (idx * 13) % 1000);
+        *reinterpret_cast<uint8_t*>(ptr) = threadIdx;
+        ptrs.push_back(ptr);
+        if (idx % 3 == 0) {
+          EXPECT_EQ(*reinterpret_cast<uint8_t*>(ptrs.front()), threadIdx);
+          pool.release(ptrs.front());
+          ptrs.erase(ptrs.begin());
+        }
+      }
+      for (void* ptr : ptrs) {
+        EXPECT_EQ(*reinterpret_cast<uint8_t*>(ptr), threadIdx);
+        pool.release(ptr);
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+}
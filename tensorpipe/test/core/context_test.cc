@@ -8,11 +8,17 @@
 
 #include <tensorpipe/tensorpipe.h>
 
+#include <tensorpipe/channel/channel.h>
+#include <tensorpipe/transport/connection.h>
+
+#include <atomic>
 #include <cstring>
 #include <exception>
 #include <future>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
 #include <gtest/gtest.h>
 
@@ -127,6 +133,224 @@ std::vector<std::string> genUrls() {
   return res;
 }
 
+// Wraps a channel context, to count how many tensors its channels send, which
+// allows to check which channel the pipe picked for each tensor.
+class CountingChannelContext : public channel::CpuContext {
+ public:
+  explicit CountingChannelContext(std::shared_ptr<channel::CpuContext> context)
+      : context_(std::move(context)) {}
+
+  int numSends() const {
+    return *numSends_;
+  }
+
+  const std::string& domainDescriptor() const override {
+    return context_->domainDescriptor();
+  }
+
+  std::shared_ptr<channel::CpuChannel> createChannel(
+      std::shared_ptr<transport::Connection> connection,
+      channel::Endpoint endpoint) override {
+    return std::make_shared<CountingChannel>(
+        context_->createChannel(std::move(connection), endpoint), numSends_);
+  }
+
+  void setId(std::string id) override {
+    context_->setId(std::move(id));
+  }
+
+  void close() override {
+    context_->close();
+  }
+
+  void join() override {
+    context_->join();
+  }
+
+ private:
+  class CountingChannel : public channel::CpuChannel {
+   public:
+    CountingChannel(
+        std::shared_ptr<channel::CpuChannel> channel,
+        std::shared_ptr<std::atomic<int>> numSends)
+        : channel_(std::move(channel)), numSends_(std::move(numSends)) {}
+
+    void send(
+        CpuBuffer buffer,
+        channel::TDescriptorCallback descriptorCallback,
+        channel::TSendCallback callback) override {
+      ++*numSends_;
+      channel_->send(
+          buffer, std::move(descriptorCallback), std::move(callback));
+    }
+
+    void recv(
+        channel::TDescriptor descriptor,
+        CpuBuffer buffer,
+        channel::TRecvCallback callback) override {
+      channel_->recv(std::move(descriptor), buffer, std::move(callback));
+    }
+
+    void setId(std::string id) override {
+      channel_->setId(std::move(id));
+    }
+
+    void close() override {
+      channel_->close();
+    }
+
+   private:
+    const std::shared_ptr<channel::CpuChannel> channel_;
+    const std::shared_ptr<std::atomic<int>> numSends_;
+  };
+
+  const std::shared_ptr<channel::CpuContext> context_;
+  const std::shared_ptr<std::atomic<int>> numSends_ =
+      std::make_shared<std::atomic<int>>(0);
+};
+
+// Wraps a transport context, to count the writes issued on each connection it
+// opens (not on the ones its listeners accept), which allows to check how the
+// pipe used its connections.
+class CountingTransportContext : public transport::Context {
+ public:
+  struct ConnectionStats {
+    std::atomic<int> numWrites{0};
+    // How many writes had been issued when the first read completed (or -1 if
+    // none did yet), which tells whether the pipe waited for the other end.
+    std::atomic<int> numWritesBeforeFirstRead{-1};
+  };
+
+  explicit CountingTransportContext(std::shared_ptr<transport::Context> context)
+      : context_(std::move(context)) {}
+
+  // Return the stats of the connections opened so far, in order.
+  std::vector<std::shared_ptr<ConnectionStats>> connectionStats() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return connectionStats_;
+  }
+
+  std::shared_ptr<transport::Connection> connect(std::string addr) override {
+    auto stats = std::make_shared<ConnectionStats>();
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      connectionStats_.push_back(stats);
+    }
+    return std::make_shared<CountingConnection>(
+        context_->connect(std::move(addr)), std::move(stats));
+  }
+
+  std::shared_ptr<transport::Listener> listen(std::string addr) override {
+    return context_->listen(std::move(addr));
+  }
+
+  const std::string& domainDescriptor() const override {
+    return context_->domainDescriptor();
+  }
+
+  void setId(std::string id) override {
+    context_->setId(std::move(id));
+  }
+
+  void close() override {
+    context_->close();
+  }
+
+  void join() override {
+    context_->join();
+  }
+
+ private:
+  class CountingConnection : public transport::Connection {
+   public:
+    CountingConnection(
+        std::shared_ptr<transport::Connection> connection,
+        std::shared_ptr<ConnectionStats> stats)
+        : connection_(std::move(connection)), stats_(std::move(stats)) {}
+
+    void read(read_callback_fn fn) override {
+      connection_->read(
+          [stats{stats_}, fn{std::move(fn)}](
+              const Error& error, const void* ptr, size_t length) {
+            onRead(*stats);
+            fn(error, ptr, length);
+          });
+    }
+
+    void read(void* ptr, size_t length, read_callback_fn fn) override {
+      connection_->read(
+          ptr,
+          length,
+          [stats{stats_}, fn{std::move(fn)}](
+              const Error& error, const void* ptr, size_t length) {
+            onRead(*stats);
+            fn(error, ptr, length);
+          });
+    }
+
+    void read(std::vector<iovec> iovs, read_iovs_callback_fn fn) override {
+      connection_->read(
+          std::move(iovs),
+          [stats{stats_}, fn{std::move(fn)}](const Error& error) {
+            onRead(*stats);
+            fn(error);
+          });
+    }
+
+    void read(AbstractNopHolder& object, read_nop_callback_fn fn) override {
+      connection_->read(
+          object, [stats{stats_}, fn{std::move(fn)}](const Error& error) {
+            onRead(*stats);
+            fn(error);
+          });
+    }
+
+    void write(const void* ptr, size_t length, write_callback_fn fn) override {
+      ++stats_->numWrites;
+      connection_->write(ptr, length, std::move(fn));
+    }
+
+    void write(std::vector<iovec> iovs, write_callback_fn fn) override {
+      ++stats_->numWrites;
+      connection_->write(std::move(iovs), std::move(fn));
+    }
+
+    void writeArray(const iovec* iovs, size_t numIovs, write_callback_fn fn)
+        override {
+      ++stats_->numWrites;
+      connection_->writeArray(iovs, numIovs, std::move(fn));
+    }
+
+    void write(const AbstractNopHolder& object, write_callback_fn fn)
+        override {
+      ++stats_->numWrites;
+      connection_->write(object, std::move(fn));
+    }
+
+    void setId(std::string id) override {
+      connection_->setId(std::move(id));
+    }
+
+    void close() override {
+      connection_->close();
+    }
+
+   private:
+    const std::shared_ptr<transport::Connection> connection_;
+    const std::shared_ptr<ConnectionStats> stats_;
+
+    static void onRead(ConnectionStats& stats) {
+      int expected = -1;
+      stats.numWritesBeforeFirstRead.compare_exchange_strong(
+          expected, stats.numWrites);
+    }
+  };
+
+  const std::shared_ptr<transport::Context> context_;
+  std::mutex mutex_;
+  std::vector<std::shared_ptr<ConnectionStats>> connectionStats_;
+};
+
 } // namespace
 
 TEST(Context, ClientPingSerial) {
@@ -445,6 +669,23 @@ TEST(Context, ServerPingPongTwice) {
   context->join();
 }
 
+// Point the payloads and the CPU tensors of the message, as given to the
+// readDescriptor callback, to newly allocated memory, which the buffers own.
+static void allocateMessage(
+    Message& message,
+    std::vector<std::unique_ptr<uint8_t[]>>& buffers) {
+  for (auto& payload : message.payloads) {
+    auto payloadData = std::make_unique<uint8_t[]>(payload.length);
+    payload.data = payloadData.get();
+    buffers.push_back(std::move(payloadData));
+  }
+  for (auto& tensor : message.tensors) {
+    auto tensorData = std::make_unique<uint8_t[]>(tensor.buffer.cpu.length);
+    tensor.buffer.cpu.ptr = tensorData.get();
+    buffers.push_back(std::move(tensorData));
+  }
+}
+
 static void pipeRead(
     std::shared_ptr<Pipe>& pipe,
     std::vector<std::unique_ptr<uint8_t[]>>& buffers,
@@ -452,16 +693,7 @@ static void pipeRead(
   pipe->readDescriptor([&pipe, &buffers, fn{std::move(fn)}](
                            const Error& error, Message message) mutable {
     ASSERT_FALSE(error);
-    for (auto& payload : message.payloads) {
-      auto payloadData = std::make_unique<uint8_t[]>(payload.length);
-      payload.data = payloadData.get();
-      buffers.push_back(std::move(payloadData));
-    }
-    for (auto& tensor : message.tensors) {
-      auto tensorData = std::make_unique<uint8_t[]>(tensor.buffer.cpu.length);
-      tensor.buffer.cpu.ptr = tensorData.get();
-      buffers.push_back(std::move(tensorData));
-    }
+    allocateMessage(message, buffers);
     pipe->read(
         std::move(message),
         [fn{std::move(fn)}](const Error& error, Message message) mutable {
@@ -539,3 +771,798 @@ TEST(Context, MixedTensorMessage) {
   clientPipe.reset();
   context->join();
 }
+
+TEST(Context, ChannelSizeRanges) {
+  std::vector<std::unique_ptr<uint8_t[]>> buffers;
+  std::promise<void> writeCompletedProm;
+  std::promise<void> readCompletedProm;
+
+  // The small tensors of the test message should go through basic even though
+  // xth has a higher priority, and the large one through xth.
+  auto context = std::make_shared<Context>(
+      ContextOptions()
+          .channelSizeRange("basic", 0, kTensorData.length())
+          .channelSizeRange("xth", kTensorData.length() + 1));
+
+  auto basicContext = std::make_shared<CountingChannelContext>(
+      std::make_shared<channel::basic::Context>());
+  auto xthContext = std::make_shared<CountingChannelContext>(
+      std::make_shared<channel::xth::Context>());
+  context->registerTransport(
+      0, "uv", std::make_shared<transport::uv::Context>());
+  context->registerChannel(0, "basic", basicContext);
+  context->registerChannel(1, "xth", xthContext);
+
+  auto listener = context->listen({"uv://127.0.0.1"});
+
+  std::string largeTensorData(1024, 'x');
+  auto makeMixedMessage = [&]() {
+    Message message = makeMessage(1, 2);
+    Message::Tensor tensor{CpuBuffer{
+        reinterpret_cast<void*>(const_cast<char*>(largeTensorData.data())),
+        largeTensorData.length()}};
+    message.tensors.push_back(std::move(tensor));
+    return message;
+  };
+
+  std::shared_ptr<Pipe> serverPipe;
+  listener->accept([&](const Error& error, std::shared_ptr<Pipe> pipe) {
+    ASSERT_FALSE(error);
+    serverPipe = std::move(pipe);
+    pipeRead(serverPipe, buffers, [&](const Error& error, Message message) {
+      ASSERT_FALSE(error);
+      EXPECT_TRUE(messagesAreEqual(message, makeMixedMessage()));
+      readCompletedProm.set_value();
+    });
+  });
+
+  auto clientPipe = context->connect(listener->url("uv"));
+  clientPipe->write(
+      makeMixedMessage(), [&](const Error& error, Message /* unused */) {
+        ASSERT_FALSE(error);
+        writeCompletedProm.set_value();
+      });
+
+  readCompletedProm.get_future().get();
+  writeCompletedProm.get_future().get();
+
+  EXPECT_EQ(basicContext->numSends(), 2);
+  EXPECT_EQ(xthContext->numSends(), 1);
+
+  serverPipe.reset();
+  listener.reset();
+  clientPipe.reset();
+  context->join();
+}
+
+TEST(Context, InlineTensors) {
+  std::vector<std::unique_ptr<uint8_t[]>> buffers;
+  std::promise<void> writeCompletedProm;
+  std::promise<void> readCompletedProm;
+
+  // Only the first tensor of the test message is small enough to be inlined.
+  auto context = std::make_shared<Context>(
+      ContextOptions().inlineTensorThreshold(kTensorData.length() + 1));
+
+  auto basicContext = std::make_shared<CountingChannelContext>(
+      std::make_shared<channel::basic::Context>());
+  context->registerTransport(
+      0, "uv", std::make_shared<transport::uv::Context>());
+  context->registerChannel(0, "basic", basicContext);
+
+  auto listener = context->listen({"uv://127.0.0.1"});
+
+  std::string largeTensorData(1024, 'x');
+  auto makeMixedMessage = [&]() {
+    Message message = makeMessage(1, 1);
+    Message::Tensor tensor{CpuBuffer{
+        reinterpret_cast<void*>(const_cast<char*>(largeTensorData.data())),
+        largeTensorData.length()}};
+    message.tensors.push_back(std::move(tensor));
+    return message;
+  };
+
+  std::shared_ptr<Pipe> serverPipe;
+  listener->accept([&](const Error& error, std::shared_ptr<Pipe> pipe) {
+    ASSERT_FALSE(error);
+    serverPipe = std::move(pipe);
+    pipeRead(serverPipe, buffers, [&](const Error& error, Message message) {
+      ASSERT_FALSE(error);
+      EXPECT_TRUE(messagesAreEqual(message, makeMixedMessage()));
+      readCompletedProm.set_value();
+    });
+  });
+
+  auto clientPipe = context->connect(listener->url("uv"));
+  clientPipe->write(
+      makeMixedMessage(), [&](const Error& error, Message /* unused */) {
+        ASSERT_FALSE(error);
+        writeCompletedProm.set_value();
+      });
+
+  readCompletedProm.get_future().get();
+  writeCompletedProm.get_future().get();
+
+  // Only the large tensor went through the channel.
+  EXPECT_EQ(basicContext->numSends(), 1);
+
+  serverPipe.reset();
+  listener.reset();
+  clientPipe.reset();
+  context->join();
+}
+
+TEST(Context, MptLargeThenSmallTensor) {
+  std::vector<std::unique_ptr<uint8_t[]>> buffers;
+  std::promise<void> writesCompletedProm;
+  std::promise<void> readsCompletedProm;
+
+  auto context = std::make_shared<Context>();
+
+  // The large tensor is split into many chunks, of which only a few can be in
+  // flight, hence the small tensor is handed to the lanes while it's still
+  // being chunked.
+  std::vector<std::shared_ptr<transport::Context>> laneContexts;
+  std::vector<std::shared_ptr<transport::Listener>> laneListeners;
+  for (int laneIdx = 0; laneIdx < 3; laneIdx++) {
+    laneContexts.push_back(std::make_shared<transport::uv::Context>());
+    laneListeners.push_back(laneContexts.back()->listen("127.0.0.1"));
+  }
+  context->registerTransport(
+      0, "uv", std::make_shared<transport::uv::Context>());
+  context->registerChannel(
+      0,
+      "mpt",
+      std::make_shared<channel::mpt::Context>(
+          std::move(laneContexts),
+          std::move(laneListeners),
+          channel::mpt::ContextOptions()
+              .stripingThreshold(1024)
+              .chunkSize(4 * 1024)
+              .maxBytesInFlight(16 * 1024)));
+
+  auto listener = context->listen({"uv://127.0.0.1"});
+
+  std::string largeTensorData(16 * 1024 * 1024, 'x');
+  auto makeLargeMessage = [&]() {
+    Message message;
+    message.tensors.push_back(Message::Tensor{CpuBuffer{
+        reinterpret_cast<void*>(const_cast<char*>(largeTensorData.data())),
+        largeTensorData.length()}});
+    return message;
+  };
+
+  // The second message is only read once the first one is done, hence its
+  // tensor must not hold back the one of the first message.
+  std::shared_ptr<Pipe> serverPipe;
+  listener->accept([&](const Error& error, std::shared_ptr<Pipe> pipe) {
+    ASSERT_FALSE(error);
+    serverPipe = std::move(pipe);
+    pipeRead(serverPipe, buffers, [&](const Error& error, Message message) {
+      ASSERT_FALSE(error);
+      EXPECT_TRUE(messagesAreEqual(message, makeLargeMessage()));
+      pipeRead(serverPipe, buffers, [&](const Error& error, Message message) {
+        ASSERT_FALSE(error);
+        EXPECT_TRUE(messagesAreEqual(message, makeMessage(0, 1)));
+        readsCompletedProm.set_value();
+      });
+    });
+  });
+
+  auto clientPipe = context->connect(listener->url("uv"));
+  std::vector<Message> messages;
+  messages.push_back(makeLargeMessage());
+  messages.push_back(makeMessage(0, 1));
+  int numWritesCompleted = 0;
+  for (Message& message : messages) {
+    clientPipe->write(
+        std::move(message), [&](const Error& error, Message /* unused */) {
+          ASSERT_FALSE(error);
+          if (++numWritesCompleted == 2) {
+            writesCompletedProm.set_value();
+          }
+        });
+  }
+
+  readsCompletedProm.get_future().get();
+  writesCompletedProm.get_future().get();
+
+  serverPipe.reset();
+  listener.reset();
+  clientPipe.reset();
+  context->join();
+}
+
+TEST(Context, ConnectionPool) {
+  std::vector<std::unique_ptr<uint8_t[]>> buffers;
+
+  // After the first pipe, the following ones (and their channels) should get
+  // spare connections that were opened ahead of time.
+  auto context =
+      std::make_shared<Context>(ContextOptions().connectionPoolSize(2));
+
+  context->registerTransport(
+      0, "uv", std::make_shared<transport::uv::Context>());
+  context->registerChannel(
+      0, "basic", std::make_shared<channel::basic::Context>());
+
+  auto listener = context->listen({"uv://127.0.0.1"});
+
+  for (int pipeIdx = 0; pipeIdx < 3; pipeIdx++) {
+    std::promise<void> writeCompletedProm;
+    std::promise<void> readCompletedProm;
+
+    std::shared_ptr<Pipe> serverPipe;
+    listener->accept([&](const Error& error, std::shared_ptr<Pipe> pipe) {
+      ASSERT_FALSE(error);
+      serverPipe = std::move(pipe);
+      pipeRead(serverPipe, buffers, [&](const Error& error, Message message) {
+        ASSERT_FALSE(error);
+        EXPECT_TRUE(messagesAreEqual(message, makeMessage(1, 1)));
+        readCompletedProm.set_value();
+      });
+    });
+
+    auto clientPipe = context->connect(listener->url("uv"));
+    clientPipe->write(
+        makeMessage(1, 1), [&](const Error& error, Message /* unused */) {
+          ASSERT_FALSE(error);
+          writeCompletedProm.set_value();
+        });
+
+    readCompletedProm.get_future().get();
+    writeCompletedProm.get_future().get();
+
+    serverPipe.reset();
+    clientPipe.reset();
+  }
+
+  listener.reset();
+  context->join();
+}
+
+// Open a pipe from the client context to the given URL, on which the listener
+// must be accepting, and return once the message it sent has been received.
+static void pipePing(
+    std::shared_ptr<Context>& clientContext,
+    std::shared_ptr<Listener>& listener,
+    const std::string& url) {
+  std::vector<std::unique_ptr<uint8_t[]>> buffers;
+  std::promise<void> writeCompletedProm;
+  std::promise<void> readCompletedProm;
+
+  std::shared_ptr<Pipe> serverPipe;
+  listener->accept([&](const Error& error, std::shared_ptr<Pipe> pipe) {
+    ASSERT_FALSE(error);
+    serverPipe = std::move(pipe);
+    pipeRead(serverPipe, buffers, [&](const Error& error, Message message) {
+      ASSERT_FALSE(error);
+      EXPECT_TRUE(messagesAreEqual(message, makeMessage(1, 1)));
+      readCompletedProm.set_value();
+    });
+  });
+
+  auto clientPipe =
+      clientContext->connect(url, PipeOptions().remoteName("server"));
+  clientPipe->write(
+      makeMessage(1, 1), [&](const Error& error, Message /* unused */) {
+        ASSERT_FALSE(error);
+        writeCompletedProm.set_value();
+      });
+
+  readCompletedProm.get_future().get();
+  writeCompletedProm.get_future().get();
+
+  serverPipe.reset();
+  clientPipe.reset();
+}
+
+TEST(Context, CachedBrochureAnswer) {
+  // After the first pipe, the following ones should set up their transport and
+  // channels without waiting for the brochure answer, and send their message
+  // together with the brochure.
+  auto context =
+      std::make_shared<Context>(ContextOptions().cacheBrochureAnswers(true));
+
+  auto transportContext = std::make_shared<CountingTransportContext>(
+      std::make_shared<transport::uv::Context>());
+  context->registerTransport(0, "uv", transportContext);
+  context->registerChannel(
+      0, "basic", std::make_shared<channel::basic::Context>());
+
+  auto listener = context->listen({"uv://127.0.0.1"});
+
+  for (int pipeIdx = 0; pipeIdx < 3; pipeIdx++) {
+    const size_t connIdx = transportContext->connectionStats().size();
+    pipePing(context, listener, listener->url("uv"));
+
+    // The client opened the pipe's connection and the channel's one, and it
+    // wrote the hello and the brochure, and then the message's descriptor and
+    // payload only if it didn't wait for the answer.
+    const auto connectionStats = transportContext->connectionStats();
+    EXPECT_EQ(connectionStats.size(), connIdx + 2);
+    const int numWritesBeforeAnswer =
+        connectionStats[connIdx]->numWritesBeforeFirstRead;
+    if (pipeIdx == 0) {
+      EXPECT_EQ(numWritesBeforeAnswer, 2);
+    } else {
+      EXPECT_GT(numWritesBeforeAnswer, 2);
+    }
+  }
+
+  listener.reset();
+  context->join();
+}
+
+TEST(Context, CachedBrochureAnswerRejected) {
+  // The server restarts with another channel, hence it rejects the setup that
+  // the client cached, which must fall back to the full negotiation and then
+  // cache the new answer instead.
+  auto clientContext =
+      std::make_shared<Context>(ContextOptions().cacheBrochureAnswers(true));
+
+  auto transportContext = std::make_shared<CountingTransportContext>(
+      std::make_shared<transport::uv::Context>());
+  clientContext->registerTransport(0, "uv", transportContext);
+  clientContext->registerChannel(
+      0, "basic", std::make_shared<channel::basic::Context>());
+  clientContext->registerChannel(
+      1, "xth", std::make_shared<channel::xth::Context>());
+
+  std::string url = "uv://127.0.0.1";
+  for (int serverIdx = 0; serverIdx < 2; serverIdx++) {
+    auto serverContext = std::make_shared<Context>();
+    serverContext->registerTransport(
+        0, "uv", std::make_shared<transport::uv::Context>());
+    if (serverIdx == 0) {
+      serverContext->registerChannel(
+          0, "basic", std::make_shared<channel::basic::Context>());
+    } else {
+      serverContext->registerChannel(
+          0, "xth", std::make_shared<channel::xth::Context>());
+    }
+    auto listener = serverContext->listen({url});
+    url = listener->url("uv");
+
+    for (int pipeIdx = 0; pipeIdx < 2; pipeIdx++) {
+      const size_t connIdx = transportContext->connectionStats().size();
+      pipePing(clientContext, listener, url);
+
+      const auto connectionStats = transportContext->connectionStats();
+      const int numWritesBeforeAnswer =
+          connectionStats[connIdx]->numWritesBeforeFirstRead;
+      if (serverIdx == 0 && pipeIdx == 0) {
+        // Nothing was cached yet.
+        EXPECT_EQ(connectionStats.size(), connIdx + 2);
+        EXPECT_EQ(numWritesBeforeAnswer, 2);
+      } else if (serverIdx == 1 && pipeIdx == 0) {
+        // The client set up the pipe as last time, then opened a replacement
+        // connection and the one of the channel picked by the server.
+        EXPECT_EQ(connectionStats.size(), connIdx + 4);
+        EXPECT_GT(numWritesBeforeAnswer, 2);
+      } else {
+        EXPECT_EQ(connectionStats.size(), connIdx + 2);
+        EXPECT_GT(numWritesBeforeAnswer, 2);
+      }
+    }
+
+    listener.reset();
+    serverContext->join();
+  }
+
+  clientContext->join();
+}
+
+TEST(Context, CachedBrochureAnswerStale) {
+  // The server restarts without the transport it picked, hence the client fails
+  // to reach it with the setup it cached, and it must start over from the URL.
+  auto clientContext =
+      std::make_shared<Context>(ContextOptions().cacheBrochureAnswers(true));
+
+  auto transportContext = std::make_shared<CountingTransportContext>(
+      std::make_shared<transport::uv::Context>());
+  auto otherTransportContext = std::make_shared<CountingTransportContext>(
+      std::make_shared<transport::uv::Context>());
+  clientContext->registerTransport(0, "uv", transportContext);
+  clientContext->registerTransport(1, "uv_other", otherTransportContext);
+  clientContext->registerChannel(
+      0, "basic", std::make_shared<channel::basic::Context>());
+
+  std::string url;
+  {
+    auto serverContext = std::make_shared<Context>();
+    serverContext->registerTransport(
+        0, "uv", std::make_shared<transport::uv::Context>());
+    serverContext->registerTransport(
+        1, "uv_other", std::make_shared<transport::uv::Context>());
+    serverContext->registerChannel(
+        0, "basic", std::make_shared<channel::basic::Context>());
+    auto listener =
+        serverContext->listen({"uv://127.0.0.1", "uv_other://127.0.0.1"});
+    url = listener->url("uv");
+
+    // The server picks the transport with the highest priority.
+    pipePing(clientContext, listener, url);
+    EXPECT_EQ(otherTransportContext->connectionStats().size(), 2);
+
+    listener.reset();
+    serverContext->join();
+  }
+
+  auto serverContext = std::make_shared<Context>();
+  serverContext->registerTransport(
+      0, "uv", std::make_shared<transport::uv::Context>());
+  serverContext->registerChannel(
+      0, "basic", std::make_shared<channel::basic::Context>());
+  auto listener = serverContext->listen({url});
+
+  // The client first tries the address it cached.
+  const size_t connIdx = transportContext->connectionStats().size();
+  pipePing(clientContext, listener, url);
+  EXPECT_GT(otherTransportContext->connectionStats().size(), 2);
+  auto connectionStats = transportContext->connectionStats();
+  EXPECT_EQ(connectionStats.size(), connIdx + 2);
+  EXPECT_EQ(connectionStats[connIdx]->numWritesBeforeFirstRead, 2);
+
+  // And then it caches the new answer.
+  pipePing(clientContext, listener, url);
+  connectionStats = transportContext->connectionStats();
+  EXPECT_EQ(connectionStats.size(), connIdx + 4);
+  EXPECT_GT(connectionStats[connIdx + 2]->numWritesBeforeFirstRead, 2);
+
+  listener.reset();
+  serverContext->join();
+  clientContext->join();
+}
+
+TEST(Context, ReadAhead) {
+  constexpr int kNumMessages = 3;
+  std::vector<std::unique_ptr<uint8_t[]>> buffers;
+  std::promise<void> writesCompletedProm;
+  std::vector<std::promise<Message>> descriptorProms(kNumMessages);
+  std::vector<std::promise<void>> readProms(kNumMessages);
+
+  // The descriptors of the first two messages are followed by their payloads,
+  // which the pipe should read on its own, thus getting to the third one before
+  // any memory is allocated.
+  auto context = std::make_shared<Context>(
+      ContextOptions().readAhead(2, kPayloadData.length()));
+
+  context->registerTransport(
+      0, "uv", std::make_shared<transport::uv::Context>());
+  context->registerChannel(
+      0, "basic", std::make_shared<channel::basic::Context>());
+
+  auto listener = context->listen({"uv://127.0.0.1"});
+
+  std::shared_ptr<Pipe> serverPipe;
+  listener->accept([&](const Error& error, std::shared_ptr<Pipe> pipe) {
+    ASSERT_FALSE(error);
+    serverPipe = std::move(pipe);
+    for (int msgIdx = 0; msgIdx < kNumMessages; msgIdx++) {
+      serverPipe->readDescriptor(
+          [&descriptorProms, msgIdx](const Error& error, Message message) {
+            ASSERT_FALSE(error);
+            descriptorProms[msgIdx].set_value(std::move(message));
+          });
+    }
+  });
+
+  auto clientPipe = context->connect(listener->url("uv"));
+  int numWritesCompleted = 0;
+  for (int msgIdx = 0; msgIdx < kNumMessages; msgIdx++) {
+    clientPipe->write(
+        makeMessage(1, 1), [&](const Error& error, Message /* unused */) {
+          ASSERT_FALSE(error);
+          if (++numWritesCompleted == kNumMessages) {
+            writesCompletedProm.set_value();
+          }
+        });
+  }
+
+  std::vector<Message> messages;
+  for (int msgIdx = 0; msgIdx < kNumMessages; msgIdx++) {
+    messages.push_back(descriptorProms[msgIdx].get_future().get());
+  }
+
+  // The second message keeps the buffers of the pipe, the others get new ones.
+  EXPECT_NE(messages[1].payloads[0].data, nullptr);
+  for (int msgIdx = 0; msgIdx < kNumMessages; msgIdx++) {
+    Message& message = messages[msgIdx];
+    const std::vector<Message::Payload> stagedPayloads = message.payloads;
+    allocateMessage(message, buffers);
+    if (msgIdx == 1) {
+      message.payloads = stagedPayloads;
+    }
+    serverPipe->read(
+        std::move(message),
+        [&readProms, msgIdx](const Error& error, Message message) {
+          ASSERT_FALSE(error);
+          // Staged payloads are only valid within the callback.
+          EXPECT_TRUE(messagesAreEqual(message, makeMessage(1, 1)));
+          readProms[msgIdx].set_value();
+        });
+  }
+
+  for (int msgIdx = 0; msgIdx < kNumMessages; msgIdx++) {
+    readProms[msgIdx].get_future().get();
+  }
+  writesCompletedProm.get_future().get();
+
+  serverPipe.reset();
+  listener.reset();
+  clientPipe.reset();
+  context->join();
+}
+
+TEST(Context, ReadMessage) {
+  constexpr int kNumMessages = 3;
+  std::vector<std::unique_ptr<uint8_t[]>> buffers;
+  std::promise<void> writesCompletedProm;
+  std::vector<std::promise<Message>> readProms(kNumMessages);
+
+  auto bufferPool = std::make_shared<BufferPool>();
+  auto context =
+      std::make_shared<Context>(ContextOptions().bufferPool(bufferPool));
+
+  context->registerTransport(
+      0, "uv", std::make_shared<transport::uv::Context>());
+  context->registerChannel(
+      0, "basic", std::make_shared<channel::basic::Context>());
+
+  auto listener = context->listen({"uv://127.0.0.1"});
+
+  // The second message goes through readDescriptor and read, to check that the
+  // two ways of reading can be interleaved.
+  std::shared_ptr<Pipe> serverPipe;
+  listener->accept([&](const Error& error, std::shared_ptr<Pipe> pipe) {
+    ASSERT_FALSE(error);
+    serverPipe = std::move(pipe);
+    serverPipe->readMessage([&readProms](const Error& error, Message message) {
+      ASSERT_FALSE(error);
+      readProms[0].set_value(std::move(message));
+    });
+    pipeRead(
+        serverPipe,
+        buffers,
+        [&readProms](const Error& error, Message message) {
+          ASSERT_FALSE(error);
+          readProms[1].set_value(std::move(message));
+        });
+    serverPipe->readMessage([&readProms](const Error& error, Message message) {
+      ASSERT_FALSE(error);
+      readProms[2].set_value(std::move(message));
+    });
+  });
+
+  auto clientPipe = context->connect(listener->url("uv"));
+  int numWritesCompleted = 0;
+  for (int msgIdx = 0; msgIdx < kNumMessages; msgIdx++) {
+    clientPipe->write(
+        makeMessage(2, 2), [&](const Error& error, Message /* unused */) {
+          ASSERT_FALSE(error);
+          if (++numWritesCompleted == kNumMessages) {
+            writesCompletedProm.set_value();
+          }
+        });
+  }
+
+  for (int msgIdx = 0; msgIdx < kNumMessages; msgIdx++) {
+    Message message = readProms[msgIdx].get_future().get();
+    EXPECT_TRUE(messagesAreEqual(message, makeMessage(2, 2)));
+    if (msgIdx != 1) {
+      bufferPool->release(message);
+      EXPECT_EQ(message.payloads[0].data, nullptr);
+      EXPECT_EQ(message.tensors[0].buffer.cpu.ptr, nullptr);
+    }
+  }
+  writesCompletedProm.get_future().get();
+
+  serverPipe.reset();
+  listener.reset();
+  clientPipe.reset();
+  context->join();
+}
+
+TEST(Context, ReadWithAllocator) {
+  std::vector<std::unique_ptr<uint8_t[]>> buffers;
+  std::promise<void> writeCompletedProm;
+  std::promise<Message> readProm;
+
+  auto context = std::make_shared<Context>();
+
+  context->registerTransport(
+      0, "uv", std::make_shared<transport::uv::Context>());
+  context->registerChannel(
+      0, "basic", std::make_shared<channel::basic::Context>());
+
+  auto listener = context->listen({"uv://127.0.0.1"});
+
+  int numAllocatorCalls = 0;
+  std::shared_ptr<Pipe> serverPipe;
+  listener->accept([&](const Error& error, std::shared_ptr<Pipe> pipe) {
+    ASSERT_FALSE(error);
+    serverPipe = std::move(pipe);
+    serverPipe->readWithAllocator(
+        [&](Message& message) {
+          ++numAllocatorCalls;
+          // The allocator sees the same as the readDescriptor callback would.
+          EXPECT_EQ(message.payloads.size(), 2);
+          EXPECT_EQ(message.tensors.size(), 2);
+          allocateMessage(message, buffers);
+        },
+        [&readProm](const Error& error, Message message) {
+          ASSERT_FALSE(error);
+          readProm.set_value(std::move(message));
+        });
+  });
+
+  auto clientPipe = context->connect(listener->url("uv"));
+  clientPipe->write(
+      makeMessage(2, 2), [&](const Error& error, Message /* unused */) {
+        ASSERT_FALSE(error);
+        writeCompletedProm.set_value();
+      });
+
+  Message message = readProm.get_future().get();
+  EXPECT_TRUE(messagesAreEqual(message, makeMessage(2, 2)));
+  EXPECT_EQ(numAllocatorCalls, 1);
+  writeCompletedProm.get_future().get();
+
+  serverPipe.reset();
+  listener.reset();
+  clientPipe.reset();
+  context->join();
+}
+
+TEST(Context, BatchedWrites) {
+  constexpr int kNumMessages = 10;
+  std::vector<std::unique_ptr<uint8_t[]>> buffers;
+  std::promise<void> writesCompletedProm;
+  std::vector<std::promise<Message>> readProms(kNumMessages);
+
+  auto context =
+      std::make_shared<Context>(ContextOptions().batchWrites(1024 * 1024));
+
+  auto transportContext = std::make_shared<CountingTransportContext>(
+      std::make_shared<transport::uv::Context>());
+  context->registerTransport(0, "uv", transportContext);
+  context->registerChannel(
+      0, "basic", std::make_shared<channel::basic::Context>());
+
+  auto listener = context->listen({"uv://127.0.0.1"});
+
+  std::shared_ptr<Pipe> serverPipe;
+  listener->accept([&](const Error& error, std::shared_ptr<Pipe> pipe) {
+    ASSERT_FALSE(error);
+    serverPipe = std::move(pipe);
+    for (int msgIdx = 0; msgIdx < kNumMessages; msgIdx++) {
+      pipeRead(
+          serverPipe,
+          buffers,
+          [&readProms, msgIdx](const Error& error, Message message) {
+            ASSERT_FALSE(error);
+            readProms[msgIdx].set_value(std::move(message));
+          });
+    }
+  });
+
+  // Messages are written in a burst, hence some of them end up in the same
+  // batch, but their write callbacks are still called one by one, in order.
+  auto clientPipe = context->connect(listener->url("uv"));
+  int numWritesCompleted = 0;
+  for (int msgIdx = 0; msgIdx < kNumMessages; msgIdx++) {
+    Message message = makeMessage(msgIdx % 3, 1);
+    message.metadata = std::to_string(msgIdx);
+    clientPipe->write(
+        std::move(message), [&, msgIdx](const Error& error, Message message) {
+          ASSERT_FALSE(error);
+          EXPECT_EQ(message.metadata, std::to_string(msgIdx));
+          EXPECT_EQ(numWritesCompleted, msgIdx);
+          if (++numWritesCompleted == kNumMessages) {
+            writesCompletedProm.set_value();
+          }
+        });
+  }
+
+  for (int msgIdx = 0; msgIdx < kNumMessages; msgIdx++) {
+    Message message = readProms[msgIdx].get_future().get();
+    Message expectedMessage = makeMessage(msgIdx % 3, 1);
+    expectedMessage.metadata = std::to_string(msgIdx);
+    EXPECT_TRUE(messagesAreEqual(message, expectedMessage));
+    EXPECT_EQ(message.metadata, expectedMessage.metadata);
+  }
+  writesCompletedProm.get_future().get();
+
+  // The client's first connection is the pipe's one, on which it wrote the
+  // hello and the brochure, and then the batches, which must have been fewer
+  // than the messages.
+  const auto connectionStats = transportContext->connectionStats();
+  ASSERT_EQ(connectionStats.size(), 2);
+  EXPECT_LT(connectionStats[0]->numWrites, 2 + kNumMessages);
+
+  serverPipe.reset();
+  listener.reset();
+  clientPipe.reset();
+  context->join();
+}
+
+TEST(Context, OutOfOrderCompletion) {
+  constexpr int kNumMessages = 3;
+  std::vector<std::unique_ptr<uint8_t[]>> buffers;
+  std::vector<int> readsCompleted;
+  std::vector<int> writesCompleted;
+  std::vector<std::promise<Message>> readProms(kNumMessages);
+  std::vector<std::promise<void>> writeProms(kNumMessages);
+
+  auto context =
+      std::make_shared<Context>(ContextOptions().outOfOrderCompletion(true));
+
+  context->registerTransport(
+      0, "uv", std::make_shared<transport::uv::Context>());
+  context->registerChannel(
+      0, "basic", std::make_shared<channel::basic::Context>());
+
+  auto listener = context->listen({"uv://127.0.0.1"});
+
+  // The first message carries a large tensor, the second one is small and
+  // independent, hence it completes first, whereas the third one is small but
+  // must still wait for the first one.
+  std::string largeTensorData(16 * 1024 * 1024, 'x');
+  auto makeMessageOfIdx = [&](int msgIdx) {
+    Message message;
+    if (msgIdx == 0) {
+      message.tensors.push_back(Message::Tensor{CpuBuffer{
+          reinterpret_cast<void*>(const_cast<char*>(largeTensorData.data())),
+          largeTensorData.length()}});
+    } else {
+      message = makeMessage(1, 0);
+    }
+    message.independent = msgIdx == 1;
+    return message;
+  };
+
+  std::shared_ptr<Pipe> serverPipe;
+  listener->accept([&](const Error& error, std::shared_ptr<Pipe> pipe) {
+    ASSERT_FALSE(error);
+    serverPipe = std::move(pipe);
+    for (int msgIdx = 0; msgIdx < kNumMessages; msgIdx++) {
+      pipeRead(
+          serverPipe,
+          buffers,
+          [&readsCompleted, &readProms, msgIdx](
+              const Error& error, Message message) {
+            ASSERT_FALSE(error);
+            EXPECT_EQ(message.independent, msgIdx == 1);
+            readsCompleted.push_back(msgIdx);
+            readProms[msgIdx].set_value(std::move(message));
+          });
+    }
+  });
+
+  auto clientPipe = context->connect(listener->url("uv"));
+  for (int msgIdx = 0; msgIdx < kNumMessages; msgIdx++) {
+    clientPipe->write(
+        makeMessageOfIdx(msgIdx),
+        [&, msgIdx](const Error& error, Message /* unused */) {
+          ASSERT_FALSE(error);
+          writesCompleted.push_back(msgIdx);
+          writeProms[msgIdx].set_value();
+        });
+  }
+
+  for (int msgIdx = 0; msgIdx < kNumMessages; msgIdx++) {
+    Message message = readProms[msgIdx].get_future().get();
+    EXPECT_TRUE(messagesAreEqual(message, makeMessageOfIdx(msgIdx)));
+    writeProms[msgIdx].get_future().get();
+  }
+
+  const std::vector<int> expectedOrder = {1, 0, 2};
+  EXPECT_EQ(readsCompleted, expectedOrder);
+  EXPECT_EQ(writesCompleted, expectedOrder);
+
+  serverPipe.reset();
+  listener.reset();
+  clientPipe.reset();
+  context->join();
+}
@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <tensorpipe/transport/connection_pool.h>
+
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <tensorpipe/transport/listener.h>
+#include <tensorpipe/transport/uv/context.h>
+
+#include <gtest/gtest.h>
+
+using namespace tensorpipe;
+using namespace tensorpipe::transport;
+
+namespace {
+
+std::shared_ptr<Connection> accept(std::shared_ptr<Listener>& listener) {
+  std::promise<std::shared_ptr<Connection>> connectionProm;
+  listener->accept(
+      [&](const Error& error, std::shared_ptr<Connection> connection) {
+        ASSERT_FALSE(error) << error.what();
+        connectionProm.set_value(std::move(connection));
+      });
+  return connectionProm.get_future().get();
+}
+
+void write(std::shared_ptr<Connection>& connection, const std::string& data) {
+  std::promise<void> writeProm;
+  connection->write(data.data(), data.length(), [&](const Error& error) {
+    EXPECT_FALSE(error) << error.what();
+    writeProm.set_value();
+  });
+  writeProm.get_future().get();
+}
+
+std::string read(std::shared_ptr<Connection>& connection, size_t length) {
+  std::string data(length, '\0');
+  std::promise<void> readProm;
+  connection->read(
+      &data[0],
+      length,
+      [&](const Error& error, const void* /* unused */, size_t /* unused */) {
+        EXPECT_FALSE(error) << error.what();
+        readProm.set_value();
+      });
+  readProm.get_future().get();
+  return data;
+}
+
+} // namespace
+
+TEST(ConnectionPool, SpareConnectionGetsFirstFrame) {
+  auto context = std::make_shared<uv::Context>();
+  auto listener = context->listen("127.0.0.1");
+  ConnectionPool pool(context, /*size=*/1);
+
+  // The first connection is opened on demand, the second one is a spare.
+  auto firstConnection = pool.connect(listener->addr());
+  auto firstPeer = accept(listener);
+  auto secondConnection = pool.connect(listener->addr());
+  auto secondPeer = accept(listener);
+
+  // The pool is already reading from the spare, hence this frame arrives before
+  // the user's read, which must still get it, followed by the other ones.
+  write(secondPeer, "hello");
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  EXPECT_EQ(read(secondConnection, 5), "hello");
+  write(secondPeer, "world");
+  EXPECT_EQ(read(secondConnection, 5), "world");
+
+  // This works both ways.
+  write(secondConnection, "ping");
+  EXPECT_EQ(read(secondPeer, 4), "ping");
+
+  pool.close();
+  context->join();
+}
+
+TEST(ConnectionPool, FailedSpareConnectionIsDiscarded) {
+  auto context = std::make_shared<uv::Context>();
+  auto listener = context->listen("127.0.0.1");
+  ConnectionPool pool(context, /*size=*/1);
+
+  auto firstConnection = pool.connect(listener->addr());
+  auto firstPeer = accept(listener);
+  auto sparePeer = accept(listener);
+  EXPECT_EQ(pool.numSpareConnections(), 1);
+
+  // Once the pool notices that the spare failed it drops it.
+  sparePeer->close();
+  while (pool.numSpareConnections() > 0) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  // Hence the next connection is a new one, which works.
+  auto secondConnection = pool.connect(listener->addr());
+  auto secondPeer = accept(listener);
+  write(secondPeer, "hello");
+  EXPECT_EQ(read(secondConnection, 5), "hello");
+
+  pool.close();
+  context->join();
+}
+
+TEST(ConnectionPool, IdleSpareConnectionsExpire) {
+  auto context = std::make_shared<uv::Context>();
+  auto listener = context->listen("127.0.0.1");
+  ConnectionPool pool(
+      context,
+      /*size=*/2,
+      /*maxNumAddresses=*/16,
+      /*maxIdleTime=*/std::chrono::milliseconds(10));
+
+  auto connection = pool.connect(listener->addr());
+  EXPECT_EQ(pool.numSpareConnections(), 2);
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  EXPECT_EQ(pool.numSpareConnections(), 0);
+
+  pool.close();
+  context->join();
+}
+
+TEST(ConnectionPool, LeastRecentlyUsedAddressIsEvicted) {
+  auto context = std::make_shared<uv::Context>();
+  auto firstListener = context->listen("127.0.0.1");
+  auto secondListener = context->listen("127.0.0.1");
+  ConnectionPool pool(context, /*size=*/2, /*maxNumAddresses=*/1);
+
+  auto firstConnection = pool.connect(firstListener->addr());
+  EXPECT_EQ(pool.numSpareConnections(), 2);
+
+  // The spares to the first address are closed to make room for the ones to
+  // the second address.
+  auto secondConnection = pool.connect(secondListener->addr());
+  EXPECT_EQ(pool.numSpareConnections(), 2);
+
+  // The connection that was handed out stays open, whereas the remote ends see
+  // the two spares being closed.
+  std::vector<std::future<Error>> readFutures;
+  std::vector<std::shared_ptr<Connection>> peers;
+  for (int connIdx = 0; connIdx < 3; connIdx++) {
+    peers.push_back(accept(firstListener));
+    auto readProm = std::make_shared<std::promise<Error>>();
+    readFutures.push_back(readProm->get_future());
+    peers.back()->read(
+        [readProm](const Error& error, const void* /* unused */, size_t) {
+          readProm->set_value(error);
+        });
+  }
+  write(firstConnection, "hello");
+  int numFailedReads = 0;
+  for (auto& readFuture : readFutures) {
+    if (readFuture.get()) {
+      numFailedReads++;
+    }
+  }
+  EXPECT_EQ(numFailedReads, 2);
+
+  pool.close();
+  context->join();
+}
@@ -175,6 +175,128 @@ TEST_P(TransportTest, Connection_QueueWritesBeforeReads) {
       });
 }
 
+TEST_P(TransportTest, Connection_VectoredWrite) {
+  const std::vector<std::string> msgs = {
+      "a", std::string(16 * 1024, 'b'), "the last one"};
+
+  testConnection(
+      [&](std::shared_ptr<Connection> conn) {
+        // The buffers must be readable separately, as if they had been written
+        // by distinct operations.
+        for (int i = 0; i < msgs.size(); i++) {
+          doRead(
+              conn,
+              [&, conn, i](const Error& error, const void* data, size_t len) {
+                ASSERT_FALSE(error) << error.what();
+                ASSERT_EQ(len, msgs[i].length());
+                ASSERT_EQ(
+                    std::string(reinterpret_cast<const char*>(data), len),
+                    msgs[i]);
+                if (i == msgs.size() - 1) {
+                  peers_->done(PeerGroup::kServer);
+                }
+              });
+        }
+        peers_->join(PeerGroup::kServer);
+      },
+      [&](std::shared_ptr<Connection> conn) {
+        std::vector<iovec> iovs;
+        for (const auto& msg : msgs) {
+          iovs.push_back(iovec{const_cast<char*>(msg.data()), msg.length()});
+        }
+        doWrite(conn, std::move(iovs), [&, conn](const Error& error) {
+          ASSERT_FALSE(error) << error.what();
+          peers_->done(PeerGroup::kClient);
+        });
+        peers_->join(PeerGroup::kClient);
+      });
+}
+
+TEST_P(TransportTest, Connection_WriteArray) {
+  const std::vector<std::string> msgs = {
+      "a", std::string(16 * 1024, 'b'), "the last one"};
+
+  testConnection(
+      [&](std::shared_ptr<Connection> conn) {
+        // The array is reused for a second write, hence all the buffers are
+        // expected twice.
+        for (int i = 0; i < 2 * msgs.size(); i++) {
+          doRead(
+              conn,
+              [&, conn, i](const Error& error, const void* data, size_t len) {
+                ASSERT_FALSE(error) << error.what();
+                const std::string& msg = msgs[i % msgs.size()];
+                ASSERT_EQ(len, msg.length());
+                ASSERT_EQ(
+                    std::string(reinterpret_cast<const char*>(data), len), msg);
+                if (i == 2 * msgs.size() - 1) {
+                  peers_->done(PeerGroup::kServer);
+                }
+              });
+        }
+        peers_->join(PeerGroup::kServer);
+      },
+      [&](std::shared_ptr<Connection> conn) {
+        // The array must remain valid until the write's callback is called,
+        // after which it can be reused.
+        std::array<iovec, 3> iovs;
+        for (int i = 0; i < msgs.size(); i++) {
+          iovs[i] = iovec{const_cast<char*>(msgs[i].data()), msgs[i].length()};
+        }
+        doWriteArray(
+            conn, iovs.data(), iovs.size(), [&, conn](const Error& error) {
+              ASSERT_FALSE(error) << error.what();
+              doWriteArray(
+                  conn,
+                  iovs.data(),
+                  iovs.size(),
+                  [&, conn](const Error& error) {
+                    ASSERT_FALSE(error) << error.what();
+                    peers_->done(PeerGroup::kClient);
+                  });
+            });
+        peers_->join(PeerGroup::kClient);
+      });
+}
+
+TEST_P(TransportTest, Connection_VectoredRead) {
+  const std::vector<std::string> msgs = {
+      "a", std::string(16 * 1024, 'b'), "the last one"};
+
+  testConnection(
+      [&](std::shared_ptr<Connection> conn) {
+        // The buffers were written by distinct operations but must be
+        // scattered by a single read.
+        std::vector<std::string> bufs;
+        std::vector<iovec> iovs;
+        for (const auto& msg : msgs) {
+          bufs.emplace_back(msg.length(), '\0');
+        }
+        for (auto& buf : bufs) {
+          iovs.push_back(iovec{&buf[0], buf.length()});
+        }
+        doRead(conn, std::move(iovs), [&, conn](const Error& error) {
+          ASSERT_FALSE(error) << error.what();
+          ASSERT_EQ(bufs, msgs);
+          peers_->done(PeerGroup::kServer);
+        });
+        peers_->join(PeerGroup::kServer);
+      },
+      [&](std::shared_ptr<Connection> conn) {
+        for (const auto& msg : msgs) {
+          doWrite(
+              conn,
+              msg.data(),
+              msg.length(),
+              [&, conn](const Error& error) {
+                ASSERT_FALSE(error) << error.what();
+              });
+        }
+        peers_->done(PeerGroup::kClient);
+        peers_->join(PeerGroup::kClient);
+      });
+}
+
 // TODO: Enable this test when uv transport could handle
 TEST_P(TransportTest, DISABLED_Connection_EmptyBuffer) {
   constexpr size_t numBytes = 13;
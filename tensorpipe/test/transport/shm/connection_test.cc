@@ -8,6 +8,8 @@
 
 #include <tensorpipe/test/transport/shm/shm_test.h>
 
+#include <cstring>
+
 #include <gtest/gtest.h>
 #include <nop/serializer.h>
 #include <nop/structure.h>
@@ -21,7 +23,7 @@ class ShmTransportTest : public TransportTest {};
 
 SHMTransportTestHelper helper;
 
-// This value is defined in tensorpipe/transport/shm/connection.h
+// This is the default value of shm::ContextOptions::bufferSize_.
 static constexpr auto kBufferSize = 2 * 1024 * 1024;
 
 } // namespace
@@ -176,3 +178,62 @@ TEST_P(ShmTransportTest, NopWriteWrapAround) {
 }
 
 INSTANTIATE_TEST_CASE_P(Shm, ShmTransportTest, ::testing::Values(&helper));
+
+namespace {
+
+class ShmTransportOptionsTest : public TransportTest {};
+
+// Huge pages are used only if the system has some available, but in either case
+// the connection must work the same.
+SHMTransportTestHelper optionsHelper(shm::ContextOptions()
+                                         .bufferSize(4 * 1024 * 1024)
+                                         .hugePageSize(2 * 1024 * 1024));
+
+} // namespace
+
+TEST_P(ShmTransportOptionsTest, LargeBufferWithHugePages) {
+  const size_t kMsgSize = 3 * 4 * 1024 * 1024;
+  std::string srcBuf(kMsgSize, 0x42);
+  auto dstBuf = std::make_unique<char[]>(kMsgSize);
+
+  testConnection(
+      [&](std::shared_ptr<Connection> conn) {
+        doRead(
+            conn,
+            dstBuf.get(),
+            kMsgSize,
+            [&, conn](const Error& error, const void* ptr, size_t len) {
+              ASSERT_FALSE(error) << error.what();
+              ASSERT_EQ(len, kMsgSize);
+              ASSERT_EQ(std::memcmp(dstBuf.get(), srcBuf.data(), kMsgSize), 0);
+              peers_->done(PeerGroup::kServer);
+            });
+        peers_->join(PeerGroup::kServer);
+      },
+      [&](std::shared_ptr<Connection> conn) {
+        doWrite(
+            conn,
+            srcBuf.c_str(),
+            srcBuf.length(),
+            [&, conn](const Error& error) {
+              ASSERT_FALSE(error) << error.what();
+              peers_->done(PeerGroup::kClient);
+            });
+        peers_->join(PeerGroup::kClient);
+      });
+}
+
+INSTANTIATE_TEST_CASE_P(
+    Shm,
+    ShmTransportOptionsTest,
+    ::testing::Values(&optionsHelper));
+
+TEST(ShmContext, InvalidReactorCpu) {
+  // Invalid CPUs are reported by the constructor, before any reactor starts.
+  EXPECT_THROW(
+      shm::Context(shm::ContextOptions().reactorCpus({CPU_SETSIZE - 1})),
+      std::runtime_error);
+  EXPECT_THROW(
+      shm::Context(shm::ContextOptions().reactorCpus({-1})),
+      std::runtime_error);
+}
@@ -9,10 +9,15 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <chrono>
+#include <thread>
+
+#include <tensorpipe/common/busy_polling_loop.h>
 #include <tensorpipe/common/defs.h>
 #include <tensorpipe/common/queue.h>
 #include <tensorpipe/common/socket.h>
 #include <tensorpipe/transport/shm/reactor.h>
+#include <tensorpipe/util/ringbuffer/shm.h>
 
 #include <gtest/gtest.h>
 
@@ -21,6 +26,8 @@ using namespace tensorpipe::transport::shm;
 
 namespace {
 
+constexpr std::chrono::microseconds kSpinDuration{1000};
+
 void run(std::function<void(int)> fn1, std::function<void(int)> fn2) {
   int fds[2];
 
@@ -48,13 +55,41 @@ void run(std::function<void(int)> fn1, std::function<void(int)> fn2) {
   wait(nullptr);
 }
 
+// Map the ring buffer of a reactor, in order to look at its futex word.
+util::ringbuffer::RingBuffer loadRingBuffer(
+    int headerFd,
+    int dataFd,
+    util::shm::Segment& headerSegment,
+    util::shm::Segment& dataSegment) {
+  util::ringbuffer::RingBuffer rb;
+  std::tie(headerSegment, dataSegment, rb) = util::ringbuffer::shm::load(
+      Fd(::dup(headerFd)),
+      Fd(::dup(dataFd)),
+      /*data_page_type=*/nullopt,
+      /*perm_write=*/true,
+      /*mirrored=*/true);
+  return rb;
+}
+
+::testing::AssertionResult waitUntilAsleep(util::ringbuffer::RingBuffer& rb) {
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (!BusyPollingLoop::isSleeping(rb.getHeader().getConsumerFutexWord())) {
+    if (std::chrono::steady_clock::now() > deadline) {
+      return ::testing::AssertionFailure() << "reactor never went to sleep";
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return ::testing::AssertionSuccess();
+}
+
 } // namespace
 
 TEST(ShmReactor, Basic) {
   run(
       [](int fd) {
         tensorpipe::Queue<int> queue;
-        auto reactor = std::make_shared<Reactor>();
+        auto reactor = std::make_shared<Reactor>(kSpinDuration);
         auto token1 = reactor->add([&] { queue.push(1); });
         auto token2 = reactor->add([&] { queue.push(2); });
 
@@ -97,7 +132,7 @@ TEST(ShmReactor, Basic) {
 
 TEST(ShmReactor, TokenReuse) {
   tensorpipe::Queue<int> queue(3);
-  auto reactor = std::make_shared<Reactor>();
+  auto reactor = std::make_shared<Reactor>(kSpinDuration);
   auto t1 = reactor->add([&] { queue.push(1); });
   auto t2 = reactor->add([&] { queue.push(2); });
   auto t3 = reactor->add([&] { queue.push(3); });
@@ -123,3 +158,66 @@ TEST(ShmReactor, TokenReuse) {
   reactor->remove(t5);
   reactor->remove(t6);
 }
+
+TEST(ShmReactor, WakeUpFromSleep) {
+  run(
+      [](int fd) {
+        tensorpipe::Queue<int> queue;
+        // Have the reactor go to sleep as soon as it's idle.
+        auto reactor = std::make_shared<Reactor>(std::chrono::microseconds(0));
+        auto token1 = reactor->add([&] { queue.push(1); });
+        auto token2 = reactor->add([&] { queue.push(2); });
+
+        // Share reactor fds and token with other process.
+        {
+          auto socket = Socket(fd);
+          auto fds = reactor->fds();
+          auto error = socket.sendPayloadAndFds(
+              token1, token2, std::get<0>(fds), std::get<1>(fds));
+          ASSERT_FALSE(error) << error.what();
+        }
+
+        // Wait for other process to run triggers.
+        ASSERT_EQ(queue.pop(), 1);
+        ASSERT_EQ(queue.pop(), 2);
+
+        // Deferred functions must wake up the reactor too.
+        util::shm::Segment headerSegment;
+        util::shm::Segment dataSegment;
+        auto rb = loadRingBuffer(
+            std::get<0>(reactor->fds()),
+            std::get<1>(reactor->fds()),
+            headerSegment,
+            dataSegment);
+        EXPECT_TRUE(waitUntilAsleep(rb));
+        reactor->deferToLoop([&] { queue.push(3); });
+        ASSERT_EQ(queue.pop(), 3);
+
+        reactor->remove(token1);
+        reactor->remove(token2);
+      },
+      [](int fd) {
+        Reactor::TToken token1;
+        Reactor::TToken token2;
+        Fd header;
+        Fd data;
+
+        // Wait for other process to share reactor fds and token.
+        {
+          auto socket = Socket(fd);
+          auto error = socket.recvPayloadAndFds(token1, token2, header, data);
+          ASSERT_FALSE(error) << error.what();
+        }
+
+        // Wait for the reactor to fall asleep before each trigger.
+        util::shm::Segment headerSegment;
+        util::shm::Segment dataSegment;
+        auto rb = loadRingBuffer(
+            header.fd(), data.fd(), headerSegment, dataSegment);
+        Reactor::Trigger trigger(std::move(header), std::move(data));
+        EXPECT_TRUE(waitUntilAsleep(rb));
+        trigger.run(token1);
+        EXPECT_TRUE(waitUntilAsleep(rb));
+        trigger.run(token2);
+      });
+}
@@ -12,6 +12,15 @@ namespace {
 
 SHMTransportTestHelper helper;
 
+// Both ends of each connection are spread across the reactors independently.
+SHMTransportTestHelper multiReactorHelper(
+    tensorpipe::transport::shm::ContextOptions().numReactors(3));
+
 } // namespace
 
 INSTANTIATE_TEST_CASE_P(Shm, TransportTest, ::testing::Values(&helper));
+
+INSTANTIATE_TEST_CASE_P(
+    ShmMultiReactor,
+    TransportTest,
+    ::testing::Values(&multiReactorHelper));
@@ -9,14 +9,20 @@
 #pragma once
 
 #include <sstream>
+#include <utility>
 
 #include <tensorpipe/test/transport/transport_test.h>
 #include <tensorpipe/transport/shm/context.h>
 
 class SHMTransportTestHelper : public TransportTestHelper {
  public:
+  explicit SHMTransportTestHelper(
+      tensorpipe::transport::shm::ContextOptions opts =
+          tensorpipe::transport::shm::ContextOptions())
+      : opts_(std::move(opts)) {}
+
   std::shared_ptr<tensorpipe::transport::Context> getContext() override {
-    return std::make_shared<tensorpipe::transport::shm::Context>();
+    return std::make_shared<tensorpipe::transport::shm::Context>(opts_);
   }
 
   std::string defaultAddr() override {
@@ -27,4 +33,7 @@ class SHMTransportTestHelper : public TransportTestHelper {
     ss << "tensorpipe_test_" << test_info->name() << "_" << getpid();
     return ss.str();
   }
+
+ private:
+  const tensorpipe::transport::shm::ContextOptions opts_;
 };
@@ -10,6 +10,7 @@
 
 #include <future>
 #include <memory>
+#include <vector>
 
 #include <gtest/gtest.h>
 
@@ -141,6 +142,24 @@ class TransportTest : public ::testing::TestWithParam<TransportTestHelper*> {
         });
   }
 
+  void doRead(
+      std::shared_ptr<tensorpipe::transport::Connection> conn,
+      std::vector<iovec> iovs,
+      tensorpipe::transport::Connection::read_iovs_callback_fn fn) {
+    auto mutex = std::make_shared<std::mutex>();
+    std::lock_guard<std::mutex> outerLock(*mutex);
+    // We acquire the same mutex while calling read and inside its callback so
+    // that we deadlock if the callback is invoked inline.
+    conn->read(
+        std::move(iovs),
+        [fn{std::move(fn)}, mutex, bomb{armBomb()}](
+            const tensorpipe::Error& error) {
+          std::lock_guard<std::mutex> innerLock(*mutex);
+          bomb->defuse();
+          fn(error);
+        });
+  }
+
   void doWrite(
       std::shared_ptr<tensorpipe::transport::Connection> conn,
       const void* ptr,
@@ -160,4 +179,42 @@ class TransportTest : public ::testing::TestWithParam<TransportTestHelper*> {
           fn(error);
         });
   }
+
+  void doWrite(
+      std::shared_ptr<tensorpipe::transport::Connection> conn,
+      std::vector<iovec> iovs,
+      tensorpipe::transport::Connection::write_callback_fn fn) {
+    auto mutex = std::make_shared<std::mutex>();
+    // We acquire the same mutex while calling write and inside its callback
+    // so that we deadlock if the callback is invoked inline.
+    std::lock_guard<std::mutex> outerLock(*mutex);
+    conn->write(
+        std::move(iovs),
+        [fn{std::move(fn)}, mutex, bomb{armBomb()}](
+            const tensorpipe::Error& error) {
+          std::lock_guard<std::mutex> innerLock(*mutex);
+          bomb->defuse();
+          fn(error);
+        });
+  }
+
+  void doWriteArray(
+      std::shared_ptr<tensorpipe::transport::Connection> conn,
+      const iovec* iovs,
+      size_t numIovs,
+      tensorpipe::transport::Connection::write_callback_fn fn) {
+    auto mutex = std::make_shared<std::mutex>();
+    // We acquire the same mutex while calling write and inside its callback
+    // so that we deadlock if the callback is invoked inline.
+    std::lock_guard<std::mutex> outerLock(*mutex);
+    conn->writeArray(
+        iovs,
+        numIovs,
+        [fn{std::move(fn)}, mutex, bomb{armBomb()}](
+            const tensorpipe::Error& error) {
+          std::lock_guard<std::mutex> innerLock(*mutex);
+          bomb->defuse();
+          fn(error);
+        });
+  }
 };
@@ -8,6 +8,9 @@
 
 #include <tensorpipe/test/transport/uv/uv_test.h>
 
+#include <string>
+#include <vector>
+
 #include <gtest/gtest.h>
 
 namespace {
@@ -50,6 +53,52 @@ TEST_P(UVTransportConnectionTest, LargeWrite) {
       });
 }
 
+TEST_P(UVTransportConnectionTest, ManySmallWritesWithLargeOne) {
+  // The small messages get drained together into the read-ahead buffer, which
+  // will then also contain the beginning of the large one.
+  constexpr int kNumMsgs = 1000;
+  std::vector<std::string> msgs;
+  for (int i = 0; i < kNumMsgs; i++) {
+    msgs.push_back(std::to_string(i));
+  }
+  msgs.push_back(std::string(1024 * 1024, 0x42));
+  msgs.push_back("the last one");
+
+  testConnection(
+      [&](std::shared_ptr<Connection> conn) {
+        for (int i = 0; i < msgs.size(); i++) {
+          doWrite(
+              conn,
+              msgs[i].c_str(),
+              msgs[i].length(),
+              [&, conn, i](const Error& error) {
+                ASSERT_FALSE(error) << error.what();
+                if (i == msgs.size() - 1) {
+                  peers_->done(PeerGroup::kServer);
+                }
+              });
+        }
+        peers_->join(PeerGroup::kServer);
+      },
+      [&](std::shared_ptr<Connection> conn) {
+        for (int i = 0; i < msgs.size(); i++) {
+          doRead(
+              conn,
+              [&, conn, i](const Error& error, const void* data, size_t len) {
+                ASSERT_FALSE(error) << error.what();
+                ASSERT_EQ(len, msgs[i].length());
+                ASSERT_EQ(
+                    std::string(reinterpret_cast<const char*>(data), len),
+                    msgs[i]);
+                if (i == msgs.size() - 1) {
+                  peers_->done(PeerGroup::kClient);
+                }
+              });
+        }
+        peers_->join(PeerGroup::kClient);
+      });
+}
+
 INSTANTIATE_TEST_CASE_P(
     Uv,
     UVTransportConnectionTest,
@@ -16,8 +16,12 @@
 #include <sys/eventfd.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <unistd.h>
 
+#include <array>
+#include <cstring>
 #include <thread>
+#include <vector>
 
 #include <gtest/gtest.h>
 
@@ -175,3 +179,39 @@ TEST(ShmRingBuffer, SingleProducer_SingleConsumer) {
   // Wait for child to make gtest happy.
   ::wait(nullptr);
 };
+
+TEST(ShmRingBuffer, Mirrored) {
+  // Use the smallest size that is a multiple of the page size.
+  const size_t size = ::sysconf(_SC_PAGESIZE);
+  Segment header_segment;
+  Segment data_segment;
+  RingBuffer rb;
+  std::tie(header_segment, data_segment, rb) =
+      shm::create(size, nullopt, /*perm_write=*/true, /*mirrored=*/true);
+  EXPECT_EQ(data_segment.getSize(), size);
+  Producer prod{rb};
+  Consumer cons{rb};
+
+  // Move the head and tail close to the end of the data.
+  std::vector<uint8_t> buf(size - 3);
+  EXPECT_EQ(prod.write(buf.data(), buf.size()), buf.size());
+  EXPECT_EQ(cons.read(buf.data(), buf.size()), buf.size());
+
+  // Write a slice that wraps around.
+  const std::array<uint8_t, 8> in = {0, 1, 2, 3, 4, 5, 6, 7};
+  EXPECT_EQ(prod.write(in.data(), in.size()), in.size());
+
+  // Both halves of the mapping alias the same memory.
+  EXPECT_EQ(rb.getData()[0], 3);
+  EXPECT_EQ(rb.getData()[size], 3);
+
+  // The slice is accessible as a single contiguous area.
+  ASSERT_EQ(cons.startTx(), 0);
+  ssize_t ret;
+  std::array<Consumer::Buffer, 2> buffers;
+  std::tie(ret, buffers) = cons.accessContiguousInTx</*allowPartial=*/false>(8);
+  ASSERT_EQ(ret, 1);
+  EXPECT_EQ(buffers[0].len, 8);
+  EXPECT_EQ(std::memcmp(buffers[0].ptr, in.data(), in.size()), 0);
+  ASSERT_EQ(cons.commitTx(), 0);
+}
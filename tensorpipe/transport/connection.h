@@ -8,10 +8,13 @@
 
 #pragma once
 
-#include <functional>
+#include <sys/uio.h>
+
 #include <string>
+#include <vector>
 
 #include <tensorpipe/common/error.h>
+#include <tensorpipe/common/inline_function.h>
 #include <tensorpipe/common/nop.h>
 #include <tensorpipe/transport/context.h>
 
@@ -21,16 +24,45 @@ namespace transport {
 class Connection {
  public:
   using read_callback_fn =
-      std::function<void(const Error& error, const void* ptr, size_t len)>;
+      InlineFunction<void(const Error& error, const void* ptr, size_t len)>;
 
   virtual void read(read_callback_fn fn) = 0;
 
   virtual void read(void* ptr, size_t length, read_callback_fn fn) = 0;
 
-  using write_callback_fn = std::function<void(const Error& error)>;
+  // Read multiple buffers in one operation.
+  //
+  // This consumes as many consecutive buffers as there are entries in the
+  // vector (i.e., the ones produced by as many separate writes, or by a single
+  // vectored write), each of which must have the length of its entry. The
+  // transport scatters them directly into the given memory, possibly as part
+  // of a single syscall or ringbuffer transaction. The callback is called once
+  // all of them have been read. The vector must not be empty.
+  using read_iovs_callback_fn = InlineFunction<void(const Error& error)>;
+
+  virtual void read(std::vector<iovec> iovs, read_iovs_callback_fn fn) = 0;
+
+  using write_callback_fn = InlineFunction<void(const Error& error)>;
 
   virtual void write(const void* ptr, size_t length, write_callback_fn fn) = 0;
 
+  // Write multiple buffers in one operation.
+  //
+  // Each buffer is framed as if it had been passed to a separate call to the
+  // write above, hence the peer can still consume them with separate reads.
+  // However the transport can coalesce them, for example into a single syscall
+  // or a single ringbuffer transaction. The callback is called once all of
+  // them have been written. The vector must not be empty.
+  virtual void write(std::vector<iovec> iovs, write_callback_fn fn) = 0;
+
+  // Same as above, for an array of buffers that the caller keeps ownership of,
+  // so that it can reuse it rather than allocate a vector for each write. Like
+  // the buffers themselves, it must remain valid until the callback is called.
+  virtual void writeArray(
+      const iovec* iovs,
+      size_t numIovs,
+      write_callback_fn fn) = 0;
+
   //
   // Helper functions for reading/writing nop objects.
   //
@@ -43,7 +75,7 @@ class Connection {
   // temporary buffer and instead instead read directly from its peer's
   // ring buffer. This saves an allocation and a memory copy.
   //
-  using read_nop_callback_fn = std::function<void(const Error& error)>;
+  using read_nop_callback_fn = InlineFunction<void(const Error& error)>;
 
   virtual void read(AbstractNopHolder& object, read_nop_callback_fn fn) = 0;
 
@@ -13,6 +13,7 @@
 #include <string>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 #include <tensorpipe/transport/connection.h>
 #include <tensorpipe/transport/connection_impl_boilerplate.h>
@@ -39,9 +40,13 @@ class ConnectionBoilerplate : public Connection {
   void read(read_callback_fn fn) override;
   void read(AbstractNopHolder& object, read_nop_callback_fn fn) override;
   void read(void* ptr, size_t length, read_callback_fn fn) override;
+  void read(std::vector<iovec> iovs, read_iovs_callback_fn fn) override;
 
   // Perform a write operation.
   void write(const void* ptr, size_t length, write_callback_fn fn) override;
+  void write(std::vector<iovec> iovs, write_callback_fn fn) override;
+  void writeArray(const iovec* iovs, size_t numIovs, write_callback_fn fn)
+      override;
   void write(const AbstractNopHolder& object, write_callback_fn fn) override;
 
   // Tell the connection what its identifier is.
@@ -98,6 +103,13 @@ void ConnectionBoilerplate<TCtx, TList, TConn>::read(
   impl_->read(ptr, length, std::move(fn));
 }
 
+template <typename TCtx, typename TList, typename TConn>
+void ConnectionBoilerplate<TCtx, TList, TConn>::read(
+    std::vector<iovec> iovs,
+    read_iovs_callback_fn fn) {
+  impl_->read(std::move(iovs), std::move(fn));
+}
+
 template <typename TCtx, typename TList, typename TConn>
 void ConnectionBoilerplate<TCtx, TList, TConn>::write(
     const void* ptr,
@@ -106,6 +118,21 @@ void ConnectionBoilerplate<TCtx, TList, TConn>::write(
   impl_->write(ptr, length, std::move(fn));
 }
 
+template <typename TCtx, typename TList, typename TConn>
+void ConnectionBoilerplate<TCtx, TList, TConn>::write(
+    std::vector<iovec> iovs,
+    write_callback_fn fn) {
+  impl_->write(std::move(iovs), std::move(fn));
+}
+
+template <typename TCtx, typename TList, typename TConn>
+void ConnectionBoilerplate<TCtx, TList, TConn>::writeArray(
+    const iovec* iovs,
+    size_t numIovs,
+    write_callback_fn fn) {
+  impl_->writeArray(iovs, numIovs, std::move(fn));
+}
+
 template <typename TCtx, typename TList, typename TConn>
 void ConnectionBoilerplate<TCtx, TList, TConn>::write(
     const AbstractNopHolder& object,
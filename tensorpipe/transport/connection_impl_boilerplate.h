@@ -11,9 +11,11 @@
 #include <memory>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include <tensorpipe/common/callback.h>
 #include <tensorpipe/common/defs.h>
+#include <tensorpipe/common/deferred_executor.h>
 #include <tensorpipe/common/error.h>
 #include <tensorpipe/common/error_macros.h>
 #include <tensorpipe/transport/connection.h>
@@ -56,16 +58,19 @@ class ConnectionImplBoilerplate : public std::enable_shared_from_this<TConn> {
   void init();
 
   // Queue a read operation.
-  using read_callback_fn = Connection::read_callback_fn;
-  using read_nop_callback_fn = Connection::read_nop_callback_fn;
-  void read(read_callback_fn fn);
-  void read(AbstractNopHolder& object, read_nop_callback_fn fn);
-  void read(void* ptr, size_t length, read_callback_fn fn);
+  void read(Connection::read_callback_fn fn);
+  void read(AbstractNopHolder& object, Connection::read_nop_callback_fn fn);
+  void read(void* ptr, size_t length, Connection::read_callback_fn fn);
+  void read(std::vector<iovec> iovs, Connection::read_iovs_callback_fn fn);
 
   // Perform a write operation.
-  using write_callback_fn = Connection::write_callback_fn;
-  void write(const void* ptr, size_t length, write_callback_fn fn);
-  void write(const AbstractNopHolder& object, write_callback_fn fn);
+  void write(const void* ptr, size_t length, Connection::write_callback_fn fn);
+  void write(std::vector<iovec> iovs, Connection::write_callback_fn fn);
+  void writeArray(
+      const iovec* iovs,
+      size_t numIovs,
+      Connection::write_callback_fn fn);
+  void write(const AbstractNopHolder& object, Connection::write_callback_fn fn);
 
   // Tell the connection what its identifier is.
   void setId(std::string id);
@@ -76,6 +81,19 @@ class ConnectionImplBoilerplate : public std::enable_shared_from_this<TConn> {
   virtual ~ConnectionImplBoilerplate() = default;
 
  protected:
+  // The callbacks given to the implementation wrap the ones given by the user
+  // with some bookkeeping, hence they have more room than those. The reads of
+  // nop objects are by default wrapped once more into plain reads.
+  using read_callback_fn = InlineFunction<
+      void(const Error& error, const void* ptr, size_t len),
+      wrappingCapacity(kWrappedCallbackInlineCapacity)>;
+  using read_nop_callback_fn =
+      InlineFunction<void(const Error& error), kWrappedCallbackInlineCapacity>;
+  using read_iovs_callback_fn =
+      InlineFunction<void(const Error& error), kWrappedCallbackInlineCapacity>;
+  using write_callback_fn =
+      InlineFunction<void(const Error& error), kWrappedCallbackInlineCapacity>;
+
   virtual void initImplFromLoop() = 0;
   virtual void readImplFromLoop(read_callback_fn fn) = 0;
   virtual void readImplFromLoop(
@@ -85,15 +103,30 @@ class ConnectionImplBoilerplate : public std::enable_shared_from_this<TConn> {
       void* ptr,
       size_t length,
       read_callback_fn fn) = 0;
+  virtual void readImplFromLoop(
+      std::vector<iovec> iovs,
+      read_iovs_callback_fn fn);
   virtual void writeImplFromLoop(
       const void* ptr,
       size_t length,
       write_callback_fn fn) = 0;
+  virtual void writeImplFromLoop(
+      std::vector<iovec> iovs,
+      write_callback_fn fn);
+  virtual void writeArrayImplFromLoop(
+      const iovec* iovs,
+      size_t numIovs,
+      write_callback_fn fn);
   virtual void writeImplFromLoop(
       const AbstractNopHolder& object,
       write_callback_fn fn);
   virtual void handleErrorImpl() = 0;
 
+  // The event loop on which all the operations of the connection are run. By
+  // default it is the one of the context, but transports that have several
+  // loops can override this to spread their connections across them.
+  virtual DeferredExecutor& getLoop();
+
   void setError(Error error);
 
   const std::shared_ptr<TCtx> context_;
@@ -110,13 +143,28 @@ class ConnectionImplBoilerplate : public std::enable_shared_from_this<TConn> {
   void initFromLoop();
 
   // Queue a read operation.
-  void readFromLoop(read_callback_fn fn);
-  void readFromLoop(AbstractNopHolder& object, read_nop_callback_fn fn);
-  void readFromLoop(void* ptr, size_t length, read_callback_fn fn);
+  void readFromLoop(Connection::read_callback_fn fn);
+  void readFromLoop(
+      AbstractNopHolder& object,
+      Connection::read_nop_callback_fn fn);
+  void readFromLoop(void* ptr, size_t length, Connection::read_callback_fn fn);
+  void readFromLoop(
+      std::vector<iovec> iovs,
+      Connection::read_iovs_callback_fn fn);
 
   // Perform a write operation.
-  void writeFromLoop(const void* ptr, size_t length, write_callback_fn fn);
-  void writeFromLoop(const AbstractNopHolder& object, write_callback_fn fn);
+  void writeFromLoop(
+      const void* ptr,
+      size_t length,
+      Connection::write_callback_fn fn);
+  void writeFromLoop(std::vector<iovec> iovs, Connection::write_callback_fn fn);
+  void writeArrayFromLoop(
+      const iovec* iovs,
+      size_t numIovs,
+      Connection::write_callback_fn fn);
+  void writeFromLoop(
+      const AbstractNopHolder& object,
+      Connection::write_callback_fn fn);
 
   void setIdFromLoop(std::string id);
 
@@ -148,7 +196,7 @@ ConnectionImplBoilerplate<TCtx, TList, TConn>::ConnectionImplBoilerplate(
 
 template <typename TCtx, typename TList, typename TConn>
 void ConnectionImplBoilerplate<TCtx, TList, TConn>::init() {
-  context_->deferToLoop(
+  getLoop().deferToLoop(
       [impl{this->shared_from_this()}]() { impl->initFromLoop(); });
 }
 
@@ -160,8 +208,14 @@ void ConnectionImplBoilerplate<TCtx, TList, TConn>::initFromLoop() {
 }
 
 template <typename TCtx, typename TList, typename TConn>
-void ConnectionImplBoilerplate<TCtx, TList, TConn>::read(read_callback_fn fn) {
-  context_->deferToLoop(
+DeferredExecutor& ConnectionImplBoilerplate<TCtx, TList, TConn>::getLoop() {
+  return *context_;
+}
+
+template <typename TCtx, typename TList, typename TConn>
+void ConnectionImplBoilerplate<TCtx, TList, TConn>::read(
+    Connection::read_callback_fn fn) {
+  getLoop().deferToLoop(
       [impl{this->shared_from_this()}, fn{std::move(fn)}]() mutable {
         impl->readFromLoop(std::move(fn));
       });
@@ -169,36 +223,37 @@ void ConnectionImplBoilerplate<TCtx, TList, TConn>::read(read_callback_fn fn) {
 
 template <typename TCtx, typename TList, typename TConn>
 void ConnectionImplBoilerplate<TCtx, TList, TConn>::readFromLoop(
-    read_callback_fn fn) {
-  TP_DCHECK(context_->inLoop());
+    Connection::read_callback_fn fn) {
+  TP_DCHECK(getLoop().inLoop());
 
   uint64_t sequenceNumber = nextBufferBeingRead_++;
   TP_VLOG(7) << "Connection " << id_ << " received a read request (#"
              << sequenceNumber << ")";
 
-  fn = [this, sequenceNumber, fn{std::move(fn)}](
-           const Error& error, const void* ptr, size_t length) {
-    TP_DCHECK_EQ(sequenceNumber, nextReadCallbackToCall_++);
-    TP_VLOG(7) << "Connection " << id_ << " is calling a read callback (#"
-               << sequenceNumber << ")";
-    fn(error, ptr, length);
-    TP_VLOG(7) << "Connection " << id_ << " done calling a read callback (#"
-               << sequenceNumber << ")";
-  };
+  read_callback_fn wrappedFn =
+      [this, sequenceNumber, fn{std::move(fn)}](
+          const Error& error, const void* ptr, size_t length) {
+        TP_DCHECK_EQ(sequenceNumber, nextReadCallbackToCall_++);
+        TP_VLOG(7) << "Connection " << id_ << " is calling a read callback (#"
+                   << sequenceNumber << ")";
+        fn(error, ptr, length);
+        TP_VLOG(7) << "Connection " << id_ << " done calling a read callback (#"
+                   << sequenceNumber << ")";
+      };
 
   if (error_) {
-    fn(error_, nullptr, 0);
+    wrappedFn(error_, nullptr, 0);
     return;
   }
 
-  readImplFromLoop(std::move(fn));
+  readImplFromLoop(std::move(wrappedFn));
 }
 
 template <typename TCtx, typename TList, typename TConn>
 void ConnectionImplBoilerplate<TCtx, TList, TConn>::read(
     AbstractNopHolder& object,
-    read_nop_callback_fn fn) {
-  context_->deferToLoop(
+    Connection::read_nop_callback_fn fn) {
+  getLoop().deferToLoop(
       [impl{this->shared_from_this()}, &object, fn{std::move(fn)}]() mutable {
         impl->readFromLoop(object, std::move(fn));
       });
@@ -207,30 +262,31 @@ void ConnectionImplBoilerplate<TCtx, TList, TConn>::read(
 template <typename TCtx, typename TList, typename TConn>
 void ConnectionImplBoilerplate<TCtx, TList, TConn>::readFromLoop(
     AbstractNopHolder& object,
-    read_nop_callback_fn fn) {
-  TP_DCHECK(context_->inLoop());
+    Connection::read_nop_callback_fn fn) {
+  TP_DCHECK(getLoop().inLoop());
 
   uint64_t sequenceNumber = nextBufferBeingRead_++;
   TP_VLOG(7) << "Connection " << id_ << " received a nop object read request (#"
              << sequenceNumber << ")";
 
-  fn = [this, sequenceNumber, fn{std::move(fn)}](const Error& error) {
-    TP_DCHECK_EQ(sequenceNumber, nextReadCallbackToCall_++);
-    TP_VLOG(7) << "Connection " << id_
-               << " is calling a nop object read callback (#" << sequenceNumber
-               << ")";
-    fn(error);
-    TP_VLOG(7) << "Connection " << id_
-               << " done calling a nop object read callback (#"
-               << sequenceNumber << ")";
-  };
+  read_nop_callback_fn wrappedFn =
+      [this, sequenceNumber, fn{std::move(fn)}](const Error& error) {
+        TP_DCHECK_EQ(sequenceNumber, nextReadCallbackToCall_++);
+        TP_VLOG(7) << "Connection " << id_
+                   << " is calling a nop object read callback (#"
+                   << sequenceNumber << ")";
+        fn(error);
+        TP_VLOG(7) << "Connection " << id_
+                   << " done calling a nop object read callback (#"
+                   << sequenceNumber << ")";
+      };
 
   if (error_) {
-    fn(error_);
+    wrappedFn(error_);
     return;
   }
 
-  readImplFromLoop(object, std::move(fn));
+  readImplFromLoop(object, std::move(wrappedFn));
 }
 
 template <typename TCtx, typename TList, typename TConn>
@@ -253,8 +309,8 @@ template <typename TCtx, typename TList, typename TConn>
 void ConnectionImplBoilerplate<TCtx, TList, TConn>::read(
     void* ptr,
     size_t length,
-    read_callback_fn fn) {
-  context_->deferToLoop([impl{this->shared_from_this()},
+    Connection::read_callback_fn fn) {
+  getLoop().deferToLoop([impl{this->shared_from_this()},
                          ptr,
                          length,
                          fn{std::move(fn)}]() mutable {
@@ -266,37 +322,109 @@ template <typename TCtx, typename TList, typename TConn>
 void ConnectionImplBoilerplate<TCtx, TList, TConn>::readFromLoop(
     void* ptr,
     size_t length,
-    read_callback_fn fn) {
-  TP_DCHECK(context_->inLoop());
+    Connection::read_callback_fn fn) {
+  TP_DCHECK(getLoop().inLoop());
 
   uint64_t sequenceNumber = nextBufferBeingRead_++;
   TP_VLOG(7) << "Connection " << id_ << " received a read request (#"
              << sequenceNumber << ")";
 
-  fn = [this, sequenceNumber, fn{std::move(fn)}](
-           const Error& error, const void* ptr, size_t length) {
-    TP_DCHECK_EQ(sequenceNumber, nextReadCallbackToCall_++);
-    TP_VLOG(7) << "Connection " << id_ << " is calling a read callback (#"
-               << sequenceNumber << ")";
-    fn(error, ptr, length);
-    TP_VLOG(7) << "Connection " << id_ << " done calling a read callback (#"
-               << sequenceNumber << ")";
-  };
+  read_callback_fn wrappedFn =
+      [this, sequenceNumber, fn{std::move(fn)}](
+          const Error& error, const void* ptr, size_t length) {
+        TP_DCHECK_EQ(sequenceNumber, nextReadCallbackToCall_++);
+        TP_VLOG(7) << "Connection " << id_ << " is calling a read callback (#"
+                   << sequenceNumber << ")";
+        fn(error, ptr, length);
+        TP_VLOG(7) << "Connection " << id_ << " done calling a read callback (#"
+                   << sequenceNumber << ")";
+      };
+
+  if (error_) {
+    wrappedFn(error_, ptr, length);
+    return;
+  }
+
+  readImplFromLoop(ptr, length, std::move(wrappedFn));
+}
+
+template <typename TCtx, typename TList, typename TConn>
+void ConnectionImplBoilerplate<TCtx, TList, TConn>::read(
+    std::vector<iovec> iovs,
+    Connection::read_iovs_callback_fn fn) {
+  getLoop().deferToLoop([impl{this->shared_from_this()},
+                         iovs{std::move(iovs)},
+                         fn{std::move(fn)}]() mutable {
+    impl->readFromLoop(std::move(iovs), std::move(fn));
+  });
+}
+
+template <typename TCtx, typename TList, typename TConn>
+void ConnectionImplBoilerplate<TCtx, TList, TConn>::readFromLoop(
+    std::vector<iovec> iovs,
+    Connection::read_iovs_callback_fn fn) {
+  TP_DCHECK(getLoop().inLoop());
+  TP_DCHECK(!iovs.empty());
+
+  uint64_t sequenceNumber = nextBufferBeingRead_++;
+  TP_VLOG(7) << "Connection " << id_ << " received a vectored read request (#"
+             << sequenceNumber << ", containing " << iovs.size()
+             << " buffers)";
+
+  read_iovs_callback_fn wrappedFn =
+      [this, sequenceNumber, fn{std::move(fn)}](const Error& error) {
+        TP_DCHECK_EQ(sequenceNumber, nextReadCallbackToCall_++);
+        TP_VLOG(7) << "Connection " << id_
+                   << " is calling a vectored read callback (#"
+                   << sequenceNumber << ")";
+        fn(error);
+        TP_VLOG(7) << "Connection " << id_
+                   << " done calling a vectored read callback (#"
+                   << sequenceNumber << ")";
+      };
 
   if (error_) {
-    fn(error_, ptr, length);
+    wrappedFn(error_);
     return;
   }
 
-  readImplFromLoop(ptr, length, std::move(fn));
+  readImplFromLoop(std::move(iovs), std::move(wrappedFn));
+}
+
+template <typename TCtx, typename TList, typename TConn>
+void ConnectionImplBoilerplate<TCtx, TList, TConn>::readImplFromLoop(
+    std::vector<iovec> iovs,
+    read_iovs_callback_fn fn) {
+  // Fall back to one read per buffer. As the callbacks of the reads are called
+  // in order, and once one fails all the following ones do too, we only need
+  // to forward the callback of the last one.
+  const size_t numIovs = iovs.size();
+  for (size_t iovIdx = 0; iovIdx < numIovs; iovIdx++) {
+    if (iovIdx + 1 < numIovs) {
+      readImplFromLoop(
+          iovs[iovIdx].iov_base,
+          iovs[iovIdx].iov_len,
+          [](const Error& /* unused */,
+             const void* /* unused */,
+             size_t /* unused */) {});
+    } else {
+      readImplFromLoop(
+          iovs[iovIdx].iov_base,
+          iovs[iovIdx].iov_len,
+          [fn{std::move(fn)}](
+              const Error& error,
+              const void* /* unused */,
+              size_t /* unused */) { fn(error); });
+    }
+  }
 }
 
 template <typename TCtx, typename TList, typename TConn>
 void ConnectionImplBoilerplate<TCtx, TList, TConn>::write(
     const void* ptr,
     size_t length,
-    write_callback_fn fn) {
-  context_->deferToLoop([impl{this->shared_from_this()},
+    Connection::write_callback_fn fn) {
+  getLoop().deferToLoop([impl{this->shared_from_this()},
                          ptr,
                          length,
                          fn{std::move(fn)}]() mutable {
@@ -308,35 +436,155 @@ template <typename TCtx, typename TList, typename TConn>
 void ConnectionImplBoilerplate<TCtx, TList, TConn>::writeFromLoop(
     const void* ptr,
     size_t length,
-    write_callback_fn fn) {
-  TP_DCHECK(context_->inLoop());
+    Connection::write_callback_fn fn) {
+  TP_DCHECK(getLoop().inLoop());
 
   uint64_t sequenceNumber = nextBufferBeingWritten_++;
   TP_VLOG(7) << "Connection " << id_ << " received a write request (#"
              << sequenceNumber << ")";
 
-  fn = [this, sequenceNumber, fn{std::move(fn)}](const Error& error) {
-    TP_DCHECK_EQ(sequenceNumber, nextWriteCallbackToCall_++);
-    TP_VLOG(7) << "Connection " << id_ << " is calling a write callback (#"
-               << sequenceNumber << ")";
-    fn(error);
-    TP_VLOG(7) << "Connection " << id_ << " done calling a write callback (#"
-               << sequenceNumber << ")";
-  };
+  write_callback_fn wrappedFn =
+      [this, sequenceNumber, fn{std::move(fn)}](const Error& error) {
+        TP_DCHECK_EQ(sequenceNumber, nextWriteCallbackToCall_++);
+        TP_VLOG(7) << "Connection " << id_ << " is calling a write callback (#"
+                   << sequenceNumber << ")";
+        fn(error);
+        TP_VLOG(7) << "Connection " << id_
+                   << " done calling a write callback (#" << sequenceNumber
+                   << ")";
+      };
 
   if (error_) {
-    fn(error_);
+    wrappedFn(error_);
     return;
   }
 
-  writeImplFromLoop(ptr, length, std::move(fn));
+  writeImplFromLoop(ptr, length, std::move(wrappedFn));
 }
 
 template <typename TCtx, typename TList, typename TConn>
 void ConnectionImplBoilerplate<TCtx, TList, TConn>::write(
-    const AbstractNopHolder& object,
+    std::vector<iovec> iovs,
+    Connection::write_callback_fn fn) {
+  getLoop().deferToLoop([impl{this->shared_from_this()},
+                         iovs{std::move(iovs)},
+                         fn{std::move(fn)}]() mutable {
+    impl->writeFromLoop(std::move(iovs), std::move(fn));
+  });
+}
+
+template <typename TCtx, typename TList, typename TConn>
+void ConnectionImplBoilerplate<TCtx, TList, TConn>::writeFromLoop(
+    std::vector<iovec> iovs,
+    Connection::write_callback_fn fn) {
+  TP_DCHECK(getLoop().inLoop());
+  TP_DCHECK(!iovs.empty());
+
+  uint64_t sequenceNumber = nextBufferBeingWritten_++;
+  TP_VLOG(7) << "Connection " << id_ << " received a vectored write request (#"
+             << sequenceNumber << ", containing " << iovs.size()
+             << " buffers)";
+
+  write_callback_fn wrappedFn =
+      [this, sequenceNumber, fn{std::move(fn)}](const Error& error) {
+        TP_DCHECK_EQ(sequenceNumber, nextWriteCallbackToCall_++);
+        TP_VLOG(7) << "Connection " << id_
+                   << " is calling a vectored write callback (#"
+                   << sequenceNumber << ")";
+        fn(error);
+        TP_VLOG(7) << "Connection " << id_
+                   << " done calling a vectored write callback (#"
+                   << sequenceNumber << ")";
+      };
+
+  if (error_) {
+    wrappedFn(error_);
+    return;
+  }
+
+  writeImplFromLoop(std::move(iovs), std::move(wrappedFn));
+}
+
+template <typename TCtx, typename TList, typename TConn>
+void ConnectionImplBoilerplate<TCtx, TList, TConn>::writeImplFromLoop(
+    std::vector<iovec> iovs,
+    write_callback_fn fn) {
+  // Fall back to one write per buffer. As the callbacks of the writes are
+  // called in order, and once one fails all the following ones do too, we only
+  // need to forward the callback of the last one.
+  const size_t numIovs = iovs.size();
+  for (size_t iovIdx = 0; iovIdx < numIovs; iovIdx++) {
+    if (iovIdx + 1 < numIovs) {
+      writeImplFromLoop(
+          iovs[iovIdx].iov_base,
+          iovs[iovIdx].iov_len,
+          [](const Error& /* unused */) {});
+    } else {
+      writeImplFromLoop(
+          iovs[iovIdx].iov_base, iovs[iovIdx].iov_len, std::move(fn));
+    }
+  }
+}
+
+template <typename TCtx, typename TList, typename TConn>
+void ConnectionImplBoilerplate<TCtx, TList, TConn>::writeArray(
+    const iovec* iovs,
+    size_t numIovs,
+    Connection::write_callback_fn fn) {
+  getLoop().deferToLoop([impl{this->shared_from_this()},
+                         iovs,
+                         numIovs,
+                         fn{std::move(fn)}]() mutable {
+    impl->writeArrayFromLoop(iovs, numIovs, std::move(fn));
+  });
+}
+
+template <typename TCtx, typename TList, typename TConn>
+void ConnectionImplBoilerplate<TCtx, TList, TConn>::writeArrayFromLoop(
+    const iovec* iovs,
+    size_t numIovs,
+    Connection::write_callback_fn fn) {
+  TP_DCHECK(getLoop().inLoop());
+  TP_DCHECK_GT(numIovs, 0);
+
+  uint64_t sequenceNumber = nextBufferBeingWritten_++;
+  TP_VLOG(7) << "Connection " << id_ << " received a vectored write request (#"
+             << sequenceNumber << ", containing " << numIovs << " buffers)";
+
+  write_callback_fn wrappedFn =
+      [this, sequenceNumber, fn{std::move(fn)}](const Error& error) {
+        TP_DCHECK_EQ(sequenceNumber, nextWriteCallbackToCall_++);
+        TP_VLOG(7) << "Connection " << id_
+                   << " is calling a vectored write callback (#"
+                   << sequenceNumber << ")";
+        fn(error);
+        TP_VLOG(7) << "Connection " << id_
+                   << " done calling a vectored write callback (#"
+                   << sequenceNumber << ")";
+      };
+
+  if (error_) {
+    wrappedFn(error_);
+    return;
+  }
+
+  writeArrayImplFromLoop(iovs, numIovs, std::move(wrappedFn));
+}
+
+template <typename TCtx, typename TList, typename TConn>
+void ConnectionImplBoilerplate<TCtx, TList, TConn>::writeArrayImplFromLoop(
+    const iovec* iovs,
+    size_t numIovs,
     write_callback_fn fn) {
-  context_->deferToLoop(
+  // Transports that don't use the array right away need their own copy.
+  writeImplFromLoop(std::vector<iovec>(iovs, iovs + numIovs), std::move(fn));
+}
+
+template <typename TCtx, typename TList, typename TConn>
+void ConnectionImplBoilerplate<TCtx, TList, TConn>::write(
+    const AbstractNopHolder& object,
+    Connection::write_callback_fn fn) {
+  getLoop().deferToLoop(
       [impl{this->shared_from_this()}, &object, fn{std::move(fn)}]() mutable {
         impl->writeFromLoop(object, std::move(fn));
       });
@@ -345,31 +593,32 @@ void ConnectionImplBoilerplate<TCtx, TList, TConn>::write(
 template <typename TCtx, typename TList, typename TConn>
 void ConnectionImplBoilerplate<TCtx, TList, TConn>::writeFromLoop(
     const AbstractNopHolder& object,
-    write_callback_fn fn) {
-  TP_DCHECK(context_->inLoop());
+    Connection::write_callback_fn fn) {
+  TP_DCHECK(getLoop().inLoop());
 
   uint64_t sequenceNumber = nextBufferBeingWritten_++;
   TP_VLOG(7) << "Connection " << id_
              << " received a nop object write request (#" << sequenceNumber
              << ")";
 
-  fn = [this, sequenceNumber, fn{std::move(fn)}](const Error& error) {
-    TP_DCHECK_EQ(sequenceNumber, nextWriteCallbackToCall_++);
-    TP_VLOG(7) << "Connection " << id_
-               << " is calling a nop object write callback (#" << sequenceNumber
-               << ")";
-    fn(error);
-    TP_VLOG(7) << "Connection " << id_
-               << " done calling a nop object write callback (#"
-               << sequenceNumber << ")";
-  };
+  write_callback_fn wrappedFn =
+      [this, sequenceNumber, fn{std::move(fn)}](const Error& error) {
+        TP_DCHECK_EQ(sequenceNumber, nextWriteCallbackToCall_++);
+        TP_VLOG(7) << "Connection " << id_
+                   << " is calling a nop object write callback (#"
+                   << sequenceNumber << ")";
+        fn(error);
+        TP_VLOG(7) << "Connection " << id_
+                   << " done calling a nop object write callback (#"
+                   << sequenceNumber << ")";
+      };
 
   if (error_) {
-    fn(error_);
+    wrappedFn(error_);
     return;
   }
 
-  writeImplFromLoop(object, std::move(fn));
+  writeImplFromLoop(object, std::move(wrappedFn));
 }
 
 template <typename TCtx, typename TList, typename TConn>
@@ -378,15 +627,7 @@ void ConnectionImplBoilerplate<TCtx, TList, TConn>::writeImplFromLoop(
     write_callback_fn fn) {
   const size_t len = object.getSize();
 
-  // Using a shared_ptr instead of unique_ptr because if the lambda captures a
-  // unique_ptr then it becomes non-copyable, which prevents it from being
-  // converted to a function. In C++20 use std::make_shared<uint8_t[]>(len).
-  //
-  // Note: this is a std::shared_ptr<uint8_t[]> semantically. A shared_ptr
-  // with array type is supported in C++17 and higher.
-  //
-  auto buf = std::shared_ptr<uint8_t>(
-      new uint8_t[len], std::default_delete<uint8_t[]>());
+  auto buf = std::unique_ptr<uint8_t[]>(new uint8_t[len]);
   auto ptr = buf.get();
 
   NopWriter writer(ptr, len);
@@ -407,7 +648,7 @@ void ConnectionImplBoilerplate<TCtx, TList, TConn>::writeImplFromLoop(
 
 template <typename TCtx, typename TList, typename TConn>
 void ConnectionImplBoilerplate<TCtx, TList, TConn>::setId(std::string id) {
-  context_->deferToLoop(
+  getLoop().deferToLoop(
       [impl{this->shared_from_this()}, id{std::move(id)}]() mutable {
         impl->setIdFromLoop(std::move(id));
       });
@@ -416,20 +657,20 @@ void ConnectionImplBoilerplate<TCtx, TList, TConn>::setId(std::string id) {
 template <typename TCtx, typename TList, typename TConn>
 void ConnectionImplBoilerplate<TCtx, TList, TConn>::setIdFromLoop(
     std::string id) {
-  TP_DCHECK(context_->inLoop());
+  TP_DCHECK(getLoop().inLoop());
   TP_VLOG(7) << "Connection " << id_ << " was renamed to " << id;
   id_ = std::move(id);
 }
 
 template <typename TCtx, typename TList, typename TConn>
 void ConnectionImplBoilerplate<TCtx, TList, TConn>::close() {
-  context_->deferToLoop(
+  getLoop().deferToLoop(
       [impl{this->shared_from_this()}]() { impl->closeFromLoop(); });
 }
 
 template <typename TCtx, typename TList, typename TConn>
 void ConnectionImplBoilerplate<TCtx, TList, TConn>::closeFromLoop() {
-  TP_DCHECK(context_->inLoop());
+  TP_DCHECK(getLoop().inLoop());
   TP_VLOG(7) << "Connection " << id_ << " is closing";
   setError(TP_CREATE_ERROR(ConnectionClosedError));
 }
@@ -448,7 +689,7 @@ void ConnectionImplBoilerplate<TCtx, TList, TConn>::setError(Error error) {
 
 template <typename TCtx, typename TList, typename TConn>
 void ConnectionImplBoilerplate<TCtx, TList, TConn>::handleError() {
-  TP_DCHECK(context_->inLoop());
+  TP_DCHECK(getLoop().inLoop());
   TP_VLOG(8) << "Connection " << id_ << " is handling error " << error_.what();
 
   handleErrorImpl();
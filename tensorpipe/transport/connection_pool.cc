@@ -0,0 +1,374 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <tensorpipe/transport/connection_pool.h>
+
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include <tensorpipe/common/defs.h>
+#include <tensorpipe/common/error_macros.h>
+#include <tensorpipe/common/inline_function.h>
+
+namespace tensorpipe {
+namespace transport {
+
+// A connection opened ahead of time, which starts reading as soon as it's
+// opened in order to notice if it fails while it's idle. Whatever that read
+// gets (i.e., the first frame sent by the remote end, or an error) is then
+// handed to the first read issued by the user. All other operations are passed
+// through to the underlying connection.
+class ConnectionPool::SpareConnection final : public Connection {
+ public:
+  explicit SpareConnection(std::shared_ptr<Connection> connection);
+
+  bool hasFailed();
+
+  std::chrono::steady_clock::time_point openedAt() const {
+    return openedAt_;
+  }
+
+  void read(read_callback_fn fn) override;
+
+  void read(void* ptr, size_t length, read_callback_fn fn) override;
+
+  void read(std::vector<iovec> iovs, read_iovs_callback_fn fn) override;
+
+  void read(AbstractNopHolder& object, read_nop_callback_fn fn) override;
+
+  void write(const void* ptr, size_t length, write_callback_fn fn) override;
+
+  void write(std::vector<iovec> iovs, write_callback_fn fn) override;
+
+  void writeArray(const iovec* iovs, size_t numIovs, write_callback_fn fn)
+      override;
+
+  void write(const AbstractNopHolder& object, write_callback_fn fn) override;
+
+  void setId(std::string id) override;
+
+  void close() override;
+
+ private:
+  using first_frame_callback_fn = InlineFunction<
+      void(const Error& error, const void* ptr, size_t len),
+      kWrappedCallbackInlineCapacity>;
+
+  // This is shared with the callback of the read, which may outlive this
+  // object.
+  struct FirstFrame {
+    std::mutex mutex;
+    bool arrived{false};
+    Error error{Error::kSuccess};
+    std::vector<uint8_t> data;
+    // The first read issued by the user, if it came before the frame.
+    first_frame_callback_fn callback;
+  };
+
+  const std::shared_ptr<Connection> connection_;
+  const std::chrono::steady_clock::time_point openedAt_;
+  const std::shared_ptr<FirstFrame> firstFrame_;
+
+  // Set once the user issued a read. Only the first one consumes the first
+  // frame, whereas the later ones go to the underlying connection, which will
+  // serve them after the frame anyways.
+  std::mutex mutex_;
+  bool hadFirstRead_{false};
+
+  // Return whether this is the first read, marking it as having happened.
+  bool isFirstRead();
+
+  void readFirstFrame(first_frame_callback_fn fn);
+
+  void readFirstFrameInto(void* ptr, size_t length, read_callback_fn fn);
+};
+
+ConnectionPool::SpareConnection::SpareConnection(
+    std::shared_ptr<Connection> connection)
+    : connection_(std::move(connection)),
+      openedAt_(std::chrono::steady_clock::now()),
+      firstFrame_(std::make_shared<FirstFrame>()) {
+  connection_->read([firstFrame{firstFrame_}](
+                        const Error& error, const void* ptr, size_t len) {
+    std::unique_lock<std::mutex> lock(firstFrame->mutex);
+    if (firstFrame->callback) {
+      first_frame_callback_fn fn = std::move(firstFrame->callback);
+      lock.unlock();
+      fn(error, ptr, len);
+      return;
+    }
+    firstFrame->arrived = true;
+    firstFrame->error = error;
+    if (!error) {
+      const uint8_t* data = reinterpret_cast<const uint8_t*>(ptr);
+      firstFrame->data.assign(data, data + len);
+    }
+  });
+}
+
+bool ConnectionPool::SpareConnection::hasFailed() {
+  std::unique_lock<std::mutex> lock(firstFrame_->mutex);
+  return firstFrame_->arrived && firstFrame_->error;
+}
+
+bool ConnectionPool::SpareConnection::isFirstRead() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  const bool isFirst = !hadFirstRead_;
+  hadFirstRead_ = true;
+  return isFirst;
+}
+
+void ConnectionPool::SpareConnection::readFirstFrame(
+    first_frame_callback_fn fn) {
+  std::unique_lock<std::mutex> lock(firstFrame_->mutex);
+  if (!firstFrame_->arrived) {
+    firstFrame_->callback = std::move(fn);
+    return;
+  }
+  // The frame doesn't change anymore once it has arrived.
+  lock.unlock();
+  fn(firstFrame_->error, firstFrame_->data.data(), firstFrame_->data.size());
+}
+
+void ConnectionPool::SpareConnection::read(read_callback_fn fn) {
+  if (!isFirstRead()) {
+    connection_->read(std::move(fn));
+    return;
+  }
+  readFirstFrame(std::move(fn));
+}
+
+void ConnectionPool::SpareConnection::read(
+    void* ptr,
+    size_t length,
+    read_callback_fn fn) {
+  if (!isFirstRead()) {
+    connection_->read(ptr, length, std::move(fn));
+    return;
+  }
+  readFirstFrameInto(ptr, length, std::move(fn));
+}
+
+void ConnectionPool::SpareConnection::readFirstFrameInto(
+    void* ptr,
+    size_t length,
+    read_callback_fn fn) {
+  readFirstFrame([ptr, length, fn{std::move(fn)}](
+                     const Error& error, const void* data, size_t len) {
+    if (error) {
+      fn(error, ptr, length);
+      return;
+    }
+    if (len != length) {
+      fn(TP_CREATE_ERROR(ShortReadError, length, len), ptr, length);
+      return;
+    }
+    std::memcpy(ptr, data, len);
+    fn(Error::kSuccess, ptr, length);
+  });
+}
+
+void ConnectionPool::SpareConnection::read(
+    std::vector<iovec> iovs,
+    read_iovs_callback_fn fn) {
+  TP_DCHECK(!iovs.empty());
+  if (!isFirstRead()) {
+    connection_->read(std::move(iovs), std::move(fn));
+    return;
+  }
+  const iovec firstIov = iovs.front();
+  if (iovs.size() == 1) {
+    readFirstFrameInto(
+        firstIov.iov_base,
+        firstIov.iov_len,
+        [fn{std::move(fn)}](
+            const Error& error,
+            const void* /* unused */,
+            size_t /* unused */) { fn(error); });
+    return;
+  }
+
+  // The other buffers come after the first frame, hence the underlying
+  // connection reports on them once the latter has been handed out, and thus
+  // also on the whole read.
+  auto firstError = std::make_shared<Error>(Error::kSuccess);
+  readFirstFrameInto(
+      firstIov.iov_base,
+      firstIov.iov_len,
+      [firstError](
+          const Error& error, const void* /* unused */, size_t /* unused */) {
+        *firstError = error;
+      });
+  iovs.erase(iovs.begin());
+  connection_->read(
+      std::move(iovs),
+      [firstError, fn{std::move(fn)}](const Error& error) {
+        fn(*firstError ? *firstError : error);
+      });
+}
+
+void ConnectionPool::SpareConnection::read(
+    AbstractNopHolder& object,
+    read_nop_callback_fn fn) {
+  if (!isFirstRead()) {
+    connection_->read(object, std::move(fn));
+    return;
+  }
+  readFirstFrame([&object, fn{std::move(fn)}](
+                     const Error& error, const void* ptr, size_t len) {
+    if (!error) {
+      NopReader reader(reinterpret_cast<const uint8_t*>(ptr), len);
+      nop::Status<void> status = object.read(reader);
+      TP_THROW_ASSERT_IF(status.has_error())
+          << "Error reading nop object: " << status.GetErrorMessage();
+    }
+    fn(error);
+  });
+}
+
+void ConnectionPool::SpareConnection::write(
+    const void* ptr,
+    size_t length,
+    write_callback_fn fn) {
+  connection_->write(ptr, length, std::move(fn));
+}
+
+void ConnectionPool::SpareConnection::write(
+    std::vector<iovec> iovs,
+    write_callback_fn fn) {
+  connection_->write(std::move(iovs), std::move(fn));
+}
+
+void ConnectionPool::SpareConnection::writeArray(
+    const iovec* iovs,
+    size_t numIovs,
+    write_callback_fn fn) {
+  connection_->writeArray(iovs, numIovs, std::move(fn));
+}
+
+void ConnectionPool::SpareConnection::write(
+    const AbstractNopHolder& object,
+    write_callback_fn fn) {
+  connection_->write(object, std::move(fn));
+}
+
+void ConnectionPool::SpareConnection::setId(std::string id) {
+  connection_->setId(std::move(id));
+}
+
+void ConnectionPool::SpareConnection::close() {
+  connection_->close();
+}
+
+ConnectionPool::ConnectionPool(
+    std::shared_ptr<Context> context,
+    size_t size,
+    size_t maxNumAddresses,
+    std::chrono::steady_clock::duration maxIdleTime)
+    : context_(std::move(context)),
+      size_(size),
+      maxNumAddresses_(maxNumAddresses),
+      maxIdleTime_(maxIdleTime) {}
+
+std::shared_ptr<Connection> ConnectionPool::connect(
+    const std::string& address) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (size_ == 0 || maxNumAddresses_ == 0 || closed_) {
+    return context_->connect(address);
+  }
+
+  dropStaleSpareConnections();
+
+  auto iter = spareConnections_.find(address);
+  if (iter == spareConnections_.end()) {
+    recentlyUsedAddresses_.push_front(address);
+    iter = spareConnections_
+               .emplace(
+                   address,
+                   SpareConnections{{}, recentlyUsedAddresses_.begin()})
+               .first;
+  } else {
+    recentlyUsedAddresses_.splice(
+        recentlyUsedAddresses_.begin(),
+        recentlyUsedAddresses_,
+        iter->second.recentlyUsedIter);
+  }
+  std::deque<std::shared_ptr<SpareConnection>>& spareConnections =
+      iter->second.connections;
+
+  std::shared_ptr<Connection> connection;
+  if (!spareConnections.empty()) {
+    connection = std::move(spareConnections.front());
+    spareConnections.pop_front();
+  } else {
+    connection = context_->connect(address);
+  }
+  // Opening a connection doesn't block, as the handshake happens in the
+  // background, hence it's fine to do it while holding the lock.
+  while (spareConnections.size() < size_) {
+    spareConnections.push_back(
+        std::make_shared<SpareConnection>(context_->connect(address)));
+  }
+
+  while (spareConnections_.size() > maxNumAddresses_) {
+    dropAddress(spareConnections_.find(recentlyUsedAddresses_.back()));
+  }
+
+  return connection;
+}
+
+size_t ConnectionPool::numSpareConnections() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  dropStaleSpareConnections();
+  size_t numSpareConnections = 0;
+  for (const auto& iter : spareConnections_) {
+    numSpareConnections += iter.second.connections.size();
+  }
+  return numSpareConnections;
+}
+
+void ConnectionPool::dropStaleSpareConnections() {
+  const auto now = std::chrono::steady_clock::now();
+  for (auto& iter : spareConnections_) {
+    std::deque<std::shared_ptr<SpareConnection>>& spareConnections =
+        iter.second.connections;
+    for (auto connIter = spareConnections.begin();
+         connIter != spareConnections.end();) {
+      SpareConnection& spareConnection = **connIter;
+      if (spareConnection.hasFailed() ||
+          now - spareConnection.openedAt() > maxIdleTime_) {
+        spareConnection.close();
+        connIter = spareConnections.erase(connIter);
+      } else {
+        ++connIter;
+      }
+    }
+  }
+}
+
+void ConnectionPool::dropAddress(
+    std::unordered_map<std::string, SpareConnections>::iterator iter) {
+  TP_DCHECK(iter != spareConnections_.end());
+  for (auto& connection : iter->second.connections) {
+    connection->close();
+  }
+  recentlyUsedAddresses_.erase(iter->second.recentlyUsedIter);
+  spareConnections_.erase(iter);
+}
+
+void ConnectionPool::close() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  closed_ = true;
+  while (!spareConnections_.empty()) {
+    dropAddress(spareConnections_.begin());
+  }
+}
+
+} // namespace transport
+} // namespace tensorpipe
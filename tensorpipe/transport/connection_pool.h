@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <tensorpipe/transport/connection.h>
+#include <tensorpipe/transport/context.h>
+
+namespace tensorpipe {
+namespace transport {
+
+// Opens connections on behalf of its users, while keeping a few spare ones to
+// each address it was asked about, which it opens ahead of time. Those who get
+// one of these connections thus don't have to wait for the transport's own
+// handshake. This relies on the remote end not sending anything on a new
+// connection before having received something on it, so that spare ones can
+// sit idle for as long as needed and then be used for any purpose.
+//
+// Each spare connection keeps a read pending, in order to find out if it fails
+// while it's idle (e.g., because the remote end went away), in which case it's
+// discarded rather than handed out. Spares are also closed once they have been
+// idle for too long, and only the ones to the most recently used addresses are
+// kept, so that the pool doesn't hold on to resources that won't be needed.
+//
+// A size of zero disables the pool: each connection is opened on demand.
+class ConnectionPool {
+ public:
+  ConnectionPool(
+      std::shared_ptr<Context> context,
+      size_t size,
+      size_t maxNumAddresses = 16,
+      std::chrono::steady_clock::duration maxIdleTime =
+          std::chrono::seconds(60));
+
+  // Return a connection to the given address, which may have been opened ahead
+  // of time, and open new spare ones to that address to keep the pool full.
+  std::shared_ptr<Connection> connect(const std::string& address);
+
+  // Return how many spare connections are currently kept, across addresses.
+  size_t numSpareConnections();
+
+  // Close the spare connections and stop opening new ones.
+  void close();
+
+ private:
+  class SpareConnection;
+
+  struct SpareConnections {
+    std::deque<std::shared_ptr<SpareConnection>> connections;
+    // The position of the address in the list of recently used ones.
+    std::list<std::string>::iterator recentlyUsedIter;
+  };
+
+  const std::shared_ptr<Context> context_;
+  const size_t size_;
+  const size_t maxNumAddresses_;
+  const std::chrono::steady_clock::duration maxIdleTime_;
+
+  std::mutex mutex_;
+  bool closed_{false};
+  std::unordered_map<std::string, SpareConnections> spareConnections_;
+
+  // The addresses that have spare connections, most recently used first.
+  std::list<std::string> recentlyUsedAddresses_;
+
+  // Close and drop the spare connections that failed or that have been idle
+  // for too long. Must be called with the mutex held.
+  void dropStaleSpareConnections();
+
+  // Close and drop all the spare connections to the given address. Must be
+  // called with the mutex held.
+  void dropAddress(
+      std::unordered_map<std::string, SpareConnections>::iterator iter);
+};
+
+} // namespace transport
+} // namespace tensorpipe
@@ -160,7 +160,7 @@ void ConnectionImpl::initImplFromLoop() {
 }
 
 void ConnectionImpl::readImplFromLoop(read_callback_fn fn) {
-  readOperations_.emplace_back(std::move(fn));
+  readOperations_.emplace_back(std::move(spareReadBuffer_), std::move(fn));
 
   // If the inbox already contains some data, we may be able to process this
   // operation right away.
@@ -193,6 +193,21 @@ void ConnectionImpl::readImplFromLoop(
   processReadOperationsFromLoop();
 }
 
+void ConnectionImpl::readImplFromLoop(
+    std::vector<iovec> iovs,
+    read_iovs_callback_fn fn) {
+  readOperations_.emplace_back(
+      std::move(iovs),
+      [fn{std::move(fn)}](
+          const Error& error, const void* /* unused */, size_t /* unused */) {
+        fn(error);
+      });
+
+  // If the inbox already contains some data, we may be able to process this
+  // operation right away.
+  processReadOperationsFromLoop();
+}
+
 void ConnectionImpl::writeImplFromLoop(
     const void* ptr,
     size_t length,
@@ -204,6 +219,16 @@ void ConnectionImpl::writeImplFromLoop(
   processWriteOperationsFromLoop();
 }
 
+void ConnectionImpl::writeImplFromLoop(
+    std::vector<iovec> iovs,
+    write_callback_fn fn) {
+  writeOperations_.emplace_back(std::move(iovs), std::move(fn));
+
+  // If the outbox has some free space, we may be able to process this operation
+  // right away.
+  processWriteOperationsFromLoop();
+}
+
 void ConnectionImpl::writeImplFromLoop(
     const AbstractNopHolder& object,
     write_callback_fn fn) {
@@ -361,6 +386,12 @@ void ConnectionImpl::processReadOperationsFromLoop() {
       numAcksInFlight_++;
     }
     if (readOperation.completed()) {
+      // The callback has been called, after which the data isn't valid anymore,
+      // hence the buffer that held it (if any) can be reused.
+      std::vector<uint8_t> buffer = readOperation.releaseBuffer();
+      if (buffer.capacity() > spareReadBuffer_.capacity()) {
+        spareReadBuffer_ = std::move(buffer);
+      }
       readOperations_.pop_front();
     } else {
       break;
@@ -13,6 +13,7 @@
 #include <deque>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include <tensorpipe/common/epoll_loop.h>
 #include <tensorpipe/common/ibv.h>
@@ -83,8 +84,12 @@ class ConnectionImpl final : public ConnectionImplBoilerplate<
   void readImplFromLoop(AbstractNopHolder& object, read_nop_callback_fn fn)
       override;
   void readImplFromLoop(void* ptr, size_t length, read_callback_fn fn) override;
+  void readImplFromLoop(std::vector<iovec> iovs, read_iovs_callback_fn fn)
+      override;
   void writeImplFromLoop(const void* ptr, size_t length, write_callback_fn fn)
       override;
+  void writeImplFromLoop(std::vector<iovec> iovs, write_callback_fn fn)
+      override;
   void writeImplFromLoop(const AbstractNopHolder& object, write_callback_fn fn)
       override;
   void handleErrorImpl() override;
@@ -152,6 +157,10 @@ class ConnectionImpl final : public ConnectionImplBoilerplate<
   // Pending read operations.
   std::deque<RingbufferReadOperation> readOperations_;
 
+  // The buffer that the last read operation of unknown length read into, which
+  // is handed to the next such operation so that it doesn't allocate again.
+  std::vector<uint8_t> spareReadBuffer_;
+
   // Pending write operations.
   std::deque<RingbufferWriteOperation> writeOperations_;
 
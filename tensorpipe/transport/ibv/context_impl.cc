@@ -209,7 +209,7 @@ bool ContextImpl::inLoop() {
   return reactor_.inLoop();
 };
 
-void ContextImpl::deferToLoop(std::function<void()> fn) {
+void ContextImpl::deferToLoop(TTask fn) {
   reactor_.deferToLoop(std::move(fn));
 };
 
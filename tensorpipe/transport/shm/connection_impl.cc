@@ -39,6 +39,7 @@ ConnectionImpl::ConnectionImpl(
           token,
           std::move(context),
           std::move(id)),
+      shard_(context_->acquireReactorShard()),
       socket_(std::move(socket)) {}
 
 ConnectionImpl::ConnectionImpl(
@@ -50,6 +51,7 @@ ConnectionImpl::ConnectionImpl(
           token,
           std::move(context),
           std::move(id)),
+      shard_(context_->acquireReactorShard()),
       sockaddr_(Sockaddr::createAbstractUnixAddr(addr)) {}
 
 void ConnectionImpl::initImplFromLoop() {
@@ -76,13 +78,18 @@ void ConnectionImpl::initImplFromLoop() {
     return;
   }
 
-  // Create ringbuffer for inbox.
+  // Create ringbuffer for inbox. Map it mirrored so that frames that wrap
+  // around can still be read with a single copy and decoded in place.
   std::tie(inboxHeaderSegment_, inboxDataSegment_, inboxRb_) =
-      util::ringbuffer::shm::create(kBufferSize);
+      util::ringbuffer::shm::create(
+          context_->getBufferSize(),
+          context_->getBufferPageType(),
+          /*perm_write=*/true,
+          /*mirrored=*/true);
 
   // Register method to be called when our peer writes to our inbox.
   inboxReactorToken_ =
-      context_->addReaction(runIfAlive(*this, [](ConnectionImpl& impl) {
+      shard_.reactor.add(runIfAlive(*this, [](ConnectionImpl& impl) {
         TP_VLOG(9) << "Connection " << impl.id_
                    << " is reacting to the peer writing to the inbox";
         impl.processReadOperationsFromLoop();
@@ -90,7 +97,7 @@ void ConnectionImpl::initImplFromLoop() {
 
   // Register method to be called when our peer reads from our outbox.
   outboxReactorToken_ =
-      context_->addReaction(runIfAlive(*this, [](ConnectionImpl& impl) {
+      shard_.reactor.add(runIfAlive(*this, [](ConnectionImpl& impl) {
         TP_VLOG(9) << "Connection " << impl.id_
                    << " is reacting to the peer reading from the outbox";
         impl.processWriteOperationsFromLoop();
@@ -98,11 +105,11 @@ void ConnectionImpl::initImplFromLoop() {
 
   // We're sending file descriptors first, so wait for writability.
   state_ = SEND_FDS;
-  context_->registerDescriptor(socket_.fd(), EPOLLOUT, shared_from_this());
+  shard_.loop.registerDescriptor(socket_.fd(), EPOLLOUT, shared_from_this());
 }
 
 void ConnectionImpl::readImplFromLoop(read_callback_fn fn) {
-  readOperations_.emplace_back(std::move(fn));
+  readOperations_.emplace_back(std::move(spareReadBuffer_), std::move(fn));
 
   // If the inbox already contains some data, we may be able to process this
   // operation right away.
@@ -135,6 +142,21 @@ void ConnectionImpl::readImplFromLoop(
   processReadOperationsFromLoop();
 }
 
+void ConnectionImpl::readImplFromLoop(
+    std::vector<iovec> iovs,
+    read_iovs_callback_fn fn) {
+  readOperations_.emplace_back(
+      std::move(iovs),
+      [fn{std::move(fn)}](
+          const Error& error, const void* /* unused */, size_t /* unused */) {
+        fn(error);
+      });
+
+  // If the inbox already contains some data, we may be able to process this
+  // operation right away.
+  processReadOperationsFromLoop();
+}
+
 void ConnectionImpl::writeImplFromLoop(
     const void* ptr,
     size_t length,
@@ -146,6 +168,16 @@ void ConnectionImpl::writeImplFromLoop(
   processWriteOperationsFromLoop();
 }
 
+void ConnectionImpl::writeImplFromLoop(
+    std::vector<iovec> iovs,
+    write_callback_fn fn) {
+  writeOperations_.emplace_back(std::move(iovs), std::move(fn));
+
+  // If the outbox has some free space, we may be able to process this operation
+  // right away.
+  processWriteOperationsFromLoop();
+}
+
 void ConnectionImpl::writeImplFromLoop(
     const AbstractNopHolder& object,
     write_callback_fn fn) {
@@ -157,7 +189,7 @@ void ConnectionImpl::writeImplFromLoop(
 }
 
 void ConnectionImpl::handleEventsFromLoop(int events) {
-  TP_DCHECK(context_->inLoop());
+  TP_DCHECK(getLoop().inLoop());
   TP_VLOG(9) << "Connection " << id_ << " is handling an event on its socket ("
              << EpollLoop::formatEpollEvents(events) << ")";
 
@@ -205,7 +237,7 @@ void ConnectionImpl::handleEventsFromLoop(int events) {
 }
 
 void ConnectionImpl::handleEventInFromLoop() {
-  TP_DCHECK(context_->inLoop());
+  TP_DCHECK(getLoop().inLoop());
   if (state_ == RECV_FDS) {
     Fd reactorHeaderFd;
     Fd reactorDataFd;
@@ -230,7 +262,11 @@ void ConnectionImpl::handleEventInFromLoop() {
     // Load ringbuffer for outbox.
     std::tie(outboxHeaderSegment_, outboxDataSegment_, outboxRb_) =
         util::ringbuffer::shm::load(
-            std::move(outboxHeaderFd), std::move(outboxDataFd));
+            std::move(outboxHeaderFd),
+            std::move(outboxDataFd),
+            /*data_page_type=*/nullopt,
+            /*perm_write=*/true,
+            /*mirrored=*/true);
 
     // Initialize remote reactor trigger.
     peerReactorTrigger_.emplace(
@@ -261,11 +297,11 @@ void ConnectionImpl::handleEventInFromLoop() {
 }
 
 void ConnectionImpl::handleEventOutFromLoop() {
-  TP_DCHECK(context_->inLoop());
+  TP_DCHECK(getLoop().inLoop());
   if (state_ == SEND_FDS) {
     int reactorHeaderFd;
     int reactorDataFd;
-    std::tie(reactorHeaderFd, reactorDataFd) = context_->reactorFds();
+    std::tie(reactorHeaderFd, reactorDataFd) = shard_.reactor.fds();
 
     // Send our reactor token, reactor fds, and inbox fds.
     auto err = socket_.sendPayloadAndFds(
@@ -282,7 +318,7 @@ void ConnectionImpl::handleEventOutFromLoop() {
 
     // Sent our fds. Wait for fds from peer.
     state_ = RECV_FDS;
-    context_->registerDescriptor(socket_.fd(), EPOLLIN, shared_from_this());
+    shard_.loop.registerDescriptor(socket_.fd(), EPOLLIN, shared_from_this());
     return;
   }
 
@@ -290,7 +326,7 @@ void ConnectionImpl::handleEventOutFromLoop() {
 }
 
 void ConnectionImpl::processReadOperationsFromLoop() {
-  TP_DCHECK(context_->inLoop());
+  TP_DCHECK(getLoop().inLoop());
 
   // Process all read read operations that we can immediately serve, only
   // when connection is established.
@@ -305,6 +341,12 @@ void ConnectionImpl::processReadOperationsFromLoop() {
       peerReactorTrigger_->run(peerOutboxReactorToken_.value());
     }
     if (readOperation.completed()) {
+      // The callback has been called, after which the data isn't valid anymore,
+      // hence the buffer that held it (if any) can be reused.
+      std::vector<uint8_t> buffer = readOperation.releaseBuffer();
+      if (buffer.capacity() > spareReadBuffer_.capacity()) {
+        spareReadBuffer_ = std::move(buffer);
+      }
       readOperations_.pop_front();
     } else {
       break;
@@ -313,7 +355,7 @@ void ConnectionImpl::processReadOperationsFromLoop() {
 }
 
 void ConnectionImpl::processWriteOperationsFromLoop() {
-  TP_DCHECK(context_->inLoop());
+  TP_DCHECK(getLoop().inLoop());
 
   if (state_ != ESTABLISHED) {
     return;
@@ -343,19 +385,24 @@ void ConnectionImpl::handleErrorImpl() {
   }
   writeOperations_.clear();
   if (inboxReactorToken_.has_value()) {
-    context_->removeReaction(inboxReactorToken_.value());
+    shard_.reactor.remove(inboxReactorToken_.value());
     inboxReactorToken_.reset();
   }
   if (outboxReactorToken_.has_value()) {
-    context_->removeReaction(outboxReactorToken_.value());
+    shard_.reactor.remove(outboxReactorToken_.value());
     outboxReactorToken_.reset();
   }
   if (socket_.hasValue()) {
     if (state_ > INITIALIZING) {
-      context_->unregisterDescriptor(socket_.fd());
+      shard_.loop.unregisterDescriptor(socket_.fd());
     }
     socket_.reset();
   }
+  context_->releaseReactorShard(shard_);
+}
+
+DeferredExecutor& ConnectionImpl::getLoop() {
+  return shard_.reactor;
 }
 
 } // namespace shm
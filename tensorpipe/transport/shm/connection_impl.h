@@ -11,6 +11,7 @@
 #include <deque>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include <tensorpipe/common/epoll_loop.h>
 #include <tensorpipe/common/nop.h>
@@ -27,14 +28,9 @@ namespace tensorpipe {
 namespace transport {
 namespace shm {
 
-namespace {
-
-constexpr auto kBufferSize = 2 * 1024 * 1024;
-
-} // namespace
-
 class ContextImpl;
 class ListenerImpl;
+struct ReactorShard;
 
 class ConnectionImpl final : public ConnectionImplBoilerplate<
                                  ContextImpl,
@@ -73,11 +69,16 @@ class ConnectionImpl final : public ConnectionImplBoilerplate<
   void readImplFromLoop(AbstractNopHolder& object, read_nop_callback_fn fn)
       override;
   void readImplFromLoop(void* ptr, size_t length, read_callback_fn fn) override;
+  void readImplFromLoop(std::vector<iovec> iovs, read_iovs_callback_fn fn)
+      override;
   void writeImplFromLoop(const void* ptr, size_t length, write_callback_fn fn)
       override;
+  void writeImplFromLoop(std::vector<iovec> iovs, write_callback_fn fn)
+      override;
   void writeImplFromLoop(const AbstractNopHolder& object, write_callback_fn fn)
       override;
   void handleErrorImpl() override;
+  DeferredExecutor& getLoop() override;
 
  private:
   // Handle events of type EPOLLIN on the UNIX domain socket.
@@ -94,6 +95,9 @@ class ConnectionImpl final : public ConnectionImplBoilerplate<
   // tokens to trigger this connection to read or write.
   void handleEventOutFromLoop();
 
+  // The reactor shard which services this connection and runs its loop.
+  ReactorShard& shard_;
+
   State state_{INITIALIZING};
   Socket socket_;
   optional<Sockaddr> sockaddr_;
@@ -118,6 +122,10 @@ class ConnectionImpl final : public ConnectionImplBoilerplate<
   // Pending read operations.
   std::deque<RingbufferReadOperation> readOperations_;
 
+  // The buffer that the last read operation of unknown length read into, which
+  // is handed to the next such operation so that it doesn't allocate again.
+  std::vector<uint8_t> spareReadBuffer_;
+
   // Pending write operations.
   std::deque<RingbufferWriteOperation> writeOperations_;
 
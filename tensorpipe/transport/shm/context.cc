@@ -20,7 +20,8 @@ namespace tensorpipe {
 namespace transport {
 namespace shm {
 
-Context::Context() : impl_(std::make_shared<ContextImpl>()) {}
+Context::Context(ContextOptions opts)
+    : impl_(std::make_shared<ContextImpl>(std::move(opts))) {}
 
 // Explicitly define all methods of the context, which just forward to the impl.
 // We cannot use an intermediate ContextBoilerplate class without forcing a
@@ -8,8 +8,11 @@
 
 #pragma once
 
+#include <chrono>
+#include <cstddef>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include <tensorpipe/transport/context.h>
 
@@ -19,9 +22,65 @@ namespace shm {
 
 class ContextImpl;
 
+class ContextOptions {
+ public:
+  size_t bufferSize_{2 * 1024 * 1024};
+  size_t hugePageSize_{0};
+  std::chrono::microseconds reactorSpinDuration_{1000};
+  size_t numReactors_{1};
+  std::vector<int> reactorCpus_;
+
+  // The size of the ringbuffer into which the peer of each connection writes,
+  // rounded up to a power of two, which must be at least the page size. Larger
+  // buffers allow large payloads to be transferred with fewer wake-ups.
+  ContextOptions&& bufferSize(size_t bufferSize) && {
+    bufferSize_ = bufferSize;
+    return std::move(*this);
+  }
+
+  // Back the ringbuffers of the connections with huge pages of this size
+  // (either 2MB or 1GB), which reduces TLB misses for large transfers. Huge
+  // pages must have been reserved in the system (e.g., through
+  // /proc/sys/vm/nr_hugepages): if none are available, or if the buffer size
+  // isn't a multiple of the huge page size, regular pages are used instead. By
+  // default (zero) regular pages are used.
+  ContextOptions&& hugePageSize(size_t hugePageSize) && {
+    hugePageSize_ = hugePageSize;
+    return std::move(*this);
+  }
+
+  // How long the thread of the context keeps polling for activity after it
+  // last found some, before going to sleep until woken up by a peer. Shorter
+  // durations save CPU time, at the cost of adding the wake-up latency to the
+  // first operation after a period of inactivity. Under load, it never sleeps.
+  ContextOptions&& reactorSpinDuration(
+      std::chrono::microseconds reactorSpinDuration) && {
+    reactorSpinDuration_ = reactorSpinDuration;
+    return std::move(*this);
+  }
+
+  // The number of reactors, each with its own thread, across which the
+  // connections are spread. Each connection is serviced by a single reactor,
+  // the least loaded one at the time it's created, which performs all the
+  // copies to and from its ringbuffers. With many concurrent connections more
+  // reactors allow to use more cores. By default a single one is used.
+  ContextOptions&& numReactors(size_t numReactors) && {
+    numReactors_ = numReactors;
+    return std::move(*this);
+  }
+
+  // Pin the thread of each reactor to a CPU: the i-th reactor is pinned to the
+  // i-th CPU of this list, which must contain one entry per reactor. By default
+  // (empty list) reactors aren't pinned.
+  ContextOptions&& reactorCpus(std::vector<int> reactorCpus) && {
+    reactorCpus_ = std::move(reactorCpus);
+    return std::move(*this);
+  }
+};
+
 class Context : public transport::Context {
  public:
-  Context();
+  explicit Context(ContextOptions opts = ContextOptions());
 
   Context(const Context&) = delete;
   Context(Context&&) = delete;
@@ -8,6 +8,11 @@
 
 #include <tensorpipe/transport/shm/context_impl.h>
 
+#include <unistd.h>
+
+#include <limits>
+
+#include <tensorpipe/common/defs.h>
 #include <tensorpipe/common/epoll_loop.h>
 #include <tensorpipe/common/system.h>
 #include <tensorpipe/transport/shm/connection_impl.h>
@@ -30,51 +35,119 @@ std::string generateDomainDescriptor() {
   return kDomainDescriptorPrefix + bootID.value();
 }
 
+size_t validateBufferSize(size_t bufferSize) {
+  const size_t pageSize = ::sysconf(_SC_PAGESIZE);
+  TP_THROW_ASSERT_IF(bufferSize < pageSize)
+      << "The buffer size (" << bufferSize
+      << " bytes) must be at least the page size (" << pageSize << " bytes)";
+  return bufferSize;
+}
+
+optional<util::shm::PageType> hugePageSizeToPageType(size_t hugePageSize) {
+  switch (hugePageSize) {
+    case 0:
+      return nullopt;
+    case 2 * 1024 * 1024:
+      return util::shm::PageType::HugeTLB_2MB;
+    case 1024 * 1024 * 1024:
+      return util::shm::PageType::HugeTLB_1GB;
+    default:
+      TP_THROW_ASSERT() << "Unsupported huge page size: " << hugePageSize
+                        << " bytes (must be either 2MB or 1GB)";
+      // Dummy return to make the compiler happy.
+      return nullopt;
+  }
+}
+
 } // namespace
 
-ContextImpl::ContextImpl()
+ContextImpl::ContextImpl(ContextOptions opts)
     : ContextImplBoilerplate<ContextImpl, ListenerImpl, ConnectionImpl>(
-          generateDomainDescriptor()) {}
+          generateDomainDescriptor()),
+      bufferSize_(validateBufferSize(opts.bufferSize_)),
+      bufferPageType_(hugePageSizeToPageType(opts.hugePageSize_)) {
+  TP_THROW_ASSERT_IF(opts.numReactors_ == 0)
+      << "There must be at least one reactor";
+  TP_THROW_ASSERT_IF(
+      !opts.reactorCpus_.empty() &&
+      opts.reactorCpus_.size() != opts.numReactors_)
+      << "Got " << opts.reactorCpus_.size() << " reactor CPUs for "
+      << opts.numReactors_ << " reactors";
+  for (int cpu : opts.reactorCpus_) {
+    validateCpu(cpu);
+  }
+
+  for (size_t shardIdx = 0; shardIdx < opts.numReactors_; shardIdx++) {
+    shards_.push_back(
+        std::make_unique<ReactorShard>(opts.reactorSpinDuration_));
+    if (!opts.reactorCpus_.empty()) {
+      const int cpu = opts.reactorCpus_[shardIdx];
+      shards_.back()->reactor.runInLoop(
+          [cpu]() { setThreadCpuAffinity(cpu); });
+    }
+  }
+}
 
 void ContextImpl::closeImpl() {
-  loop_.close();
-  reactor_.close();
+  for (auto& shard : shards_) {
+    shard->loop.close();
+    shard->reactor.close();
+  }
 }
 
 void ContextImpl::joinImpl() {
-  loop_.join();
-  reactor_.join();
+  for (auto& shard : shards_) {
+    shard->loop.join();
+    shard->reactor.join();
+  }
 }
 
 bool ContextImpl::inLoop() {
-  return reactor_.inLoop();
+  return shards_.front()->reactor.inLoop();
 };
 
-void ContextImpl::deferToLoop(std::function<void()> fn) {
-  reactor_.deferToLoop(std::move(fn));
+void ContextImpl::deferToLoop(TTask fn) {
+  shards_.front()->reactor.deferToLoop(std::move(fn));
 };
 
 void ContextImpl::registerDescriptor(
     int fd,
     int events,
     std::shared_ptr<EpollLoop::EventHandler> h) {
-  loop_.registerDescriptor(fd, events, std::move(h));
+  shards_.front()->loop.registerDescriptor(fd, events, std::move(h));
 }
 
 void ContextImpl::unregisterDescriptor(int fd) {
-  loop_.unregisterDescriptor(fd);
+  shards_.front()->loop.unregisterDescriptor(fd);
+}
+
+ReactorShard& ContextImpl::acquireReactorShard() {
+  // Concurrent assignments may pick the same shard, which can only make the
+  // balance slightly off, hence it's not worth synchronizing them.
+  ReactorShard* bestShard = nullptr;
+  size_t bestNumConnections = std::numeric_limits<size_t>::max();
+  for (auto& shard : shards_) {
+    const size_t numConnections = shard->numConnections.load();
+    if (numConnections < bestNumConnections) {
+      bestShard = shard.get();
+      bestNumConnections = numConnections;
+    }
+  }
+  ++bestShard->numConnections;
+  return *bestShard;
 }
 
-ContextImpl::TToken ContextImpl::addReaction(TFunction fn) {
-  return reactor_.add(std::move(fn));
+void ContextImpl::releaseReactorShard(ReactorShard& shard) {
+  TP_DCHECK_GT(shard.numConnections.load(), 0);
+  --shard.numConnections;
 }
 
-void ContextImpl::removeReaction(TToken token) {
-  reactor_.remove(token);
+size_t ContextImpl::getBufferSize() const {
+  return bufferSize_;
 }
 
-std::tuple<int, int> ContextImpl::reactorFds() {
-  return reactor_.fds();
+optional<util::shm::PageType> ContextImpl::getBufferPageType() const {
+  return bufferPageType_;
 }
 
 } // namespace shm
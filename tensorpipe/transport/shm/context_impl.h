@@ -8,13 +8,18 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <functional>
 #include <memory>
-#include <tuple>
+#include <vector>
 
 #include <tensorpipe/common/epoll_loop.h>
+#include <tensorpipe/common/optional.h>
 #include <tensorpipe/transport/context_impl_boilerplate.h>
+#include <tensorpipe/transport/shm/context.h>
 #include <tensorpipe/transport/shm/reactor.h>
+#include <tensorpipe/util/shm/segment.h>
 
 namespace tensorpipe {
 namespace transport {
@@ -23,14 +28,28 @@ namespace shm {
 class ConnectionImpl;
 class ListenerImpl;
 
+// A reactor, together with the epoll loop that runs its handlers on it. The
+// context has one or more of these, and each connection is serviced by a single
+// one of them for its whole lifetime.
+struct ReactorShard {
+  explicit ReactorShard(std::chrono::microseconds spinDuration)
+      : reactor(spinDuration) {}
+
+  Reactor reactor;
+  EpollLoop loop{this->reactor};
+
+  // The number of open connections assigned to this shard.
+  std::atomic<size_t> numConnections{0};
+};
+
 class ContextImpl final
     : public ContextImplBoilerplate<ContextImpl, ListenerImpl, ConnectionImpl> {
  public:
-  ContextImpl();
+  explicit ContextImpl(ContextOptions opts);
 
   // Implement the DeferredExecutor interface.
   bool inLoop() override;
-  void deferToLoop(std::function<void()> fn) override;
+  void deferToLoop(TTask fn) override;
 
   void registerDescriptor(
       int fd,
@@ -39,14 +58,15 @@ class ContextImpl final
 
   void unregisterDescriptor(int fd);
 
-  using TToken = uint32_t;
-  using TFunction = std::function<void()>;
-
-  TToken addReaction(TFunction fn);
+  // Assign a new connection to the reactor shard with the fewest connections.
+  // The connection must release it once it's closed.
+  ReactorShard& acquireReactorShard();
 
-  void removeReaction(TToken token);
+  void releaseReactorShard(ReactorShard& shard);
 
-  std::tuple<int, int> reactorFds();
+  // The size and the page type of the connections' inbox ringbuffers.
+  size_t getBufferSize() const;
+  optional<util::shm::PageType> getBufferPageType() const;
 
  protected:
   // Implement the entry points called by ContextImplBoilerplate.
@@ -54,8 +74,11 @@ class ContextImpl final
   void joinImpl() override;
 
  private:
-  Reactor reactor_;
-  EpollLoop loop_{this->reactor_};
+  const size_t bufferSize_;
+  const optional<util::shm::PageType> bufferPageType_;
+
+  // The first shard also runs the context's own loop, used by the listeners.
+  std::vector<std::unique_ptr<ReactorShard>> shards_;
 };
 
 } // namespace shm
@@ -42,10 +42,14 @@ void writeToken(util::ringbuffer::Producer& producer, Reactor::TToken token) {
 
 } // namespace
 
-Reactor::Reactor() {
-  std::tie(headerSegment_, dataSegment_, rb_) =
-      util::ringbuffer::shm::create(kSize);
-
+Reactor::Reactor(std::chrono::microseconds spinDuration) {
+  std::tie(headerSegment_, dataSegment_, rb_) = util::ringbuffer::shm::create(
+      kSize,
+      /*data_page_type=*/nullopt,
+      /*perm_write=*/true,
+      /*mirrored=*/true);
+
+  enableSleeping(rb_.getHeader().getConsumerFutexWord(), spinDuration);
   startThread("TP_SHM_reactor");
 }
 
@@ -87,7 +91,7 @@ Reactor::TToken Reactor::add(TFunction fn) {
     functions_.resize(token + 1);
   }
 
-  functions_[token] = std::move(fn);
+  functions_[token] = std::make_shared<TFunction>(std::move(fn));
 
   functionCount_++;
 
@@ -114,9 +118,9 @@ bool Reactor::pollOnce() {
   }
   TP_THROW_SYSTEM_IF(ret < 0, -ret);
 
-  TFunction fn;
+  std::shared_ptr<TFunction> fn;
 
-  // Make copy of std::function so we don't need
+  // Take a reference to the function so we don't need
   // to hold the lock while executing it.
   {
     std::unique_lock<std::mutex> lock(mutex_);
@@ -125,7 +129,7 @@ bool Reactor::pollOnce() {
   }
 
   if (fn) {
-    fn();
+    (*fn)();
   }
 
   return true;
@@ -138,13 +142,18 @@ bool Reactor::readyToClose() {
 Reactor::Trigger::Trigger(Fd headerFd, Fd dataFd) {
   // The header and data segment objects take over ownership
   // of file descriptors. Release them to avoid double close.
-  std::tie(headerSegment_, dataSegment_, rb_) =
-      util::ringbuffer::shm::load(std::move(headerFd), std::move(dataFd));
+  std::tie(headerSegment_, dataSegment_, rb_) = util::ringbuffer::shm::load(
+      std::move(headerFd),
+      std::move(dataFd),
+      /*data_page_type=*/nullopt,
+      /*perm_write=*/true,
+      /*mirrored=*/true);
 }
 
 void Reactor::Trigger::run(TToken token) {
   util::ringbuffer::Producer producer(rb_);
   writeToken(producer, token);
+  wakeUpLoop(rb_.getHeader().getConsumerFutexWord());
 }
 
 } // namespace shm
@@ -9,9 +9,10 @@
 #pragma once
 
 #include <atomic>
-#include <functional>
+#include <chrono>
 #include <future>
 #include <list>
+#include <memory>
 #include <mutex>
 #include <set>
 #include <thread>
@@ -20,6 +21,7 @@
 #include <tensorpipe/common/busy_polling_loop.h>
 #include <tensorpipe/common/callback.h>
 #include <tensorpipe/common/fd.h>
+#include <tensorpipe/common/inline_function.h>
 #include <tensorpipe/common/optional.h>
 #include <tensorpipe/util/ringbuffer/consumer.h>
 #include <tensorpipe/util/ringbuffer/producer.h>
@@ -34,18 +36,18 @@ namespace shm {
 // Companion class to the event loop in `loop.h` that executes
 // functions on triggers. The triggers are posted to a shared memory
 // ring buffer, so this can be done by other processes on the same
-// machine. It uses extra data in the ring buffer header to store a
-// mutex and condition variable to avoid a busy loop.
+// machine. After having been idle for a while it goes to sleep on a
+// futex word in the ring buffer header, which triggers use to wake it.
 //
 class Reactor final : public BusyPollingLoop {
   // This allows for buffering 1M triggers (at 4 bytes a piece).
   static constexpr auto kSize = 4 * 1024 * 1024;
 
  public:
-  using TFunction = std::function<void()>;
+  using TFunction = InlineFunction<void()>;
   using TToken = uint32_t;
 
-  Reactor();
+  explicit Reactor(std::chrono::microseconds spinDuration);
 
   // Add function to the reactor.
   // Returns token that can be used to trigger it.
@@ -83,9 +85,11 @@ class Reactor final : public BusyPollingLoop {
   // Map reactor tokens to functions.
   //
   // The tokens are reused so we don't worry about unbounded growth
-  // and comfortably use a std::vector here.
+  // and comfortably use a std::vector here. The functions are held by
+  // shared_ptrs so that they can be taken out of the vector, to be run
+  // without holding the lock, without copying (and allocating) them.
   //
-  std::vector<TFunction> functions_;
+  std::vector<std::shared_ptr<TFunction>> functions_;
 
   // Count how many functions are registered.
   std::atomic<uint64_t> functionCount_{0};
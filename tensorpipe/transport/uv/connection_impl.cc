@@ -8,8 +8,10 @@
 
 #include <tensorpipe/transport/uv/connection_impl.h>
 
+#include <algorithm>
 #include <array>
-#include <deque>
+#include <cstring>
+#include <vector>
 
 #include <tensorpipe/common/callback.h>
 #include <tensorpipe/common/defs.h>
@@ -26,6 +28,13 @@ namespace tensorpipe {
 namespace transport {
 namespace uv {
 
+namespace {
+
+// How many buffers a write can have before their array is heap-allocated.
+constexpr unsigned int kNumInlineWriteBufs = 16;
+
+} // namespace
+
 ConnectionImpl::ConnectionImpl(
     ConstructorToken token,
     std::shared_ptr<ContextImpl> context,
@@ -67,45 +76,90 @@ void ConnectionImpl::initImplFromLoop() {
   handle_->armReadCallbackFromLoop([this](ssize_t nread, const uv_buf_t* buf) {
     this->readCallbackFromLoop(nread, buf);
   });
+  handle_->armWriteCallbackFromLoop(
+      [this](int status) { this->writeCallbackFromLoop(status); });
 }
 
 void ConnectionImpl::readImplFromLoop(read_callback_fn fn) {
-  readOperations_.emplace_back(std::move(fn));
+  readOperations_.pushBack().reset(std::move(spareReadBuffer_), std::move(fn));
 
-  // Start reading if this is the first read operation.
-  if (readOperations_.size() == 1) {
-    handle_->readStartFromLoop();
-  }
+  // If some data was already read ahead, we may be able to process this
+  // operation right away.
+  processReadOperationsFromLoop();
 }
 
 void ConnectionImpl::readImplFromLoop(
     void* ptr,
     size_t length,
     read_callback_fn fn) {
-  readOperations_.emplace_back(ptr, length, std::move(fn));
+  readOperations_.pushBack().reset(ptr, length, std::move(fn));
 
-  // Start reading if this is the first read operation.
-  if (readOperations_.size() == 1) {
-    handle_->readStartFromLoop();
-  }
+  // If some data was already read ahead, we may be able to process this
+  // operation right away.
+  processReadOperationsFromLoop();
+}
+
+void ConnectionImpl::readImplFromLoop(
+    std::vector<iovec> iovs,
+    read_iovs_callback_fn fn) {
+  readOperations_.pushBack().reset(
+      std::move(iovs),
+      [fn{std::move(fn)}](
+          const Error& error, const void* /* unused */, size_t /* unused */) {
+        fn(error);
+      });
+
+  // If some data was already read ahead, we may be able to process this
+  // operation right away.
+  processReadOperationsFromLoop();
 }
 
 void ConnectionImpl::writeImplFromLoop(
     const void* ptr,
     size_t length,
     write_callback_fn fn) {
-  writeOperations_.emplace_back(ptr, length, std::move(fn));
+  auto& writeOperation = writeOperations_.pushBack();
+  writeOperation.reset(ptr, length, std::move(fn));
 
-  auto& writeOperation = writeOperations_.back();
   StreamWriteOperation::Buf* bufsPtr;
   unsigned int bufsLen;
   std::tie(bufsPtr, bufsLen) = writeOperation.getBufs();
   const std::array<uv_buf_t, 2> uvBufs = {
       uv_buf_t{bufsPtr[0].base, bufsPtr[0].len},
       uv_buf_t{bufsPtr[1].base, bufsPtr[1].len}};
-  handle_->writeFromLoop(uvBufs.data(), bufsLen, [this](int status) {
-    this->writeCallbackFromLoop(status);
-  });
+  handle_->writeFromLoop(uvBufs.data(), bufsLen);
+}
+
+void ConnectionImpl::writeImplFromLoop(
+    std::vector<iovec> iovs,
+    write_callback_fn fn) {
+  // The operation copies what it needs from the array right away.
+  writeArrayImplFromLoop(iovs.data(), iovs.size(), std::move(fn));
+}
+
+void ConnectionImpl::writeArrayImplFromLoop(
+    const iovec* iovs,
+    size_t numIovs,
+    write_callback_fn fn) {
+  auto& writeOperation = writeOperations_.pushBack();
+  writeOperation.reset(iovs, numIovs, std::move(fn));
+
+  StreamWriteOperation::Buf* bufsPtr;
+  unsigned int bufsLen;
+  std::tie(bufsPtr, bufsLen) = writeOperation.getBufs();
+  // Libuv copies the array of buffers, so it's fine for it to be temporary,
+  // and thus to live on the stack unless there are too many of them.
+  std::array<uv_buf_t, kNumInlineWriteBufs> inlineUvBufs;
+  std::vector<uv_buf_t> heapUvBufs;
+  uv_buf_t* uvBufs = inlineUvBufs.data();
+  if (bufsLen > kNumInlineWriteBufs) {
+    heapUvBufs.resize(bufsLen);
+    uvBufs = heapUvBufs.data();
+  }
+  for (unsigned int bufIdx = 0; bufIdx < bufsLen; bufIdx++) {
+    uvBufs[bufIdx] = uv_buf_t{bufsPtr[bufIdx].base, bufsPtr[bufIdx].len};
+  }
+  handle_->writeFromLoop(uvBufs, bufsLen);
 }
 
 void ConnectionImpl::allocCallbackFromLoop(uv_buf_t* buf) {
@@ -113,7 +167,22 @@ void ConnectionImpl::allocCallbackFromLoop(uv_buf_t* buf) {
   TP_THROW_ASSERT_IF(readOperations_.empty());
   TP_VLOG(9) << "Connection " << id_
              << " has incoming data for which it needs to provide a buffer";
+  // Any data read ahead is consumed before reading more from the handle.
+  TP_DCHECK_EQ(readAheadStart_, readAheadEnd_);
   readOperations_.front().allocFromLoop(&buf->base, &buf->len);
+  // Read small chunks (e.g., the length headers) greedily into our own buffer,
+  // in order to drain several of them with a single syscall, but read large
+  // ones directly into their destination to avoid an extra copy.
+  if (buf->len < kReadAheadBufferSize) {
+    if (readAheadBuffer_ == nullptr) {
+      readAheadBuffer_ = std::make_unique<char[]>(kReadAheadBufferSize);
+    }
+    buf->base = readAheadBuffer_.get();
+    buf->len = kReadAheadBufferSize;
+    readingIntoReadAheadBuffer_ = true;
+  } else {
+    readingIntoReadAheadBuffer_ = false;
+  }
 }
 
 void ConnectionImpl::readCallbackFromLoop(
@@ -131,18 +200,55 @@ void ConnectionImpl::readCallbackFromLoop(
   }
 
   TP_THROW_ASSERT_IF(readOperations_.empty());
-  auto& readOperation = readOperations_.front();
-  readOperation.readFromLoop(nread);
-  if (readOperation.completeFromLoop()) {
-    readOperation.callbackFromLoop(Error::kSuccess);
-    // Remove the completed operation.
-    // If this was the final pending operation, this instance should
-    // no longer receive allocation and read callbacks.
-    readOperations_.pop_front();
-    if (readOperations_.empty()) {
-      handle_->readStopFromLoop();
+  if (readingIntoReadAheadBuffer_) {
+    readAheadStart_ = 0;
+    readAheadEnd_ = nread;
+  } else {
+    readOperations_.front().readFromLoop(nread);
+  }
+  processReadOperationsFromLoop();
+}
+
+void ConnectionImpl::processReadOperationsFromLoop() {
+  TP_DCHECK(context_->inLoop());
+
+  while (!readOperations_.empty()) {
+    auto& readOperation = readOperations_.front();
+    while (!readOperation.completeFromLoop() &&
+           readAheadStart_ < readAheadEnd_) {
+      char* base;
+      size_t len;
+      readOperation.allocFromLoop(&base, &len);
+      len = std::min(len, readAheadEnd_ - readAheadStart_);
+      std::memcpy(base, readAheadBuffer_.get() + readAheadStart_, len);
+      readAheadStart_ += len;
+      readOperation.readFromLoop(len);
+    }
+    if (!readOperation.completeFromLoop()) {
+      break;
+    }
+    // Remove the completed operation before firing its callback, in case the
+    // latter ends up queueing new read operations, which may recycle it.
+    StreamReadOperation completedOperation = std::move(readOperation);
+    readOperations_.popFront();
+    completedOperation.callbackFromLoop(Error::kSuccess);
+    // The data is only valid during the callback, hence the buffer that held
+    // it (if any) can now be reused.
+    std::vector<char> buffer = completedOperation.releaseBuffer();
+    if (buffer.capacity() > spareReadBuffer_.capacity()) {
+      spareReadBuffer_ = std::move(buffer);
     }
   }
+
+  // If there are no pending operations, this instance should no longer receive
+  // allocation and read callbacks.
+  if (readOperations_.empty() && reading_) {
+    handle_->readStopFromLoop();
+    reading_ = false;
+  } else if (!readOperations_.empty() && !reading_) {
+    handle_->readStartFromLoop();
+    reading_ = true;
+  }
 }
 
 void ConnectionImpl::writeCallbackFromLoop(int status) {
@@ -163,7 +269,7 @@ void ConnectionImpl::writeCallbackFromLoop(int status) {
   TP_THROW_ASSERT_IF(writeOperations_.empty());
   auto& writeOperation = writeOperations_.front();
   writeOperation.callbackFromLoop(error_);
-  writeOperations_.pop_front();
+  writeOperations_.popFront();
 }
 
 void ConnectionImpl::closeCallbackFromLoop() {
@@ -174,10 +280,12 @@ void ConnectionImpl::closeCallbackFromLoop() {
 }
 
 void ConnectionImpl::handleErrorImpl() {
-  for (auto& readOperation : readOperations_) {
-    readOperation.callbackFromLoop(error_);
+  for (size_t opIdx = 0; opIdx < readOperations_.size(); ++opIdx) {
+    readOperations_[opIdx].callbackFromLoop(error_);
+  }
+  while (!readOperations_.empty()) {
+    readOperations_.popFront();
   }
-  readOperations_.clear();
   // Do NOT fire the callbacks of the write operations, because we must wait for
   // their corresponding UV write requests to complete (or else the user may
   // deallocate the buffers while the loop is still processing them).
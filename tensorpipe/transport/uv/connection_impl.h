@@ -9,11 +9,12 @@
 #pragma once
 
 #include <cstddef>
-#include <deque>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include <tensorpipe/common/optional.h>
+#include <tensorpipe/common/recycling_queue.h>
 #include <tensorpipe/common/stream_read_write_ops.h>
 #include <tensorpipe/transport/connection_impl_boilerplate.h>
 #include <tensorpipe/transport/uv/sockaddr.h>
@@ -23,6 +24,15 @@ namespace tensorpipe {
 namespace transport {
 namespace uv {
 
+namespace {
+
+// Size of the buffer into which libuv reads ahead whenever the pending read
+// operation needs fewer bytes than this. Reads of this size or larger go
+// directly into the user's memory.
+constexpr size_t kReadAheadBufferSize = 64 * 1024;
+
+} // namespace
+
 class ContextImpl;
 class ListenerImpl;
 
@@ -50,8 +60,16 @@ class ConnectionImpl final : public ConnectionImplBoilerplate<
   void initImplFromLoop() override;
   void readImplFromLoop(read_callback_fn fn) override;
   void readImplFromLoop(void* ptr, size_t length, read_callback_fn fn) override;
+  void readImplFromLoop(std::vector<iovec> iovs, read_iovs_callback_fn fn)
+      override;
   void writeImplFromLoop(const void* ptr, size_t length, write_callback_fn fn)
       override;
+  void writeImplFromLoop(std::vector<iovec> iovs, write_callback_fn fn)
+      override;
+  void writeArrayImplFromLoop(
+      const iovec* iovs,
+      size_t numIovs,
+      write_callback_fn fn) override;
   void handleErrorImpl() override;
 
  private:
@@ -67,11 +85,31 @@ class ConnectionImpl final : public ConnectionImplBoilerplate<
   // Called when libuv has closed the handle.
   void closeCallbackFromLoop();
 
+  // Satisfy the pending read operations with the data that was read ahead,
+  // and start or stop reading from the handle depending on whether any of
+  // them is still waiting for data.
+  void processReadOperationsFromLoop();
+
   std::shared_ptr<TCPHandle> handle_;
   optional<Sockaddr> sockaddr_;
 
-  std::deque<StreamReadOperation> readOperations_;
-  std::deque<StreamWriteOperation> writeOperations_;
+  // The operations are recycled, together with the memory they allocated.
+  RecyclingQueue<StreamReadOperation> readOperations_;
+  RecyclingQueue<StreamWriteOperation> writeOperations_;
+
+  // The buffer that the last read operation of unknown length read into, which
+  // is handed to the next such operation so that it doesn't allocate again.
+  std::vector<char> spareReadBuffer_;
+
+  // Data read by libuv in excess of what the read operation at the front of
+  // the queue asked for. The valid bytes are the ones between the start and
+  // the end offsets. The buffer is allocated upon first use.
+  std::unique_ptr<char[]> readAheadBuffer_;
+  size_t readAheadStart_{0};
+  size_t readAheadEnd_{0};
+  // Whether the buffer last handed to libuv was the read-ahead one.
+  bool readingIntoReadAheadBuffer_{false};
+  bool reading_{false};
 
   // By having the instance store a shared_ptr to itself we create a reference
   // cycle which will "leak" the instance. This allows us to detach its
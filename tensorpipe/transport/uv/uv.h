@@ -15,6 +15,7 @@
 #include <tensorpipe/common/callback.h>
 #include <tensorpipe/common/defs.h>
 #include <tensorpipe/common/optional.h>
+#include <tensorpipe/common/recycling_queue.h>
 #include <tensorpipe/transport/uv/loop.h>
 #include <tensorpipe/transport/uv/macros.h>
 #include <tensorpipe/transport/uv/sockaddr.h>
@@ -139,32 +140,6 @@ class BaseRequest : public BaseResource<T, U> {
   U request_;
 };
 
-class WriteRequest final : public BaseRequest<WriteRequest, uv_write_t> {
-  static void uv__write_cb(uv_write_t* req, int status) {
-    WriteRequest* request = reinterpret_cast<WriteRequest*>(req->data);
-    request->writeCallback(status);
-    request->unleak();
-  }
-
- public:
-  using TWriteCallback = std::function<void(int status)>;
-
-  WriteRequest(ConstructorToken /* unused */, Loop& loop, TWriteCallback fn)
-      : BaseRequest<WriteRequest, uv_write_t>(ConstructorToken(), loop),
-        fn_(std::move(fn)) {}
-
-  uv_write_cb callback() {
-    return uv__write_cb;
-  }
-
-  void writeCallback(int status) {
-    fn_(status);
-  }
-
- protected:
-  TWriteCallback fn_;
-};
-
 template <typename T, typename U>
 class StreamHandle : public BaseHandle<T, U> {
   static void uv__connection_cb(uv_stream_t* server, int status) {
@@ -191,6 +166,15 @@ class StreamHandle : public BaseHandle<T, U> {
     ref.readCallback_.value()(nread, buf);
   }
 
+  static void uv__write_cb(uv_write_t* req, int status) {
+    T& ref = *reinterpret_cast<T*>(req->data);
+    TP_DCHECK(ref.writeCallback_.has_value());
+    // Libuv completes the writes to a stream in the order they were issued.
+    TP_DCHECK_EQ(req, &ref.writeRequests_.front());
+    ref.writeRequests_.popFront();
+    ref.writeCallback_.value()(status);
+  }
+
   static constexpr int kBacklog = 128;
 
  public:
@@ -198,6 +182,7 @@ class StreamHandle : public BaseHandle<T, U> {
   using TAcceptCallback = std::function<void(int status)>;
   using TAllocCallback = std::function<void(uv_buf_t* buf)>;
   using TReadCallback = std::function<void(ssize_t nread, const uv_buf_t* buf)>;
+  using TWriteCallback = std::function<void(int status)>;
 
   using BaseHandle<T, U>::BaseHandle;
 
@@ -252,18 +237,24 @@ class StreamHandle : public BaseHandle<T, U> {
     TP_THROW_UV_IF(rv < 0, rv);
   }
 
-  void writeFromLoop(
-      const uv_buf_t bufs[],
-      unsigned int nbufs,
-      WriteRequest::TWriteCallback fn) {
+  // The callback is called once for each write, in the order they were issued.
+  void armWriteCallbackFromLoop(TWriteCallback fn) {
+    TP_DCHECK(this->loop_.inLoop());
+    TP_THROW_ASSERT_IF(writeCallback_.has_value());
+    writeCallback_ = std::move(fn);
+  }
+
+  void writeFromLoop(const uv_buf_t bufs[], unsigned int nbufs) {
     TP_DCHECK(this->loop_.inLoop());
-    auto request = WriteRequest::create(this->loop_, std::move(fn));
+    TP_THROW_ASSERT_IF(!writeCallback_.has_value());
+    uv_write_t& request = writeRequests_.pushBack();
+    request.data = static_cast<T*>(this);
     auto rv = uv_write(
-        request->ptr(),
+        &request,
         reinterpret_cast<uv_stream_t*>(this->ptr()),
         bufs,
         nbufs,
-        request->callback());
+        uv__write_cb);
     TP_THROW_UV_IF(rv < 0, rv);
   }
 
@@ -271,6 +262,12 @@ class StreamHandle : public BaseHandle<T, U> {
   optional<TConnectionCallback> connectionCallback_;
   optional<TAllocCallback> allocCallback_;
   optional<TReadCallback> readCallback_;
+  optional<TWriteCallback> writeCallback_;
+
+  // The requests of the ongoing writes. Libuv needs them to stay alive until
+  // their write completes, and they are recycled rather than allocated anew for
+  // each write.
+  RecyclingQueue<uv_write_t> writeRequests_;
 };
 
 class ConnectRequest : public BaseRequest<ConnectRequest, uv_connect_t> {
@@ -8,6 +8,9 @@
 
 #pragma once
 
+#include <array>
+#include <utility>
+
 #include <tensorpipe/util/ringbuffer/ringbuffer.h>
 
 namespace tensorpipe {
@@ -23,7 +26,10 @@ class Consumer {
  public:
   Consumer() = delete;
 
-  Consumer(RingBuffer& rb) : header_{rb.getHeader()}, data_{rb.getData()} {
+  Consumer(RingBuffer& rb)
+      : header_{rb.getHeader()},
+        data_{rb.getData()},
+        mirrored_{rb.isMirrored()} {
     TP_THROW_IF_NULLPTR(data_);
   }
 
@@ -95,7 +101,8 @@ class Consumer {
   // elements of the array are valid (0, 1 or 2). The elements are ptr+len pairs
   // of contiguous areas of the ringbuffer that, chained together, represent a
   // slice of the requested size (or less if not enough data is available, and
-  // allowPartial is set to true).
+  // allowPartial is set to true). If the ringbuffer is mirrored there is never
+  // more than one element, as slices that wrap around are still contiguous.
   template <bool allowPartial>
   [[nodiscard]] std::pair<ssize_t, std::array<Buffer, 2>> accessContiguousInTx(
       size_t size) noexcept {
@@ -109,11 +116,15 @@ class Consumer {
       return {0, result};
     }
 
-    const uint64_t head = header_.readHead();
+    uint64_t head = header_.readCachedHead();
     const uint64_t tail = header_.readTail();
+    size_t avail = head - tail - tx_size_;
+    if (avail < size) {
+      // Our view of the head may be stale, only now look at the real one.
+      head = header_.refreshCachedHead();
+      avail = head - tail - tx_size_;
+    }
     TP_DCHECK_LE(head - tail, header_.kDataPoolByteSize);
-
-    const size_t avail = head - tail - tx_size_;
     TP_DCHECK_GE(avail, 0);
 
     if (!allowPartial && avail < size) {
@@ -133,7 +144,7 @@ class Consumer {
 
     // end == 0 is the same as end == bufferSize, in which case it doesn't wrap.
     const bool wrap = (start >= end && end > 0);
-    if (likely(!wrap)) {
+    if (likely(!wrap || mirrored_)) {
       result[0] = {.ptr = data_ + start, .len = size};
       return {1, result};
     } else {
@@ -205,6 +216,7 @@ class Consumer {
  private:
   RingBufferHeader& header_;
   const uint8_t* const data_;
+  const bool mirrored_;
   unsigned tx_size_ = 0;
   bool inTx_{false};
 };
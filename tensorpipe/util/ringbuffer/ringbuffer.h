@@ -44,6 +44,13 @@ namespace tensorpipe {
 namespace util {
 namespace ringbuffer {
 
+// The fields of the header are grouped by the side that writes them, and each
+// group is padded to this size so that the producer and the consumer never
+// write to the same cache line. We use two cache lines, rather than one,
+// because the header may not be aligned to a cache line (e.g., when it's not
+// in shared memory) and because some CPUs prefetch adjacent lines in pairs.
+constexpr size_t kFalseSharingPaddingSize = 2 * 64;
+
 ///
 /// RingBufferHeader contains the head, tail and other control information
 /// of the RingBuffer.
@@ -132,16 +139,62 @@ class RingBufferHeader {
     atomicTail_.fetch_add(inc, std::memory_order_release);
   }
 
+  // Each side keeps a copy of the last value it read of the index owned by the
+  // other side, which lives on its own cache line and is thus cheap to access.
+  // As the indices only increase, a stale copy only underestimates how much
+  // data (or space) is available, hence the actual index needs to be read only
+  // when the copy says there isn't enough. These must only be accessed within
+  // a transaction of the corresponding type.
+
+  uint64_t readCachedTail() const {
+    return cachedTail_;
+  }
+
+  uint64_t refreshCachedTail() {
+    cachedTail_ = readTail();
+    return cachedTail_;
+  }
+
+  uint64_t readCachedHead() const {
+    return cachedHead_;
+  }
+
+  uint64_t refreshCachedHead() {
+    cachedHead_ = readHead();
+    return cachedHead_;
+  }
+
+  // A word that a consumer can use to declare that it's sleeping while waiting
+  // for data, and to be woken up by the producers, through a futex (see
+  // BusyPollingLoop). As producers check it after each transaction, whereas the
+  // consumer writes it only when falling asleep or waking up, it lives on the
+  // producers' cache line.
+  std::atomic<uint32_t>& getConsumerFutexWord() {
+    return consumerFutexWord_;
+  }
+
  protected:
-  // Acquired by producers.
-  std::atomic_flag in_write_tx = ATOMIC_FLAG_INIT;
-  // Acquired by consumers.
-  std::atomic_flag in_read_tx = ATOMIC_FLAG_INIT;
+  uint8_t readOnlyPadding_[kFalseSharingPaddingSize - 2 * sizeof(uint64_t)];
 
   // Written by producers.
   std::atomic<uint64_t> atomicHead_{0};
+  uint64_t cachedTail_{0};
+  // Read by producers.
+  std::atomic<uint32_t> consumerFutexWord_{0};
+  // Acquired by producers.
+  std::atomic_flag in_write_tx = ATOMIC_FLAG_INIT;
+  uint8_t producerPadding_
+      [kFalseSharingPaddingSize - 2 * sizeof(uint64_t) -
+       sizeof(std::atomic<uint32_t>) - sizeof(std::atomic_flag)];
+
   // Written by consumers.
   std::atomic<uint64_t> atomicTail_{0};
+  uint64_t cachedHead_{0};
+  // Acquired by consumers.
+  std::atomic_flag in_read_tx = ATOMIC_FLAG_INIT;
+  uint8_t consumerPadding_
+      [kFalseSharingPaddingSize - 2 * sizeof(uint64_t) -
+       sizeof(std::atomic_flag)];
 
   // http://www.open-std.org/jtc1/sc22/wg21/docs/papers/2007/n2427.html#atomics.lockfree
   // static_assert(
@@ -156,12 +209,18 @@ class RingBufferHeader {
 /// Process' view of a ring buffer.
 /// This cannot reside in shared memory since it has pointers.
 ///
+/// If <mirrored>, the data is immediately followed in virtual memory by a
+/// second mapping of itself, which allows every slice of the ringbuffer to be
+/// accessed as a single contiguous area, even if it wraps around. This is a
+/// property of each process' view, hence producers and consumers of the same
+/// ringbuffer can choose it independently.
+///
 class RingBuffer final {
  public:
   RingBuffer() = default;
 
-  RingBuffer(RingBufferHeader* header, uint8_t* data)
-      : header_(header), data_(data) {
+  RingBuffer(RingBufferHeader* header, uint8_t* data, bool mirrored = false)
+      : header_(header), data_(data), mirrored_(mirrored) {
     TP_THROW_IF_NULLPTR(header_) << "Header cannot be nullptr";
     TP_THROW_IF_NULLPTR(data_) << "Data cannot be nullptr";
   }
@@ -182,9 +241,14 @@ class RingBuffer final {
     return data_;
   }
 
+  bool isMirrored() const {
+    return mirrored_;
+  }
+
  protected:
   RingBufferHeader* header_ = nullptr;
   uint8_t* data_ = nullptr;
+  bool mirrored_ = false;
 };
 
 } // namespace ringbuffer
@@ -16,7 +16,8 @@ namespace shm {
 std::tuple<util::shm::Segment, util::shm::Segment, RingBuffer> create(
     size_t min_rb_byte_size,
     optional<util::shm::PageType> data_page_type,
-    bool perm_write) {
+    bool perm_write,
+    bool mirrored) {
   util::shm::Segment header_segment;
   RingBufferHeader* header;
   std::tie(header_segment, header) =
@@ -26,21 +27,22 @@ std::tuple<util::shm::Segment, util::shm::Segment, RingBuffer> create(
   util::shm::Segment data_segment;
   uint8_t* data;
   std::tie(data_segment, data) = util::shm::Segment::create<uint8_t[]>(
-      header->kDataPoolByteSize, perm_write, data_page_type);
+      header->kDataPoolByteSize, perm_write, data_page_type, mirrored);
 
   // Note: cannot use implicit construction from initializer list on GCC 5.5:
   // "converting to XYZ from initializer list would use explicit constructor".
   return std::make_tuple(
       std::move(header_segment),
       std::move(data_segment),
-      RingBuffer(header, data));
+      RingBuffer(header, data, mirrored));
 }
 
 std::tuple<util::shm::Segment, util::shm::Segment, RingBuffer> load(
     Fd header_fd,
     Fd data_fd,
     optional<util::shm::PageType> data_page_type,
-    bool perm_write) {
+    bool perm_write,
+    bool mirrored) {
   util::shm::Segment header_segment;
   RingBufferHeader* header;
   std::tie(header_segment, header) = util::shm::Segment::load<RingBufferHeader>(
@@ -53,7 +55,7 @@ std::tuple<util::shm::Segment, util::shm::Segment, RingBuffer> load(
   util::shm::Segment data_segment;
   uint8_t* data;
   std::tie(data_segment, data) = util::shm::Segment::load<uint8_t[]>(
-      std::move(data_fd), perm_write, data_page_type);
+      std::move(data_fd), perm_write, data_page_type, mirrored);
   if (unlikely(header->kDataPoolByteSize != data_segment.getSize())) {
     TP_THROW_SYSTEM(EPERM) << "Data segment of unexpected size";
   }
@@ -61,7 +63,7 @@ std::tuple<util::shm::Segment, util::shm::Segment, RingBuffer> load(
   return std::make_tuple(
       std::move(header_segment),
       std::move(data_segment),
-      RingBuffer(header, data));
+      RingBuffer(header, data, mirrored));
 }
 
 } // namespace shm
@@ -20,9 +20,11 @@ namespace shm {
 /// Creates ringbuffer on shared memory.
 ///
 /// RingBuffer's data can have any <util::shm::PageType>
-/// (e.g. 4KB or a HugeTLB Page of 2MB or 1GB). If  <data_page_type> is not
-/// provided, then choose the largest page that would result in
-/// close to full occupancy.
+/// (e.g. 4KB or a HugeTLB Page of 2MB or 1GB). If huge pages are requested
+/// but cannot be used (e.g., none are available, or the size isn't a multiple
+/// of theirs), regular pages are used instead. If <data_page_type> is not
+/// provided, regular pages are used. When loading, the page type is determined
+/// by the file descriptor, hence <data_page_type> is ignored.
 ///
 /// If <persistent>, the shared memory will not be unlinked
 /// when RingBuffer is destroyed.
@@ -30,16 +32,24 @@ namespace shm {
 /// <min_rb_byte_size> is the minimum size of the data section
 /// of a RingBuffer (or each CPU's RingBuffer).
 ///
+/// If <mirrored>, the data section is mapped twice, back to back, so that any
+/// slice of the RingBuffer is contiguous in virtual memory. Mirroring only
+/// affects the local mapping, hence it can be chosen independently by
+/// create and load. It requires the data size to be a multiple of the page
+/// size.
+///
 std::tuple<util::shm::Segment, util::shm::Segment, RingBuffer> create(
     size_t min_rb_byte_size,
     optional<util::shm::PageType> data_page_type = nullopt,
-    bool perm_write = true);
+    bool perm_write = true,
+    bool mirrored = false);
 
 std::tuple<util::shm::Segment, util::shm::Segment, RingBuffer> load(
     Fd header_fd,
     Fd data_fd,
     optional<util::shm::PageType> data_page_type = nullopt,
-    bool perm_write = true);
+    bool perm_write = true,
+    bool mirrored = false);
 
 } // namespace shm
 } // namespace ringbuffer
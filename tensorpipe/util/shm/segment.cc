@@ -9,13 +9,16 @@
 #include <tensorpipe/util/shm/segment.h>
 
 #include <fcntl.h>
+#include <linux/memfd.h>
 #include <linux/mman.h>
 #include <sched.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/statfs.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cstring>
 #include <memory>
 #include <sstream>
@@ -31,12 +34,93 @@ namespace {
 // Default base path for all segments created.
 constexpr const char* kBasePath = "/dev/shm";
 
-Fd createShmFd() {
+constexpr size_t kHugePageSize2MB = 2ull * 1024ull * 1024ull;
+constexpr size_t kHugePageSize1GB = 1024ull * 1024ull * 1024ull;
+
+// Try to allocate the shared memory on hugetlbfs. This fails if the kernel
+// doesn't support it, if the size isn't a multiple of the huge page size, or if
+// not enough huge pages have been reserved, in which case we return nullopt so
+// that the caller can fall back to regular pages.
+optional<Fd> createHugeTlbShmFd(size_t byte_size, PageType page_type) {
+#if defined(MFD_HUGETLB) && defined(MFD_HUGE_2MB) && defined(MFD_HUGE_1GB)
+  size_t page_size;
+  int flags = MFD_CLOEXEC | MFD_HUGETLB;
+  switch (page_type) {
+    case PageType::HugeTLB_2MB:
+      page_size = kHugePageSize2MB;
+      flags |= MFD_HUGE_2MB;
+      break;
+    case PageType::HugeTLB_1GB:
+      page_size = kHugePageSize1GB;
+      flags |= MFD_HUGE_1GB;
+      break;
+    default:
+      return nullopt;
+  }
+  if (byte_size == 0 || byte_size % page_size != 0) {
+    TP_VLOG(5) << "Not using huge pages of " << page_size
+               << " bytes for a shared memory segment of " << byte_size
+               << " bytes as its size isn't a multiple of the page size";
+    return nullopt;
+  }
+
+  int fd = ::memfd_create("tensorpipe_shm", flags);
+  if (fd == -1) {
+    TP_VLOG(5) << "Not using huge pages of " << page_size
+               << " bytes for a shared memory segment as memfd_create failed: "
+               << std::strerror(errno);
+    return nullopt;
+  }
+  Fd hugeTlbFd(fd);
+
+  // Allocate all the pages now, since running out of huge pages later would
+  // cause a SIGBUS upon access.
+  int ret = ::fallocate(hugeTlbFd.fd(), 0, 0, static_cast<off_t>(byte_size));
+  if (ret == -1) {
+    TP_VLOG(5) << "Not using huge pages of " << page_size
+               << " bytes for a shared memory segment of " << byte_size
+               << " bytes as they couldn't be allocated: "
+               << std::strerror(errno);
+    return nullopt;
+  }
+
+  return std::move(hugeTlbFd);
+#else
+  return nullopt;
+#endif
+}
+
+Fd createShmFd(size_t byte_size, optional<PageType> page_type) {
+  if (page_type.has_value() && page_type.value() != PageType::Default) {
+    optional<Fd> hugeTlbFd = createHugeTlbShmFd(byte_size, page_type.value());
+    if (hugeTlbFd.has_value()) {
+      return std::move(hugeTlbFd.value());
+    }
+  }
+
   int flags = O_TMPFILE | O_EXCL | O_RDWR | O_CLOEXEC;
   int fd = ::open(kBasePath, flags, 0);
   TP_THROW_SYSTEM_IF(fd == -1, errno)
       << "Failed to open shared memory file descriptor at " << kBasePath;
-  return Fd(fd);
+  Fd shmFd(fd);
+
+  // grow size to contain byte_size bytes.
+  off_t len = static_cast<off_t>(byte_size);
+  int ret = ::fallocate(shmFd.fd(), 0, 0, len);
+  TP_THROW_SYSTEM_IF(ret == -1, errno)
+      << "Error while allocating " << byte_size << " bytes in shared memory";
+
+  return shmFd;
+}
+
+// The size of the pages backing the file, which is larger than the system's
+// one for files on hugetlbfs.
+size_t getFdPageSize(int fd) {
+  struct statfs sfs;
+  int ret = ::fstatfs(fd, &sfs);
+  TP_THROW_SYSTEM_IF(ret == -1, errno)
+      << "Error while fstatfs shared memory file";
+  return static_cast<size_t>(sfs.f_bsize);
 }
 
 /// Choose a reasonable page size for a given size.
@@ -83,42 +167,84 @@ update to obtain the latest correctness checks."
     prot |= PROT_WRITE;
   }
 
-  // FIXME mmap seems to fail with EINVAL if it cannot use hugepages when asked
-  // to do so. We could try with hugepages and, if it fails, try again without.
-  // But this adds complexity and I first want to know how much performance we
-  // gain through hugepages but so far I haven't been able to get them to work.
-  // switch (page_type.value_or(getDefaultPageType(byte_size))) {
-  //   case PageType::Default:
-  //     break;
-  //   case PageType::HugeTLB_2MB:
-  //     flags |= MAP_HUGETLB | MAP_HUGE_2MB;
-  //     break;
-  //   case PageType::HugeTLB_1GB:
-  //     flags |= MAP_HUGETLB | MAP_HUGE_1GB;
-  //     break;
-  // }
-
+  // There's no need for MAP_HUGETLB (which only applies to anonymous memory),
+  // as files on hugetlbfs are always mapped using huge pages.
   return MmappedPtr(byte_size, prot, flags, fd);
 }
 
+MmappedPtr mmapShmFdMirrored(int fd, size_t byte_size, bool perm_write) {
+  const size_t page_size = getFdPageSize(fd);
+  TP_THROW_SYSTEM_IF(byte_size % page_size != 0, EINVAL)
+      << "Cannot mirror a shared memory segment of " << byte_size
+      << " bytes, as it isn't a multiple of the page size (" << page_size
+      << " bytes)";
+
+  int prot = PROT_READ;
+  if (perm_write) {
+    prot |= PROT_WRITE;
+  }
+
+  // Reserve a range of virtual memory large enough for two copies, and then
+  // replace each of its halves with a mapping of the file. The reservation is
+  // released as a whole (including the file mappings) when the pointer dies.
+  // Huge pages must be mapped at an address aligned to their size, hence we
+  // reserve some extra space, and then trim it, to be able to align it.
+  const size_t system_page_size = ::sysconf(_SC_PAGESIZE);
+  const size_t slack = std::max(page_size, system_page_size) - system_page_size;
+  void* reservation = ::mmap(
+      nullptr,
+      2 * byte_size + slack,
+      PROT_NONE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+      /*fd=*/-1,
+      0);
+  TP_THROW_SYSTEM_IF(reservation == MAP_FAILED, errno)
+      << "Failed to reserve virtual memory to mirror shared memory segment";
+  uint8_t* base = reinterpret_cast<uint8_t*>(reservation);
+  uint8_t* aligned = reinterpret_cast<uint8_t*>(
+      (reinterpret_cast<uintptr_t>(base) + page_size - 1) & ~(page_size - 1));
+  if (aligned > base) {
+    int ret = ::munmap(base, aligned - base);
+    TP_THROW_SYSTEM_IF(ret != 0, errno);
+  }
+  if (base + slack > aligned) {
+    int ret = ::munmap(aligned + 2 * byte_size, base + slack - aligned);
+    TP_THROW_SYSTEM_IF(ret != 0, errno);
+  }
+  MmappedPtr ptr(aligned, 2 * byte_size);
+
+  for (size_t offset = 0; offset < 2 * byte_size; offset += byte_size) {
+    void* addr = ::mmap(
+        ptr.ptr() + offset, byte_size, prot, MAP_SHARED | MAP_FIXED, fd, 0);
+    TP_THROW_SYSTEM_IF(addr == MAP_FAILED, errno)
+        << "Failed to mirror shared memory segment of " << byte_size
+        << " bytes";
+  }
+
+  return ptr;
+}
+
 } // namespace
 
 Segment::Segment(
     size_t byte_size,
     bool perm_write,
-    optional<PageType> page_type)
-    : fd_(createShmFd()) {
-  // grow size to contain byte_size bytes.
-  off_t len = static_cast<off_t>(byte_size);
-  int ret = ::fallocate(fd_.fd(), 0, 0, len);
-  TP_THROW_SYSTEM_IF(ret == -1, errno)
-      << "Error while allocating " << byte_size << " bytes in shared memory";
-
-  ptr_ = mmapShmFd(fd_.fd(), byte_size, perm_write, page_type);
+    optional<PageType> page_type,
+    bool mirrored)
+    : fd_(createShmFd(byte_size, page_type)), mirrored_(mirrored) {
+  if (mirrored_) {
+    ptr_ = mmapShmFdMirrored(fd_.fd(), byte_size, perm_write);
+  } else {
+    ptr_ = mmapShmFd(fd_.fd(), byte_size, perm_write, page_type);
+  }
 }
 
-Segment::Segment(Fd fd, bool perm_write, optional<PageType> page_type)
-    : fd_(std::move(fd)) {
+Segment::Segment(
+    Fd fd,
+    bool perm_write,
+    optional<PageType> page_type,
+    bool mirrored)
+    : fd_(std::move(fd)), mirrored_(mirrored) {
   // Load whole file. Use fstat to obtain size.
   struct stat sb;
   int ret = ::fstat(fd_.fd(), &sb);
@@ -126,7 +252,11 @@ Segment::Segment(Fd fd, bool perm_write, optional<PageType> page_type)
       << "Error while fstat shared memory file";
   size_t byte_size = static_cast<size_t>(sb.st_size);
 
-  ptr_ = mmapShmFd(fd_.fd(), byte_size, perm_write, page_type);
+  if (mirrored_) {
+    ptr_ = mmapShmFdMirrored(fd_.fd(), byte_size, perm_write);
+  } else {
+    ptr_ = mmapShmFd(fd_.fd(), byte_size, perm_write, page_type);
+  }
 }
 
 } // namespace shm
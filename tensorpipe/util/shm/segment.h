@@ -34,16 +34,28 @@ namespace shm {
 /// The final page type depends on system configuration
 /// and availability of pages of requested size.
 /// HugeTLB pages often need to be reserved at boot time and
-/// may none left by the time Segment that request one is cerated.
+/// may none left by the time Segment that request one is cerated,
+/// in which case the Segment falls back to regular pages.
 enum class PageType { Default, HugeTLB_2MB, HugeTLB_1GB };
 
 class Segment {
  public:
   Segment() = default;
 
-  Segment(size_t byte_size, bool perm_write, optional<PageType> page_type);
+  /// If <mirrored>, the memory is mapped twice, back to back, so that the
+  /// virtual range [ptr, ptr + 2 * size) is valid and its second half aliases
+  /// the first one. This requires the size to be a multiple of the page size.
+  Segment(
+      size_t byte_size,
+      bool perm_write,
+      optional<PageType> page_type,
+      bool mirrored = false);
 
-  Segment(Fd fd, bool perm_write, optional<PageType> page_type);
+  Segment(
+      Fd fd,
+      bool perm_write,
+      optional<PageType> page_type,
+      bool mirrored = false);
 
   /// Allocate shared memory to contain an object of type T and construct it.
   ///
@@ -85,7 +97,8 @@ class Segment {
   static std::pair<Segment, TScalar*> create(
       size_t num_elements,
       bool perm_write,
-      optional<PageType> page_type) {
+      optional<PageType> page_type,
+      bool mirrored = false) {
     static_assert(
         std::is_same<TScalar[], T>::value,
         "Only one-dimensional unbounded arrays are supported");
@@ -95,7 +108,7 @@ class Segment {
         "are trivially copyable (i.e. no pointers and no heap allocation");
 
     size_t byte_size = sizeof(TScalar) * num_elements;
-    Segment segment(byte_size, perm_write, page_type);
+    Segment segment(byte_size, perm_write, page_type, mirrored);
     TP_DCHECK_EQ(segment.getSize(), byte_size);
 
     // Initialize in place.
@@ -142,7 +155,8 @@ class Segment {
   static std::pair<Segment, TScalar*> load(
       Fd fd,
       bool perm_write,
-      optional<PageType> page_type) {
+      optional<PageType> page_type,
+      bool mirrored = false) {
     static_assert(
         std::is_same<TScalar[], T>::value,
         "Only one-dimensional unbounded arrays are supported");
@@ -151,7 +165,7 @@ class Segment {
         "Shared memory segments are restricted to only store objects that "
         "are trivially copyable (i.e. no pointers and no heap allocation");
 
-    Segment segment(std::move(fd), perm_write, page_type);
+    Segment segment(std::move(fd), perm_write, page_type, mirrored);
     auto ptr = static_cast<TScalar*>(segment.getPtr());
 
     return {std::move(segment), ptr};
@@ -169,8 +183,14 @@ class Segment {
     return ptr_.ptr();
   }
 
+  /// The size of the shared memory, which, for mirrored segments, is half the
+  /// size of the virtual memory range they occupy.
   size_t getSize() const {
-    return ptr_.getLength();
+    return mirrored_ ? ptr_.getLength() / 2 : ptr_.getLength();
+  }
+
+  bool isMirrored() const {
+    return mirrored_;
   }
 
  private:
@@ -179,6 +199,9 @@ class Segment {
 
   // Base pointer of mmmap'ed shared memory segment.
   MmappedPtr ptr_;
+
+  // Whether the shared memory is mapped twice in a row.
+  bool mirrored_{false};
 };
 
 } // namespace shm